@@ -0,0 +1,312 @@
+#include "png_batch.h"
+#include "png_thread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * 批量解码
+ *
+ * 文件按大小从大到小排序后轮流分配到各工作线程的双端队列。每个线程从自己队列的头部（大文件一端）取任务，
+ * 自己的队列空了就从其他线程队列的尾部（小文件一端）窃取。大文件最先开始，临近结束时剩下的都是小文件，
+ * 各线程的完成时间因此接近，不会出现最后只剩一个线程在解码大文件的长尾。
+ *
+ * 每个工作线程持有自己的解码上下文（压缩数据与解压缓冲区、zlib 解压流）和输出缓冲区，在多个文件之间复用，
+ * 稳定之后解码每个文件都不再分配这些大缓冲区。
+ */
+
+// 单个文件任务
+typedef struct {
+    uint32_t index;                 // 在输入列表中的序号
+    uint64_t size;                  // 文件字节数
+} PNG_BatchTask;
+
+// 工作线程的任务双端队列，任务数量在开始前已确定，只出不进
+typedef struct {
+    png_mutex_t mutex;
+    uint32_t* tasks;                // 任务在排序后数组中的序号
+    uint32_t head;
+    uint32_t tail;
+} PNG_BatchDeque;
+
+// 工作线程独占的解码上下文
+typedef struct {
+    struct PNG_Batch* batch;
+    int worker;
+    PNG_DecodeContext* decoder;     // 解码上下文，在多个文件之间复用
+    uint8_t* pixels;                // 输出缓冲区，在多个文件之间复用
+    size_t pixels_capacity;
+    PNG_BatchStats stats;
+} PNG_BatchWorker;
+
+typedef struct PNG_Batch {
+    const char* const* filenames;
+    PNG_BatchTask* tasks;
+    PNG_BatchDeque* deques;
+    PNG_BatchWorker* workers;
+    int worker_count;
+    int format;
+    PNG_BatchCallback callback;
+    void* user_data;
+    png_mutex_t callback_mutex;
+} PNG_Batch;
+
+static int png_batch_compare_size(const void* a, const void* b) {
+    const PNG_BatchTask* x = (const PNG_BatchTask*)a;
+    const PNG_BatchTask* y = (const PNG_BatchTask*)b;
+    if (x->size != y->size) {
+        return x->size < y->size ? 1 : -1;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * 取出下一个任务：先取自己队列的头部，队列为空时依次从其他线程的队列尾部窃取
+ *
+ * @return      是否取到任务，返回 1(真) 或 0(假)
+ */
+static int png_batch_next_task(PNG_BatchWorker* worker, uint32_t* task) {
+    PNG_Batch* batch = worker->batch;
+
+    for (int i = 0; i < batch->worker_count; i++) {
+        PNG_BatchDeque* deque = &batch->deques[(worker->worker + i) % batch->worker_count];
+        int found = 0;
+
+        png_mutex_lock(&deque->mutex);
+        if (deque->head < deque->tail) {
+            *task = i == 0 ? deque->tasks[deque->head++] : deque->tasks[--deque->tail];
+            found = 1;
+        }
+        png_mutex_unlock(&deque->mutex);
+
+        if (found) {
+            if (i > 0) {
+                worker->stats.steals++;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 释放解码结果：image_data 属于工作线程的解码上下文，只释放调色板与 tRNS
+ */
+static void png_batch_free_image(PNG_Image* image) {
+    image->image_data = NULL;
+    png_free_image(image);
+}
+
+/**
+ * 用工作线程的解码上下文解码单个文件，并转换到工作线程的输出缓冲区
+ *
+ * 转换逐行串行进行：批量解码已经在文件之间并行，不再占用全局线程池。
+ *
+ * @return      是否解码成功，返回 1(真) 或 0(假)
+ */
+static int png_batch_decode_file(PNG_BatchWorker* worker, const char* filename, PNG_Image* image, size_t* pixels_size) {
+    if (!worker->decoder) {
+        worker->decoder = png_decode_context_create();
+    }
+    if (!png_read_file_context(filename, image, worker->decoder, NULL)) {
+        return 0;
+    }
+
+    uint32_t width = image->header.width;
+    uint32_t height = image->header.height;
+    uint32_t src_row_bytes = png_row_bytes(&image->header, width);
+    size_t dst_row_bytes = (size_t)width * png_format_bytes_per_pixel(worker->batch->format);
+    uint64_t size = (uint64_t)dst_row_bytes * height;
+    if (size > SIZE_MAX || size > png_get_memory_budget()) {
+        png_batch_free_image(image);
+        return 0;
+    }
+
+    if (size > worker->pixels_capacity) {
+        uint8_t* pixels = (uint8_t*)realloc(worker->pixels, (size_t)size);
+        if (!pixels) {
+            png_batch_free_image(image);
+            return 0;
+        }
+        worker->pixels = pixels;
+        worker->pixels_capacity = (size_t)size;
+    }
+
+    PNG_ConvertContext ctx;
+    if (!png_convert_context_init(&ctx, image, worker->batch->format)) {
+        png_batch_free_image(image);
+        return 0;
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        png_convert_row(&ctx, image->image_data + (size_t)y * src_row_bytes, worker->pixels + y * dst_row_bytes);
+    }
+    png_convert_context_free(&ctx);
+
+    *pixels_size = (size_t)size;
+    return 1;
+}
+
+/**
+ * 工作线程主循环
+ */
+static void png_batch_worker_main(void* arg) {
+    PNG_BatchWorker* worker = (PNG_BatchWorker*)arg;
+    PNG_Batch* batch = worker->batch;
+    uint32_t task;
+
+    while (png_batch_next_task(worker, &task)) {
+        uint32_t index = batch->tasks[task].index;
+        const char* filename = batch->filenames[index];
+        PNG_Image image;
+        size_t pixels_size = 0;
+        int ok = png_batch_decode_file(worker, filename, &image, &pixels_size);
+
+        if (ok) {
+            worker->stats.files++;
+            worker->stats.input_bytes += batch->tasks[task].size;
+            worker->stats.output_bytes += pixels_size;
+        } else {
+            worker->stats.failed++;
+        }
+
+        if (batch->callback) {
+            png_mutex_lock(&batch->callback_mutex);
+            batch->callback(batch->user_data, index, filename, ok ? &image : NULL, ok ? worker->pixels : NULL, pixels_size);
+            png_mutex_unlock(&batch->callback_mutex);
+        }
+        if (ok) {
+            png_batch_free_image(&image);
+        }
+    }
+}
+
+/**
+ * 在工作窃取线程池上批量解码多个文件
+ *
+ * @param filenames     文件路径列表
+ * @param count         文件数
+ * @param format        输出像素格式（PNG_FORMAT_*）
+ * @param thread_count  工作线程数（包括调用线程），0 表示使用 CPU 核心数
+ * @param callback      完成回调，可以为 NULL
+ * @param user_data     传给回调的自定义数据
+ * @param stats         统计信息，可以为 NULL
+ *
+ * @return              是否全部解码成功，返回 1(真) 或 0(假)；单个文件失败不会中断其余文件
+ */
+int png_decode_batch(const char* const* filenames, uint32_t count, int format, int thread_count,
+    PNG_BatchCallback callback, void* user_data, PNG_BatchStats* stats) {
+    if ((!filenames && count > 0) || png_format_bytes_per_pixel(format) == 0) {
+        return 0;
+    }
+    if (stats) {
+        memset(stats, 0, sizeof(PNG_BatchStats));
+    }
+    if (count == 0) {
+        return 1;
+    }
+
+    if (thread_count <= 0) {
+        thread_count = png_cpu_count();
+    }
+    if (thread_count > PNG_MAX_THREADS) {
+        thread_count = PNG_MAX_THREADS;
+    }
+    if ((uint32_t)thread_count > count) {
+        thread_count = (int)count;
+    }
+
+    PNG_Batch batch;
+    memset(&batch, 0, sizeof(PNG_Batch));
+    batch.filenames = filenames;
+    batch.worker_count = thread_count;
+    batch.format = format;
+    batch.callback = callback;
+    batch.user_data = user_data;
+
+    png_thread_t threads[PNG_MAX_THREADS];
+    int started = 0;
+    int deques_ready = 0;
+    int ok = 0;
+
+    batch.tasks = (PNG_BatchTask*)malloc(count * sizeof(PNG_BatchTask));
+    batch.deques = (PNG_BatchDeque*)calloc(thread_count, sizeof(PNG_BatchDeque));
+    batch.workers = (PNG_BatchWorker*)calloc(thread_count, sizeof(PNG_BatchWorker));
+    if (!batch.tasks || !batch.deques || !batch.workers) {
+        goto cleanup;
+    }
+
+    // 按文件大小从大到小排序；无法获取大小的文件排在最后，由解码时报告失败
+    for (uint32_t i = 0; i < count; i++) {
+        struct stat st;
+        batch.tasks[i].index = i;
+        batch.tasks[i].size = stat(filenames[i], &st) == 0 ? (uint64_t)st.st_size : 0;
+    }
+    qsort(batch.tasks, count, sizeof(PNG_BatchTask), png_batch_compare_size);
+
+    // 轮流分配，使每个队列的头部都是它所分到的最大文件
+    for (int w = 0; w < thread_count; w++) {
+        PNG_BatchDeque* deque = &batch.deques[w];
+        deque->tasks = (uint32_t*)malloc((count / thread_count + 1) * sizeof(uint32_t));
+        if (!deque->tasks) {
+            goto cleanup;
+        }
+        for (uint32_t t = w; t < count; t += thread_count) {
+            deque->tasks[deque->tail++] = t;
+        }
+        png_mutex_init(&deque->mutex);
+        deques_ready++;
+    }
+    png_mutex_init(&batch.callback_mutex);
+
+    for (int w = 0; w < thread_count; w++) {
+        batch.workers[w].batch = &batch;
+        batch.workers[w].worker = w;
+    }
+
+    // 调用线程本身作为 0 号工作线程
+    for (started = 1; started < thread_count; started++) {
+        if (!png_thread_create(&threads[started], png_batch_worker_main, &batch.workers[started])) {
+            break;
+        }
+    }
+    png_batch_worker_main(&batch.workers[0]);
+    for (int w = 1; w < started; w++) {
+        png_thread_join(threads[w]);
+    }
+    png_mutex_destroy(&batch.callback_mutex);
+
+    ok = 1;
+    for (int w = 0; w < thread_count; w++) {
+        PNG_BatchStats* s = &batch.workers[w].stats;
+        if (s->failed > 0) {
+            ok = 0;
+        }
+        if (stats) {
+            stats->files += s->files;
+            stats->failed += s->failed;
+            stats->input_bytes += s->input_bytes;
+            stats->output_bytes += s->output_bytes;
+            stats->steals += s->steals;
+        }
+    }
+
+cleanup:
+    if (batch.deques) {
+        for (int w = 0; w < thread_count; w++) {
+            if (w < deques_ready) {
+                png_mutex_destroy(&batch.deques[w].mutex);
+            }
+            free(batch.deques[w].tasks);
+        }
+    }
+    if (batch.workers) {
+        for (int w = 0; w < thread_count; w++) {
+            png_decode_context_destroy(batch.workers[w].decoder);
+            free(batch.workers[w].pixels);
+        }
+    }
+    free(batch.tasks);
+    free(batch.deques);
+    free(batch.workers);
+    return ok;
+}
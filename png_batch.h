@@ -0,0 +1,34 @@
+#ifndef PNG_BATCH_H
+#define PNG_BATCH_H
+
+#include "png_decoder.h"
+
+/**
+ * 批量解码完成回调
+ *
+ * 按完成顺序调用，调用之间互斥（回调本身无需线程安全），但可能来自任意工作线程。
+ * image 与 pixels 只在回调期间有效，需要保留时应自行复制。
+ *
+ * @param user_data     调用方传入的自定义数据
+ * @param index         文件在输入列表中的序号
+ * @param filename      文件路径
+ * @param image         解码后的图像（header、palette 等），解码失败时为 NULL
+ * @param pixels        转换后的像素，解码失败时为 NULL
+ * @param pixels_size   像素数据大小
+ */
+typedef void (*PNG_BatchCallback)(void* user_data, uint32_t index, const char* filename,
+    const PNG_Image* image, const uint8_t* pixels, size_t pixels_size);
+
+// 批量解码统计
+typedef struct {
+    uint32_t files;                 // 成功解码的文件数
+    uint32_t failed;                // 解码失败的文件数
+    uint64_t input_bytes;           // 成功解码的文件总字节数
+    uint64_t output_bytes;          // 输出像素总字节数
+    uint32_t steals;                // 从其他工作线程窃取的任务数
+} PNG_BatchStats;
+
+int png_decode_batch(const char* const* filenames, uint32_t count, int format, int thread_count,
+    PNG_BatchCallback callback, void* user_data, PNG_BatchStats* stats);
+
+#endif // PNG_BATCH_H
@@ -0,0 +1,1342 @@
+#include "png_batch.h"
+#include "png_cache.h"
+#include "png_decoder.h"
+#include "png_encoder.h"
+#include "png_palette.h"
+#include "png_pipeline.h"
+#include "png_progressive.h"
+#include "png_reduce.h"
+#include "png_region.h"
+#include "png_rows.h"
+#include "png_scale.h"
+#include "png_thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * 解码性能测试工具
+ *
+ * 用法：png_bench decode [-n 次数] <文件.png> ...
+ *       png_bench progressive <文件.png> ...
+ *       png_bench threads [-n 次数] [-t 最大线程数] <文件.png> ...
+ *       png_bench pipeline [-n 次数] <文件.png> ...
+ *       png_bench batch [-t 线程数] [-l 列表文件] <文件.png> ...
+ *       png_bench rows <文件.png> ...
+ *       png_bench region [-n 次数] [-r x,y,宽,高] [-i] <文件.png> ...
+ *       png_bench scaled [-n 次数] [-s 2|4|8] <文件.png> ...
+ *       png_bench cache [-n 次数] [-d 缓存目录] <文件.png> ...
+ *       png_bench encode [-n 次数] [-t 最大线程数] <文件.png> ...
+ *       png_bench palette [-n 次数] <文件.png> ...
+ *       png_bench restart [-n 次数] <文件.png> ...
+ *       png_bench interlace [-n 次数] <文件.png> ...
+ *       png_bench stream <文件.png> ...
+ *
+ * decode：对每个文件重复解码若干次，分别统计“读取 + 解压 + 还原滤波”与“像素格式转换”两个阶段的耗时中位数。
+ * 同一幅图像分别以隔行与非隔行方式保存后一起测试，即可比较 Adam7 带来的额外开销。
+ *
+ * progressive：流式解码，打印每一遍预览交付的时间点，无需图形界面即可验证逐遍预览。
+ *
+ * threads：解码一次后，以 1、2、4 …… 直到最大线程数分别测试像素格式转换的耗时，观察行带并行的扩展性
+ * （建议使用 5000 万像素以上的图像）。
+ *
+ * pipeline：比较串行解码（png_read_file + 格式转换）与三级流水线解码（png_read_file_pipelined）的总耗时。
+ *
+ * batch：用 png_decode_batch 批量解码所有文件，按完成顺序打印结果，最后报告每秒文件数与吞吐量。
+ * 文件较多时可用 -l 指定列表文件（每行一个路径），避免命令行长度限制。
+ *
+ * region：比较整幅解码与 png_decode_region 区域解码的耗时，区域默认为左上角 1024x1024（超出图像时截断）。
+ * 区域越靠近图像顶部，区域解码越快。指定 -i 时再测试借助随机访问索引（png_index_open，索引文件不存在时先建立）的区域解码。
+ *
+ * scaled：比较整幅解码（png_read_file + 格式转换）与 png_read_file_scaled 缩小解码（默认 1/8）的耗时和内存占用。
+ * 隔行图像只需解压前几遍，缩小解码的加速最明显。
+ *
+ * cache：比较整幅解码与 png_cache_open 从解码结果缓存映射像素的耗时（缓存目录默认为当前目录下的 png_cache）。
+ * 第一次打开未命中时解码并写入缓存，之后每次打开都直接映射缓存文件并逐页读取一遍像素。
+ *
+ * encode：解码一次后，先报告无损缩减分析（png_reduce_analyze）的耗时与结果，再分别用固定 Paeth 滤波、默认选项
+ * （逐行按最小绝对差之和选择滤波）、逐行按熵估算选择滤波、快速预设（png_encode_options_fast，分段并行压缩）、
+ * 带分段索引的快速预设与不做无损缩减（reduce = 0）的默认选项把图像编码到内存（带 α 通道的图像再加上分别复制左侧 / 上方像素
+ * 清理透明像素颜色的默认选项），报告编码耗时中位数、吞吐量（按未压缩的样本字节数计算）与编码后的大小；
+ * 再以 1、2、4 …… 直到最大线程数测试快速预设的扩展性。
+ *
+ * palette：解码并无损缩减为调色板图像（不能缩减为调色板的图像跳过）后，分别按原顺序、亮度、使用次数与最近邻遍历排列调色板，
+ * 以不滤波与逐行选择滤波编码，最后用自动选择（png_palette_sort 抽样试压缩）编码，报告编码耗时中位数与编码后的大小。
+ *
+ * restart：比较整幅编码与创建可局部重新编码的编码器（png_restart_encoder_create）的耗时和大小，再在图像中央模拟一次
+ * 64x64 的笔刷修改，报告只重新压缩受影响的段后保存（png_restart_encoder_write）的耗时。
+ *
+ * interlace：分别用默认选项与快速预设把图像编码为非隔行与 Adam7 隔行图像，报告编码耗时中位数、编码后的大小，
+ * 以及隔行相对非隔行增加的耗时与大小（隔行输出总是单线程压缩，快速预设下还包括失去分段并行的代价）。
+ *
+ * stream：流式转码，png_read_file_rows 按行带解码，转为 RGBA8 后逐批提交给流式编码器（png_encoder_push_rows），
+ * 报告耗时、输出大小，以及与整幅解码再整幅编码相比的内存占用。
+ *
+ * rows：用 png_read_file_rows 按行带流式解码，报告耗时、行带数，以及与整幅解码（png_read_file + 格式转换）相比的内存占用。
+ */
+
+#define BENCH_DEFAULT_ITERATIONS 5
+#define BENCH_CACHE_DIRECTORY "png_cache"
+
+/**
+ * 获取单调递增的时间（秒）
+ */
+static double bench_now(void) {
+    return png_monotonic_time();
+}
+
+static int bench_compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 求耗时样本的中位数（会对样本数组排序）
+ */
+static double bench_median(double* samples, int count) {
+    qsort(samples, count, sizeof(double), bench_compare_double);
+    return samples[count / 2];
+}
+
+/**
+ * 测试单个文件的解码耗时
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_decode_file(const char* filename, int iterations) {
+    double* decode_times = (double*)malloc(iterations * sizeof(double));
+    double* convert_times = (double*)malloc(iterations * sizeof(double));
+    if (!decode_times || !convert_times) {
+        free(decode_times);
+        free(convert_times);
+        return 0;
+    }
+
+    PNG_IHDR header = {0};
+    for (int i = 0; i < iterations; i++) {
+        PNG_Image image;
+        double t0 = bench_now();
+        if (!png_read_file(filename, &image)) {
+            fprintf(stderr, "%s: decode failed\n", filename);
+            free(decode_times);
+            free(convert_times);
+            return 0;
+        }
+        double t1 = bench_now();
+
+        uint8_t* pixels = NULL;
+        size_t pixels_size = 0;
+        int ok = png_convert_to_rgba(&image, &pixels, &pixels_size);
+        double t2 = bench_now();
+
+        header = image.header;
+        free(pixels);
+        png_free_image(&image);
+        if (!ok) {
+            fprintf(stderr, "%s: convert failed\n", filename);
+            free(decode_times);
+            free(convert_times);
+            return 0;
+        }
+
+        decode_times[i] = t1 - t0;
+        convert_times[i] = t2 - t1;
+    }
+
+    double decode = bench_median(decode_times, iterations);
+    double convert = bench_median(convert_times, iterations);
+    double megapixels = (double)header.width * header.height / 1e6;
+
+    printf("%-40s %6ux%-6u %-9s decode %9.2f ms  convert %9.2f ms  %8.1f MP/s\n",
+        filename, header.width, header.height,
+        header.interlace_method == PNG_INTERLACE_METHOD_ADAM7 ? "adam7" : "none",
+        decode * 1e3, convert * 1e3, megapixels / (decode + convert));
+
+    free(decode_times);
+    free(convert_times);
+    return 1;
+}
+
+// 区域解码测试的目标区域
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} BenchRegion;
+
+/**
+ * 比较整幅解码与区域解码的耗时
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ * @param region        目标区域，超出图像的部分被截断
+ * @param use_index     是否同时测试借助随机访问索引的区域解码
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_region_file(const char* filename, int iterations, BenchRegion region, int use_index) {
+    double* full_times = (double*)malloc(iterations * sizeof(double));
+    double* region_times = (double*)malloc(iterations * sizeof(double));
+    double* indexed_times = (double*)malloc(iterations * sizeof(double));
+    if (!full_times || !region_times || !indexed_times) {
+        free(full_times);
+        free(region_times);
+        free(indexed_times);
+        return 0;
+    }
+
+    PNG_Index index = {0};
+    double index_time = 0;
+    if (use_index) {
+        double t0 = bench_now();
+        if (!png_index_open(filename, 0, &index, NULL)) {
+            fprintf(stderr, "%s: cannot index (interlaced or invalid)\n", filename);
+            free(full_times);
+            free(region_times);
+            free(indexed_times);
+            return 0;
+        }
+        index_time = bench_now() - t0;
+    }
+
+    PNG_IHDR header = {0};
+    int ok = 1;
+    for (int i = 0; i < iterations && ok; i++) {
+        PNG_Image image;
+        uint8_t* pixels = NULL;
+        size_t pixels_size = 0;
+
+        double t0 = bench_now();
+        ok = png_read_file(filename, &image) && png_convert_to_rgba(&image, &pixels, &pixels_size);
+        double t1 = bench_now();
+        if (!ok) {
+            break;
+        }
+        header = image.header;
+        png_free_image(&image);
+        free(pixels);
+        pixels = NULL;
+
+        if (region.x >= header.width || region.y >= header.height) {
+            ok = 0;
+            break;
+        }
+        if (region.width > header.width - region.x) {
+            region.width = header.width - region.x;
+        }
+        if (region.height > header.height - region.y) {
+            region.height = header.height - region.y;
+        }
+
+        double t2 = bench_now();
+        ok = png_decode_region(filename, &image, PNG_FORMAT_BGRA8, region.x, region.y, region.width, region.height,
+            &pixels, &pixels_size, NULL);
+        double t3 = bench_now();
+        if (ok) {
+            png_free_image(&image);
+        }
+        free(pixels);
+        pixels = NULL;
+
+        if (ok && use_index) {
+            ok = png_decode_region_indexed(filename, &index, &image, PNG_FORMAT_BGRA8, region.x, region.y, region.width,
+                region.height, &pixels, &pixels_size, NULL);
+            if (ok) {
+                png_free_image(&image);
+            }
+            free(pixels);
+        }
+        double t4 = bench_now();
+
+        full_times[i] = t1 - t0;
+        region_times[i] = t3 - t2;
+        indexed_times[i] = t4 - t3;
+    }
+
+    if (ok) {
+        double full = bench_median(full_times, iterations);
+        double part = bench_median(region_times, iterations);
+        printf("%-40s %6ux%-6u region %u,%u %ux%u  full %9.2f ms  region %9.2f ms  speedup %6.2fx\n",
+            filename, header.width, header.height, region.x, region.y, region.width, region.height,
+            full * 1e3, part * 1e3, full / part);
+        if (use_index) {
+            double indexed = bench_median(indexed_times, iterations);
+            printf("%-40s %u checkpoints  index %9.2f ms  indexed region %9.2f ms  speedup %6.2fx\n",
+                "", index.count, index_time * 1e3, indexed * 1e3, full / indexed);
+        }
+    } else {
+        fprintf(stderr, "%s: decode failed\n", filename);
+    }
+
+    png_index_free(&index);
+    free(full_times);
+    free(region_times);
+    free(indexed_times);
+    return ok;
+}
+
+/**
+ * 比较整幅解码与缩小解码的耗时
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ * @param scale         缩小倍数（2、4、8）
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_scaled_file(const char* filename, int iterations, uint32_t scale) {
+    double* full_times = (double*)malloc(iterations * sizeof(double));
+    double* scaled_times = (double*)malloc(iterations * sizeof(double));
+    if (!full_times || !scaled_times) {
+        free(full_times);
+        free(scaled_times);
+        return 0;
+    }
+
+    PNG_IHDR header = {0};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int ok = 1;
+    for (int i = 0; i < iterations && ok; i++) {
+        PNG_Image image;
+        uint8_t* pixels = NULL;
+        size_t pixels_size = 0;
+
+        double t0 = bench_now();
+        ok = png_read_file(filename, &image) && png_convert_to_rgba(&image, &pixels, &pixels_size);
+        double t1 = bench_now();
+        if (!ok) {
+            break;
+        }
+        header = image.header;
+        png_free_image(&image);
+        free(pixels);
+        pixels = NULL;
+
+        ok = png_read_file_scaled(filename, &image, PNG_FORMAT_BGRA8, scale, &pixels, &pixels_size, &width, &height,
+            NULL);
+        double t2 = bench_now();
+        if (ok) {
+            png_free_image(&image);
+        }
+        free(pixels);
+
+        full_times[i] = t1 - t0;
+        scaled_times[i] = t2 - t1;
+    }
+
+    if (ok) {
+        double full = bench_median(full_times, iterations);
+        double scaled = bench_median(scaled_times, iterations);
+        uint64_t full_memory = png_decoded_size(&header) + (uint64_t)header.width * header.height * 4;
+        printf("%-40s %6ux%-6u %s 1/%u -> %ux%u  full %9.2f ms  scaled %9.2f ms  speedup %6.2fx\n",
+            filename, header.width, header.height, header.interlace_method ? "adam7" : "plain", scale, width, height,
+            full * 1e3, scaled * 1e3, full / scaled);
+        printf("%-40s memory  whole image %10.1f MB  scaled %10.1f MB\n", "", full_memory / 1048576.0,
+            png_scaled_memory_size(&header, PNG_FORMAT_BGRA8, scale) / 1048576.0);
+    } else {
+        fprintf(stderr, "%s: decode failed\n", filename);
+    }
+
+    free(full_times);
+    free(scaled_times);
+    return ok;
+}
+
+/**
+ * 比较整幅解码与从解码结果缓存映射的耗时
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ * @param directory     缓存目录
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_cache_file(const char* filename, int iterations, const char* directory) {
+    if (!png_cache_set_directory(directory)) {
+        fprintf(stderr, "%s: cannot use cache directory\n", directory);
+        return 0;
+    }
+
+    double* full_times = (double*)malloc(iterations * sizeof(double));
+    double* cached_times = (double*)malloc(iterations * sizeof(double));
+    if (!full_times || !cached_times) {
+        free(full_times);
+        free(cached_times);
+        return 0;
+    }
+
+    PNG_IHDR header = {0};
+    int ok = 1;
+    for (int i = 0; i < iterations && ok; i++) {
+        PNG_Image image;
+        uint8_t* pixels = NULL;
+        size_t pixels_size = 0;
+
+        double t0 = bench_now();
+        ok = png_read_file(filename, &image) && png_convert_to_rgba(&image, &pixels, &pixels_size);
+        full_times[i] = bench_now() - t0;
+        if (ok) {
+            header = image.header;
+            png_free_image(&image);
+        }
+        free(pixels);
+    }
+
+    // 第一次打开：未命中时解码并写入缓存
+    PNG_CachedImage cached;
+    double t0 = bench_now();
+    ok = ok && png_cache_open(filename, PNG_FORMAT_BGRA8, &cached, NULL);
+    double first_time = bench_now() - t0;
+    int first_hit = ok && cached.mapped;
+    if (ok) {
+        png_cache_close(&cached);
+    }
+
+    // 之后的打开应全部命中，逐页读取一遍像素，计入缺页与磁盘读取的耗时
+    uint32_t checksum = 0;
+    for (int i = 0; i < iterations && ok; i++) {
+        double t1 = bench_now();
+        ok = png_cache_open(filename, PNG_FORMAT_BGRA8, &cached, NULL) && cached.mapped;
+        if (ok) {
+            for (size_t offset = 0; offset < cached.pixels_size; offset += PNG_CACHE_PAGE_SIZE) {
+                checksum += cached.pixels[offset];
+            }
+            png_cache_close(&cached);
+        }
+        cached_times[i] = bench_now() - t1;
+    }
+
+    if (ok) {
+        double full = bench_median(full_times, iterations);
+        double hit = bench_median(cached_times, iterations);
+        double size = (double)header.width * header.height * 4;
+        printf("%-40s %6ux%-6u full %9.2f ms  first open %9.2f ms (%s)  cached %9.2f ms  %8.1f MB/s  speedup %6.2fx"
+            "  checksum %08x\n", filename, header.width, header.height, full * 1e3, first_time * 1e3,
+            first_hit ? "hit" : "miss", hit * 1e3, size / hit / 1048576.0, full / hit, checksum);
+    } else {
+        fprintf(stderr, "%s: decode or cache failed\n", filename);
+    }
+
+    free(full_times);
+    free(cached_times);
+    return ok;
+}
+
+typedef struct {
+    double start;
+    uint32_t checksum;
+} BenchProgress;
+
+/**
+ * 逐遍预览回调：记录交付时间，并对预览求 FNV-1a 校验和，确保预览内容确实被读取
+ */
+static void bench_on_pass(void* user_data, int pass, const uint8_t* preview, uint32_t width, uint32_t height) {
+    BenchProgress* progress = (BenchProgress*)user_data;
+    uint32_t sum = 2166136261u;
+    for (size_t i = 0; i < (size_t)width * height * 4; i++) {
+        sum = (sum ^ preview[i]) * 16777619u;
+    }
+    progress->checksum = sum;
+    printf("  pass %d  %9.2f ms  checksum %08x\n", pass + 1, (bench_now() - progress->start) * 1e3, sum);
+}
+
+/**
+ * 测试单个文件的逐遍预览交付时间
+ */
+static int bench_progressive_file(const char* filename) {
+    BenchProgress progress = { bench_now(), 0 };
+    PNG_Image image;
+
+    printf("%s\n", filename);
+    if (!png_read_file_progressive(filename, &image, PNG_FORMAT_BGRA8, bench_on_pass, &progress, NULL)) {
+        fprintf(stderr, "%s: decode failed\n", filename);
+        return 0;
+    }
+    printf("  done    %9.2f ms\n", (bench_now() - progress.start) * 1e3);
+    png_free_image(&image);
+    return 1;
+}
+
+/**
+ * 测试单个文件在不同线程数下的像素格式转换耗时
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    每种线程数的重复次数
+ * @param max_threads   最大线程数
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_threads_file(const char* filename, int iterations, int max_threads) {
+    PNG_Image image;
+    if (!png_read_file(filename, &image)) {
+        fprintf(stderr, "%s: decode failed\n", filename);
+        return 0;
+    }
+
+    double* samples = (double*)malloc(iterations * sizeof(double));
+    if (!samples) {
+        png_free_image(&image);
+        return 0;
+    }
+
+    double megapixels = (double)image.header.width * image.header.height / 1e6;
+    double single = 0;
+    printf("%s  %ux%u (%.1f MP)\n", filename, image.header.width, image.header.height, megapixels);
+
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > max_threads) {
+            threads = max_threads;
+        }
+        png_set_thread_count(threads);
+        for (int i = 0; i < iterations; i++) {
+            uint8_t* pixels = NULL;
+            size_t pixels_size = 0;
+            double t0 = bench_now();
+            png_convert_to_rgba(&image, &pixels, &pixels_size);
+            samples[i] = bench_now() - t0;
+            free(pixels);
+        }
+        double t = bench_median(samples, iterations);
+        if (threads == 1) {
+            single = t;
+        }
+        printf("  %2d threads  convert %9.2f ms  %8.1f MP/s  speedup %5.2fx\n",
+            png_get_thread_count(), t * 1e3, megapixels / t, single / t);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    png_set_thread_count(0);
+    free(samples);
+    png_free_image(&image);
+    return 1;
+}
+
+/**
+ * 比较单个文件串行解码与流水线解码的总耗时
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_pipeline_file(const char* filename, int iterations) {
+    double* serial_times = (double*)malloc(iterations * sizeof(double));
+    double* pipelined_times = (double*)malloc(iterations * sizeof(double));
+    if (!serial_times || !pipelined_times) {
+        free(serial_times);
+        free(pipelined_times);
+        return 0;
+    }
+
+    PNG_IHDR header = {0};
+    int ok = 1;
+    for (int i = 0; i < iterations && ok; i++) {
+        PNG_Image image;
+        uint8_t* pixels = NULL;
+        size_t pixels_size = 0;
+
+        double t0 = bench_now();
+        ok = png_read_file(filename, &image) && png_convert_to_rgba(&image, &pixels, &pixels_size);
+        double t1 = bench_now();
+        if (ok) {
+            png_free_image(&image);
+        }
+        free(pixels);
+        pixels = NULL;
+
+        ok = ok && png_read_file_pipelined(filename, &image, PNG_FORMAT_BGRA8, &pixels, &pixels_size);
+        double t2 = bench_now();
+        if (ok) {
+            header = image.header;
+            png_free_image(&image);
+        }
+        free(pixels);
+
+        serial_times[i] = t1 - t0;
+        pipelined_times[i] = t2 - t1;
+    }
+
+    if (ok) {
+        double serial = bench_median(serial_times, iterations);
+        double pipelined = bench_median(pipelined_times, iterations);
+        printf("%-40s %6ux%-6u serial %9.2f ms  pipelined %9.2f ms  speedup %5.2fx\n",
+            filename, header.width, header.height, serial * 1e3, pipelined * 1e3, serial / pipelined);
+    } else {
+        fprintf(stderr, "%s: decode failed\n", filename);
+    }
+
+    free(serial_times);
+    free(pipelined_times);
+    return ok;
+}
+
+// 编码测试的各组选项
+static const char* const bench_encode_names[] = { "paeth", "minsum", "entropy", "fast", "indexed", "noreduce", "clean-l",
+    "clean-a" };
+#define BENCH_ENCODE_PRESETS 8
+
+/**
+ * 先报告无损缩减分析的结果与耗时，再比较固定 Paeth 滤波、逐行自适应滤波（默认选项的最小绝对差之和，以及熵估算）、
+ * 快速预设、带分段索引的快速预设与不做无损缩减的默认选项的编码耗时和压缩率（带 α 通道的图像再加上清理透明像素颜色的默认选项），
+ * 再以 1、2、4 …… 直到最大线程数测试快速预设分段并行压缩的扩展性
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ * @param max_threads   最大线程数
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_encode_file(const char* filename, int iterations, int max_threads) {
+    PNG_Image image;
+    if (!png_read_file(filename, &image)) {
+        fprintf(stderr, "%s: decode failed\n", filename);
+        return 0;
+    }
+
+    double* samples = (double*)malloc(iterations * sizeof(double));
+    if (!samples) {
+        png_free_image(&image);
+        return 0;
+    }
+
+    double raw_bytes = (double)image.header.height * png_row_bytes(&image.header, image.header.width);
+    printf("%-40s %6ux%-6u %8.1f MB raw\n", filename, image.header.width, image.header.height, raw_bytes / 1048576.0);
+
+    PNG_ReduceInfo info;
+    int ok = 1;
+    for (int i = 0; i < iterations && ok; i++) {
+        double t0 = bench_now();
+        ok = png_reduce_analyze(&image, &info);
+        samples[i] = bench_now() - t0;
+    }
+    if (ok) {
+        printf("  reduce   analyze %8.2f ms  type %u/%u-bit -> %u/%u-bit  colors %s%u\n", bench_median(samples, iterations) * 1e3,
+            image.header.color_type, image.header.bit_depth, info.color_type, info.bit_depth,
+            info.color_count > PNG_REDUCE_MAX_COLORS ? ">" : "",
+            info.color_count > PNG_REDUCE_MAX_COLORS ? PNG_REDUCE_MAX_COLORS : info.color_count);
+    }
+
+    int has_alpha = image.header.color_type == PNG_COLOR_TYPE_GRAY_ALPHA ||
+        image.header.color_type == PNG_COLOR_TYPE_RGBA;
+    for (int preset = 0; preset < BENCH_ENCODE_PRESETS && ok; preset++) {
+        if (preset >= 6 && !has_alpha) {
+            break;
+        }
+        PNG_EncodeOptions options;
+        png_encode_options_init(&options);
+        if (preset == 0) {
+            options.filter = PNG_FILTER_PAETH;
+        } else if (preset == 2) {
+            options.filter = PNG_ENCODE_FILTER_ENTROPY;
+        } else if (preset == 3 || preset == 4) {
+            png_encode_options_fast(&options);
+            options.segment_index = preset == 4;
+        }
+        if (preset == 5) {
+            options.reduce = 0;
+        }
+        if (preset >= 6) {
+            options.transparent = preset == 6 ? PNG_CLEAN_LEFT : PNG_CLEAN_ABOVE;
+        }
+
+        size_t encoded_size = 0;
+        for (int i = 0; i < iterations && ok; i++) {
+            uint8_t* encoded = NULL;
+            double t0 = bench_now();
+            ok = png_write_memory(&image, &options, &encoded, &encoded_size);
+            samples[i] = bench_now() - t0;
+            free(encoded);
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: encode failed\n", filename);
+            break;
+        }
+
+        double t = bench_median(samples, iterations);
+        printf("  %-8s encode %9.2f ms  %8.1f MB/s  %10.1f KB  ratio %6.2f%%\n", bench_encode_names[preset],
+            t * 1e3, raw_bytes / 1048576.0 / t, encoded_size / 1024.0, encoded_size * 100.0 / raw_bytes);
+    }
+
+    double single = 0;
+    for (int threads = 1; ok; threads *= 2) {
+        if (threads > max_threads) {
+            threads = max_threads;
+        }
+        PNG_EncodeOptions options;
+        png_encode_options_fast(&options);
+        png_set_thread_count(threads);
+        for (int i = 0; i < iterations && ok; i++) {
+            uint8_t* encoded = NULL;
+            size_t encoded_size = 0;
+            double t0 = bench_now();
+            ok = png_write_memory(&image, &options, &encoded, &encoded_size);
+            samples[i] = bench_now() - t0;
+            free(encoded);
+        }
+        if (!ok) {
+            break;
+        }
+        double t = bench_median(samples, iterations);
+        if (threads == 1) {
+            single = t;
+        }
+        printf("  %2d threads  fast encode %9.2f ms  %8.1f MB/s  speedup %5.2fx\n", png_get_thread_count(), t * 1e3,
+            raw_bytes / 1048576.0 / t, single / t);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+    png_set_thread_count(0);
+
+    free(samples);
+    png_free_image(&image);
+    return ok;
+}
+
+// 调色板测试的排序方式
+static const char* const bench_palette_names[] = { "keep", "luma", "frequency", "nearest" };
+
+/**
+ * 编码一次调色板图像并统计耗时中位数
+ */
+static int bench_palette_encode(const PNG_Image* image, const PNG_EncodeOptions* options, int iterations,
+    double* samples, double* elapsed, size_t* encoded_size) {
+    int ok = 1;
+    for (int i = 0; i < iterations && ok; i++) {
+        uint8_t* encoded = NULL;
+        double t0 = bench_now();
+        ok = png_write_memory(image, options, &encoded, encoded_size);
+        samples[i] = bench_now() - t0;
+        free(encoded);
+    }
+    *elapsed = bench_median(samples, iterations);
+    return ok;
+}
+
+/**
+ * 无损缩减为调色板图像后，比较各种调色板排序方式在不滤波与逐行选择滤波下的编码耗时和大小，以及自动选择的结果
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)；不能缩减为调色板的图像跳过，也返回 1
+ */
+static int bench_palette_file(const char* filename, int iterations) {
+    PNG_Image image;
+    if (!png_read_file(filename, &image)) {
+        fprintf(stderr, "%s: decode failed\n", filename);
+        return 0;
+    }
+    PNG_Image reduced;
+    int has_reduced = png_reduce_image(&image, &reduced);
+    const PNG_Image* indexed = has_reduced ? &reduced : &image;
+    if (indexed->header.color_type != PNG_COLOR_TYPE_PALETTE) {
+        printf("%-40s not reducible to a palette, skipped\n", filename);
+        if (has_reduced) {
+            png_free_image(&reduced);
+        }
+        png_free_image(&image);
+        return 1;
+    }
+
+    double* samples = (double*)malloc(iterations * sizeof(double));
+    int ok = samples != NULL;
+    printf("%-40s %6ux%-6u %3u colors %u-bit\n", filename, indexed->header.width, indexed->header.height,
+        indexed->palette_size, indexed->header.bit_depth);
+
+    static const int filters[] = { PNG_FILTER_NONE, PNG_ENCODE_FILTER_MINSUM };
+    for (int order = PNG_ENCODE_PALETTE_KEEP; order <= PNG_ENCODE_PALETTE_NEAREST && ok; order++) {
+        for (int f = 0; f < 2 && ok; f++) {
+            PNG_EncodeOptions options;
+            png_encode_options_init(&options);
+            options.reduce = 0;
+            options.palette = order;
+            options.filter = filters[f];
+            double elapsed;
+            size_t encoded_size = 0;
+            ok = bench_palette_encode(indexed, &options, iterations, samples, &elapsed, &encoded_size);
+            if (ok) {
+                printf("  %-9s %-6s encode %9.2f ms  %10.1f KB\n", bench_palette_names[order], f ? "minsum" : "none",
+                    elapsed * 1e3, encoded_size / 1024.0);
+            }
+        }
+    }
+
+    if (ok) {
+        PNG_EncodeOptions options;
+        png_encode_options_init(&options);
+        options.reduce = 0;
+        PNG_Image sorted;
+        int filter;
+        double t0 = bench_now();
+        int has_sorted = png_palette_sort(indexed, &options, &sorted, &filter);
+        double choose = bench_now() - t0;
+        if (has_sorted) {
+            png_free_image(&sorted);
+        }
+
+        double elapsed;
+        size_t encoded_size = 0;
+        ok = bench_palette_encode(indexed, &options, iterations, samples, &elapsed, &encoded_size);
+        if (ok) {
+            printf("  %-9s %-6s encode %9.2f ms  %10.1f KB  (choose %.2f ms)\n", "auto",
+                filter == PNG_FILTER_NONE || filter == PNG_ENCODE_FILTER_AUTO ? "none" : "minsum", elapsed * 1e3,
+                encoded_size / 1024.0, choose * 1e3);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: encode failed\n", filename);
+    }
+
+    free(samples);
+    if (has_reduced) {
+        png_free_image(&reduced);
+    }
+    png_free_image(&image);
+    return ok;
+}
+
+// 局部重新编码测试中模拟的笔刷大小（像素）
+#define BENCH_BRUSH_SIZE 64
+
+static int bench_count_bytes(void* user_data, const uint8_t* data, size_t size) {
+    (void)data;
+    *(uint64_t*)user_data += size;
+    return 1;
+}
+
+/**
+ * 比较整幅编码、创建可局部重新编码的编码器（全部段），以及在图像中央模拟一次笔刷修改后局部保存的耗时与大小
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_restart_file(const char* filename, int iterations) {
+    PNG_Image image;
+    if (!png_read_file(filename, &image)) {
+        fprintf(stderr, "%s: decode failed\n", filename);
+        return 0;
+    }
+    double* samples = (double*)malloc(iterations * 3 * sizeof(double));
+    if (!samples) {
+        png_free_image(&image);
+        return 0;
+    }
+
+    // 与局部重新编码相同的表示：不做无损缩减与调色板重排
+    PNG_EncodeOptions options;
+    png_encode_options_init(&options);
+    options.reduce = 0;
+    options.palette = PNG_ENCODE_PALETTE_KEEP;
+
+    const PNG_IHDR* header = &image.header;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    uint32_t brush_rows = header->height < BENCH_BRUSH_SIZE ? header->height : BENCH_BRUSH_SIZE;
+    uint32_t brush_y = (header->height - brush_rows) / 2;
+    uint32_t brush_bytes = bytes_per_line < BENCH_BRUSH_SIZE * 8 ? bytes_per_line : BENCH_BRUSH_SIZE * 8;
+    size_t brush_x = (bytes_per_line - brush_bytes) / 2;
+
+    uint64_t full_size = 0;
+    uint64_t restart_size = 0;
+    uint32_t refreshed = 0;
+    uint32_t segments = 0;
+    uint32_t restart_rows = 0;
+    int ok = 1;
+    for (int i = 0; i < iterations && ok; i++) {
+        full_size = 0;
+        double t0 = bench_now();
+        ok = png_write_callback(&image, &options, bench_count_bytes, &full_size);
+        double t1 = bench_now();
+        PNG_RestartEncoder* encoder = ok ? png_restart_encoder_create(&image, &options, 0) : NULL;
+        restart_size = 0;
+        ok = encoder && png_restart_encoder_write(encoder, &image, bench_count_bytes, &restart_size, NULL);
+        segments = png_restart_encoder_segments(encoder, &restart_rows);
+        double t2 = bench_now();
+
+        // 笔刷：改写中央区域的样本（调色板图像改为索引 0，保证索引有效）
+        for (uint32_t y = brush_y; y < brush_y + brush_rows && ok; y++) {
+            uint8_t* row = image.image_data + (size_t)y * bytes_per_line + brush_x;
+            for (uint32_t x = 0; x < brush_bytes; x++) {
+                row[x] = header->color_type == PNG_COLOR_TYPE_PALETTE ? 0 : (uint8_t)(row[x] ^ 0x5A);
+            }
+        }
+        double t3 = bench_now();
+        if (ok) {
+            png_restart_encoder_invalidate(encoder, brush_y, brush_rows);
+            uint64_t size = 0;
+            ok = png_restart_encoder_write(encoder, &image, bench_count_bytes, &size, &refreshed);
+        }
+        double t4 = bench_now();
+        png_restart_encoder_destroy(encoder);
+
+        samples[i] = t1 - t0;
+        samples[iterations + i] = t2 - t1;
+        samples[iterations * 2 + i] = t4 - t3;
+    }
+
+    if (ok) {
+        printf("%-40s %6ux%-6u\n", filename, header->width, header->height);
+        printf("  full     encode %9.2f ms  %10.1f KB\n", bench_median(samples, iterations) * 1e3, full_size / 1024.0);
+        printf("  restart  encode %9.2f ms  %10.1f KB  %u segments of %u rows\n",
+            bench_median(samples + iterations, iterations) * 1e3, restart_size / 1024.0, segments, restart_rows);
+        printf("  brush    save   %9.2f ms  %u/%u segments re-encoded\n",
+            bench_median(samples + iterations * 2, iterations) * 1e3, refreshed, segments);
+    } else {
+        fprintf(stderr, "%s: encode failed\n", filename);
+    }
+
+    free(samples);
+    png_free_image(&image);
+    return ok;
+}
+
+/**
+ * 比较非隔行与 Adam7 隔行编码的耗时和大小（默认选项与快速预设）
+ *
+ * @param filename      PNG 文件路径
+ * @param iterations    重复次数
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_interlace_file(const char* filename, int iterations) {
+    PNG_Image image;
+    if (!png_read_file(filename, &image)) {
+        fprintf(stderr, "%s: decode failed\n", filename);
+        return 0;
+    }
+    double* samples = (double*)malloc(iterations * sizeof(double));
+    int ok = samples != NULL;
+    printf("%-40s %6ux%-6u\n", filename, image.header.width, image.header.height);
+
+    static const char* const presets[] = { "default", "fast" };
+    for (int preset = 0; preset < 2 && ok; preset++) {
+        double elapsed[2];
+        size_t encoded_size[2] = { 0, 0 };
+        for (int interlace = PNG_INTERLACE_METHOD_NONE; interlace <= PNG_INTERLACE_METHOD_ADAM7 && ok; interlace++) {
+            PNG_EncodeOptions options;
+            if (preset == 0) {
+                png_encode_options_init(&options);
+            } else {
+                png_encode_options_fast(&options);
+            }
+            options.interlace = interlace;
+            for (int i = 0; i < iterations && ok; i++) {
+                uint8_t* encoded = NULL;
+                double t0 = bench_now();
+                ok = png_write_memory(&image, &options, &encoded, &encoded_size[interlace]);
+                samples[i] = bench_now() - t0;
+                free(encoded);
+            }
+            elapsed[interlace] = bench_median(samples, iterations);
+        }
+        if (ok) {
+            printf("  %-8s none   encode %9.2f ms  %10.1f KB\n", presets[preset], elapsed[0] * 1e3,
+                encoded_size[0] / 1024.0);
+            printf("  %-8s adam7  encode %9.2f ms  %10.1f KB  (time %+.1f%%, size %+.1f%%)\n", presets[preset],
+                elapsed[1] * 1e3, encoded_size[1] / 1024.0,
+                elapsed[0] > 0 ? (elapsed[1] / elapsed[0] - 1) * 100 : 0.0,
+                encoded_size[0] > 0 ? ((double)encoded_size[1] / encoded_size[0] - 1) * 100 : 0.0);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: encode failed\n", filename);
+    }
+
+    free(samples);
+    png_free_image(&image);
+    return ok;
+}
+
+// 行带解码统计
+typedef struct {
+    uint32_t bands;
+    uint64_t bytes;
+    uint32_t checksum;
+} BenchRows;
+
+/**
+ * 行带回调：累计行带数、字节数与校验和（防止编译器优化掉解码结果）
+ */
+static void bench_on_rows(void* user_data, uint32_t y, uint32_t rows, const uint8_t* pixels, size_t stride) {
+    BenchRows* stats = (BenchRows*)user_data;
+    (void)y;
+    stats->bands++;
+    stats->bytes += (uint64_t)rows * stride;
+    for (size_t i = 0; i < (size_t)rows * stride; i += 4096) {
+        stats->checksum = stats->checksum * 31 + pixels[i];
+    }
+}
+
+/**
+ * 按行带流式解码单个文件
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_rows_file(const char* filename) {
+    PNG_Image image;
+    BenchRows stats = {0};
+
+    double t0 = bench_now();
+    int ok = png_read_file_rows(filename, &image, PNG_FORMAT_BGRA8, bench_on_rows, &stats, NULL);
+    double elapsed = bench_now() - t0;
+    if (!ok) {
+        fprintf(stderr, "%s: decode failed\n", filename);
+        return 0;
+    }
+
+    printf("%-40s %6ux%-6u %9.2f ms  %6u bands  %8.1f MB out  memory %8.1f MB (whole image %8.1f MB)  checksum %08x\n",
+        filename, image.header.width, image.header.height, elapsed * 1e3, stats.bands, stats.bytes / 1e6,
+        png_rows_memory_size(&image.header, PNG_FORMAT_BGRA8) / 1e6, (png_decoded_size(&image.header) + stats.bytes) / 1e6,
+        stats.checksum);
+    png_free_image(&image);
+    return 1;
+}
+
+// 流式转码状态
+typedef struct {
+    const PNG_Image* image;         // png_read_file_rows 在第一次回调前填好图像头
+    PNG_Encoder* encoder;           // 第一次回调时创建
+    uint8_t* rgba;                  // 一个行带的 RGBA8 样本
+    size_t rgba_size;
+    uint64_t bytes_out;
+    int ok;
+} BenchStream;
+
+static int bench_count_output(void* user_data, const uint8_t* data, size_t size) {
+    (void)data;
+    ((BenchStream*)user_data)->bytes_out += size;
+    return 1;
+}
+
+/**
+ * 行带回调：BGRA8 转为 PNG 的 RGBA8 样本顺序后提交给流式编码器
+ */
+static void bench_on_stream_rows(void* user_data, uint32_t y, uint32_t rows, const uint8_t* pixels, size_t stride) {
+    BenchStream* stream = (BenchStream*)user_data;
+    if (!stream->ok) {
+        return;
+    }
+    if (y == 0) {
+        PNG_Image header = { { stream->image->header.width, stream->image->header.height, 8, PNG_COLOR_TYPE_RGBA,
+            0, 0, 0 }, NULL, 0, NULL, 0, NULL, 0 };
+        stream->encoder = png_encoder_create(&header, NULL, bench_count_output, stream);
+        if (!stream->encoder) {
+            stream->ok = 0;
+            return;
+        }
+    }
+    if (stream->rgba_size < (size_t)rows * stride) {
+        free(stream->rgba);
+        stream->rgba_size = (size_t)rows * stride;
+        stream->rgba = (uint8_t*)malloc(stream->rgba_size);
+        if (!stream->rgba) {
+            stream->ok = 0;
+            return;
+        }
+    }
+    for (size_t i = 0; i < (size_t)rows * stride; i += 4) {
+        stream->rgba[i] = pixels[i + 2];
+        stream->rgba[i + 1] = pixels[i + 1];
+        stream->rgba[i + 2] = pixels[i];
+        stream->rgba[i + 3] = pixels[i + 3];
+    }
+    stream->ok = png_encoder_push_rows(stream->encoder, stream->rgba, rows, stride);
+}
+
+/**
+ * 流式转码单个文件：按行带解码为 BGRA8，逐批提交给流式编码器重新编码为 RGBA8 PNG（输出只计数，不保存）
+ *
+ * @return              是否测试成功，返回 1(真) 或 0(假)
+ */
+static int bench_stream_file(const char* filename) {
+    PNG_Image image;
+    BenchStream stream = { &image, NULL, NULL, 0, 0, 1 };
+
+    double t0 = bench_now();
+    int ok = png_read_file_rows(filename, &image, PNG_FORMAT_BGRA8, bench_on_stream_rows, &stream, NULL) &&
+        stream.ok && png_encoder_finish(stream.encoder);
+    double elapsed = bench_now() - t0;
+    png_encoder_destroy(stream.encoder);
+    free(stream.rgba);
+    if (!ok) {
+        fprintf(stderr, "%s: transcode failed\n", filename);
+        return 0;
+    }
+
+    PNG_IHDR rgba = { image.header.width, image.header.height, 8, PNG_COLOR_TYPE_RGBA, 0, 0, 0 };
+    uint64_t memory = png_rows_memory_size(&image.header, PNG_FORMAT_BGRA8) + png_encoder_memory_size(&rgba, NULL);
+    uint64_t whole = png_decoded_size(&image.header) + png_decoded_size(&rgba) + (uint64_t)image.header.width *
+        image.header.height * 4;
+    printf("%-40s %6ux%-6u %9.2f ms  %8.1f MB out  memory %8.1f MB (whole image %8.1f MB)\n", filename,
+        image.header.width, image.header.height, elapsed * 1e3, stream.bytes_out / 1e6, memory / 1e6, whole / 1e6);
+    png_free_image(&image);
+    return 1;
+}
+
+/**
+ * 批量解码完成回调：打印单个文件的结果
+ */
+static void bench_on_batch_file(void* user_data, uint32_t index, const char* filename,
+    const PNG_Image* image, const uint8_t* pixels, size_t pixels_size) {
+    (void)user_data;
+    (void)index;
+    (void)pixels;
+    (void)pixels_size;
+    if (image) {
+        printf("  %-40s %6ux%-6u\n", filename, image->header.width, image->header.height);
+    } else {
+        printf("  %-40s failed\n", filename);
+    }
+}
+
+/**
+ * 向文件列表追加一个路径（复制字符串）
+ *
+ * @return      是否追加成功，返回 1(真) 或 0(假)
+ */
+static int bench_append_file(const char* path, char*** files, uint32_t* count, uint32_t* capacity) {
+    if (*count == *capacity) {
+        uint32_t new_capacity = *capacity ? *capacity * 2 : 64;
+        char** grown = (char**)realloc(*files, new_capacity * sizeof(char*));
+        if (!grown) {
+            return 0;
+        }
+        *files = grown;
+        *capacity = new_capacity;
+    }
+
+    char* copy = (char*)malloc(strlen(path) + 1);
+    if (!copy) {
+        return 0;
+    }
+    strcpy(copy, path);
+    (*files)[(*count)++] = copy;
+    return 1;
+}
+
+/**
+ * 读取列表文件，每行一个路径，追加到文件列表
+ *
+ * @return      是否读取成功，返回 1(真) 或 0(假)
+ */
+static int bench_read_list(const char* list_path, char*** files, uint32_t* count, uint32_t* capacity) {
+    FILE* file = fopen(list_path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char line[4096];
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] != 0) {
+            ok = bench_append_file(line, files, count, capacity);
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+/**
+ * 批量解码命令：png_bench batch [-t 线程数] [-l 列表文件] <文件.png> ...
+ */
+static int bench_batch(int argc, char** argv) {
+    char** files = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    int threads = 0;
+    int ok = 1;
+
+    for (int i = 2; i < argc && ok; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            ok = bench_read_list(argv[++i], &files, &count, &capacity);
+            if (!ok) {
+                fprintf(stderr, "%s: cannot read file list\n", argv[i]);
+            }
+            continue;
+        }
+        ok = bench_append_file(argv[i], &files, &count, &capacity);
+    }
+
+    if (ok) {
+        PNG_BatchStats stats;
+        double t0 = bench_now();
+        png_decode_batch((const char* const*)files, count, PNG_FORMAT_BGRA8, threads, bench_on_batch_file, NULL, &stats);
+        double elapsed = bench_now() - t0;
+
+        printf("%u files, %u failed, %u stolen  %9.2f ms  %8.1f files/s  %8.1f MB/s in  %8.1f MB/s out\n",
+            stats.files, stats.failed, stats.steals, elapsed * 1e3,
+            stats.files / elapsed, stats.input_bytes / 1e6 / elapsed, stats.output_bytes / 1e6 / elapsed);
+        ok = stats.failed == 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        free(files[i]);
+    }
+    free(files);
+    return ok;
+}
+
+static void bench_usage(void) {
+    fprintf(stderr, "usage: png_bench decode [-n iterations] <file.png> ...\n");
+    fprintf(stderr, "       png_bench progressive <file.png> ...\n");
+    fprintf(stderr, "       png_bench threads [-n iterations] [-t max_threads] <file.png> ...\n");
+    fprintf(stderr, "       png_bench pipeline [-n iterations] <file.png> ...\n");
+    fprintf(stderr, "       png_bench batch [-t threads] [-l list.txt] <file.png> ...\n");
+    fprintf(stderr, "       png_bench rows <file.png> ...\n");
+    fprintf(stderr, "       png_bench region [-n iterations] [-r x,y,width,height] [-i] <file.png> ...\n");
+    fprintf(stderr, "       png_bench scaled [-n iterations] [-s 2|4|8] <file.png> ...\n");
+    fprintf(stderr, "       png_bench cache [-n iterations] [-d cache_dir] <file.png> ...\n");
+    fprintf(stderr, "       png_bench encode [-n iterations] [-t max_threads] <file.png> ...\n");
+    fprintf(stderr, "       png_bench palette [-n iterations] <file.png> ...\n");
+    fprintf(stderr, "       png_bench restart [-n iterations] <file.png> ...\n");
+    fprintf(stderr, "       png_bench interlace [-n iterations] <file.png> ...\n");
+    fprintf(stderr, "       png_bench stream <file.png> ...\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        bench_usage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "progressive") == 0) {
+        int failed = 0;
+        for (int i = 2; i < argc; i++) {
+            if (!bench_progressive_file(argv[i])) {
+                failed = 1;
+            }
+        }
+        return failed;
+    }
+
+    if (strcmp(argv[1], "rows") == 0) {
+        int failed = 0;
+        for (int i = 2; i < argc; i++) {
+            if (!bench_rows_file(argv[i])) {
+                failed = 1;
+            }
+        }
+        return failed;
+    }
+
+    if (strcmp(argv[1], "stream") == 0) {
+        int failed = 0;
+        for (int i = 2; i < argc; i++) {
+            if (!bench_stream_file(argv[i])) {
+                failed = 1;
+            }
+        }
+        return failed;
+    }
+
+    if (strcmp(argv[1], "batch") == 0) {
+        return !bench_batch(argc, argv);
+    }
+
+    int threads_mode = strcmp(argv[1], "threads") == 0;
+    int pipeline_mode = strcmp(argv[1], "pipeline") == 0;
+    int region_mode = strcmp(argv[1], "region") == 0;
+    int scaled_mode = strcmp(argv[1], "scaled") == 0;
+    int cache_mode = strcmp(argv[1], "cache") == 0;
+    int encode_mode = strcmp(argv[1], "encode") == 0;
+    int palette_mode = strcmp(argv[1], "palette") == 0;
+    int restart_mode = strcmp(argv[1], "restart") == 0;
+    int interlace_mode = strcmp(argv[1], "interlace") == 0;
+    if (!threads_mode && !pipeline_mode && !region_mode && !scaled_mode && !cache_mode && !encode_mode &&
+        !palette_mode && !restart_mode && !interlace_mode && strcmp(argv[1], "decode") != 0) {
+        bench_usage();
+        return 1;
+    }
+
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int max_threads = png_cpu_count();
+    BenchRegion region = { 0, 0, 1024, 1024 };
+    int use_index = 0;
+    uint32_t scale = PNG_SCALE_MAX;
+    const char* cache_directory = BENCH_CACHE_DIRECTORY;
+    int failed = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+            if (iterations <= 0) {
+                bench_usage();
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+            if (max_threads <= 0 || max_threads > PNG_MAX_THREADS) {
+                bench_usage();
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%u,%u,%u,%u", &region.x, &region.y, &region.width, &region.height) != 4 ||
+                region.width == 0 || region.height == 0) {
+                bench_usage();
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scale = (uint32_t)atoi(argv[++i]);
+            if (scale != 2 && scale != 4 && scale != 8) {
+                bench_usage();
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            cache_directory = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-i") == 0) {
+            use_index = 1;
+            continue;
+        }
+        int ok;
+        if (threads_mode) {
+            ok = bench_threads_file(argv[i], iterations, max_threads);
+        } else if (pipeline_mode) {
+            ok = bench_pipeline_file(argv[i], iterations);
+        } else if (region_mode) {
+            ok = bench_region_file(argv[i], iterations, region, use_index);
+        } else if (scaled_mode) {
+            ok = bench_scaled_file(argv[i], iterations, scale);
+        } else if (cache_mode) {
+            ok = bench_cache_file(argv[i], iterations, cache_directory);
+        } else if (encode_mode) {
+            ok = bench_encode_file(argv[i], iterations, max_threads);
+        } else if (palette_mode) {
+            ok = bench_palette_file(argv[i], iterations);
+        } else if (restart_mode) {
+            ok = bench_restart_file(argv[i], iterations);
+        } else if (interlace_mode) {
+            ok = bench_interlace_file(argv[i], iterations);
+        } else {
+            ok = bench_decode_file(argv[i], iterations);
+        }
+        if (!ok) {
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
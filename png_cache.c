@@ -0,0 +1,663 @@
+#include "png_cache.h"
+#include "png_file.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <utime.h>
+#include <zlib.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+ * 解码结果缓存
+ *
+ * 同一幅大图像再次打开时不必重新解压：第一次解码后把转换好的像素原样写入缓存目录，之后直接把缓存文件映射到内存，
+ * 打开耗时只取决于磁盘读取速度。
+ *
+ * 缓存文件格式（小端序）：
+ *   文件头  "PNGPIX1\n"，宽、高、像素格式、源文件指纹（各 4 字节），每行字节数、像素数据偏移、像素数据大小、
+ *           源文件大小、源文件修改时间（各 8 字节），源文件路径长度与保留字段（各 4 字节），之后是源文件路径；
+ *           文件头补零到 PNG_CACHE_PAGE_SIZE
+ *   像素    从 PNG_CACHE_PAGE_SIZE 开始，与内存中的布局完全相同
+ *
+ * 缓存文件名为源文件路径的 64 位 FNV-1a 散列加像素格式，文件头中保存完整路径以排除散列冲突。
+ * 源文件的大小、修改时间或首尾 64KB 的 CRC 任一不符即视为过期。每次命中都会更新缓存文件的修改时间，
+ * 目录超出大小上限时按修改时间从旧到新删除（近似 LRU）。写入中途退出的进程留下的临时文件超过宽限期后在淘汰时删除。
+ */
+
+static const uint8_t png_cache_magic[8] = { 'P', 'N', 'G', 'P', 'I', 'X', '1', '\n' };
+
+#define PNG_CACHE_HEADER_SIZE (8 + 16 + 40 + 8)
+#define PNG_CACHE_PATH_MAX 1024
+
+// 残留临时文件的宽限期（秒）：修改时间早于此的临时文件不可能还在写入，淘汰时直接删除
+#define PNG_CACHE_TEMP_GRACE (60 * 60)
+
+static char png_cache_directory[PNG_CACHE_PATH_MAX] = "";
+static _Atomic uint64_t png_cache_limit = PNG_CACHE_DEFAULT_LIMIT;
+
+/**
+ * 缓存目录中的一个缓存文件（淘汰时使用）
+ */
+typedef struct {
+    char* path;
+    uint64_t size;
+    int64_t mtime;                  // 修改时间（自 1970 年起的秒数）
+    int temp;                       // 是否为写入缓存时的临时文件
+} PNG_CacheEntry;
+
+static void png_cache_put32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void png_cache_put64(uint8_t* p, uint64_t v) {
+    png_cache_put32(p, (uint32_t)v);
+    png_cache_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t png_cache_get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t png_cache_get64(const uint8_t* p) {
+    return (uint64_t)png_cache_get32(p) | ((uint64_t)png_cache_get32(p + 4) << 32);
+}
+
+/**
+ * 获取文件的大小与修改时间
+ *
+ * @return      是否获取成功，返回 1(真) 或 0(假)
+ */
+static int png_cache_stat(const char* filename, uint64_t* size, int64_t* mtime) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return 0;
+    }
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return 1;
+}
+
+/**
+ * 移动到文件中的指定位置（64 位，支持超过 2GB 的文件）
+ */
+static int png_cache_seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (int64_t)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+/**
+ * 计算源文件的指纹：开头与末尾各 PNG_CACHE_FINGERPRINT_BYTES 字节的 CRC（文件较小时为整个文件）
+ *
+ * 只读取文件首尾，与解压整个文件相比开销可以忽略，又能发现大小与修改时间都未变化的改动（例如修改时间精度不足）。
+ *
+ * @param filename      源文件路径
+ * @param size          源文件大小
+ * @param fingerprint   指纹
+ *
+ * @return              是否计算成功，返回 1(真) 或 0(假)
+ */
+static int png_cache_fingerprint(const char* filename, uint64_t size, uint32_t* fingerprint) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    uint8_t* buffer = (uint8_t*)malloc(PNG_CACHE_FINGERPRINT_BYTES);
+    int ok = buffer != NULL;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint64_t head = size < 2 * PNG_CACHE_FINGERPRINT_BYTES ? size : PNG_CACHE_FINGERPRINT_BYTES;
+    uint64_t tail = size - head < PNG_CACHE_FINGERPRINT_BYTES ? size - head : PNG_CACHE_FINGERPRINT_BYTES;
+
+    // 文件小于两倍读取量时整个文件都计入 head
+    while (ok && head > 0) {
+        size_t count = head < PNG_CACHE_FINGERPRINT_BYTES ? (size_t)head : PNG_CACHE_FINGERPRINT_BYTES;
+        ok = fread(buffer, 1, count, file) == count;
+        if (ok) {
+            crc = crc32(crc, buffer, (uInt)count);
+            head -= count;
+        }
+    }
+    if (ok && tail > 0) {
+        ok = png_cache_seek(file, size - tail) && fread(buffer, 1, (size_t)tail, file) == tail;
+        if (ok) {
+            crc = crc32(crc, buffer, (uInt)tail);
+        }
+    }
+
+    free(buffer);
+    fclose(file);
+    *fingerprint = (uint32_t)crc;
+    return ok;
+}
+
+/**
+ * 生成源文件在缓存目录中对应的缓存文件路径
+ *
+ * @param filename      源文件路径
+ * @param format        像素格式（PNG_FORMAT_*）
+ * @param path          缓存文件路径
+ * @param size          path 缓冲区大小
+ *
+ * @return              是否生成成功，返回 1(真) 或 0(假)；未设置缓存目录时返回 0
+ */
+static int png_cache_path(const char* filename, int format, char* path, size_t size) {
+    if (png_cache_directory[0] == '\0') {
+        return 0;
+    }
+
+    // 64 位 FNV-1a 散列
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const char* p = filename; *p; p++) {
+        hash ^= (uint8_t)*p;
+        hash *= 0x100000001B3ULL;
+    }
+
+    int length = snprintf(path, size, "%s/%016llx-%d%s", png_cache_directory, (unsigned long long)hash, format,
+        PNG_CACHE_SUFFIX);
+    return length > 0 && (size_t)length < size;
+}
+
+/**
+ * 以只读方式把整个文件映射到内存
+ *
+ * @param path          文件路径
+ * @param view          映射的起始地址
+ * @param view_size     映射的大小（文件大小）
+ *
+ * @return              是否映射成功，返回 1(真) 或 0(假)
+ */
+static int png_cache_map(const char* path, void** view, size_t* view_size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 || (uint64_t)size.QuadPart > SIZE_MAX) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    // 映射建立后即可关闭文件与映射句柄，视图会保持它们有效直到 UnmapViewOfFile
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return 0;
+    }
+    *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!*view) {
+        return 0;
+    }
+    *view_size = (size_t)size.QuadPart;
+    return 1;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return 0;
+    }
+
+    void* address = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        return 0;
+    }
+#ifdef MADV_WILLNEED
+    // 提前按顺序预读整个文件，使打开耗时只受磁盘带宽限制，而不是逐页缺页中断
+    madvise(address, (size_t)st.st_size, MADV_WILLNEED);
+#endif
+    *view = address;
+    *view_size = (size_t)st.st_size;
+    return 1;
+#endif
+}
+
+/**
+ * 解除 png_cache_map 建立的映射
+ */
+static void png_cache_unmap(void* view, size_t view_size) {
+#ifdef _WIN32
+    (void)view_size;
+    UnmapViewOfFile(view);
+#else
+    munmap(view, view_size);
+#endif
+}
+
+/**
+ * 设置缓存目录，目录不存在时创建
+ *
+ * 应在程序启动时、开始解码之前设置一次。未设置缓存目录时 png_cache_lookup 总是未命中，
+ * png_cache_store 不写入任何文件，png_cache_open 等同于普通解码。
+ *
+ * @param directory     缓存目录路径，NULL 或空字符串表示停用缓存
+ *
+ * @return              是否设置成功，返回 1(真) 或 0(假)
+ */
+int png_cache_set_directory(const char* directory) {
+    png_cache_directory[0] = '\0';
+    if (!directory || directory[0] == '\0') {
+        return 1;
+    }
+
+    size_t length = strlen(directory);
+    if (length >= PNG_CACHE_PATH_MAX - 64) {
+        return 0;
+    }
+
+    struct stat st;
+    if (stat(directory, &st) != 0) {
+#ifdef _WIN32
+        int created = _mkdir(directory) == 0;
+#else
+        int created = mkdir(directory, 0755) == 0;
+#endif
+        if (!created) {
+            return 0;
+        }
+    } else if (!S_ISDIR(st.st_mode)) {
+        return 0;
+    }
+
+    memcpy(png_cache_directory, directory, length + 1);
+    return 1;
+}
+
+/**
+ * 设置缓存目录的大小上限，每次写入缓存后淘汰最久未使用的缓存文件直到不超过上限
+ *
+ * @param bytes     大小上限（字节），0 表示恢复默认值 PNG_CACHE_DEFAULT_LIMIT
+ */
+void png_cache_set_limit(uint64_t bytes) {
+    atomic_store(&png_cache_limit, bytes ? bytes : PNG_CACHE_DEFAULT_LIMIT);
+}
+
+/**
+ * 查找源文件的缓存，命中时把缓存文件映射到内存
+ *
+ * 缓存过期（源文件已修改）或损坏时删除缓存文件并返回 0。
+ *
+ * @param filename      PNG 文件路径
+ * @param format        像素格式（PNG_FORMAT_*）
+ * @param cached        命中时为映射的像素，使用完毕后调用 png_cache_close 释放
+ *
+ * @return              是否命中，返回 1(真) 或 0(假)
+ */
+int png_cache_lookup(const char* filename, int format, PNG_CachedImage* cached) {
+    memset(cached, 0, sizeof(PNG_CachedImage));
+
+    char path[PNG_CACHE_PATH_MAX];
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (!png_cache_path(filename, format, path, sizeof(path)) || !png_cache_stat(filename, &source_size, &source_mtime)) {
+        return 0;
+    }
+
+    // 映射之前更新修改时间（Windows 上映射期间无法修改文件属性），淘汰时按修改时间判断最近是否使用过
+    utime(path, NULL);
+
+    void* view;
+    size_t view_size;
+    if (!png_cache_map(path, &view, &view_size)) {
+        return 0;
+    }
+
+    const uint8_t* header = (const uint8_t*)view;
+    size_t path_length = strlen(filename);
+    uint32_t pixel_bytes = png_format_bytes_per_pixel(format);
+    int valid = view_size >= PNG_CACHE_PAGE_SIZE && memcmp(header, png_cache_magic, 8) == 0;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t stride = 0;
+    uint64_t pixels_size = 0;
+    if (valid) {
+        width = png_cache_get32(header + 8);
+        height = png_cache_get32(header + 12);
+        stride = png_cache_get64(header + 24);
+        pixels_size = png_cache_get64(header + 40);
+        valid = png_cache_get32(header + 16) == (uint32_t)format &&
+            png_cache_get64(header + 32) == PNG_CACHE_PAGE_SIZE &&
+            png_cache_get64(header + 48) == source_size &&
+            (int64_t)png_cache_get64(header + 56) == source_mtime &&
+            png_cache_get32(header + 64) == path_length &&
+            path_length <= PNG_CACHE_PAGE_SIZE - PNG_CACHE_HEADER_SIZE &&
+            memcmp(header + PNG_CACHE_HEADER_SIZE, filename, path_length) == 0 &&
+            width > 0 && height > 0 && stride == (uint64_t)width * pixel_bytes &&
+            pixels_size / height == stride && pixels_size % height == 0 &&
+            pixels_size == view_size - PNG_CACHE_PAGE_SIZE;
+    }
+
+    // 最后才读取源文件首尾计算指纹
+    uint32_t fingerprint;
+    if (valid) {
+        valid = png_cache_fingerprint(filename, source_size, &fingerprint) &&
+            fingerprint == png_cache_get32(header + 20);
+    }
+
+    if (!valid) {
+        png_cache_unmap(view, view_size);
+        remove(path);
+        return 0;
+    }
+
+    cached->pixels = (uint8_t*)view + PNG_CACHE_PAGE_SIZE;
+    cached->pixels_size = (size_t)pixels_size;
+    cached->width = width;
+    cached->height = height;
+    cached->stride = (size_t)stride;
+    cached->format = format;
+    cached->mapped = 1;
+    cached->view = view;
+    cached->view_size = view_size;
+    return 1;
+}
+
+/**
+ * 把解码好的像素写入缓存，之后淘汰超出大小上限的旧缓存
+ *
+ * 先写入临时文件再改名，其他线程或进程不会映射到写了一半的缓存文件。
+ *
+ * @param filename      PNG 文件路径
+ * @param format        像素格式（PNG_FORMAT_*）
+ * @param pixels        像素数据，逐行紧密排列
+ * @param width         图像宽度
+ * @param height        图像高度
+ *
+ * @return              是否写入成功，返回 1(真) 或 0(假)；未设置缓存目录时返回 0
+ */
+int png_cache_store(const char* filename, int format, const uint8_t* pixels, uint32_t width, uint32_t height) {
+    char path[PNG_CACHE_PATH_MAX];
+    uint32_t pixel_bytes = png_format_bytes_per_pixel(format);
+    size_t path_length = strlen(filename);
+    if (!pixels || width == 0 || height == 0 || pixel_bytes == 0 ||
+        path_length > PNG_CACHE_PAGE_SIZE - PNG_CACHE_HEADER_SIZE || !png_cache_path(filename, format, path, sizeof(path))) {
+        return 0;
+    }
+
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint32_t fingerprint;
+    uint64_t stride = (uint64_t)width * pixel_bytes;
+    uint64_t pixels_size = stride * height;
+    if (pixels_size > SIZE_MAX || pixels_size > png_cache_limit || !png_cache_stat(filename, &source_size, &source_mtime) ||
+        !png_cache_fingerprint(filename, source_size, &fingerprint)) {
+        return 0;
+    }
+
+    uint8_t* header = (uint8_t*)calloc(1, PNG_CACHE_PAGE_SIZE);
+    if (!header) {
+        return 0;
+    }
+    memcpy(header, png_cache_magic, 8);
+    png_cache_put32(header + 8, width);
+    png_cache_put32(header + 12, height);
+    png_cache_put32(header + 16, (uint32_t)format);
+    png_cache_put32(header + 20, fingerprint);
+    png_cache_put64(header + 24, stride);
+    png_cache_put64(header + 32, PNG_CACHE_PAGE_SIZE);
+    png_cache_put64(header + 40, pixels_size);
+    png_cache_put64(header + 48, source_size);
+    png_cache_put64(header + 56, (uint64_t)source_mtime);
+    png_cache_put32(header + 64, (uint32_t)path_length);
+    memcpy(header + PNG_CACHE_HEADER_SIZE, filename, path_length);
+
+    // 临时文件名各不相同且以独占方式创建，多个进程同时缓存同一图像时各写各的，最后一次替换生效
+    char* temp_path = NULL;
+    FILE* file = png_file_create_temp(path, &temp_path);
+    int ok = file != NULL;
+    if (ok) {
+        ok = fwrite(header, 1, PNG_CACHE_PAGE_SIZE, file) == PNG_CACHE_PAGE_SIZE &&
+            fwrite(pixels, 1, (size_t)pixels_size, file) == pixels_size;
+        ok = png_file_commit_temp(file, temp_path, path, ok);
+    }
+    free(temp_path);
+    free(header);
+
+    if (ok) {
+        png_cache_evict(png_cache_limit);
+    }
+    return ok;
+}
+
+/**
+ * 打开 PNG 文件的像素：缓存命中时直接映射，否则解码并写入缓存
+ *
+ * 写入缓存失败（例如未设置缓存目录、磁盘已满）不影响解码结果。
+ *
+ * @param filename      PNG 文件路径
+ * @param format        像素格式（PNG_FORMAT_*）
+ * @param cached        像素，使用完毕后调用 png_cache_close 释放
+ * @param cancel        取消令牌，可以为 NULL，只在未命中需要解码时检查
+ *
+ * @return              是否成功，返回 1(真) 或 0(假)
+ */
+int png_cache_open(const char* filename, int format, PNG_CachedImage* cached, const PNG_CancelToken* cancel) {
+    if (png_cache_lookup(filename, format, cached)) {
+        return 1;
+    }
+
+    PNG_Image image;
+    if (!png_read_file_cancellable(filename, &image, cancel)) {
+        return 0;
+    }
+
+    uint8_t* pixels = NULL;
+    size_t pixels_size = 0;
+    if (!png_convert_image(&image, format, &pixels, &pixels_size, cancel)) {
+        png_free_image(&image);
+        return 0;
+    }
+
+    cached->pixels = pixels;
+    cached->pixels_size = pixels_size;
+    cached->width = image.header.width;
+    cached->height = image.header.height;
+    cached->stride = (size_t)image.header.width * png_format_bytes_per_pixel(format);
+    cached->format = format;
+    cached->mapped = 0;
+    png_free_image(&image);
+
+    png_cache_store(filename, format, pixels, cached->width, cached->height);
+    return 1;
+}
+
+/**
+ * 释放 png_cache_lookup 或 png_cache_open 得到的像素
+ */
+void png_cache_close(PNG_CachedImage* cached) {
+    if (!cached) {
+        return;
+    }
+    if (cached->mapped) {
+        png_cache_unmap(cached->view, cached->view_size);
+    } else {
+        free(cached->pixels);
+    }
+    memset(cached, 0, sizeof(PNG_CachedImage));
+}
+
+/**
+ * 向缓存文件列表追加一项
+ *
+ * @return      是否追加成功，返回 1(真) 或 0(假)
+ */
+static int png_cache_add_entry(PNG_CacheEntry** entries, uint32_t* count, uint32_t* capacity, const char* name,
+    uint64_t size, int64_t mtime, int temp) {
+    if (*count == *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 64;
+        PNG_CacheEntry* resized = (PNG_CacheEntry*)realloc(*entries, grown * sizeof(PNG_CacheEntry));
+        if (!resized) {
+            return 0;
+        }
+        *entries = resized;
+        *capacity = grown;
+    }
+
+    size_t length = strlen(png_cache_directory) + 1 + strlen(name) + 1;
+    char* path = (char*)malloc(length);
+    if (!path) {
+        return 0;
+    }
+    snprintf(path, length, "%s/%s", png_cache_directory, name);
+    (*entries)[*count].path = path;
+    (*entries)[*count].size = size;
+    (*entries)[*count].mtime = mtime;
+    (*entries)[*count].temp = temp;
+    (*count)++;
+    return 1;
+}
+
+/**
+ * 判断文件名是否以缓存文件后缀结尾
+ */
+static int png_cache_is_entry(const char* name) {
+    size_t length = strlen(name);
+    size_t suffix = sizeof(PNG_CACHE_SUFFIX) - 1;
+    return length > suffix && strcmp(name + length - suffix, PNG_CACHE_SUFFIX) == 0;
+}
+
+/**
+ * 判断文件名是否为写入缓存时的临时文件（png_file_create_temp 生成的 "<缓存文件名>.<进程号>-<序号>.tmp"）
+ */
+static int png_cache_is_temp(const char* name) {
+    const char* suffix = strstr(name, PNG_CACHE_SUFFIX ".");
+    size_t length = strlen(name);
+    return suffix && suffix != name && length > 4 && strcmp(name + length - 4, ".tmp") == 0;
+}
+
+/**
+ * 列出缓存目录中的所有缓存文件与残留的临时文件
+ *
+ * @return      是否列出成功，返回 1(真) 或 0(假)
+ */
+static int png_cache_list(PNG_CacheEntry** entries, uint32_t* count) {
+    uint32_t capacity = 0;
+    int ok = 1;
+    *entries = NULL;
+    *count = 0;
+
+#ifdef _WIN32
+    char pattern[PNG_CACHE_PATH_MAX + 16];
+    snprintf(pattern, sizeof(pattern), "%s/*%s*", png_cache_directory, PNG_CACHE_SUFFIX);
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+    do {
+        int temp = png_cache_is_temp(data.cFileName);
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !(temp || png_cache_is_entry(data.cFileName))) {
+            continue;
+        }
+        uint64_t size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        // FILETIME 是自 1601 年起的 100ns 数，换算为与 time() 相同的自 1970 年起的秒数
+        uint64_t ticks = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+        int64_t mtime = (int64_t)(ticks / 10000000) - 11644473600LL;
+        ok = png_cache_add_entry(entries, count, &capacity, data.cFileName, size, mtime, temp);
+    } while (ok && FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(png_cache_directory);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent* item;
+    while (ok && (item = readdir(dir)) != NULL) {
+        int temp = png_cache_is_temp(item->d_name);
+        if (!temp && !png_cache_is_entry(item->d_name)) {
+            continue;
+        }
+        char path[PNG_CACHE_PATH_MAX + 256];
+        uint64_t size;
+        int64_t mtime;
+        snprintf(path, sizeof(path), "%s/%s", png_cache_directory, item->d_name);
+        if (png_cache_stat(path, &size, &mtime)) {
+            ok = png_cache_add_entry(entries, count, &capacity, item->d_name, size, mtime, temp);
+        }
+    }
+    closedir(dir);
+#endif
+
+    return ok;
+}
+
+static int png_cache_compare_entry(const void* a, const void* b) {
+    int64_t x = ((const PNG_CacheEntry*)a)->mtime;
+    int64_t y = ((const PNG_CacheEntry*)b)->mtime;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 淘汰缓存：按修改时间从旧到新删除缓存文件，直到缓存目录的总大小不超过上限
+ *
+ * 修改时间超过 PNG_CACHE_TEMP_GRACE 的残留临时文件总是被删除；未到宽限期的临时文件可能正在写入，既不删除也不计入总大小。
+ * 正在被映射的缓存文件在 Windows 上无法删除，会被跳过。
+ *
+ * @param limit     大小上限（字节）
+ *
+ * @return          是否淘汰到上限以内，返回 1(真) 或 0(假)
+ */
+int png_cache_evict(uint64_t limit) {
+    if (png_cache_directory[0] == '\0') {
+        return 1;
+    }
+
+    PNG_CacheEntry* entries;
+    uint32_t count;
+    int ok = png_cache_list(&entries, &count);
+
+    int64_t now = (int64_t)time(NULL);
+    uint64_t total = 0;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (entries[i].temp) {
+            if (now - entries[i].mtime > PNG_CACHE_TEMP_GRACE) {
+                remove(entries[i].path);
+            }
+            free(entries[i].path);
+            continue;
+        }
+        total += entries[i].size;
+        entries[kept++] = entries[i];
+    }
+    count = kept;
+
+    if (count > 1) {
+        qsort(entries, count, sizeof(PNG_CacheEntry), png_cache_compare_entry);
+    }
+    for (uint32_t i = 0; i < count && total > limit; i++) {
+        if (remove(entries[i].path) == 0) {
+            total -= entries[i].size;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        free(entries[i].path);
+    }
+    free(entries);
+    return ok && total <= limit;
+}
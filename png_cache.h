@@ -0,0 +1,41 @@
+#ifndef PNG_CACHE_H
+#define PNG_CACHE_H
+
+#include "png_decoder.h"
+
+// 缓存文件的后缀名，缓存目录中只有此后缀的文件会被淘汰
+#define PNG_CACHE_SUFFIX ".pngcache"
+
+// 像素数据在缓存文件中的偏移，即文件头占用的大小（一个内存页，映射后像素数据按页对齐）
+#define PNG_CACHE_PAGE_SIZE 4096
+
+// 校验源文件时读取开头与末尾各 64KB 计算 CRC，再结合文件大小与修改时间判断缓存是否过期
+#define PNG_CACHE_FINGERPRINT_BYTES (64 * 1024)
+
+// 缓存目录默认大小上限 4GB
+#define PNG_CACHE_DEFAULT_LIMIT (4ULL * 1024 * 1024 * 1024)
+
+/**
+ * 从缓存映射（或刚解码得到）的像素
+ */
+typedef struct {
+    uint8_t* pixels;                // 像素数据，逐行排列，每行 stride 字节（只读）
+    size_t pixels_size;             // 像素数据大小
+    uint32_t width;
+    uint32_t height;
+    size_t stride;                  // 每行字节数
+    int format;                     // 像素格式（PNG_FORMAT_*）
+    int mapped;                     // 1 表示映射自缓存文件，0 表示由 malloc 分配
+    void* view;                     // 映射的整个缓存文件（mapped 为 1 时有效）
+    size_t view_size;
+} PNG_CachedImage;
+
+int png_cache_set_directory(const char* directory);
+void png_cache_set_limit(uint64_t bytes);
+int png_cache_lookup(const char* filename, int format, PNG_CachedImage* cached);
+int png_cache_store(const char* filename, int format, const uint8_t* pixels, uint32_t width, uint32_t height);
+int png_cache_open(const char* filename, int format, PNG_CachedImage* cached, const PNG_CancelToken* cancel);
+void png_cache_close(PNG_CachedImage* cached);
+int png_cache_evict(uint64_t limit);
+
+#endif // PNG_CACHE_H
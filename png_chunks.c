@@ -0,0 +1,437 @@
+#include "png_chunks.h"
+#include "png_file.h"
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/*
+ * 块级改写
+ *
+ * 删除元数据、修改文本或添加辅助块都不需要解码像素：逐块读取源文件，要删除的块直接跳过，
+ * 保留的块连同原来的 CRC 按字节原样复制（IDAT 也不例外），只有新写入的块需要计算 CRC。
+ * 处理速度只受磁盘读写速度限制。
+ *
+ * 改写结果先写入唯一命名的临时文件（png_file_create_temp），成功后再替换输出文件并保留其原有的权限位，
+ * 因此输出路径可以与输入路径相同（原地改写），中途失败时原文件保持不变。
+ */
+
+// 必须写在 PLTE 之前的辅助块
+static const uint32_t png_chunks_before_plte[] = {
+    PNG_CHUNK_TYPE('g', 'A', 'M', 'A'), PNG_CHUNK_TYPE('c', 'H', 'R', 'M'), PNG_CHUNK_TYPE('s', 'R', 'G', 'B'),
+    PNG_CHUNK_TYPE('i', 'C', 'C', 'P'), PNG_CHUNK_TYPE('s', 'B', 'I', 'T'), PNG_CHUNK_TYPE('c', 'I', 'C', 'P'),
+};
+
+// PNG_STRIP_METADATA 保留的辅助块：影响显示效果的块与 APNG 动画块
+static const uint32_t png_chunks_keep_metadata[] = {
+    PNG_CHUNK_tRNS, PNG_CHUNK_TYPE('g', 'A', 'M', 'A'), PNG_CHUNK_TYPE('c', 'H', 'R', 'M'),
+    PNG_CHUNK_TYPE('s', 'R', 'G', 'B'), PNG_CHUNK_TYPE('i', 'C', 'C', 'P'), PNG_CHUNK_TYPE('s', 'B', 'I', 'T'),
+    PNG_CHUNK_TYPE('c', 'I', 'C', 'P'), PNG_CHUNK_TYPE('p', 'H', 'Y', 's'), PNG_CHUNK_TYPE('a', 'c', 'T', 'L'),
+    PNG_CHUNK_TYPE('f', 'c', 'T', 'L'), PNG_CHUNK_TYPE('f', 'd', 'A', 'T'),
+};
+
+// PNG_STRIP_ALL 保留的辅助块：还原像素所必需的块
+static const uint32_t png_chunks_keep_all[] = {
+    PNG_CHUNK_tRNS, PNG_CHUNK_TYPE('a', 'c', 'T', 'L'), PNG_CHUNK_TYPE('f', 'c', 'T', 'L'),
+    PNG_CHUNK_TYPE('f', 'd', 'A', 'T'),
+};
+
+#define PNG_CHUNKS_COUNT(list) ((uint32_t)(sizeof(list) / sizeof((list)[0])))
+
+static uint32_t png_chunks_get32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void png_chunks_put32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/**
+ * 判断块类型是否合法（4 个 ASCII 字母）
+ */
+static int png_chunk_type_valid(uint32_t type) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint8_t c = (uint8_t)(type >> shift);
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 判断是否为关键块（第一个字母大写）
+ */
+static int png_chunk_is_critical(uint32_t type) {
+    return (type & 0x20000000u) == 0;
+}
+
+static int png_chunk_in_list(uint32_t type, const uint32_t* list, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (list[i] == type) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 在文件中向后跳过指定字节数（64 位，块长度可达 2^31 - 1）
+ */
+static int png_chunks_skip(FILE* file, uint64_t size) {
+#ifdef _WIN32
+    return _fseeki64(file, (int64_t)size, SEEK_CUR) == 0;
+#else
+    return fseeko(file, (off_t)size, SEEK_CUR) == 0;
+#endif
+}
+
+/**
+ * 读取块的长度与类型
+ *
+ * @return      是否读取成功，返回 1(真) 或 0(假)；长度超出规范上限或类型非法时返回 0
+ */
+static int png_chunks_read_header(FILE* file, uint32_t* length, uint32_t* type) {
+    uint8_t buf[8];
+    if (fread(buf, 1, 8, file) != 8) {
+        return 0;
+    }
+    *length = png_chunks_get32(buf);
+    *type = png_chunks_get32(buf + 4);
+    return *length <= PNG_MAX_IDAT_LENGTH && png_chunk_type_valid(*type);
+}
+
+/**
+ * 写入一个完整的块并计算 CRC
+ *
+ * @return      是否写入成功，返回 1(真) 或 0(假)
+ */
+static int png_chunks_write(FILE* file, uint32_t type, const uint8_t* prefix, uint32_t prefix_size,
+    const uint8_t* data, uint32_t length) {
+    uint8_t header[8];
+    uint8_t crc_buf[4];
+    png_chunks_put32(header, prefix_size + length);
+    png_chunks_put32(header + 4, type);
+
+    uLong crc = crc32(0L, header + 4, 4);
+    if (prefix_size > 0) {
+        crc = crc32(crc, prefix, prefix_size);
+    }
+    if (length > 0) {
+        crc = crc32(crc, data, length);
+    }
+    png_chunks_put32(crc_buf, (uint32_t)crc);
+
+    return fwrite(header, 1, 8, file) == 8 && (prefix_size == 0 || fwrite(prefix, 1, prefix_size, file) == prefix_size) &&
+        (length == 0 || fwrite(data, 1, length, file) == length) && fwrite(crc_buf, 1, 4, file) == 4;
+}
+
+/**
+ * 把当前块原样复制到输出文件（已读取的块头与数据开头由调用者传入）
+ *
+ * @param in            输入文件，位于块数据的第 head_size 字节
+ * @param out           输出文件
+ * @param type          块类型
+ * @param length        块数据长度
+ * @param head          已读取的块数据开头
+ * @param head_size     已读取的字节数
+ * @param buffer        复制缓冲区（PNG_CHUNK_COPY_BYTES 字节）
+ * @param verify_crc    是否校验 CRC
+ *
+ * @return              是否复制成功，返回 1(真) 或 0(假)
+ */
+static int png_chunks_copy(FILE* in, FILE* out, uint32_t type, uint32_t length, const uint8_t* head, uint32_t head_size,
+    uint8_t* buffer, int verify_crc) {
+    uint8_t header[8];
+    png_chunks_put32(header, length);
+    png_chunks_put32(header + 4, type);
+    if (fwrite(header, 1, 8, out) != 8 || (head_size > 0 && fwrite(head, 1, head_size, out) != head_size)) {
+        return 0;
+    }
+
+    uLong crc = crc32(0L, header + 4, 4);
+    if (verify_crc && head_size > 0) {
+        crc = crc32(crc, head, head_size);
+    }
+
+    uint64_t remaining = (uint64_t)length - head_size;
+    while (remaining > 0) {
+        size_t count = remaining < PNG_CHUNK_COPY_BYTES ? (size_t)remaining : PNG_CHUNK_COPY_BYTES;
+        if (fread(buffer, 1, count, in) != count || fwrite(buffer, 1, count, out) != count) {
+            return 0;
+        }
+        if (verify_crc) {
+            crc = crc32(crc, buffer, (uInt)count);
+        }
+        remaining -= count;
+    }
+
+    uint8_t crc_buf[4];
+    if (fread(crc_buf, 1, 4, in) != 4 || fwrite(crc_buf, 1, 4, out) != 4) {
+        return 0;
+    }
+    return !verify_crc || png_chunks_get32(crc_buf) == (uint32_t)crc;
+}
+
+/**
+ * 判断文本块的关键字是否在修改列表中
+ *
+ * @param head          块数据开头（至少包含关键字与其后的 NUL，或整个块）
+ * @param head_size     head 的字节数
+ * @param options       改写选项
+ *
+ * @return              是否匹配，返回 1(真) 或 0(假)
+ */
+static int png_chunks_text_matches(const uint8_t* head, uint32_t head_size, const PNG_RewriteOptions* options) {
+    const uint8_t* end = (const uint8_t*)memchr(head, 0, head_size);
+    if (!end) {
+        // 关键字不完整的文本块不做处理
+        return 0;
+    }
+    size_t keyword_length = (size_t)(end - head);
+    for (uint32_t i = 0; i < options->text_count; i++) {
+        const char* keyword = options->text_edits[i].keyword;
+        if (strlen(keyword) == keyword_length && memcmp(keyword, head, keyword_length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 写入添加的块与新文本
+ *
+ * @param out           输出文件
+ * @param options       改写选项
+ * @param before_plte   1 写入必须位于 PLTE 之前的块；0 写入其余的块与新文本（位于第一个 IDAT 之前）
+ *
+ * @return              是否写入成功，返回 1(真) 或 0(假)
+ */
+static int png_chunks_write_added(FILE* out, const PNG_RewriteOptions* options, int before_plte) {
+    for (uint32_t i = 0; i < options->add_count; i++) {
+        const PNG_Chunk* chunk = &options->add_chunks[i];
+        int early = png_chunk_in_list(chunk->type, png_chunks_before_plte, PNG_CHUNKS_COUNT(png_chunks_before_plte));
+        if (early == before_plte && !png_chunks_write(out, chunk->type, NULL, 0, chunk->data, chunk->length)) {
+            return 0;
+        }
+    }
+    if (before_plte) {
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < options->text_count; i++) {
+        const PNG_TextEdit* edit = &options->text_edits[i];
+        if (!edit->text) {
+            continue;
+        }
+        size_t keyword_length = strlen(edit->keyword);
+        size_t text_length = strlen(edit->text);
+        if (text_length > MAX_CHUNK_LENGTH ||
+            !png_chunks_write(out, PNG_CHUNK_tEXt, (const uint8_t*)edit->keyword, (uint32_t)keyword_length + 1,
+                (const uint8_t*)edit->text, (uint32_t)text_length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 检查改写选项：不允许删除或添加关键块，文本关键字长度必须合法
+ */
+static int png_chunks_options_valid(const PNG_RewriteOptions* options) {
+    if (options->strip < PNG_STRIP_NONE || options->strip > PNG_STRIP_ALL) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < options->remove_count; i++) {
+        if (!png_chunk_type_valid(options->remove_types[i]) || png_chunk_is_critical(options->remove_types[i])) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < options->add_count; i++) {
+        const PNG_Chunk* chunk = &options->add_chunks[i];
+        if (!png_chunk_type_valid(chunk->type) || png_chunk_is_critical(chunk->type) ||
+            chunk->length > MAX_CHUNK_LENGTH || (chunk->length > 0 && !chunk->data)) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < options->text_count; i++) {
+        const char* keyword = options->text_edits[i].keyword;
+        size_t length = keyword ? strlen(keyword) : 0;
+        if (length == 0 || length > PNG_TEXT_KEYWORD_MAX) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 判断源文件中的块是否要删除
+ */
+static int png_chunks_should_remove(uint32_t type, const PNG_RewriteOptions* options) {
+    if (png_chunk_is_critical(type)) {
+        return 0;
+    }
+    if (png_chunk_in_list(type, options->remove_types, options->remove_count)) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < options->add_count; i++) {
+        if (options->add_chunks[i].type == type) {
+            return 1;
+        }
+    }
+    if (options->strip == PNG_STRIP_METADATA) {
+        return !png_chunk_in_list(type, png_chunks_keep_metadata, PNG_CHUNKS_COUNT(png_chunks_keep_metadata));
+    }
+    if (options->strip == PNG_STRIP_ALL) {
+        return !png_chunk_in_list(type, png_chunks_keep_all, PNG_CHUNKS_COUNT(png_chunks_keep_all));
+    }
+    return 0;
+}
+
+/**
+ * 列出 PNG 文件中的所有块（只读取块头，跳过块数据，不校验 CRC）
+ *
+ * @param filename      PNG 文件路径
+ * @param callback      对每个块调用一次
+ * @param user_data     传给回调的参数
+ *
+ * @return              是否读取到 IEND，返回 1(真) 或 0(假)
+ */
+int png_list_chunks(const char* filename, PNG_ChunkCallback callback, void* user_data) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    if (!png_validate_signature(file)) {
+        fclose(file);
+        return 0;
+    }
+
+    uint64_t offset = PNG_SIGNATURE_SIZE;
+    uint32_t length, type;
+    int has_iend = 0;
+    while (!has_iend && png_chunks_read_header(file, &length, &type)) {
+        if (callback) {
+            callback(user_data, type, length, offset);
+        }
+        has_iend = type == PNG_CHUNK_IEND;
+        if (!has_iend && !png_chunks_skip(file, (uint64_t)length + 4)) {
+            break;
+        }
+        offset += (uint64_t)length + 12;
+    }
+
+    fclose(file);
+    return has_iend;
+}
+
+/**
+ * 在块级改写 PNG 文件，不解码像素
+ *
+ * 依次执行：删除 options->strip 指定级别的辅助块与 remove_types 中的块；删除关键字在 text_edits 中的文本块，
+ * 并写入新的 tEXt 块；用 add_chunks 替换同类型的块。关键块（IHDR、PLTE、IDAT、IEND）与其余保留的块按字节原样复制。
+ * 新写入的块放在第一个 IDAT 之前，gAMA、cHRM、sRGB、iCCP、sBIT、cICP 放在 PLTE 之前。IEND 之后的数据被丢弃。
+ *
+ * @param input         源 PNG 文件路径
+ * @param output        输出文件路径，可以与 input 相同（原地改写）
+ * @param options       改写选项
+ *
+ * @return              是否改写成功，返回 1(真) 或 0(假)；失败时输出文件保持不变
+ */
+int png_rewrite_chunks(const char* input, const char* output, const PNG_RewriteOptions* options) {
+    if (!input || !output || !options || !png_chunks_options_valid(options)) {
+        return 0;
+    }
+
+    char* temp_path = NULL;
+    uint8_t* buffer = (uint8_t*)malloc(PNG_CHUNK_COPY_BYTES);
+    FILE* in = fopen(input, "rb");
+    FILE* out = NULL;
+    int ok = 0;
+    if (!buffer || !in || !png_validate_signature(in)) {
+        goto cleanup;
+    }
+    out = png_file_create_temp(output, &temp_path);
+    if (!out || fwrite(PNG_SIGNATURE, 1, PNG_SIGNATURE_SIZE, out) != PNG_SIGNATURE_SIZE) {
+        goto cleanup;
+    }
+
+    int has_ihdr = 0;
+    int has_idat = 0;
+    int has_iend = 0;
+    int early_written = 0;
+    int late_written = 0;
+    uint32_t length, type;
+    while (!has_iend && png_chunks_read_header(in, &length, &type)) {
+        if (!has_ihdr && type != PNG_CHUNK_IHDR) {
+            // IHDR 必须是第一个块
+            goto cleanup;
+        }
+        has_ihdr = 1;
+
+        if ((type == PNG_CHUNK_PLTE || type == PNG_CHUNK_IDAT) && !early_written) {
+            if (!png_chunks_write_added(out, options, 1)) {
+                goto cleanup;
+            }
+            early_written = 1;
+        }
+        if (type == PNG_CHUNK_IDAT && !late_written) {
+            if (!png_chunks_write_added(out, options, 0)) {
+                goto cleanup;
+            }
+            late_written = 1;
+        }
+        if (type == PNG_CHUNK_IDAT) {
+            has_idat = 1;
+        }
+        if (type == PNG_CHUNK_IEND) {
+            if (!has_idat) {
+                goto cleanup;
+            }
+            has_iend = 1;
+        }
+
+        if (png_chunks_should_remove(type, options)) {
+            if (!png_chunks_skip(in, (uint64_t)length + 4)) {
+                goto cleanup;
+            }
+            continue;
+        }
+
+        // 文本块先读出关键字再决定是否删除
+        uint32_t head_size = 0;
+        if (options->text_count > 0 && (type == PNG_CHUNK_tEXt || type == PNG_CHUNK_zTXt || type == PNG_CHUNK_iTXt)) {
+            head_size = length < PNG_TEXT_KEYWORD_MAX + 1 ? length : PNG_TEXT_KEYWORD_MAX + 1;
+            if (fread(buffer, 1, head_size, in) != head_size) {
+                goto cleanup;
+            }
+            if (png_chunks_text_matches(buffer, head_size, options)) {
+                if (!png_chunks_skip(in, (uint64_t)length - head_size + 4)) {
+                    goto cleanup;
+                }
+                continue;
+            }
+        }
+
+        // 复制时 buffer 会被覆盖，先把已读取的开头移到缓冲区之外
+        uint8_t head[PNG_TEXT_KEYWORD_MAX + 1];
+        memcpy(head, buffer, head_size);
+        if (!png_chunks_copy(in, out, type, length, head, head_size, buffer, options->verify_crc)) {
+            goto cleanup;
+        }
+    }
+    ok = has_iend;
+
+cleanup:
+    if (in) {
+        fclose(in);
+    }
+    if (out) {
+        ok = png_file_commit_temp(out, temp_path, output, ok);
+    }
+    free(temp_path);
+    free(buffer);
+    return ok;
+}
@@ -0,0 +1,60 @@
+#ifndef PNG_CHUNKS_H
+#define PNG_CHUNKS_H
+
+#include "png_decoder.h"
+
+// 由 4 个 ASCII 字符组成块类型
+#define PNG_CHUNK_TYPE(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+// 文本块
+#define PNG_CHUNK_tEXt PNG_CHUNK_TYPE('t', 'E', 'X', 't')
+#define PNG_CHUNK_zTXt PNG_CHUNK_TYPE('z', 'T', 'X', 't')
+#define PNG_CHUNK_iTXt PNG_CHUNK_TYPE('i', 'T', 'X', 't')
+
+// 删除辅助块的级别
+#define PNG_STRIP_NONE 0                // 不删除
+#define PNG_STRIP_METADATA 1            // 删除文本、时间、EXIF 等元数据，保留透明度、颜色管理、像素比例与 APNG 动画块
+#define PNG_STRIP_ALL 2                 // 只保留还原像素所必需的辅助块（tRNS 与 APNG 动画块）
+
+// 文本关键字的最大长度（PNG 规范规定 1 ~ 79 字节）
+#define PNG_TEXT_KEYWORD_MAX 79
+
+// 原样复制块数据时每次读写 1MB
+#define PNG_CHUNK_COPY_BYTES (1024 * 1024)
+
+/**
+ * 文本修改：删除关键字相同的所有文本块（tEXt、zTXt、iTXt），text 不为 NULL 时再写入新的 tEXt 块
+ */
+typedef struct {
+    const char* keyword;            // 关键字（1 ~ 79 字节）
+    const char* text;               // 新文本（Latin-1），NULL 表示只删除
+} PNG_TextEdit;
+
+/**
+ * 块级改写选项
+ */
+typedef struct {
+    int strip;                      // 删除辅助块的级别（PNG_STRIP_*）
+    const uint32_t* remove_types;   // 另外要删除的辅助块类型
+    uint32_t remove_count;
+    const PNG_TextEdit* text_edits; // 文本修改
+    uint32_t text_count;
+    const PNG_Chunk* add_chunks;    // 要添加的辅助块（替换源文件中同类型的块，crc 字段被忽略）
+    uint32_t add_count;
+    int verify_crc;                 // 是否校验原样复制的块的 CRC（默认不校验，字节原样复制）
+} PNG_RewriteOptions;
+
+/**
+ * png_list_chunks 对每个块调用一次的回调
+ *
+ * @param user_data     png_list_chunks 传入的参数
+ * @param type          块类型
+ * @param length        块数据长度
+ * @param offset        块（长度字段）在文件中的位置
+ */
+typedef void (*PNG_ChunkCallback)(void* user_data, uint32_t type, uint32_t length, uint64_t offset);
+
+int png_list_chunks(const char* filename, PNG_ChunkCallback callback, void* user_data);
+int png_rewrite_chunks(const char* input, const char* output, const PNG_RewriteOptions* options);
+
+#endif // PNG_CHUNKS_H
@@ -1,4 +1,8 @@
 #include "png_decoder.h"
+#include "png_filter.h"
+#include "png_interlace.h"
+#include "png_pixel.h"
+#include "png_thread.h"
 #include <stdlib.h>
 #include <string.h>
 #include <zlib.h>
@@ -11,7 +15,7 @@
  * @return      转换为大端存储方式的 32 位
  */
 static uint32_t read_uint32_be(const uint8_t* data) {
-    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
 }
 
 /**
@@ -24,10 +28,11 @@ static uint32_t read_uint32_be(const uint8_t* data) {
  * @return      更新后的 CRC32 值
  */
 static uint32_t png_crc32(uint32_t crc, const uint8_t* buf, size_t len) {
-    static uint32_t crc_table[256];
-    static int crc_table_computed = 0;
+    // 每个线程各有一份，多个线程同时解码时无需同步
+    static _Thread_local uint32_t crc_table[256];
+    static _Thread_local int crc_table_computed = 0;
 
-    // 初始化 CRC 表（只需计算一次）
+    // 初始化 CRC 表（每个线程只需计算一次）
     if (!crc_table_computed) {
         for (uint32_t i = 0; i < 256; i++) {
             uint32_t c = i;
@@ -53,6 +58,35 @@ static uint32_t png_crc32(uint32_t crc, const uint8_t* buf, size_t len) {
     return crc ^ 0xFFFFFFFF;
 }
 
+/**
+ * 初始化取消令牌（未取消状态）
+ * 
+ * @param token        		取消令牌
+ */
+void png_cancel_init(PNG_CancelToken* token) {
+	atomic_init(&token->cancelled, 0);
+}
+
+/**
+ * 请求取消，可在任意线程调用
+ * 
+ * @param token        		取消令牌
+ */
+void png_cancel_request(PNG_CancelToken* token) {
+	atomic_store_explicit(&token->cancelled, 1, memory_order_relaxed);
+}
+
+/**
+ * 查询是否已请求取消
+ * 
+ * @param token        		取消令牌，可以为 NULL
+ * 
+ * @return      是否已请求取消，返回 1(真) 或 0(假)
+ */
+int png_cancel_requested(const PNG_CancelToken* token) {
+	return token && atomic_load_explicit(&((PNG_CancelToken*)token)->cancelled, memory_order_relaxed);
+}
+
 /**
  * 识别文件是否为 PNG 格式
  * 
@@ -77,33 +111,44 @@ int png_validate_signature(FILE* file) {
 }
 
 /**
- * 读取并验证 PNG 文件的数据块
+ * 读取块的长度与类型
  * 
- * @param file  指向已打开的 PNG 文件的文件指针
- * @param chunk 指向 PNG_Chunk 结构体指针，用于存储读取的块数据
+ * @param file      指向已打开的 PNG 文件的文件指针
+ * @param length    块数据长度
+ * @param type      块类型
+ * 
+ * @return      是否读取成功，返回 1(真) 或 0(假)
+ */
+static int png_read_chunk_header(FILE* file, uint32_t* length, uint32_t* type) {
+    uint8_t buf[8];
+    if (fread(buf, 1, 8, file) != 8) return 0;
+    *length = read_uint32_be(buf);
+    *type = read_uint32_be(buf + 4);
+    return 1;
+}
+
+/**
+ * 读取块数据与 CRC 并校验（块的长度与类型已由 png_read_chunk_header 读取）
+ * 
+ * @param file      指向已打开的 PNG 文件的文件指针
+ * @param length    块数据长度
+ * @param type      块类型
+ * @param chunk     指向 PNG_Chunk 结构体指针，用于存储读取的块数据
  * 
  * @return      是否成功读取并验证块，返回 1(真) 或 0(假)
  */
-int png_read_chunk(FILE* file, PNG_Chunk* chunk) {
-    if (!file || !chunk) return 0;
-    
+static int png_read_chunk_body(FILE* file, uint32_t length, uint32_t type, PNG_Chunk* chunk) {
     // 将 chunk 内存清零，避免未初始化数据
     memset(chunk, 0, sizeof(PNG_Chunk));
+    chunk->length = length;
+    chunk->type = type;
 
-    // 1. 读取块长度
-    uint8_t length_buf[4];
-    if (fread(length_buf, 1, 4, file) != 4) return 0;
-    chunk->length = read_uint32_be(length_buf);
-
-    // 2. 检查是否超出最大长度
+    // 检查是否超出最大长度
     if (chunk->length > MAX_CHUNK_LENGTH) goto fail;
 
-    // 3. 读取块类型
-    uint8_t type_buf[4];
-    if (fread(type_buf, 1, 4, file) != 4) goto fail;
-    chunk->type = read_uint32_be(type_buf);
+    uint8_t type_buf[4] = { (uint8_t)(type >> 24), (uint8_t)(type >> 16), (uint8_t)(type >> 8), (uint8_t)type };
 
-    // 4. 读取数据
+    // 读取数据
     if (chunk->length > 0) {
         chunk->data = malloc(chunk->length);
         if (!chunk->data || fread(chunk->data, 1, chunk->length, file) != chunk->length) {
@@ -111,7 +156,7 @@ int png_read_chunk(FILE* file, PNG_Chunk* chunk) {
         }
     }
 
-    // 5. 读取并验证CRC
+    // 读取并验证CRC
     uint8_t crc_buf[4];
     if (fread(crc_buf, 1, 4, file) != 4) goto fail;
     chunk->crc = read_uint32_be(crc_buf);
@@ -131,6 +176,75 @@ fail:
     return 0;
 }
 
+/**
+ * 读取并验证 PNG 文件的数据块
+ * 
+ * @param file  指向已打开的 PNG 文件的文件指针
+ * @param chunk 指向 PNG_Chunk 结构体指针，用于存储读取的块数据
+ * 
+ * @return      是否成功读取并验证块，返回 1(真) 或 0(假)
+ */
+int png_read_chunk(FILE* file, PNG_Chunk* chunk) {
+    if (!file || !chunk) return 0;
+    
+    uint32_t length, type;
+    return png_read_chunk_header(file, &length, &type) && png_read_chunk_body(file, length, type, chunk);
+}
+
+/**
+ * 把 IDAT 块的数据直接追加到压缩数据缓冲区并校验 CRC（块的长度与类型已读取）
+ * 
+ * 不经过块缓冲区，因此单个 IDAT 的长度可达规范上限 2^31 - 1；压缩数据总量受内存预算限制。
+ * 
+ * @param file      	指向已打开的 PNG 文件的文件指针
+ * @param length    	块数据长度
+ * @param data      	压缩数据缓冲区
+ * @param size      	缓冲区中已有的数据量
+ * @param capacity  	缓冲区容量，按需倍增
+ * 
+ * @return      是否读取成功，返回 1(真) 或 0(假)
+ */
+static int png_read_idat_payload(FILE* file, uint32_t length, uint8_t** data, size_t* size, size_t* capacity) {
+    uint64_t total = (uint64_t)*size + length;
+    if (length > PNG_MAX_IDAT_LENGTH || total > png_get_memory_budget() || total > SIZE_MAX) {
+        return 0;
+    }
+
+    if (total > *capacity) {
+        uint64_t grown = (uint64_t)*capacity * 2;
+        if (grown > png_get_memory_budget() || grown > SIZE_MAX) {
+            grown = total;
+        }
+        if (grown < total) {
+            grown = total;
+        }
+        uint8_t* new_data = (uint8_t*)realloc(*data, (size_t)grown);
+        if (!new_data) {
+            return 0;
+        }
+        *data = new_data;
+        *capacity = (size_t)grown;
+    }
+
+    uint8_t* payload = *data ? *data + *size : NULL;
+    if (fread(payload, 1, length, file) != length) {
+        return 0;
+    }
+
+    uint8_t crc_buf[4];
+    if (fread(crc_buf, 1, 4, file) != 4) {
+        return 0;
+    }
+    uint8_t type_buf[4] = { 'I', 'D', 'A', 'T' };
+    uint32_t crc = png_crc32(png_crc32(0, type_buf, 4), payload, length);
+    if (crc != read_uint32_be(crc_buf)) {
+        return 0;
+    }
+
+    *size = (size_t)total;
+    return 1;
+}
+
 /**
  * 释放 chunk 的数据块内存
  * 
@@ -167,8 +281,8 @@ int png_parse_ihdr(PNG_Chunk* chunk, PNG_IHDR* ihdr) {
     ihdr->filter_method = chunk->data[11];
     ihdr->interlace_method = chunk->data[12];
     
-    // 图像宽度或高度为 0 表示无效图像
-    if (ihdr->width == 0 || ihdr->height == 0) {
+    // 图像宽度或高度为 0 表示无效图像，超过 2^31 - 1 违反规范
+    if (ihdr->width == 0 || ihdr->height == 0 || ihdr->width > PNG_MAX_DIMENSION || ihdr->height > PNG_MAX_DIMENSION) {
         return 0;
     }
     
@@ -319,7 +433,7 @@ int png_parse_trns(PNG_Chunk* chunk, uint8_t color_type, uint8_t** transparency,
  * 
  * @return      是否处理成功，返回 1(真) 或 0(假)
  */
-int png_process_idat(PNG_Chunk* chunk, uint8_t** image_data, uint32_t* image_data_size) {
+int png_process_idat(PNG_Chunk* chunk, uint8_t** image_data, size_t* image_data_size) {
     if (!chunk || !image_data || !image_data_size) {
         return 0;
     }
@@ -333,7 +447,13 @@ int png_process_idat(PNG_Chunk* chunk, uint8_t** image_data, uint32_t* image_dat
         memcpy(*image_data, chunk->data, chunk->length);
         *image_data_size = chunk->length;
     } else {
-        // 处理后续 IDAT 块，注意 realloc 可能返回新地址
+        // 处理后续 IDAT 块，压缩数据总量同样受内存预算限制
+        uint64_t total = (uint64_t)*image_data_size + chunk->length;
+        if (total > SIZE_MAX || total > png_get_memory_budget()) {
+            return 0;
+        }
+        
+        // 注意 realloc 可能返回新地址
         uint8_t* new_data = (uint8_t*)realloc(*image_data, *image_data_size + chunk->length);
         if (!new_data) {
             return 0;
@@ -348,460 +468,799 @@ int png_process_idat(PNG_Chunk* chunk, uint8_t** image_data, uint32_t* image_dat
 }
 
 /**
- * 使用 zlib 解压图像数据 (将 DEFLATE 压缩的图像数据解压为原始像素数据)
+ * 用已初始化（或已重置）的 zlib 流把压缩数据解压到可增长的缓冲区，直到数据流结束
  * 
+ * @param stream            zlib 解压流
  * @param compressed        压缩数据指针
  * @param compressed_size   压缩数据大小
- * @param decompressed      已解压数据指针
- * @param decompressed_size 已解压数据大小
+ * @param buffer            输出缓冲区（输入输出参数），容量不足时按倍数扩展，失败时不释放
+ * @param capacity          输出缓冲区容量（输入输出参数）
+ * @param size              输出参数，已解压数据大小
+ * @param cancel            取消令牌，可以为 NULL
  * 
  * @return      是否解压成功，返回 1(真) 或 0(假)
  */
-int png_decompress_data(uint8_t* compressed, uint32_t compressed_size, uint8_t** decompressed, uint32_t* decompressed_size) {
-    // 初始化 zlib 流，设置自定义内存分配器为 NULL(使用默认)
-    z_stream stream;
-    int ret;
-    
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.opaque = Z_NULL;
-    stream.avail_in = compressed_size;
-    stream.next_in = compressed;
-    
-    // 初始化 zlib 解压
-    ret = inflateInit(&stream);
-    if (ret != Z_OK) {
-        return 0;
-    }
-    
-    // 初始化解压缓冲区 (4KB)
-    uint32_t buffer_size = 4096;
-    uint32_t total_size = 0;
-    *decompressed = (uint8_t*)malloc(buffer_size);
-    if (!*decompressed) {
-        // 分配内存失败则清理 zlib 并返回
-        inflateEnd(&stream);
-        return 0;
+static int png_inflate_buffer(z_stream* stream, uint8_t* compressed, size_t compressed_size, uint8_t** buffer,
+    size_t* capacity, size_t* size, const PNG_CancelToken* cancel) {
+    // zlib 的 avail_in 只有 32 位，超过 4GB 的压缩数据分段送入
+    size_t remaining_in = compressed_size;
+    stream->avail_in = 0;
+    stream->next_in = compressed;
+
+    // 初始缓冲区 4KB
+    if (*capacity == 0) {
+        uint8_t* initial = (uint8_t*)realloc(*buffer, 4096);
+        if (!initial) {
+            return 0;
+        }
+        *buffer = initial;
+        *capacity = 4096;
     }
-    
+
+    size_t total_size = 0;
+    int ret;
     do {
-        // 设置输出缓冲区剩余空间
-        stream.avail_out = buffer_size - total_size;
-        stream.next_out = *decompressed + total_size;
+        if (png_cancel_requested(cancel)) {
+            return 0;
+        }
+        
+        if (stream->avail_in == 0 && remaining_in > 0) {
+            stream->avail_in = remaining_in < UINT32_MAX ? (uInt)remaining_in : UINT32_MAX;
+            remaining_in -= stream->avail_in;
+        }
+        
+        // 设置输出缓冲区剩余空间，每次最多解压 PNG_CANCEL_CHECK_BYTES 以便及时响应取消
+        size_t avail = *capacity - total_size;
+        stream->avail_out = avail < PNG_CANCEL_CHECK_BYTES ? (uInt)avail : PNG_CANCEL_CHECK_BYTES;
+        stream->next_out = *buffer + total_size;
         
-        // 执行解压
-        ret = inflate(&stream, Z_NO_FLUSH);
-        if (ret == Z_STREAM_ERROR) {
-            free(*decompressed);
-            inflateEnd(&stream);
+        // 执行解压（数据损坏或截断时 zlib 返回 Z_DATA_ERROR / Z_BUF_ERROR，不再有进展）
+        ret = inflate(stream, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
             return 0;
         }
         
         // 计算已解压数据大小
-        total_size = buffer_size - stream.avail_out;
+        total_size = (size_t)(stream->next_out - *buffer);
         
-        if (stream.avail_out == 0) {
-            // 缓冲区不足时双倍扩展
-            buffer_size *= 2;
-            uint8_t* new_buffer = (uint8_t*)realloc(*decompressed, buffer_size);
+        if (total_size == *capacity && ret != Z_STREAM_END) {
+            // 缓冲区不足时双倍扩展，但不超过内存预算（解压结果超出预算说明数据异常）
+            uint64_t limit = png_get_memory_budget() < SIZE_MAX ? png_get_memory_budget() : SIZE_MAX;
+            uint64_t grown = (uint64_t)*capacity * 2;
+            if (grown > limit) {
+                grown = limit;
+            }
+            if (grown <= *capacity) {
+                return 0;
+            }
+            uint8_t* new_buffer = (uint8_t*)realloc(*buffer, (size_t)grown);
             if (!new_buffer) {
-                // 重分配失败则清理资源并返回
-                free(*decompressed);
-                inflateEnd(&stream);
                 return 0;
             }
-            *decompressed = new_buffer;
+            *buffer = new_buffer;
+            *capacity = (size_t)grown;
         }
     } while (ret != Z_STREAM_END);
     
-    // 设置最终解压大小
-    *decompressed_size = total_size;
+    *size = total_size;
+    return 1;
+}
+
+/**
+ * 使用 zlib 解压图像数据 (将 DEFLATE 压缩的图像数据解压为原始像素数据)
+ * 
+ * @param compressed        压缩数据指针
+ * @param compressed_size   压缩数据大小
+ * @param decompressed      已解压数据指针
+ * @param decompressed_size 已解压数据大小
+ * @param cancel            取消令牌，可以为 NULL
+ * 
+ * @return      是否解压成功，返回 1(真) 或 0(假)；取消时返回 0 并释放输出缓冲区
+ */
+int png_decompress_data(uint8_t* compressed, size_t compressed_size, uint8_t** decompressed, size_t* decompressed_size,
+    const PNG_CancelToken* cancel) {
+    // 初始化 zlib 流，设置自定义内存分配器为 NULL(使用默认)
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.avail_in = 0;
+    stream.next_in = Z_NULL;
+    if (inflateInit(&stream) != Z_OK) {
+        return 0;
+    }
     
-    // 结束 zlib 流
+    *decompressed = NULL;
+    size_t capacity = 0;
+    int ok = png_inflate_buffer(&stream, compressed, compressed_size, decompressed, &capacity, decompressed_size, cancel);
     inflateEnd(&stream);
+    if (!ok) {
+        free(*decompressed);
+        *decompressed = NULL;
+        return 0;
+    }
     
     // 调整缓冲区到实际大小
     uint8_t* final_buffer = (uint8_t*)realloc(*decompressed, *decompressed_size);
     if (final_buffer) {
         *decompressed = final_buffer;
     }
-
-    return ret == Z_STREAM_END ? 1 : 0;
+    return 1;
 }
 
 /**
- * 将经过滤波压缩的扫描线数据还原为原始像素数据
+ * 还原 Adam7 隔行扫描数据：7 遍子图像依次按各自宽度还原，再分散写入最终图像
  * 
- * @param image_data        压缩图像数据
- * @param image_data_size   压缩数据大小
+ * @param image_data        已解压的扫描线数据，还原后的最终图像写回此缓冲区
+ * @param image_data_size   已解压数据大小
  * @param header      		指向 PNG_IHDR 结构体指针
+ * @param bytes_per_line    最终图像每行字节数
+ * @param cancel            取消令牌，可以为 NULL
  * 
  * @return      是否还原成功，返回 1(真) 或 0(假)
  */
-int png_apply_filters(uint8_t* image_data, uint32_t image_data_size, PNG_IHDR* header) {
-	if (!image_data || !header || header->width == 0 || header->height == 0) {
+static int png_apply_filters_adam7(uint8_t* image_data, size_t image_data_size, PNG_IHDR* header, uint32_t bytes_per_line,
+	const PNG_CancelToken* cancel) {
+	uint32_t bytes_per_pixel = png_bytes_per_pixel(header);
+	uint64_t final_size = (uint64_t)header->height * bytes_per_line;
+	if (image_data_size < final_size) {
 		return 0;
 	}
 
-	uint32_t width = header->width;
-	uint8_t color_type = header->color_type;
-	uint8_t bit_depth = header->bit_depth;
+	// 位深小于 8 时按位写入，最终图像必须预先清零
+	uint8_t* final_image = (uint8_t*)calloc((size_t)final_size, 1);
+	uint8_t* zero_line = (uint8_t*)calloc(bytes_per_line, 1);
+	if (!final_image || !zero_line) {
+		free(final_image);
+		free(zero_line);
+		return 0;
+	}
 
-	// 根据 PNG 规范确定每像素字节数
-	int bytes_per_pixel;
-	switch (color_type) {
-		case PNG_COLOR_TYPE_GRAY:
-			bytes_per_pixel = (bit_depth >= 8) ? 1 : 0;
-			break;
-		case PNG_COLOR_TYPE_RGB:
-			bytes_per_pixel = 3 * ((bit_depth >= 8) ? 1 : 0);
-			break;
-		case PNG_COLOR_TYPE_PALETTE:
-			bytes_per_pixel = 1;
-			break;
-		case PNG_COLOR_TYPE_GRAY_ALPHA:
-			bytes_per_pixel = 2 * ((bit_depth >= 8) ? 1 : 0);
-			break;
-		case PNG_COLOR_TYPE_RGBA:
-			bytes_per_pixel = 4 * ((bit_depth >= 8) ? 1 : 0);
-			break;
-		default:
-			return 0;
+	uint8_t* data_ptr = image_data;
+	uint8_t* data_end = image_data + image_data_size;
+
+	for (int pass = 0; pass < PNG_ADAM7_PASSES; pass++) {
+		uint32_t pass_width, pass_height;
+		png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+		if (pass_width == 0) {
+			continue;
+		}
+
+		const PNG_Adam7Pass* p = &png_adam7_passes[pass];
+		uint32_t pass_row_bytes = png_row_bytes(header, pass_width);
+		if ((size_t)(data_end - data_ptr) / (pass_row_bytes + 1) < pass_height) {
+			goto fail;
+		}
+
+		// 子图像的首行同样以全零行作为“上一行”
+		const uint8_t* prev_line = zero_line;
+		for (uint32_t py = 0; py < pass_height; py++) {
+			if (png_cancel_requested(cancel)) {
+				goto fail;
+			}
+			uint8_t filter_type = *data_ptr++;
+			if (!png_unfilter_row(filter_type, data_ptr, prev_line, pass_row_bytes, bytes_per_pixel)) {
+				goto fail;
+			}
+			uint32_t y = p->y0 + py * p->dy;
+			png_adam7_scatter_row(header, pass, data_ptr, final_image + (size_t)y * bytes_per_line, pass_width);
+			prev_line = data_ptr;
+			data_ptr += pass_row_bytes;
+		}
 	}
 
-	if (bit_depth < 8 && (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_PALETTE)) {
-		// 特殊处理：对于位深小于 8 的灰度或调色板图像，多个像素可能打包在一个字节中
-		bytes_per_pixel = 1;
-		width = (width * bit_depth + 7) / 8; 		// 计算行宽
-	} else if (bit_depth == 16) {
-		bytes_per_pixel *= 2; 						// 16 位深度每个通道 2 字节
+	memcpy(image_data, final_image, (size_t)final_size);
+	free(final_image);
+	free(zero_line);
+	return 1;
+
+fail:
+	free(final_image);
+	free(zero_line);
+	return 0;
+}
+
+/**
+ * 将经过滤波压缩的扫描线数据还原为原始像素数据
+ * 
+ * 还原后的扫描线去掉滤波类型字节，紧密排列在 image_data 开头；隔行扫描图像同时还原为逐行排列。
+ * 
+ * @param image_data        压缩图像数据
+ * @param image_data_size   压缩数据大小
+ * @param header      		指向 PNG_IHDR 结构体指针
+ * @param cancel            取消令牌，可以为 NULL，每还原一行检查一次
+ * 
+ * @return      是否还原成功，返回 1(真) 或 0(假)
+ */
+int png_apply_filters(uint8_t* image_data, size_t image_data_size, PNG_IHDR* header, const PNG_CancelToken* cancel) {
+	if (!image_data || !header || header->width == 0 || header->height == 0) {
+		return 0;
 	}
 
 	// 每个扫描行 (scanline) 的存储结构：[filter_type (1字节)][像素数据 (bytes_per_line 字节)]
 	// 计算每扫描线的字节数 (不包括过滤类型字节，即扫面行的第一个字节)
-	uint32_t bytes_per_line = width * bytes_per_pixel;
+	uint32_t bytes_per_pixel = png_bytes_per_pixel(header);
+	uint32_t bytes_per_line = png_row_bytes(header, header->width);
 	if (bytes_per_line == 0) {
 		return 0;
 	}
 
+	if (header->interlace_method == PNG_INTERLACE_METHOD_ADAM7) {
+		return png_apply_filters_adam7(image_data, image_data_size, header, bytes_per_line, cancel);
+	}
+
 	// 计算每行应占字节数 (+1 是因为每行有 filter type 字节)
-	uint32_t expected_size = header->height * (bytes_per_line + 1);
+	uint64_t expected_size = (uint64_t)header->height * (bytes_per_line + 1);
 	if (image_data_size < expected_size) {
 		return 0;
 	}
 
-	// 分配临时缓冲区用于滤波处理：上一行和当前行
-	uint8_t* prev_line = (uint8_t*)calloc(bytes_per_line, 1);
-	if (!prev_line) {
-		return 0;
-	}
-	uint8_t* current_line = (uint8_t*)malloc(bytes_per_line);
-	if (!current_line) {
-		free(prev_line);
+	// 首行的“上一行”视为全零
+	uint8_t* zero_line = (uint8_t*)calloc(bytes_per_line, 1);
+	if (!zero_line) {
 		return 0;
 	}
 
 	uint8_t* data_ptr = image_data;
 	uint8_t* output_ptr = image_data;
+	const uint8_t* prev_line = zero_line;
 
 	for (uint32_t y = 0; y < header->height; y++) {
 		uint8_t filter_type = *data_ptr++;		// 每行第一个字节是过滤类型
-		
-		if (filter_type > 4) {
-			free(prev_line);
-			free(current_line);
+
+		// 原地还原当前行，上一行已经还原并前移到输出位置
+		if (png_cancel_requested(cancel) || !png_unfilter_row(filter_type, data_ptr, prev_line, bytes_per_line, bytes_per_pixel)) {
+			free(zero_line);
 			return 0;
 		}
 
-		// 复制行数据到当前缓冲区
-		memcpy(current_line, data_ptr, bytes_per_line);
+		// 去掉滤波类型字节，把行前移到输出位置（两者可能重叠）
+		memmove(output_ptr, data_ptr, bytes_per_line);
+		prev_line = output_ptr;
+		output_ptr += bytes_per_line;
 		data_ptr += bytes_per_line;
+	}
 
-		for (uint32_t x = 0; x < bytes_per_line; x++) {
-			uint8_t left = (x >= bytes_per_pixel) ? current_line[x - bytes_per_pixel] : 0;
-			uint8_t above = prev_line[x];
-			uint8_t upper_left = (x >= bytes_per_pixel) ? prev_line[x - bytes_per_pixel] : 0;
-
-			// 根据滤波类型处理当前行的每一个字节
-			switch (filter_type) {
-				// None
-				case 0: 
-					break;
-				// Sub
-				case 1: 
-					current_line[x] += left;
-					break;
-				// Up
-				case 2: 
-					current_line[x] += above;
-					break;
-				// Average
-				case 3: 
-					current_line[x] += (left + above) / 2;
-					break;
-				// Paeth
-				case 4: {
-					int p = left + above - upper_left;
-					int pa = abs(p - left);
-					int pb = abs(p - above);
-					int pc = abs(p - upper_left);
-
-					if (pa <= pb && pa <= pc) {
-						current_line[x] += left;
-					} else if (pb <= pc) {
-						current_line[x] += above;
-					} else {
-						current_line[x] += upper_left;
-					}
-					break;
-				}
-			}
-		}
+	free(zero_line);
 
-		// 复制处理后的行到输出
-		memcpy(output_ptr, current_line, bytes_per_line + 1);
-		output_ptr += bytes_per_line;
+	return 1;
+}
 
-		// 将当前行作为前一行，以供下一行使用
-		memcpy(prev_line, current_line, bytes_per_line + 1);
+/**
+ * 获取颜色类型对应的通道数
+ */
+static uint32_t png_channels(uint8_t color_type) {
+	switch (color_type) {
+		case PNG_COLOR_TYPE_GRAY:       return 1;
+		case PNG_COLOR_TYPE_RGB:        return 3;
+		case PNG_COLOR_TYPE_PALETTE:    return 1;
+		case PNG_COLOR_TYPE_GRAY_ALPHA: return 2;
+		case PNG_COLOR_TYPE_RGBA:       return 4;
+		default:                        return 0;
 	}
+}
 
-	free(prev_line);
-	free(current_line);
-
-	return 1;
+/**
+ * 计算像素的字节跨度，即滤波时“左侧像素”所对应的字节偏移（位深小于 8 时按 1 字节计）
+ * 
+ * @param header      		指向 PNG_IHDR 结构体指针
+ * 
+ * @return      每像素字节数，颜色类型非法时返回 0
+ */
+uint32_t png_bytes_per_pixel(const PNG_IHDR* header) {
+	uint32_t bits = png_channels(header->color_type) * header->bit_depth;
+	return (bits > 0 && bits < 8) ? 1 : bits / 8;
 }
 
 /**
- * 从任意 PNG 格式到标准 32 位 RGBA 格式的完整转换
+ * 计算指定宽度的扫描行字节数（不包括行首的滤波类型字节）
  * 
- * @param image        		已解压的图像数据结构体
- * @param output   			输出缓冲区指针
- * @param output_size      	输出缓冲区大小
+ * @param header      		指向 PNG_IHDR 结构体指针
+ * @param width      		扫描行像素宽度（隔行扫描时为子图像宽度）
  * 
- * @return      是否还原成功，返回 1(真) 或 0(假)
+ * @return      扫描行字节数，颜色类型非法时返回 0
  */
-int png_convert_to_rgba(PNG_Image* image, uint8_t** output, uint32_t* output_size) {
-	if (!image || !output || !output_size) {
-		return 0;
-	}
+uint32_t png_row_bytes(const PNG_IHDR* header, uint32_t width) {
+	uint32_t bits = png_channels(header->color_type) * header->bit_depth;
+	uint64_t bytes = ((uint64_t)width * bits + 7) / 8;
+	// 加上过滤类型字节后仍须能用 32 位表示
+	return bytes < UINT32_MAX ? (uint32_t)bytes : 0;
+}
 
-	uint32_t width = image->header.width;
-	uint32_t height = image->header.height;
-	uint8_t bit_depth = image->header.bit_depth;
-	uint8_t color_type = image->header.color_type;
+// 单次解码的内存预算，可在任意线程修改
+static _Atomic uint64_t png_memory_budget = PNG_DEFAULT_MEMORY_BUDGET;
 
-	*output_size = width * height * 4;		// 分配输出缓冲区内存：RGBA 格式，所以 x4
-	*output = (uint8_t*)malloc(*output_size);
-	if (!*output) {
-		return 0;
-	}
+/**
+ * 设置单次解码的内存预算，超出预算的图像在读到 IHDR 后立即被拒绝，不做任何解压
+ * 
+ * @param bytes        		预算字节数，0 表示恢复默认值 PNG_DEFAULT_MEMORY_BUDGET
+ */
+void png_set_memory_budget(uint64_t bytes) {
+	atomic_store(&png_memory_budget, bytes ? bytes : PNG_DEFAULT_MEMORY_BUDGET);
+}
 
-	uint8_t* src = image->image_data;
-	uint8_t* dst = *output;
-	uint32_t src_bpp = 0; 					// 源数据中每个像素占多少字节
-	uint32_t src_row_bytes = 0;
+/**
+ * 获取单次解码的内存预算
+ */
+uint64_t png_get_memory_budget(void) {
+	return atomic_load(&png_memory_budget);
+}
 
-	switch (color_type) {
-		case PNG_COLOR_TYPE_GRAY:
-			src_bpp = (bit_depth >= 8) ? 1 : 0;
-			src_row_bytes = (width * bit_depth + 7) / 8;
-			break;
-		case PNG_COLOR_TYPE_RGB:
-			src_bpp = 3 * ((bit_depth >= 8) ? 1 : 0);
-			src_row_bytes = width * src_bpp;
-			break;
-		case PNG_COLOR_TYPE_PALETTE:
-			src_bpp = 1;
-			src_row_bytes = (width * bit_depth + 7) / 8;
-			break;
-		case PNG_COLOR_TYPE_GRAY_ALPHA:
-			src_bpp = 2 * ((bit_depth >= 8) ? 1 : 0);
-			src_row_bytes = width * src_bpp;
-			break;
-		case PNG_COLOR_TYPE_RGBA:
-			src_bpp = 4 * ((bit_depth >= 8) ? 1 : 0);
-			src_row_bytes = width * src_bpp;
-			break;
-		default:
-			free(*output);
-			*output = NULL;
-			return 0;
+/**
+ * 计算解压后扫描线数据的字节数（含每行的过滤类型字节，隔行图像为 7 遍之和）
+ * 
+ * @param header      		指向 PNG_IHDR 结构体指针
+ * 
+ * @return      字节数（64 位，不会溢出）
+ */
+uint64_t png_decoded_size(const PNG_IHDR* header) {
+	uint32_t bits = png_channels(header->color_type) * header->bit_depth;
+	if (header->interlace_method != PNG_INTERLACE_METHOD_ADAM7) {
+		return (uint64_t)header->height * (((uint64_t)header->width * bits + 7) / 8 + 1);
 	}
 
-	if (bit_depth == 16) {
-		// 16 位数据实际占用 2 字节
-		src_bpp *= 2;
-		src_row_bytes *= 2;
+	uint64_t total = 0;
+	for (int pass = 0; pass < PNG_ADAM7_PASSES; pass++) {
+		uint32_t pass_width, pass_height;
+		png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+		if (pass_width > 0) {
+			total += (uint64_t)pass_height * (((uint64_t)pass_width * bits + 7) / 8 + 1);
+		}
 	}
+	return total;
+}
 
-	if (image->image_data_size < height * src_row_bytes) {
-		// 验证源数据是否足够，不足时清理已分配内存
-		free(*output);
-		*output = NULL;
+/**
+ * 根据 IHDR 估算解码的峰值内存，检查是否在预算之内
+ * 
+ * 估算值为解压后的扫描线数据、隔行图像还原时的最终图像，以及输出像素之和（压缩数据通常远小于此，忽略不计）。
+ * 检查时还不知道调用者要转换的格式，输出像素按最宽的 PNG_FORMAT_RGBA16（每像素 8 字节）计算。
+ * 
+ * @param header      		指向 PNG_IHDR 结构体指针
+ * 
+ * @return      是否在预算之内，返回 1(真) 或 0(假)
+ */
+int png_check_memory_budget(const PNG_IHDR* header) {
+	if (png_row_bytes(header, header->width) == 0) {
 		return 0;
 	}
 
-	for (uint32_t y = 0; y < height; y++) {
-		uint8_t* src_row = src + y * src_row_bytes;			// 计算当前处理行的起始位置
-		uint8_t* dst_row = dst + y * width * 4;				// 目标缓冲区对应位置
-		uint8_t r = 0, g = 0, b = 0, a = 255;
-
-		for (uint32_t x = 0; x < width; x++) {
-			switch (color_type) {
-				case PNG_COLOR_TYPE_GRAY:
-					if (bit_depth == 16) {
-						uint16_t gray = (src_row[x * 2] << 8) | src_row[x * 2 + 1];
-						r = g = b = (uint8_t)(gray >> 8);
-					} else if (bit_depth >= 8) {
-						r = g = b = src_row[x];
-					} else {
-						// 对于位深小于 8 的像素，提取正确的位
-						uint8_t shift = 8 - bit_depth - (x * bit_depth) % 8;
-						uint8_t mask = (1 << bit_depth) - 1;
-						uint8_t val = (src_row[(x * bit_depth) / 8] >> shift) & mask;
-						val = (val * 255) / ((1 << bit_depth) - 1);
-						r = g = b = val;
-					}
-					break;
-
-				case PNG_COLOR_TYPE_RGB:
-					if (bit_depth == 16) {
-						r = src_row[x * 6];
-						g = src_row[x * 6 + 2];
-						b = src_row[x * 6 + 4];
-					} else {
-						r = src_row[x * 3];
-						g = src_row[x * 3 + 1];
-						b = src_row[x * 3 + 2];
-					}
-					break;
-
-				case PNG_COLOR_TYPE_PALETTE:
-					if (!image->palette) {
-						free(*output);
-						*output = NULL;
-						return 0;
-					}
-					if (bit_depth == 16) {
-						// Shouldn't happen for palette, but handle anyway
-						uint16_t index = (src_row[x * 2] << 8) | src_row[x * 2 + 1];
-						if (index < image->palette_size) {
-							r = image->palette[index].red;
-							g = image->palette[index].green;
-							b = image->palette[index].blue;
-						}
-					} else {
-						uint8_t index;
-						if (bit_depth >= 8) {
-							index = src_row[x];
-						} else {
-							uint8_t shift = 8 - bit_depth - (x * bit_depth) % 8;
-							uint8_t mask = (1 << bit_depth) - 1;
-							index = (src_row[(x * bit_depth) / 8] >> shift) & mask;
-						}
-						if (index < image->palette_size) {
-							r = image->palette[index].red;
-							g = image->palette[index].green;
-							b = image->palette[index].blue;
-						}
-					}
-					// Handle transparency for palette
-					if (image->transparency) {
-						if (bit_depth >= 8) {
-							if (src_row[x] < image->transparency_size) {
-								a = image->transparency[src_row[x]];
-							}
-						} else {
-							uint8_t shift = 8 - bit_depth - (x * bit_depth) % 8;
-							uint8_t mask = (1 << bit_depth) - 1;
-							uint8_t index = (src_row[(x * bit_depth) / 8] >> shift) & mask;
-							if (index < image->transparency_size) {
-								a = image->transparency[index];
-							}
-						}
-					}
-					break;
-
-				case PNG_COLOR_TYPE_GRAY_ALPHA:
-					if (bit_depth == 16) {
-						uint16_t gray = (src_row[x * 4] << 8) | src_row[x * 4 + 1];
-						uint16_t alpha = (src_row[x * 4 + 2] << 8) | src_row[x * 4 + 3];
-						r = g = b = (uint8_t)(gray >> 8);
-						a = (uint8_t)(alpha >> 8);
-					} else {
-						r = g = b = src_row[x * 2];
-						a = src_row[x * 2 + 1];
-					}
-					break;
-
-				case PNG_COLOR_TYPE_RGBA:
-					if (bit_depth == 16) {
-						r = src_row[x * 8];
-						g = src_row[x * 8 + 2];
-						b = src_row[x * 8 + 4];
-						a = src_row[x * 8 + 6];
-					} else {
-						r = src_row[x * 4];
-						g = src_row[x * 4 + 1];
-						b = src_row[x * 4 + 2];
-						a = src_row[x * 4 + 3];
-					}
-					break;
-
-				default:
-					free(*output);
-					*output = NULL;
-					return 0;
-			}
+	uint64_t pixels = (uint64_t)header->width * header->height;
+	uint64_t estimate = png_decoded_size(header) + pixels * png_format_bytes_per_pixel(PNG_FORMAT_RGBA16);
+	if (header->interlace_method == PNG_INTERLACE_METHOD_ADAM7) {
+		estimate += (uint64_t)header->height * png_row_bytes(header, header->width);
+	}
+	return estimate <= png_get_memory_budget();
+}
 
-			if (color_type == PNG_COLOR_TYPE_GRAY && image->transparency) {
-				// 检查 tRNS 块数据
-				if (bit_depth == 16) {
-					uint16_t gray = (src_row[x * 2] << 8) | src_row[x * 2 + 1];
-					if (image->transparency_size >= 2) {
-						uint16_t trans_gray = (image->transparency[0] << 8) | image->transparency[1];
-						a = (gray == trans_gray) ? 0 : 255;
-					}
-				} else {
-					if (image->transparency_size >= 1) {
-						a = (src_row[x] == image->transparency[0]) ? 0 : 255;
-					}
-				}
-			}
+/**
+ * 按 PNG 规范将位深小于 8 的样本值线性放大到 8 位
+ */
+static uint8_t png_scale_to_8(uint32_t val, uint8_t bit_depth) {
+	return (uint8_t)((val * 255) / ((1u << bit_depth) - 1));
+}
 
-			if (color_type == PNG_COLOR_TYPE_RGB && image->transparency) {
-				// 检查 tRNS 块数据
-				if (bit_depth == 16) {
-					if (image->transparency_size >= 6) {
-						uint16_t r_val = (src_row[x * 6] << 8) | src_row[x * 6 + 1];
-						uint16_t g_val = (src_row[x * 6 + 2] << 8) | src_row[x * 6 + 3];
-						uint16_t b_val = (src_row[x * 6 + 4] << 8) | src_row[x * 6 + 5];
-						uint16_t trans_r = (image->transparency[0] << 8) | image->transparency[1];
-						uint16_t trans_g = (image->transparency[2] << 8) | image->transparency[3];
-						uint16_t trans_b = (image->transparency[4] << 8) | image->transparency[5];
-						a = (r_val == trans_r && g_val == trans_g && b_val == trans_b) ? 0 : 255;
-					}
-				} else {
-					if (image->transparency_size >= 3) {
-						a = (src_row[x * 3] == image->transparency[0] &&
-							src_row[x * 3 + 1] == image->transparency[1] &&
-							src_row[x * 3 + 2] == image->transparency[2]) ? 0 : 255;
-					}
-				}
+/**
+ * 初始化转换上下文，预先计算整幅图像共享的查找表，并分配一行中间缓冲区
+ * 
+ * @param ctx        		转换上下文
+ * @param image        		已解析头部信息的图像结构体（只读取 header、palette、transparency）
+ * @param format      		输出像素格式（PNG_FORMAT_*）
+ * 
+ * @return      是否初始化成功，返回 1(真) 或 0(假)；失败后也需调用 png_convert_context_free
+ */
+int png_convert_context_init(PNG_ConvertContext* ctx, const PNG_Image* image, int format) {
+	memset(ctx, 0, sizeof(PNG_ConvertContext));
+	ctx->image = image;
+	ctx->format = format;
+
+	uint8_t color_type = image->header.color_type;
+	uint8_t bit_depth = image->header.bit_depth;
+
+	if (image->transparency && (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_RGB)) {
+		uint32_t samples = color_type == PNG_COLOR_TYPE_GRAY ? 1 : 3;
+		if (image->transparency_size >= samples * 2) {
+			for (uint32_t i = 0; i < samples; i++) {
+				ctx->trns[i] = (uint16_t)((image->transparency[i * 2] << 8) | image->transparency[i * 2 + 1]);
 			}
+			ctx->has_trns = 1;
+		}
+	}
 
-			// DIB（BI_RGB）默认期望 B, G, R, A 顺序
-			dst_row[x * 4] = b;
-			dst_row[x * 4 + 1] = g;
-			dst_row[x * 4 + 2] = r;
-			dst_row[x * 4 + 3] = a;
+	if (color_type == PNG_COLOR_TYPE_PALETTE) {
+		if (!image->palette) {
+			return 0;
+		}
+		// 调色板之外的索引按不透明黑色处理
+		for (uint32_t i = 0; i < 256; i++) {
+			uint8_t r = 0, g = 0, b = 0, a = 255;
+			if (i < image->palette_size) {
+				r = image->palette[i].red;
+				g = image->palette[i].green;
+				b = image->palette[i].blue;
+			}
+			if (image->transparency && i < image->transparency_size) {
+				a = image->transparency[i];
+			}
+			ctx->lut[i][0] = b;
+			ctx->lut[i][1] = g;
+			ctx->lut[i][2] = r;
+			ctx->lut[i][3] = a;
 		}
+	} else if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth <= 8) {
+		uint32_t count = 1u << bit_depth;
+		for (uint32_t i = 0; i < count; i++) {
+			uint8_t v = bit_depth == 8 ? (uint8_t)i : png_scale_to_8(i, bit_depth);
+			uint8_t a = (ctx->has_trns && ctx->trns[0] == i) ? 0 : 255;
+			ctx->lut[i][0] = ctx->lut[i][1] = ctx->lut[i][2] = v;
+			ctx->lut[i][3] = a;
+		}
+	}
+
+	// 中间行缓冲区：按最宽的 RGBA16 分配，足以容纳 BGRA8
+	ctx->scratch = malloc((size_t)image->header.width * 8);
+	return ctx->scratch != NULL;
+}
+
+/**
+ * 释放转换上下文的中间缓冲区
+ */
+void png_convert_context_free(PNG_ConvertContext* ctx) {
+	free(ctx->scratch);
+	ctx->scratch = NULL;
+}
+
+/**
+ * 将位深 ≤ 8 的一行源数据中从 x_begin 开始的 width 个像素展开为 BGRA8
+ */
+static void png_expand_row_8(const PNG_ConvertContext* ctx, const uint8_t* src_row, uint32_t x_begin, uint32_t width,
+	uint8_t* dst_row) {
+	const PNG_IHDR* header = &ctx->image->header;
+	uint8_t bit_depth = header->bit_depth;
+
+	// 位深为 8 时直接跳到起始像素；位深小于 8 时起始像素可能位于字节中间，按位偏移计算
+	if (bit_depth == 8) {
+		src_row += (size_t)x_begin * png_channels(header->color_type);
+	}
+
+	switch (header->color_type) {
+		case PNG_COLOR_TYPE_GRAY:
+		case PNG_COLOR_TYPE_PALETTE:
+			if (bit_depth == 8) {
+				for (uint32_t x = 0; x < width; x++) {
+					memcpy(dst_row + x * 4, ctx->lut[src_row[x]], 4);
+				}
+			} else {
+				// 位深小于 8 时多个像素打包在一个字节中，高位在前
+				uint8_t mask = (uint8_t)((1 << bit_depth) - 1);
+				for (uint32_t x = 0; x < width; x++) {
+					size_t bit = (size_t)(x_begin + x) * bit_depth;
+					uint8_t shift = (uint8_t)(8 - bit_depth - (bit & 7));
+					memcpy(dst_row + x * 4, ctx->lut[(src_row[bit >> 3] >> shift) & mask], 4);
+				}
+			}
+			break;
+
+		case PNG_COLOR_TYPE_RGB:
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t* p = src_row + x * 3;
+				dst_row[x * 4] = p[2];
+				dst_row[x * 4 + 1] = p[1];
+				dst_row[x * 4 + 2] = p[0];
+				dst_row[x * 4 + 3] = (ctx->has_trns && p[0] == ctx->trns[0] && p[1] == ctx->trns[1] && p[2] == ctx->trns[2]) ? 0 : 255;
+			}
+			break;
+
+		case PNG_COLOR_TYPE_GRAY_ALPHA:
+			for (uint32_t x = 0; x < width; x++) {
+				uint8_t v = src_row[x * 2];
+				dst_row[x * 4] = v;
+				dst_row[x * 4 + 1] = v;
+				dst_row[x * 4 + 2] = v;
+				dst_row[x * 4 + 3] = src_row[x * 2 + 1];
+			}
+			break;
+
+		case PNG_COLOR_TYPE_RGBA:
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t* p = src_row + x * 4;
+				dst_row[x * 4] = p[2];
+				dst_row[x * 4 + 1] = p[1];
+				dst_row[x * 4 + 2] = p[0];
+				dst_row[x * 4 + 3] = p[3];
+			}
+			break;
+	}
+}
+
+/**
+ * 将位深为 16 的一行源数据（大端序）中从 x_begin 开始的 width 个像素完整保留精度展开为 RGBA16
+ */
+static void png_expand_row_16(const PNG_ConvertContext* ctx, const uint8_t* src_row, uint32_t x_begin, uint32_t width,
+	uint16_t* dst_row) {
+	const PNG_IHDR* header = &ctx->image->header;
+	src_row += (size_t)x_begin * png_channels(header->color_type) * 2;
+
+	switch (header->color_type) {
+		case PNG_COLOR_TYPE_GRAY:
+			for (uint32_t x = 0; x < width; x++) {
+				uint16_t v = (uint16_t)((src_row[x * 2] << 8) | src_row[x * 2 + 1]);
+				dst_row[x * 4] = dst_row[x * 4 + 1] = dst_row[x * 4 + 2] = v;
+				dst_row[x * 4 + 3] = (ctx->has_trns && v == ctx->trns[0]) ? 0 : 65535;
+			}
+			break;
+
+		case PNG_COLOR_TYPE_RGB:
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t* p = src_row + x * 6;
+				uint16_t r = (uint16_t)((p[0] << 8) | p[1]);
+				uint16_t g = (uint16_t)((p[2] << 8) | p[3]);
+				uint16_t b = (uint16_t)((p[4] << 8) | p[5]);
+				dst_row[x * 4] = r;
+				dst_row[x * 4 + 1] = g;
+				dst_row[x * 4 + 2] = b;
+				dst_row[x * 4 + 3] = (ctx->has_trns && r == ctx->trns[0] && g == ctx->trns[1] && b == ctx->trns[2]) ? 0 : 65535;
+			}
+			break;
+
+		case PNG_COLOR_TYPE_GRAY_ALPHA:
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t* p = src_row + x * 4;
+				uint16_t v = (uint16_t)((p[0] << 8) | p[1]);
+				dst_row[x * 4] = dst_row[x * 4 + 1] = dst_row[x * 4 + 2] = v;
+				dst_row[x * 4 + 3] = (uint16_t)((p[2] << 8) | p[3]);
+			}
+			break;
+
+		case PNG_COLOR_TYPE_RGBA:
+			for (uint32_t x = 0; x < width * 4; x++) {
+				dst_row[x] = (uint16_t)((src_row[x * 2] << 8) | src_row[x * 2 + 1]);
+			}
+			break;
 	}
+}
 
+/**
+ * 将一行已还原的扫描线数据转换为目标像素格式
+ * 
+ * @param ctx        		转换上下文
+ * @param src_row      		源扫描线（不含滤波类型字节）
+ * @param dst_row      		目标像素行
+ * 
+ * @return      无
+ */
+void png_convert_row(PNG_ConvertContext* ctx, const uint8_t* src_row, uint8_t* dst_row) {
+	png_convert_row_span(ctx, src_row, 0, ctx->image->header.width, dst_row);
+}
+
+/**
+ * 只转换一行扫描线中 [x_begin, x_begin + width) 范围内的像素，范围之外的列不做任何处理
+ * 
+ * @param ctx        		转换上下文
+ * @param src_row      		源扫描线（不含滤波类型字节），为完整的一行
+ * @param x_begin      		起始列
+ * @param width      		像素数，x_begin + width 不超过图像宽度
+ * @param dst_row      		目标像素，第一个像素对应 x_begin 列
+ * 
+ * @return      无
+ */
+void png_convert_row_span(PNG_ConvertContext* ctx, const uint8_t* src_row, uint32_t x_begin, uint32_t width, uint8_t* dst_row) {
+	int is_16 = ctx->image->header.bit_depth == 16;
+
+	if (ctx->format == PNG_FORMAT_RGBA16) {
+		if (is_16) {
+			png_expand_row_16(ctx, src_row, x_begin, width, (uint16_t*)dst_row);
+		} else {
+			png_expand_row_8(ctx, src_row, x_begin, width, (uint8_t*)ctx->scratch);
+			png_row_bgra8_to_rgba16((const uint8_t*)ctx->scratch, (uint16_t*)dst_row, width);
+		}
+	} else {
+		if (is_16) {
+			// 16 位源数据先完整展开，再统一做正确舍入的向量化降位
+			png_expand_row_16(ctx, src_row, x_begin, width, (uint16_t*)ctx->scratch);
+			png_row_rgba16_to_bgra8((const uint16_t*)ctx->scratch, dst_row, width);
+		} else {
+			png_expand_row_8(ctx, src_row, x_begin, width, dst_row);
+		}
+		if (ctx->format == PNG_FORMAT_BGRA8_PREMULTIPLIED) {
+			// 趁行数据仍在缓存中时原地预乘，不再额外遍历整幅图像
+			png_row_premultiply_bgra8(dst_row, dst_row, width);
+		}
+	}
+}
+
+/**
+ * 获取输出像素格式每像素占用的字节数
+ * 
+ * @param format      		输出像素格式（PNG_FORMAT_*）
+ * 
+ * @return      每像素字节数，格式非法时返回 0
+ */
+uint32_t png_format_bytes_per_pixel(int format) {
+	switch (format) {
+		case PNG_FORMAT_BGRA8:                return 4;
+		case PNG_FORMAT_BGRA8_PREMULTIPLIED:  return 4;
+		case PNG_FORMAT_RGBA16:               return 8;
+		default:                              return 0;
+	}
+}
+
+/**
+ * 为每个工作线程创建一个转换上下文
+ * 
+ * @param image        		已解析头部信息的图像结构体
+ * @param format      		输出像素格式（PNG_FORMAT_*）
+ * @param count      		上下文个数（通常为 png_get_thread_count() 的返回值）
+ * 
+ * @return      转换上下文数组，失败时返回 NULL
+ */
+PNG_ConvertContext* png_convert_contexts_create(const PNG_Image* image, int format, int count) {
+	PNG_ConvertContext* contexts = (PNG_ConvertContext*)calloc(count, sizeof(PNG_ConvertContext));
+	if (!contexts) {
+		return NULL;
+	}
+	for (int i = 0; i < count; i++) {
+		if (!png_convert_context_init(&contexts[i], image, format)) {
+			png_convert_contexts_free(contexts, i + 1);
+			return NULL;
+		}
+	}
+	return contexts;
+}
+
+/**
+ * 释放 png_convert_contexts_create 创建的转换上下文数组
+ */
+void png_convert_contexts_free(PNG_ConvertContext* contexts, int count) {
+	if (!contexts) {
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		png_convert_context_free(&contexts[i]);
+	}
+	free(contexts);
+}
+
+// 整幅图像转换任务：每个工作线程使用各自的转换上下文处理分到的行带
+typedef struct {
+	PNG_Image* image;
+	PNG_ConvertContext* contexts;
+	uint8_t* output;
+	size_t src_row_bytes;
+	size_t dst_row_bytes;
+	const PNG_CancelToken* cancel;
+} PNG_ConvertJob;
+
+static void png_convert_band(void* ctx, uint32_t y_begin, uint32_t y_end, int worker) {
+	PNG_ConvertJob* job = (PNG_ConvertJob*)ctx;
+	// 已取消时跳过尚未开始的行带
+	if (png_cancel_requested(job->cancel)) {
+		return;
+	}
+	for (uint32_t y = y_begin; y < y_end; y++) {
+		png_convert_row(&job->contexts[worker], job->image->image_data + (size_t)y * job->src_row_bytes,
+			job->output + (size_t)y * job->dst_row_bytes);
+	}
+}
+
+/**
+ * 将已还原的图像数据转换为指定的像素格式
+ * 
+ * @param image        		已解压的图像数据结构体
+ * @param format      		输出像素格式（PNG_FORMAT_*）
+ * @param output   			输出缓冲区指针
+ * @param output_size      	输出缓冲区大小
+ * @param cancel      		取消令牌，可以为 NULL，每个行带开始前检查一次
+ * 
+ * @return      是否转换成功，返回 1(真) 或 0(假)；取消时返回 0 并释放输出缓冲区
+ */
+int png_convert_image(PNG_Image* image, int format, uint8_t** output, size_t* output_size, const PNG_CancelToken* cancel) {
+	if (!image || !output || !output_size) {
+		return 0;
+	}
+
+	uint32_t width = image->header.width;
+	uint32_t height = image->header.height;
+	uint32_t dst_bpp = png_format_bytes_per_pixel(format);
+	uint32_t src_row_bytes = png_row_bytes(&image->header, width);
+	if (dst_bpp == 0 || src_row_bytes == 0) {
+		return 0;
+	}
+
+	if (image->image_data_size < (uint64_t)height * src_row_bytes) {
+		// 验证源数据是否足够
+		return 0;
+	}
+
+	int threads = png_get_thread_count();
+	PNG_ConvertContext* contexts = png_convert_contexts_create(image, format, threads);
+	if (!contexts) {
+		return 0;
+	}
+
+	// 输出大小受地址空间与内存预算限制
+	uint64_t size = (uint64_t)width * height * dst_bpp;
+	if (size > SIZE_MAX || size > png_get_memory_budget()) {
+		png_convert_contexts_free(contexts, threads);
+		return 0;
+	}
+	*output_size = (size_t)size;
+	*output = (uint8_t*)malloc(*output_size);
+	if (!*output) {
+		png_convert_contexts_free(contexts, threads);
+		return 0;
+	}
+
+	// 各行互不依赖，按缓存大小的行带分给线程池并行转换
+	PNG_ConvertJob job = { image, contexts, *output, src_row_bytes, (size_t)width * dst_bpp, cancel };
+	png_parallel_bands(height, job.dst_row_bytes, png_convert_band, &job);
+
+	png_convert_contexts_free(contexts, threads);
+	if (png_cancel_requested(cancel)) {
+		free(*output);
+		*output = NULL;
+		*output_size = 0;
+		return 0;
+	}
 	return 1;
 }
 
+/**
+ * 从任意 PNG 格式到标准 32 位 RGBA 格式的完整转换（像素按 Windows DIB 期望的 B, G, R, A 顺序排列）
+ * 
+ * @param image        		已解压的图像数据结构体
+ * @param output   			输出缓冲区指针
+ * @param output_size      	输出缓冲区大小
+ * 
+ * @return      是否还原成功，返回 1(真) 或 0(假)
+ */
+int png_convert_to_rgba(PNG_Image* image, uint8_t** output, size_t* output_size) {
+	return png_convert_image(image, PNG_FORMAT_BGRA8, output, output_size, NULL);
+}
+
+/**
+ * 处理图像数据之前的头部信息块（IHDR、PLTE、tRNS），其余类型的块直接忽略
+ * 
+ * @param chunk        		已读取并通过 CRC 校验的块
+ * @param image        		图像结构体，解析结果写入其中
+ * @param has_ihdr        	IHDR 块是否已经出现，解析到 IHDR 时置 1
+ * 
+ * @return      是否处理成功，返回 1(真) 或 0(假)
+ */
+int png_process_header_chunk(PNG_Chunk* chunk, PNG_Image* image, int* has_ihdr) {
+	switch (chunk->type) {
+		case PNG_CHUNK_IHDR:
+			if (*has_ihdr || !png_parse_ihdr(chunk, &image->header)) {
+				// 重复 IHDR 或解析失败
+				return 0;
+			}
+			*has_ihdr = 1;
+			return 1;
+
+		case PNG_CHUNK_PLTE:
+			if (!*has_ihdr || image->header.color_type == PNG_COLOR_TYPE_GRAY || 
+				image->header.color_type == PNG_COLOR_TYPE_GRAY_ALPHA || image->palette) {
+				// 非法颜色类型出现 PLTE，或重复 PLTE
+				return 0;
+			}
+			// 调色板解析失败时返回 0
+			return png_parse_plte(chunk, &image->palette, &image->palette_size);
+
+		case PNG_CHUNK_tRNS:
+			if (!*has_ihdr || image->header.color_type == PNG_COLOR_TYPE_GRAY_ALPHA || 
+				image->header.color_type == PNG_COLOR_TYPE_RGBA || image->transparency) {
+				// 带 alpha 通道的图像不应有 tRNS，或重复 tRNS
+				return 0;
+			}
+			// 透明度数据解析失败时返回 0
+			return png_parse_trns(chunk, image->header.color_type, &image->transparency, &image->transparency_size);
+
+		default:
+			// 忽略其他块
+			return 1;
+	}
+}
+
 /**
  * 读取 PNG 文件，将复杂的文件格式转换为可用的图像数据（入口函数）
  * 
@@ -811,70 +1270,66 @@ int png_convert_to_rgba(PNG_Image* image, uint8_t** output, uint32_t* output_siz
  * @return      是否还原成功，返回 1(真) 或 0(假)
  */
 int png_read_file(const char* filename, PNG_Image* image) {
-    FILE* file = fopen(filename, "rb");				// 以二进制模式打开文件
-    if (!file) {
-		// 文件打开失败
-        return 0;
-    }
-    
-    if (!png_validate_signature(file)) {
-		// PNG签名无效
-        fclose(file);
-        return 0;
-    }
-    
-    memset(image, 0, sizeof(PNG_Image));			// 清零图像结构体
+	return png_read_file_cancellable(filename, image, NULL);
+}
+
+/**
+ * 读取签名之后的所有块直到 IEND：解析头部信息块，IDAT 数据追加到可增长的压缩数据缓冲区
+ * 
+ * @param file              已读过签名的文件
+ * @param image        		图像结构体（已清零），写入 header、palette、transparency
+ * @param idat              压缩数据缓冲区（输入输出参数）
+ * @param idat_size         输出参数，压缩数据大小
+ * @param idat_capacity     压缩数据缓冲区容量（输入输出参数）
+ * @param cancel        	取消令牌，可以为 NULL
+ * 
+ * @return      是否读取成功（IHDR、IDAT、IEND 齐全），返回 1(真) 或 0(假)；失败时不释放 image
+ */
+static int png_read_chunks(FILE* file, PNG_Image* image, uint8_t** idat, size_t* idat_size, size_t* idat_capacity,
+    const PNG_CancelToken* cancel) {
     int has_ihdr = 0;								// IHDR 块标志
     int has_idat = 0;								// IDAT 块标志
     int has_iend = 0;								// IEND 块标志
     
-    PNG_Chunk chunk;
+    PNG_Chunk chunk = {0};
+    uint32_t length, type;
+    *idat_size = 0;
 
 	// 循环读取 PNG 块直到遇到 IEND 块
-    while (!has_iend && png_read_chunk(file, &chunk)) {
+    while (!has_iend && png_read_chunk_header(file, &length, &type)) {
+        if (png_cancel_requested(cancel)) {
+            goto error_cleanup;
+        }
+        
+        if (type == PNG_CHUNK_IDAT) {
+            if (!has_ihdr) {
+				// 必须在 IHDR 后 IEND 前
+                goto error_cleanup;
+            }
+            // IDAT 数据直接读入压缩数据缓冲区，不经过块缓冲区
+            if (!png_read_idat_payload(file, length, idat, idat_size, idat_capacity)) {
+				// 图像数据读取失败
+                goto error_cleanup;
+            }
+            has_idat = 1;
+            continue;
+        }
+        
+        if (!png_read_chunk_body(file, length, type, &chunk)) {
+            goto error_cleanup;
+        }
         switch (chunk.type) {
             case PNG_CHUNK_IHDR:
-                if (has_ihdr || !png_parse_ihdr(&chunk, &image->header)) {
-					// 重复 IHDR 或解析失败
-                    goto error_cleanup;
-                }
-                has_ihdr = 1;
-                break;
-                
             case PNG_CHUNK_PLTE:
-                if (!has_ihdr || image->header.color_type == PNG_COLOR_TYPE_GRAY || 
-                    image->header.color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-					// 非法颜色类型出现 PLTE
-					goto error_cleanup;
-                }
-                if (!png_parse_plte(&chunk, &image->palette, &image->palette_size)) {
-					// 调色板解析失败
-                    goto error_cleanup;
-                }
-                break;
-                
             case PNG_CHUNK_tRNS:
-                if (!has_ihdr || image->header.color_type == PNG_COLOR_TYPE_GRAY_ALPHA || 
-                    image->header.color_type == PNG_COLOR_TYPE_RGBA) {
-					// 带 alpha 通道的图像不应有 tRNS
-					goto error_cleanup;
-                }
-                if (!png_parse_trns(&chunk, image->header.color_type, &image->transparency, &image->transparency_size)) {
-					// 透明度数据解析失败
-                    goto error_cleanup;
-                }
-                break;
-                
-            case PNG_CHUNK_IDAT:
-                if (!has_ihdr || has_iend) {
-					// 必须在 IHDR 后 IEND 前
+                if (!png_process_header_chunk(&chunk, image, &has_ihdr)) {
+					// 头部信息块非法或解析失败
                     goto error_cleanup;
                 }
-                if (!png_process_idat(&chunk, &image->image_data, &image->image_data_size)) {
-					// 图像数据处理失败
+                if (chunk.type == PNG_CHUNK_IHDR && !png_check_memory_budget(&image->header)) {
+					// 解码所需内存超出预算，在读取图像数据之前拒绝
                     goto error_cleanup;
                 }
-                has_idat = 1;
                 break;
                 
             case PNG_CHUNK_IEND:
@@ -893,17 +1348,48 @@ int png_read_file(const char* filename, PNG_Image* image) {
         png_free_chunk(&chunk);
     }
     
-    fclose(file);
+    return has_ihdr && has_idat && has_iend;
+
+error_cleanup:
+	png_free_chunk(&chunk);
+	return 0;
+}
+
+/**
+ * 可取消地读取 PNG 文件：每读取一个块、每解压一段数据、每还原一行检查一次取消请求
+ * 
+ * @param filename   		PNG 文件绝对路径
+ * @param image        		图像结构体
+ * @param cancel        	取消令牌，可以为 NULL
+ * 
+ * @return      是否还原成功，返回 1(真) 或 0(假)；取消时返回 0 并释放所有内存
+ */
+int png_read_file_cancellable(const char* filename, PNG_Image* image, const PNG_CancelToken* cancel) {
+    FILE* file = fopen(filename, "rb");				// 以二进制模式打开文件
+    if (!file) {
+		// 文件打开失败
+        return 0;
+    }
+    
+    if (!png_validate_signature(file)) {
+		// PNG签名无效
+        fclose(file);
+        return 0;
+    }
     
-    if (!has_ihdr || !has_idat || !has_iend) {
+    memset(image, 0, sizeof(PNG_Image));			// 清零图像结构体
+    size_t idat_capacity = 0;						// 压缩数据缓冲区容量
+    int ok = png_read_chunks(file, image, &image->image_data, &image->image_data_size, &idat_capacity, cancel);
+    fclose(file);
+    if (!ok) {
         png_free_image(image);
         return 0;
     }
     
     // DEFLATE 解压缩图像数据
     uint8_t* decompressed = NULL;
-    uint32_t decompressed_size = 0;
-    if (!png_decompress_data(image->image_data, image->image_data_size, &decompressed, &decompressed_size)) {
+    size_t decompressed_size = 0;
+    if (!png_decompress_data(image->image_data, image->image_data_size, &decompressed, &decompressed_size, cancel)) {
         png_free_image(image);
         return 0;
     }
@@ -913,19 +1399,117 @@ int png_read_file(const char* filename, PNG_Image* image) {
     image->image_data_size = decompressed_size;
     
     // 对已解压图像数据应用扫描线滤波
-    if (!png_apply_filters(image->image_data, image->image_data_size, &image->header)) {
+    if (!png_apply_filters(image->image_data, image->image_data_size, &image->header, cancel)) {
         png_free_image(image);
         return 0;
     }
     
     return 1;
+}
 
-error_cleanup:
-	png_free_chunk(&chunk);
-	png_free_image(image);
-	fclose(file);
+/*
+ * 可复用的解码上下文
+ *
+ * 保存压缩数据缓冲区、解压缓冲区与 zlib 解压流，按需增长，在多次解码之间复用。连续解码大量文件时
+ * （如批量解码的每个工作线程），省去每个文件重新分配缓冲区与初始化 zlib 的开销。
+ */
+struct PNG_DecodeContext {
+    uint8_t* compressed;            // IDAT 压缩数据
+    size_t compressed_capacity;
+    uint8_t* raw;                   // 解压并还原后的扫描线，解码结果的 image_data 指向这里
+    size_t raw_capacity;
+    z_stream stream;
+    int stream_ready;
+};
 
-	return 0;
+/**
+ * 创建解码上下文
+ * 
+ * @return      解码上下文（由调用者 png_decode_context_destroy），内存不足时返回 NULL
+ */
+PNG_DecodeContext* png_decode_context_create(void) {
+    return (PNG_DecodeContext*)calloc(1, sizeof(PNG_DecodeContext));
+}
+
+/**
+ * 释放解码上下文及其缓冲区（用它解码的图像的 image_data 随之失效）
+ * 
+ * @param context      		解码上下文，可以为 NULL
+ */
+void png_decode_context_destroy(PNG_DecodeContext* context) {
+    if (!context) {
+        return;
+    }
+    if (context->stream_ready) {
+        inflateEnd(&context->stream);
+    }
+    free(context->compressed);
+    free(context->raw);
+    free(context);
+}
+
+/**
+ * 使用解码上下文读取 PNG 文件，结果与 png_read_file_cancellable 相同，但不为每个文件重新分配缓冲区
+ * 
+ * image->image_data 指向上下文的缓冲区，在下一次用同一上下文解码或销毁上下文之前有效；
+ * 释放图像时须先把 image_data 置为 NULL 再调用 png_free_image（只释放调色板与 tRNS）。
+ * 
+ * @param filename   		PNG 文件绝对路径
+ * @param image        		图像结构体
+ * @param context      		解码上下文
+ * @param cancel        	取消令牌，可以为 NULL
+ * 
+ * @return      是否还原成功，返回 1(真) 或 0(假)；失败时 image 已释放
+ */
+int png_read_file_context(const char* filename, PNG_Image* image, PNG_DecodeContext* context,
+    const PNG_CancelToken* cancel) {
+    if (!context) {
+        return 0;
+    }
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    if (!png_validate_signature(file)) {
+        fclose(file);
+        return 0;
+    }
+
+    memset(image, 0, sizeof(PNG_Image));
+    size_t compressed_size = 0;
+    int ok = png_read_chunks(file, image, &context->compressed, &compressed_size, &context->compressed_capacity, cancel);
+    fclose(file);
+
+    // 解压缓冲区一次扩展到预计的大小（IHDR 处已检查内存预算）
+    size_t raw_size = 0;
+    uint64_t expected = ok ? png_decoded_size(&image->header) : 0;
+    if (ok && expected > context->raw_capacity) {
+        uint8_t* raw = (uint8_t*)realloc(context->raw, (size_t)expected);
+        ok = raw != NULL;
+        if (raw) {
+            context->raw = raw;
+            context->raw_capacity = (size_t)expected;
+        }
+    }
+    if (ok) {
+        if (context->stream_ready) {
+            ok = inflateReset(&context->stream) == Z_OK;
+        } else {
+            memset(&context->stream, 0, sizeof(z_stream));
+            context->stream_ready = ok = inflateInit(&context->stream) == Z_OK;
+        }
+    }
+    ok = ok && png_inflate_buffer(&context->stream, context->compressed, compressed_size, &context->raw,
+        &context->raw_capacity, &raw_size, cancel);
+    ok = ok && png_apply_filters(context->raw, raw_size, &image->header, cancel);
+    if (!ok) {
+        png_free_image(image);
+        return 0;
+    }
+
+    image->image_data = context->raw;
+    image->image_data_size = raw_size;
+    return 1;
 }
 
 /**
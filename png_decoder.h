@@ -1,6 +1,7 @@
 #ifndef PNG_DECODER_H
 #define PNG_DECODER_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -16,9 +17,12 @@
 #define PNG_SIGNATURE "\x89PNG\r\n\x1a\n"
 #define PNG_SIGNATURE_SIZE 8
 
-// 长度检查 100MB
+// 长度检查 100MB（IDAT 块除外，其数据不经过块缓冲区，直接追加到压缩数据或边读边解压）
 #define MAX_CHUNK_LENGTH (100 * 1024 * 1024)
 
+// PNG 规范规定的块长度上限 2^31 - 1，适用于 IDAT 块
+#define PNG_MAX_IDAT_LENGTH 0x7FFFFFFFu
+
 // 块类型
 #define PNG_CHUNK_IHDR 0x49484452
 #define PNG_CHUNK_IDAT 0x49444154
@@ -26,6 +30,15 @@
 #define PNG_CHUNK_PLTE 0x504C5445
 #define PNG_CHUNK_tRNS 0x74524E53
 
+// IHDR 中宽度和高度的上限（PNG 规范规定不超过 2^31 - 1）
+#define PNG_MAX_DIMENSION 0x7FFFFFFFu
+
+// 默认单次解码的内存预算 2GB
+#define PNG_DEFAULT_MEMORY_BUDGET ((uint64_t)2 * 1024 * 1024 * 1024)
+
+// 可取消的解压每次最多输出 1MB 后检查一次取消请求
+#define PNG_CANCEL_CHECK_BYTES (1024 * 1024)
+
 // 颜色类型
 #define PNG_COLOR_TYPE_GRAY 0
 #define PNG_COLOR_TYPE_RGB 2
@@ -43,6 +56,11 @@
 #define PNG_INTERLACE_METHOD_NONE 0
 #define PNG_INTERLACE_METHOD_ADAM7 1
 
+// 输出像素格式
+#define PNG_FORMAT_BGRA8 0              // 每像素 4 字节，按 B, G, R, A 顺序排列（Windows DIB 布局）
+#define PNG_FORMAT_RGBA16 1             // 每像素 4 个 16 位通道，按 R, G, B, A 顺序排列（主机字节序），保留完整的 16 位精度
+#define PNG_FORMAT_BGRA8_PREMULTIPLIED 2 // 同 PNG_FORMAT_BGRA8，但颜色通道已预乘 α（AlphaBlend、图层混合与缩放所需）
+
 typedef struct {
     uint32_t width;                 // 图像的宽度（像素），大端序
     uint32_t height;                // 图像的高度（像素），大端序
@@ -73,20 +91,67 @@ typedef struct {
     uint8_t* transparency;
     uint32_t transparency_size;
     uint8_t* image_data;
-    uint32_t image_data_size;
+    size_t image_data_size;
 } PNG_Image;
 
+// 像素格式转换上下文：整幅图像共享的查找表，以及每行使用的临时缓冲区
+typedef struct {
+    const PNG_Image* image;
+    int format;                     // 输出像素格式（PNG_FORMAT_*）
+    uint8_t lut[256][4];            // 灰度（位深 ≤ 8）与调色板图像：样本值 -> BGRA8 像素
+    uint16_t trns[3];               // 灰度 / 真彩色图像的 tRNS 透明色（16 位样本值）
+    int has_trns;
+    void* scratch;                  // 一行 RGBA16 或 BGRA8 的中间结果
+} PNG_ConvertContext;
+
+/**
+ * 协作式取消令牌
+ *
+ * 由发起解码的线程创建并传给解码函数，任意线程调用 png_cancel_request 后，解码函数在下一个检查点
+ * （每个块、每段解压输出、每行 / 每个行带）返回失败并释放已分配的内存。所有接受令牌的函数都允许传入 NULL。
+ */
+typedef struct {
+    atomic_int cancelled;
+} PNG_CancelToken;
+
+// 可复用的解码上下文：压缩数据缓冲区、解压缓冲区与 zlib 解压流在多次解码之间复用
+typedef struct PNG_DecodeContext PNG_DecodeContext;
+
+void png_cancel_init(PNG_CancelToken* token);
+void png_cancel_request(PNG_CancelToken* token);
+int png_cancel_requested(const PNG_CancelToken* token);
 int png_validate_signature(FILE* file);
 int png_read_chunk(FILE* file, PNG_Chunk* chunk);
 void png_free_chunk(PNG_Chunk* chunk);
 int png_parse_ihdr(PNG_Chunk* chunk, PNG_IHDR* ihdr);
 int png_parse_plte(PNG_Chunk* chunk, PNG_PaletteEntry** palette, uint32_t* palette_size);
 int png_parse_trns(PNG_Chunk* chunk, uint8_t color_type, uint8_t** transparency, uint32_t* transparency_size);
-int png_process_idat(PNG_Chunk* chunk, uint8_t** image_data, uint32_t* image_data_size);
-int png_decompress_data(uint8_t* compressed, uint32_t compressed_size, uint8_t** decompressed, uint32_t* decompressed_size);
-int png_apply_filters(uint8_t* image_data, uint32_t image_data_size, PNG_IHDR* header);
-int png_convert_to_rgba(PNG_Image* image, uint8_t** output, uint32_t* output_size);
+int png_process_idat(PNG_Chunk* chunk, uint8_t** image_data, size_t* image_data_size);
+int png_decompress_data(uint8_t* compressed, size_t compressed_size, uint8_t** decompressed, size_t* decompressed_size,
+    const PNG_CancelToken* cancel);
+int png_apply_filters(uint8_t* image_data, size_t image_data_size, PNG_IHDR* header, const PNG_CancelToken* cancel);
+void png_set_memory_budget(uint64_t bytes);
+uint64_t png_get_memory_budget(void);
+uint64_t png_decoded_size(const PNG_IHDR* header);
+int png_check_memory_budget(const PNG_IHDR* header);
+uint32_t png_bytes_per_pixel(const PNG_IHDR* header);
+uint32_t png_row_bytes(const PNG_IHDR* header, uint32_t width);
+uint32_t png_format_bytes_per_pixel(int format);
+int png_convert_context_init(PNG_ConvertContext* ctx, const PNG_Image* image, int format);
+void png_convert_row(PNG_ConvertContext* ctx, const uint8_t* src_row, uint8_t* dst_row);
+void png_convert_row_span(PNG_ConvertContext* ctx, const uint8_t* src_row, uint32_t x_begin, uint32_t width, uint8_t* dst_row);
+void png_convert_context_free(PNG_ConvertContext* ctx);
+PNG_ConvertContext* png_convert_contexts_create(const PNG_Image* image, int format, int count);
+void png_convert_contexts_free(PNG_ConvertContext* contexts, int count);
+int png_convert_image(PNG_Image* image, int format, uint8_t** output, size_t* output_size, const PNG_CancelToken* cancel);
+int png_convert_to_rgba(PNG_Image* image, uint8_t** output, size_t* output_size);
+int png_process_header_chunk(PNG_Chunk* chunk, PNG_Image* image, int* has_ihdr);
 int png_read_file(const char* filename, PNG_Image* image);
+int png_read_file_cancellable(const char* filename, PNG_Image* image, const PNG_CancelToken* cancel);
+PNG_DecodeContext* png_decode_context_create(void);
+void png_decode_context_destroy(PNG_DecodeContext* context);
+int png_read_file_context(const char* filename, PNG_Image* image, PNG_DecodeContext* context,
+    const PNG_CancelToken* cancel);
 void png_free_image(PNG_Image* image);
 
 #endif // PNG_DECODER_H
@@ -0,0 +1,1439 @@
+#include "png_encoder.h"
+#include "png_file.h"
+#include "png_interlace.h"
+#include "png_palette.h"
+#include "png_reduce.h"
+#include "png_thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * PNG 编码
+ *
+ * 输入与解码器的输出格式相同：image_data 按行紧密排列原始样本（不含滤波类型字节，隔行图像已还原为逐行顺序），
+ * 调色板与 tRNS 原样写出，因此解码结果可以直接重新编码。默认输出非隔行图像，设置 interlace 时写为 Adam7 隔行图像。
+ *
+ * 每次把若干行（约 PNG_ENCODE_BAND_BYTES）滤波到行带缓冲区后再交给 deflate，避免逐行调用 zlib 的开销；
+ * deflate 直接输出到 IDAT 块缓冲区，写满 idat_size 字节后连同长度、类型与 CRC 一次交给输出回调。
+ * 整幅图像的编码与流式编码（png_encoder_push_rows）共用同一套实现。
+ */
+
+// 块的长度、类型与 CRC 共 12 字节
+#define PNG_ENCODE_CHUNK_OVERHEAD 12
+
+// deflate 窗口大小（并行压缩时每段预设字典的长度）
+#define PNG_ENCODE_WINDOW_BYTES (32 * 1024)
+
+// 分段索引中每段占 12 字节：起始行、zlib 流中的偏移（64 位）
+#define PNG_ENCODE_SEGMENT_ENTRY_BYTES 12
+
+static void png_encode_put32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/**
+ * 初始化为默认编码选项：压缩级别 6，自动选择滤波（逐行按最小绝对差之和选择），IDAT 块 64KB，
+ * 先无损缩减颜色类型与位深
+ *
+ * @param options       编码选项
+ */
+void png_encode_options_init(PNG_EncodeOptions* options) {
+    options->level = PNG_ENCODE_DEFAULT_LEVEL;
+    options->strategy = Z_DEFAULT_STRATEGY;
+    options->mem_level = PNG_ENCODE_DEFAULT_MEM_LEVEL;
+    options->filter = PNG_ENCODE_FILTER_AUTO;
+    options->idat_size = PNG_ENCODE_DEFAULT_IDAT_SIZE;
+    options->segment_bytes = 0;
+    options->segment_index = 0;
+    options->reduce = 1;
+    options->transparent = PNG_CLEAN_NONE;
+    options->palette = PNG_ENCODE_PALETTE_AUTO;
+    options->interlace = PNG_INTERLACE_METHOD_NONE;
+}
+
+/**
+ * 初始化为快速编码选项：每行固定使用 Up 滤波，zlib 压缩级别 1，IDAT 块 1MB，按 1MB 分段并行压缩，
+ * 不做无损缩减，保持调色板原有顺序
+ *
+ * 适合编辑过程中频繁保存的场景。Up 滤波只需一次减法；Z_RLE 只能匹配距离为 1 的重复，
+ * 对 RGB / RGBA 渐变与界面截图的压缩率远不如级别 1，速度也没有优势，因此不使用。
+ * 无损缩减要先扫描整幅图像，自动排序调色板还要并行试压缩多种顺序，都会使保存耗时成倍增加，
+ * 需要时由调用方重新打开 reduce 与 palette。
+ *
+ * @param options       编码选项
+ */
+void png_encode_options_fast(PNG_EncodeOptions* options) {
+    png_encode_options_init(options);
+    options->level = 1;
+    options->filter = PNG_FILTER_UP;
+    options->idat_size = PNG_ENCODE_FAST_IDAT_SIZE;
+    options->segment_bytes = PNG_ENCODE_SEGMENT_BYTES;
+    options->reduce = 0;
+    options->palette = PNG_ENCODE_PALETTE_KEEP;
+}
+
+/**
+ * 检查编码选项是否合法
+ */
+static int png_encode_options_valid(const PNG_EncodeOptions* options) {
+    return options->level >= Z_DEFAULT_COMPRESSION && options->level <= Z_BEST_COMPRESSION &&
+        options->mem_level >= 1 && options->mem_level <= MAX_MEM_LEVEL &&
+        options->filter >= PNG_FILTER_NONE && options->filter <= PNG_ENCODE_FILTER_ENTROPY &&
+        options->idat_size > 0 && options->idat_size <= PNG_MAX_IDAT_LENGTH &&
+        options->transparent >= PNG_CLEAN_NONE && options->transparent <= PNG_CLEAN_ABOVE &&
+        options->palette >= PNG_ENCODE_PALETTE_KEEP && options->palette <= PNG_ENCODE_PALETTE_AUTO &&
+        (options->interlace == PNG_INTERLACE_METHOD_NONE || options->interlace == PNG_INTERLACE_METHOD_ADAM7);
+}
+
+/**
+ * 输出一个完整的块
+ *
+ * @param chunk         块缓冲区：前 8 字节留给长度与类型，随后是 length 字节数据，末尾 4 字节留给 CRC
+ * @param type          块类型
+ * @param length        数据长度
+ *
+ * @return              是否输出成功，返回 1(真) 或 0(假)
+ */
+static int png_encode_emit_chunk(PNG_WriteCallback callback, void* user_data, uint8_t* chunk, uint32_t type,
+    uint32_t length) {
+    png_encode_put32(chunk, length);
+    png_encode_put32(chunk + 4, type);
+    png_encode_put32(chunk + 8 + length, (uint32_t)crc32(0L, chunk + 4, length + 4));
+    return callback(user_data, chunk, (size_t)length + PNG_ENCODE_CHUNK_OVERHEAD);
+}
+
+/**
+ * 检查图像头、调色板与 tRNS 是否可以编码（不检查像素数据），并生成 IHDR 块数据（隔行方式写为非隔行，由调用者按需改写）
+ *
+ * @param image         要编码的图像
+ * @param ihdr          输出 13 字节的 IHDR 块数据
+ *
+ * @return              是否可以编码，返回 1(真) 或 0(假)
+ */
+static int png_encode_header_valid(const PNG_Image* image, uint8_t* ihdr) {
+    const PNG_IHDR* header = &image->header;
+    png_encode_put32(ihdr, header->width);
+    png_encode_put32(ihdr + 4, header->height);
+    ihdr[8] = header->bit_depth;
+    ihdr[9] = header->color_type;
+    ihdr[10] = PNG_COMPRESSION_METHOD_DEFLATE;
+    ihdr[11] = PNG_FILTER_METHOD_ADAPTIVE;
+    ihdr[12] = PNG_INTERLACE_METHOD_NONE;
+
+    // 与读取时使用同一套规则检查尺寸、颜色类型与位深组合
+    PNG_Chunk chunk = { 13, PNG_CHUNK_IHDR, ihdr, 0 };
+    PNG_IHDR parsed;
+    if (!png_parse_ihdr(&chunk, &parsed)) {
+        return 0;
+    }
+
+    if (png_row_bytes(header, header->width) == 0) {
+        return 0;
+    }
+
+    // 调色板图像必须有 1 ~ 256 项调色板；灰度图像不允许调色板，真彩色图像可以附带建议调色板
+    if (image->palette_size > 256 || (image->palette_size > 0 && !image->palette)) {
+        return 0;
+    }
+    if (header->color_type == PNG_COLOR_TYPE_PALETTE && image->palette_size == 0) {
+        return 0;
+    }
+    if ((header->color_type == PNG_COLOR_TYPE_GRAY || header->color_type == PNG_COLOR_TYPE_GRAY_ALPHA) &&
+        image->palette_size > 0) {
+        return 0;
+    }
+
+    if (image->transparency_size == 0) {
+        return 1;
+    }
+    if (!image->transparency) {
+        return 0;
+    }
+    switch (header->color_type) {
+        case PNG_COLOR_TYPE_GRAY:
+            return image->transparency_size == 2;
+        case PNG_COLOR_TYPE_RGB:
+            return image->transparency_size == 6;
+        case PNG_COLOR_TYPE_PALETTE:
+            return image->transparency_size <= image->palette_size;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * 检查图像头后写入 PNG 签名与 IHDR、PLTE、tRNS 块
+ *
+ * @param interlace     IHDR 中的隔行方式（PNG_INTERLACE_METHOD_NONE 或 PNG_INTERLACE_METHOD_ADAM7）
+ *
+ * @return              是否写入成功，返回 1(真) 或 0(假)
+ */
+static int png_encode_write_header(const PNG_Image* image, int interlace, PNG_WriteCallback callback,
+    void* user_data) {
+    uint8_t chunk[8 + 256 * 3 + 4];
+
+    if (!png_encode_header_valid(image, chunk + 8) ||
+        !callback(user_data, (const uint8_t*)PNG_SIGNATURE, PNG_SIGNATURE_SIZE)) {
+        return 0;
+    }
+    chunk[8 + 12] = (uint8_t)interlace;
+    if (!png_encode_emit_chunk(callback, user_data, chunk, PNG_CHUNK_IHDR, 13)) {
+        return 0;
+    }
+
+    if (image->palette_size > 0) {
+        for (uint32_t i = 0; i < image->palette_size; i++) {
+            chunk[8 + i * 3] = image->palette[i].red;
+            chunk[8 + i * 3 + 1] = image->palette[i].green;
+            chunk[8 + i * 3 + 2] = image->palette[i].blue;
+        }
+        if (!png_encode_emit_chunk(callback, user_data, chunk, PNG_CHUNK_PLTE, image->palette_size * 3)) {
+            return 0;
+        }
+    }
+
+    if (image->transparency_size > 0) {
+        memcpy(chunk + 8, image->transparency, image->transparency_size);
+        if (!png_encode_emit_chunk(callback, user_data, chunk, PNG_CHUNK_tRNS, image->transparency_size)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * 确定滤波策略：固定的滤波类型（PNG_FILTER_*）或逐行选择（PNG_ENCODE_FILTER_MINSUM / ENTROPY）
+ */
+static int png_encode_filter_strategy(const PNG_IHDR* header, int filter) {
+    if (filter != PNG_ENCODE_FILTER_AUTO) {
+        return filter;
+    }
+    // 调色板索引与位深小于 8 的样本之间没有数值上的连续性，滤波通常反而使压缩率变差
+    if (header->color_type == PNG_COLOR_TYPE_PALETTE || header->bit_depth < 8) {
+        return PNG_FILTER_NONE;
+    }
+    return PNG_ENCODE_FILTER_MINSUM;
+}
+
+// 扫描线滤波器：滤波参数与逐行选择滤波时的候选缓冲区
+typedef struct {
+    uint32_t row_bytes;
+    uint32_t bytes_per_pixel;
+    int strategy;                   // PNG_FILTER_* 或 PNG_ENCODE_FILTER_MINSUM / ENTROPY
+    uint8_t* candidates[PNG_FILTER_COUNT];
+    uint8_t* scratch;               // 5 个候选缓冲区（逐行选择时）
+    uint8_t* zero_row;              // 首行的“上一行”
+} PNG_RowFilter;
+
+/**
+ * 初始化扫描线滤波器
+ *
+ * @param header        图像头信息
+ * @param strategy      滤波策略（PNG_FILTER_* 或 PNG_ENCODE_FILTER_*）
+ * @param row_bytes     扫描线字节数
+ *
+ * @return              是否初始化成功，返回 1(真) 或 0(假)
+ */
+static int png_row_filter_init(PNG_RowFilter* filter, const PNG_IHDR* header, int strategy, uint32_t row_bytes) {
+    memset(filter, 0, sizeof(*filter));
+    filter->row_bytes = row_bytes;
+    filter->bytes_per_pixel = png_bytes_per_pixel(header);
+    filter->strategy = png_encode_filter_strategy(header, strategy);
+    filter->zero_row = (uint8_t*)calloc(row_bytes ? row_bytes : 1, 1);
+    if (!filter->zero_row) {
+        return 0;
+    }
+    if (filter->strategy == PNG_ENCODE_FILTER_MINSUM || filter->strategy == PNG_ENCODE_FILTER_ENTROPY) {
+        filter->scratch = (uint8_t*)malloc((size_t)row_bytes * PNG_FILTER_COUNT);
+        if (!filter->scratch) {
+            free(filter->zero_row);
+            filter->zero_row = NULL;
+            return 0;
+        }
+        for (int f = 0; f < PNG_FILTER_COUNT; f++) {
+            filter->candidates[f] = filter->scratch + (size_t)f * row_bytes;
+        }
+    }
+    return 1;
+}
+
+static void png_row_filter_free(PNG_RowFilter* filter) {
+    free(filter->scratch);
+    free(filter->zero_row);
+    filter->scratch = NULL;
+    filter->zero_row = NULL;
+}
+
+/**
+ * 滤波一条扫描线；逐行选择时一次遍历算出全部 5 种滤波结果，按启发式代价取最小者（代价相同时取编号小的类型）
+ *
+ * @param row           原始扫描线
+ * @param prev_row      上一条原始扫描线，NULL 表示首行
+ * @param out           输出滤波类型字节与滤波结果（row_bytes + 1 字节）
+ */
+static void png_row_filter_apply(PNG_RowFilter* filter, const uint8_t* row, const uint8_t* prev_row, uint8_t* out) {
+    uint32_t row_bytes = filter->row_bytes;
+    if (!prev_row) {
+        prev_row = filter->zero_row;
+    }
+    if (!filter->scratch) {
+        out[0] = (uint8_t)filter->strategy;
+        png_filter_row((uint8_t)filter->strategy, row, prev_row, row_bytes, filter->bytes_per_pixel, out + 1);
+        return;
+    }
+
+    uint64_t sums[PNG_FILTER_COUNT];
+    png_filter_row_all(row, prev_row, row_bytes, filter->bytes_per_pixel, filter->candidates, sums);
+
+    int best = PNG_FILTER_NONE;
+    if (filter->strategy == PNG_ENCODE_FILTER_ENTROPY) {
+        double best_bits = png_filter_entropy(filter->candidates[PNG_FILTER_NONE], row_bytes);
+        for (int f = PNG_FILTER_SUB; f < PNG_FILTER_COUNT; f++) {
+            double bits = png_filter_entropy(filter->candidates[f], row_bytes);
+            if (bits < best_bits) {
+                best_bits = bits;
+                best = f;
+            }
+        }
+    } else {
+        for (int f = PNG_FILTER_SUB; f < PNG_FILTER_COUNT; f++) {
+            if (sums[f] < sums[best]) {
+                best = f;
+            }
+        }
+    }
+
+    out[0] = (uint8_t)best;
+    memcpy(out + 1, filter->candidates[best], row_bytes);
+}
+
+/**
+ * 滤波图像中 [y, y + rows) 范围内的扫描线，连续写入 out（每行 row_bytes + 1 字节）
+ */
+static void png_row_filter_rows(PNG_RowFilter* filter, const PNG_Image* image, uint32_t y, uint32_t rows, uint8_t* out) {
+    uint32_t row_bytes = filter->row_bytes;
+    for (uint32_t r = 0; r < rows; r++) {
+        const uint8_t* row = image->image_data + (size_t)(y + r) * row_bytes;
+        png_row_filter_apply(filter, row, y + r > 0 ? row - row_bytes : NULL, out + (size_t)r * (row_bytes + 1));
+    }
+}
+
+/**
+ * 每个行带的行数：约 bytes 字节，至少一行，不超过 rows
+ */
+static uint32_t png_encode_band_rows(uint32_t filtered_line, uint32_t rows, uint32_t bytes) {
+    uint32_t band_rows = bytes / filtered_line;
+    if (band_rows == 0) {
+        band_rows = 1;
+    }
+    return band_rows > rows ? rows : band_rows;
+}
+
+// IDAT 输出：deflate 结果攒满 idat_size 字节后作为一个 IDAT 块输出
+typedef struct {
+    PNG_WriteCallback callback;
+    void* user_data;
+    uint8_t* chunk;                 // 块缓冲区（长度、类型、idat_size 字节数据与 CRC）
+    uint32_t idat_size;
+    uint32_t used;                  // 已写入的数据字节数
+} PNG_IdatWriter;
+
+static int png_idat_writer_init(PNG_IdatWriter* writer, uint32_t idat_size, PNG_WriteCallback callback,
+    void* user_data) {
+    writer->callback = callback;
+    writer->user_data = user_data;
+    writer->idat_size = idat_size;
+    writer->used = 0;
+    writer->chunk = (uint8_t*)malloc((size_t)idat_size + PNG_ENCODE_CHUNK_OVERHEAD);
+    return writer->chunk != NULL;
+}
+
+/**
+ * 输出缓冲区中已有的数据（没有数据时不输出空的 IDAT 块）
+ */
+static int png_idat_writer_flush(PNG_IdatWriter* writer) {
+    if (writer->used == 0) {
+        return 1;
+    }
+    uint32_t length = writer->used;
+    writer->used = 0;
+    return png_encode_emit_chunk(writer->callback, writer->user_data, writer->chunk, PNG_CHUNK_IDAT, length);
+}
+
+/**
+ * 追加已压缩的数据
+ */
+static int png_idat_writer_append(PNG_IdatWriter* writer, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        uint32_t room = writer->idat_size - writer->used;
+        uint32_t count = size < room ? (uint32_t)size : room;
+        memcpy(writer->chunk + 8 + writer->used, data, count);
+        writer->used += count;
+        data += count;
+        size -= count;
+        if (writer->used == writer->idat_size && !png_idat_writer_flush(writer)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 压缩 strm 中的全部输入，deflate 直接输出到 IDAT 块缓冲区
+ *
+ * @param flush         Z_NO_FLUSH 或 Z_FINISH
+ *
+ * @return              是否压缩成功，返回 1(真) 或 0(假)
+ */
+static int png_idat_writer_deflate(PNG_IdatWriter* writer, z_stream* strm, int flush) {
+    int ret;
+    int full;
+    do {
+        strm->next_out = writer->chunk + 8 + writer->used;
+        strm->avail_out = writer->idat_size - writer->used;
+        ret = deflate(strm, flush);
+        if (ret == Z_STREAM_ERROR) {
+            return 0;
+        }
+        full = strm->avail_out == 0;
+        writer->used = writer->idat_size - strm->avail_out;
+        if (full && !png_idat_writer_flush(writer)) {
+            return 0;
+        }
+    } while (strm->avail_in > 0 || full || (flush == Z_FINISH && ret != Z_STREAM_END));
+    return 1;
+}
+
+/*
+ * 并行压缩（与 pigz 相同的做法）
+ *
+ * 图像按行分成若干段（每段约 segment_bytes 字节的滤波后数据），每段由线程池中的一个任务独立滤波并压缩为
+ * 原始 deflate 数据：非末段以 Z_SYNC_FLUSH 结束（对齐到字节边界的空存储块），末段以 Z_FINISH 结束，
+ * 各段首尾相接即是一个合法的 deflate 流，再加上 zlib 头与由各段 Adler-32 合并得到的校验和。
+ *
+ * 默认每段以前一段末尾 32KB 的滤波后数据作为预设字典（由任务自己重新滤波得到，段之间没有依赖），
+ * 压缩率几乎不受分段影响。写入分段索引（segment_index）时各段不使用字典，可以从段起点独立解压，
+ * 索引块 zsEG 记录每段的起始行与在 zlib 流中的偏移，供解码器并行解压。
+ */
+
+// 一段的压缩结果
+typedef struct {
+    uint32_t y_begin;
+    uint32_t y_end;
+    uint8_t* data;                  // 原始 deflate 数据
+    size_t size;
+    uLong adler;                    // 滤波后数据的 Adler-32
+    size_t length;                  // 滤波后数据的字节数
+    int ok;
+} PNG_EncodeSegment;
+
+typedef struct {
+    const PNG_Image* image;
+    const PNG_EncodeOptions* options;
+    PNG_EncodeSegment* segments;
+    uint32_t bytes_per_line;
+} PNG_EncodeSegmentJob;
+
+/**
+ * 压缩一段扫描线（线程池任务）
+ */
+static void png_encode_segment_task(void* ctx, uint32_t index, int worker) {
+    PNG_EncodeSegmentJob* job = (PNG_EncodeSegmentJob*)ctx;
+    PNG_EncodeSegment* segment = &job->segments[index];
+    const PNG_IHDR* header = &job->image->header;
+    uint32_t filtered_line = job->bytes_per_line + 1;
+    uint32_t rows = segment->y_end - segment->y_begin;
+    uint32_t band_rows = png_encode_band_rows(filtered_line, rows, PNG_ENCODE_BAND_BYTES);
+    int last = segment->y_end == header->height;
+    (void)worker;
+
+    // 字典所需的行数：覆盖 deflate 的 32KB 窗口
+    uint32_t dictionary_rows = 0;
+    if (segment->y_begin > 0 && !job->options->segment_index) {
+        dictionary_rows = (PNG_ENCODE_WINDOW_BYTES + filtered_line - 1) / filtered_line;
+        if (dictionary_rows > segment->y_begin) {
+            dictionary_rows = segment->y_begin;
+        }
+    }
+    if (dictionary_rows > band_rows) {
+        band_rows = dictionary_rows;
+    }
+
+    PNG_RowFilter filter;
+    if (!png_row_filter_init(&filter, header, job->options->filter, job->bytes_per_line)) {
+        return;
+    }
+    uint8_t* band = (uint8_t*)malloc((size_t)band_rows * filtered_line);
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    int stream_ready = 0;
+    size_t capacity = 0;
+
+    if (!band) {
+        goto cleanup;
+    }
+    if (deflateInit2(&strm, job->options->level, Z_DEFLATED, -MAX_WBITS, job->options->mem_level,
+        job->options->strategy) != Z_OK) {
+        goto cleanup;
+    }
+    stream_ready = 1;
+
+    if (dictionary_rows > 0) {
+        size_t dictionary_size = (size_t)dictionary_rows * filtered_line;
+        size_t used = dictionary_size < PNG_ENCODE_WINDOW_BYTES ? dictionary_size : PNG_ENCODE_WINDOW_BYTES;
+        png_row_filter_rows(&filter, job->image, segment->y_begin - dictionary_rows, dictionary_rows, band);
+        if (deflateSetDictionary(&strm, band + dictionary_size - used, (uInt)used) != Z_OK) {
+            goto cleanup;
+        }
+    }
+
+    // 按上限一次分配输出缓冲区，Z_SYNC_FLUSH 的空存储块另留余量
+    segment->length = (size_t)rows * filtered_line;
+    capacity = deflateBound(&strm, (uLong)segment->length) + 16;
+    segment->data = (uint8_t*)malloc(capacity);
+    if (!segment->data) {
+        goto cleanup;
+    }
+    strm.next_out = segment->data;
+    strm.avail_out = (uInt)capacity;
+    segment->adler = adler32(0L, Z_NULL, 0);
+
+    for (uint32_t y = segment->y_begin; y < segment->y_end; y += band_rows) {
+        uint32_t count = segment->y_end - y < band_rows ? segment->y_end - y : band_rows;
+        size_t size = (size_t)count * filtered_line;
+        png_row_filter_rows(&filter, job->image, y, count, band);
+        segment->adler = adler32(segment->adler, band, (uInt)size);
+
+        int flush = y + count < segment->y_end ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+        strm.next_in = band;
+        strm.avail_in = (uInt)size;
+        int ret;
+        do {
+            if (strm.avail_out == 0) {
+                // 超出估算上限时扩大缓冲区（正常情况下不会发生）
+                size_t produced = capacity - strm.avail_out;
+                uint8_t* grown = (uint8_t*)realloc(segment->data, capacity * 2);
+                if (!grown) {
+                    goto cleanup;
+                }
+                segment->data = grown;
+                strm.next_out = grown + produced;
+                strm.avail_out = (uInt)capacity;
+                capacity *= 2;
+            }
+            ret = deflate(&strm, flush);
+            if (ret == Z_STREAM_ERROR) {
+                goto cleanup;
+            }
+        } while (strm.avail_in > 0 || strm.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    }
+    segment->size = capacity - strm.avail_out;
+    segment->ok = 1;
+
+cleanup:
+    if (stream_ready) {
+        deflateEnd(&strm);
+    }
+    free(band);
+    png_row_filter_free(&filter);
+}
+
+/**
+ * 生成 zlib 流头（CMF、FLG），FLEVEL 与 zlib 对同样参数的取值一致
+ */
+static void png_encode_zlib_header(const PNG_EncodeOptions* options, uint8_t* out) {
+    int level = options->level == Z_DEFAULT_COMPRESSION ? 6 : options->level;
+    int flags;
+    if (options->strategy >= Z_HUFFMAN_ONLY || level < 2) {
+        flags = 0;
+    } else if (level < 6) {
+        flags = 1;
+    } else if (level == 6) {
+        flags = 2;
+    } else {
+        flags = 3;
+    }
+    uint32_t header = (0x78u << 8) | ((uint32_t)flags << 6);
+    header += 31 - header % 31;
+    out[0] = (uint8_t)(header >> 8);
+    out[1] = (uint8_t)header;
+}
+
+/**
+ * 写入分段索引块 zsEG：段数，随后每段的起始行与在 zlib 流中的偏移（64 位，高 32 位在前）
+ *
+ * @return              是否写入成功，返回 1(真) 或 0(假)
+ */
+static int png_encode_write_segment_index(const PNG_EncodeSegment* segments, uint32_t count,
+    PNG_WriteCallback callback, void* user_data) {
+    uint32_t length = 4 + count * PNG_ENCODE_SEGMENT_ENTRY_BYTES;
+    uint8_t* chunk = (uint8_t*)malloc((size_t)length + PNG_ENCODE_CHUNK_OVERHEAD);
+    if (!chunk) {
+        return 0;
+    }
+
+    png_encode_put32(chunk + 8, count);
+    uint64_t offset = 2;
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t* entry = chunk + 12 + (size_t)i * PNG_ENCODE_SEGMENT_ENTRY_BYTES;
+        png_encode_put32(entry, segments[i].y_begin);
+        png_encode_put32(entry + 4, (uint32_t)(offset >> 32));
+        png_encode_put32(entry + 8, (uint32_t)offset);
+        offset += segments[i].size;
+    }
+
+    int ok = png_encode_emit_chunk(callback, user_data, chunk, PNG_CHUNK_zsEG, length);
+    free(chunk);
+    return ok;
+}
+
+/**
+ * 按顺序拼接各段的压缩数据，加上 zlib 头与合并后的 Adler-32 写入 IDAT 块（需要时先写入分段索引块）
+ *
+ * @return              是否写入成功，返回 1(真) 或 0(假)
+ */
+static int png_encode_write_segments(const PNG_EncodeSegment* segments, uint32_t count,
+    const PNG_EncodeOptions* options, PNG_IdatWriter* writer) {
+    int ok = 1;
+    if (options->segment_index) {
+        ok = png_encode_write_segment_index(segments, count, writer->callback, writer->user_data);
+    }
+
+    uint8_t zlib_header[2];
+    png_encode_zlib_header(options, zlib_header);
+    ok = ok && png_idat_writer_append(writer, zlib_header, sizeof(zlib_header));
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (uint32_t i = 0; i < count && ok; i++) {
+        ok = png_idat_writer_append(writer, segments[i].data, segments[i].size);
+        adler = adler32_combine(adler, segments[i].adler, (z_off_t)segments[i].length);
+    }
+    if (ok) {
+        uint8_t trailer[4];
+        png_encode_put32(trailer, (uint32_t)adler);
+        ok = png_idat_writer_append(writer, trailer, sizeof(trailer));
+    }
+    return ok;
+}
+
+/**
+ * 分段并行滤波与压缩，按顺序拼接为一个 zlib 流写入 IDAT 块
+ *
+ * @return              是否写入成功，返回 1(真) 或 0(假)
+ */
+static int png_encode_idat_parallel(const PNG_Image* image, const PNG_EncodeOptions* options, uint32_t segment_rows,
+    PNG_IdatWriter* writer) {
+    const PNG_IHDR* header = &image->header;
+    uint32_t count = (uint32_t)(((uint64_t)header->height + segment_rows - 1) / segment_rows);
+    PNG_EncodeSegment* segments = (PNG_EncodeSegment*)calloc(count, sizeof(PNG_EncodeSegment));
+    if (!segments) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        segments[i].y_begin = i * segment_rows;
+        segments[i].y_end = header->height - segments[i].y_begin > segment_rows ?
+            segments[i].y_begin + segment_rows : header->height;
+    }
+
+    PNG_EncodeSegmentJob job = { image, options, segments, png_row_bytes(header, header->width) };
+    png_parallel_tasks(count, png_encode_segment_task, &job);
+
+    int ok = 1;
+    for (uint32_t i = 0; i < count; i++) {
+        ok = ok && segments[i].ok;
+    }
+    ok = ok && png_encode_write_segments(segments, count, options, writer);
+
+    for (uint32_t i = 0; i < count; i++) {
+        free(segments[i].data);
+    }
+    free(segments);
+    return ok;
+}
+
+/*
+ * 流式编码
+ *
+ * 调用者逐批提供扫描线：每行与上一行做滤波后追加到行带缓冲区，攒满约 PNG_ENCODE_BAND_BYTES 后交给 deflate，
+ * deflate 直接输出到 IDAT 块缓冲区，每满 idat_size 字节输出一个 IDAT 块。
+ * 编码器只保留上一行、行带缓冲区、IDAT 块缓冲区与 zlib 的压缩状态，内存占用与图像高度无关。
+ */
+struct PNG_Encoder {
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_line;
+    uint32_t rows_pushed;           // 已提交的行数
+    PNG_RowFilter filter;
+    uint8_t* prev_row;              // 上一批最后一行的副本
+    uint8_t* band;                  // 滤波后的行带
+    uint32_t band_rows;             // 行带容量（行）
+    uint32_t band_used;             // 行带中已有的行数
+    PNG_IdatWriter writer;
+    z_stream strm;
+    int stream_ready;
+    int failed;                     // 出错后拒绝后续调用
+    int finished;
+};
+
+/**
+ * 估算流式编码器占用的内存（行缓冲区、行带、IDAT 块缓冲区与 zlib 的压缩状态），与图像高度无关
+ *
+ * @param header        图像头信息
+ * @param options       编码选项，NULL 表示使用默认选项
+ *
+ * @return              所需字节数，参数非法时返回 UINT64_MAX
+ */
+uint64_t png_encoder_memory_size(const PNG_IHDR* header, const PNG_EncodeOptions* options) {
+    PNG_EncodeOptions defaults;
+    if (!options) {
+        png_encode_options_init(&defaults);
+        options = &defaults;
+    }
+    uint32_t bytes_per_line = header ? png_row_bytes(header, header->width) : 0;
+    if (bytes_per_line == 0 || !png_encode_options_valid(options)) {
+        return UINT64_MAX;
+    }
+
+    int strategy = png_encode_filter_strategy(header, options->filter);
+    uint32_t filtered_line = bytes_per_line + 1;
+    uint64_t size = (uint64_t)png_encode_band_rows(filtered_line, header->height, PNG_ENCODE_BAND_BYTES) * filtered_line;
+    size += 2 * (uint64_t)bytes_per_line;       // 上一行与首行使用的全零行
+    if (strategy == PNG_ENCODE_FILTER_MINSUM || strategy == PNG_ENCODE_FILTER_ENTROPY) {
+        size += (uint64_t)bytes_per_line * PNG_FILTER_COUNT;
+    }
+    size += (uint64_t)options->idat_size + PNG_ENCODE_CHUNK_OVERHEAD;
+    // zlib 文档给出的 deflate 内存用量：(1 << (windowBits + 2)) + (1 << (memLevel + 9)) 字节
+    size += ((uint64_t)1 << (MAX_WBITS + 2)) + ((uint64_t)1 << (options->mem_level + 9));
+    return size;
+}
+
+/**
+ * 释放流式编码器
+ *
+ * @param encoder       png_encoder_create 创建的编码器，可以为 NULL
+ */
+void png_encoder_destroy(PNG_Encoder* encoder) {
+    if (!encoder) {
+        return;
+    }
+    if (encoder->stream_ready) {
+        deflateEnd(&encoder->strm);
+    }
+    png_row_filter_free(&encoder->filter);
+    free(encoder->prev_row);
+    free(encoder->band);
+    free(encoder->writer.chunk);
+    free(encoder);
+}
+
+/**
+ * 创建流式编码器，并立即输出 PNG 签名与 IHDR、PLTE、tRNS 块
+ *
+ * 流式编码总是单线程压缩为一个连续的 deflate 流，输出非隔行图像
+ * （忽略 segment_bytes、segment_index、reduce、transparent、palette 与 interlace）。
+ *
+ * @param image         图像头、调色板与 tRNS（不使用 image_data），隔行图像写为非隔行
+ * @param options       编码选项，NULL 表示使用默认选项
+ * @param callback      输出回调
+ * @param user_data     传给回调的参数
+ *
+ * @return              编码器，参数非法、内存不足或输出失败时返回 NULL
+ */
+PNG_Encoder* png_encoder_create(const PNG_Image* image, const PNG_EncodeOptions* options, PNG_WriteCallback callback,
+    void* user_data) {
+    PNG_EncodeOptions defaults;
+    if (!options) {
+        png_encode_options_init(&defaults);
+        options = &defaults;
+    }
+    if (!image || !callback || !png_encode_options_valid(options)) {
+        return NULL;
+    }
+
+    PNG_Encoder* encoder = (PNG_Encoder*)calloc(1, sizeof(PNG_Encoder));
+    if (!encoder) {
+        return NULL;
+    }
+    encoder->width = image->header.width;
+    encoder->height = image->header.height;
+
+    if (!png_encode_write_header(image, PNG_INTERLACE_METHOD_NONE, callback, user_data)) {
+        goto fail;
+    }
+
+    encoder->bytes_per_line = png_row_bytes(&image->header, encoder->width);
+    uint32_t filtered_line = encoder->bytes_per_line + 1;
+    encoder->band_rows = png_encode_band_rows(filtered_line, encoder->height, PNG_ENCODE_BAND_BYTES);
+    if (!png_row_filter_init(&encoder->filter, &image->header, options->filter, encoder->bytes_per_line) ||
+        !png_idat_writer_init(&encoder->writer, options->idat_size, callback, user_data)) {
+        goto fail;
+    }
+    encoder->prev_row = (uint8_t*)malloc(encoder->bytes_per_line);
+    encoder->band = (uint8_t*)malloc((size_t)encoder->band_rows * filtered_line);
+    if (!encoder->prev_row || !encoder->band) {
+        goto fail;
+    }
+    if (deflateInit2(&encoder->strm, options->level, Z_DEFLATED, MAX_WBITS, options->mem_level,
+        options->strategy) != Z_OK) {
+        goto fail;
+    }
+    encoder->stream_ready = 1;
+    return encoder;
+
+fail:
+    png_encoder_destroy(encoder);
+    return NULL;
+}
+
+/**
+ * 压缩行带中已滤波的行
+ */
+static int png_encoder_flush_band(PNG_Encoder* encoder) {
+    // 行带最多约 PNG_ENCODE_BAND_BYTES 字节，单行时不超过 32 位
+    encoder->strm.next_in = encoder->band;
+    encoder->strm.avail_in = (uInt)((size_t)encoder->band_used * (encoder->bytes_per_line + 1));
+    encoder->band_used = 0;
+    int flush = encoder->rows_pushed == encoder->height ? Z_FINISH : Z_NO_FLUSH;
+    return png_idat_writer_deflate(&encoder->writer, &encoder->strm, flush);
+}
+
+/**
+ * 提交若干行扫描线
+ *
+ * @param encoder       流式编码器
+ * @param rows          第一行的起始地址，每行为 png_row_bytes 字节的原始样本（与 PNG_Image.image_data 的行相同）
+ * @param count         行数，累计不能超过图像高度
+ * @param stride        相邻两行起始地址的间距（字节）
+ *
+ * @return              是否成功，返回 1(真) 或 0(假)；失败后编码器只能销毁
+ */
+int png_encoder_push_rows(PNG_Encoder* encoder, const uint8_t* rows, uint32_t count, size_t stride) {
+    if (!encoder || encoder->failed) {
+        return 0;
+    }
+    if ((count > 0 && !rows) || count > encoder->height - encoder->rows_pushed) {
+        encoder->failed = 1;
+        return 0;
+    }
+
+    uint32_t filtered_line = encoder->bytes_per_line + 1;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* row = rows + (size_t)i * stride;
+        const uint8_t* prev_row = i > 0 ? row - stride : (encoder->rows_pushed > 0 ? encoder->prev_row : NULL);
+        png_row_filter_apply(&encoder->filter, row, prev_row, encoder->band + (size_t)encoder->band_used * filtered_line);
+        encoder->band_used++;
+        encoder->rows_pushed++;
+        if ((encoder->band_used == encoder->band_rows || encoder->rows_pushed == encoder->height) &&
+            !png_encoder_flush_band(encoder)) {
+            encoder->failed = 1;
+            return 0;
+        }
+    }
+
+    // 下一批的第一行与本批最后一行做滤波，调用者之后可以复用本批的缓冲区
+    if (count > 0 && encoder->rows_pushed < encoder->height) {
+        memcpy(encoder->prev_row, rows + (size_t)(count - 1) * stride, encoder->bytes_per_line);
+    }
+    return 1;
+}
+
+/**
+ * 结束编码：输出最后一个 IDAT 块与 IEND 块
+ *
+ * @param encoder       流式编码器，必须已提交全部行
+ *
+ * @return              是否成功，返回 1(真) 或 0(假)
+ */
+int png_encoder_finish(PNG_Encoder* encoder) {
+    if (!encoder || encoder->failed || encoder->finished || encoder->rows_pushed != encoder->height) {
+        return 0;
+    }
+
+    uint8_t iend[PNG_ENCODE_CHUNK_OVERHEAD];
+    encoder->finished = png_idat_writer_flush(&encoder->writer) &&
+        png_encode_emit_chunk(encoder->writer.callback, encoder->writer.user_data, iend, PNG_CHUNK_IEND, 0);
+    encoder->failed = !encoder->finished;
+    return encoder->finished;
+}
+
+/**
+ * 试压缩：按滤波策略滤波整幅图像，用调用者提供的 deflate 流压缩，只统计 zlib 流的字节数而不输出
+ *
+ * strm 由调用者用 deflateInit2（windowBits 为 MAX_WBITS）初始化，调用时须处于初始状态（刚初始化或 deflateReset 之后，
+ * 可以再用 deflateParams 修改压缩级别与策略），因此多次试压缩可以复用同一个流的内存。
+ * 压缩参数与滤波策略相同时，统计结果与 png_write_callback 单线程压缩写出的 IDAT 数据总长度相同。
+ *
+ * @param image         要压缩的图像（与解码器输出的格式相同）
+ * @param filter        滤波策略（PNG_FILTER_* 或 PNG_ENCODE_FILTER_*）
+ * @param strm          deflate 流
+ * @param cancel        取消令牌，每个行带检查一次，可以为 NULL
+ * @param size          输出参数，zlib 流的字节数
+ *
+ * @return              是否成功，返回 1(真) 或 0(假)；取消时返回 0
+ */
+int png_encode_deflate_size(const PNG_Image* image, int filter, z_stream* strm, const PNG_CancelToken* cancel,
+    uint64_t* size) {
+    uint8_t ihdr[13];
+    if (!image || !strm || !size || filter < PNG_FILTER_NONE || filter > PNG_ENCODE_FILTER_ENTROPY ||
+        !png_encode_header_valid(image, ihdr)) {
+        return 0;
+    }
+    const PNG_IHDR* header = &image->header;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    if (!image->image_data || image->image_data_size / bytes_per_line < header->height) {
+        return 0;
+    }
+
+    uint32_t filtered_line = bytes_per_line + 1;
+    uint32_t band_rows = png_encode_band_rows(filtered_line, header->height, PNG_ENCODE_BAND_BYTES);
+    PNG_RowFilter row_filter;
+    memset(&row_filter, 0, sizeof(row_filter));
+    uint8_t* band = (uint8_t*)malloc((size_t)band_rows * filtered_line);
+    uint8_t* out = (uint8_t*)malloc(PNG_ENCODE_DEFAULT_IDAT_SIZE);
+    int ok = band && out && png_row_filter_init(&row_filter, header, filter, bytes_per_line);
+
+    uint64_t total = 0;
+    for (uint32_t y = 0; ok && y < header->height; y += band_rows) {
+        if (png_cancel_requested(cancel)) {
+            ok = 0;
+            break;
+        }
+        uint32_t rows = header->height - y < band_rows ? header->height - y : band_rows;
+        png_row_filter_rows(&row_filter, image, y, rows, band);
+        strm->next_in = band;
+        strm->avail_in = (uInt)((size_t)rows * filtered_line);
+        int flush = y + rows == header->height ? Z_FINISH : Z_NO_FLUSH;
+        int status;
+        do {
+            strm->next_out = out;
+            strm->avail_out = PNG_ENCODE_DEFAULT_IDAT_SIZE;
+            status = deflate(strm, flush);
+            if (status == Z_STREAM_ERROR) {
+                ok = 0;
+                break;
+            }
+            total += PNG_ENCODE_DEFAULT_IDAT_SIZE - strm->avail_out;
+        } while (strm->avail_out == 0);
+        if (flush == Z_FINISH && status != Z_STREAM_END) {
+            ok = 0;
+        }
+    }
+
+    png_row_filter_free(&row_filter);
+    free(band);
+    free(out);
+    if (ok) {
+        *size = total;
+    }
+    return ok;
+}
+
+/*
+ * Adam7 隔行编码
+ *
+ * 七遍子图像依次取出、滤波并送入同一个 deflate 流。每遍相当于一幅独立的小图像：扫描线字节数按该遍的宽度计算，
+ * 每遍第一行的“上一行”是全零行，滤波策略与非隔行编码相同（逐行选择时在每遍的扫描线上各自选择）。
+ * 子图像的行由 png_adam7_gather_row 按像素字节数以定长步进复制取出，不生成整遍的子图像；
+ * 第 7 遍的列步长为 1，直接滤波原图像的行。
+ */
+
+/**
+ * 按 Adam7 顺序滤波并压缩整幅图像，输出到 IDAT
+ *
+ * @return              是否压缩成功，返回 1(真) 或 0(假)
+ */
+static int png_encode_idat_adam7(const PNG_Image* image, const PNG_EncodeOptions* options, PNG_IdatWriter* writer) {
+    const PNG_IHDR* header = &image->header;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+
+    // 最后一个非空的遍以 Z_FINISH 结束（第 1 遍总是非空）
+    int last_pass = 0;
+    for (int pass = 1; pass < PNG_ADAM7_PASSES; pass++) {
+        uint32_t pass_width, pass_height;
+        png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+        if (pass_width > 0) {
+            last_pass = pass;
+        }
+    }
+
+    // 行带最多约 PNG_ENCODE_BAND_BYTES 字节，至少一行
+    size_t band_bytes = (size_t)bytes_per_line + 1 > PNG_ENCODE_BAND_BYTES ?
+        (size_t)bytes_per_line + 1 : PNG_ENCODE_BAND_BYTES;
+    uint8_t* band = (uint8_t*)malloc(band_bytes);
+    uint8_t* rows = (uint8_t*)malloc((size_t)bytes_per_line * 2);  // 交替存放当前与上一条子图像扫描线
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (!band || !rows || deflateInit2(&strm, options->level, Z_DEFLATED, MAX_WBITS, options->mem_level,
+        options->strategy) != Z_OK) {
+        free(band);
+        free(rows);
+        return 0;
+    }
+
+    int ok = 1;
+    for (int pass = 0; ok && pass <= last_pass; pass++) {
+        uint32_t pass_width, pass_height;
+        png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+        if (pass_width == 0) {
+            continue;
+        }
+        const PNG_Adam7Pass* p = &png_adam7_passes[pass];
+        uint32_t pass_bytes = png_row_bytes(header, pass_width);
+        uint32_t filtered_line = pass_bytes + 1;
+        uint32_t band_rows = png_encode_band_rows(filtered_line, pass_height, PNG_ENCODE_BAND_BYTES);
+        PNG_RowFilter filter;
+        if (!png_row_filter_init(&filter, header, options->filter, pass_bytes)) {
+            ok = 0;
+            break;
+        }
+
+        const uint8_t* prev_row = NULL;
+        for (uint32_t r = 0; ok && r < pass_height; r += band_rows) {
+            uint32_t count = pass_height - r < band_rows ? pass_height - r : band_rows;
+            for (uint32_t i = 0; i < count; i++) {
+                const uint8_t* src_row = image->image_data + (size_t)(p->y0 + (r + i) * p->dy) * bytes_per_line;
+                const uint8_t* row = src_row;
+                if (p->dx > 1) {
+                    uint8_t* gathered = rows + (size_t)((r + i) & 1) * bytes_per_line;
+                    png_adam7_gather_row(header, pass, src_row, gathered, pass_width);
+                    row = gathered;
+                }
+                png_row_filter_apply(&filter, row, prev_row, band + (size_t)i * filtered_line);
+                prev_row = row;
+            }
+            strm.next_in = band;
+            strm.avail_in = (uInt)((size_t)count * filtered_line);
+            int flush = pass == last_pass && r + count == pass_height ? Z_FINISH : Z_NO_FLUSH;
+            ok = png_idat_writer_deflate(writer, &strm, flush);
+        }
+        png_row_filter_free(&filter);
+    }
+
+    deflateEnd(&strm);
+    free(band);
+    free(rows);
+    return ok;
+}
+
+/**
+ * 编码 PNG 图像，按顺序把文件内容交给输出回调
+ *
+ * 设置了 segment_bytes 且图像多于一段时分段并行压缩，否则与流式编码相同；Adam7 隔行输出总是单线程压缩。
+ *
+ * @param image         要编码的图像（与解码器输出的格式相同），隔行方式由 options->interlace 决定
+ * @param options       编码选项，NULL 表示使用默认选项
+ * @param callback      输出回调
+ * @param user_data     传给回调的参数
+ *
+ * @return              是否编码成功，返回 1(真) 或 0(假)
+ */
+int png_write_callback(const PNG_Image* image, const PNG_EncodeOptions* options, PNG_WriteCallback callback,
+    void* user_data) {
+    PNG_EncodeOptions defaults;
+    if (!options) {
+        png_encode_options_init(&defaults);
+        options = &defaults;
+    }
+    if (!image || !callback || !png_encode_options_valid(options)) {
+        return 0;
+    }
+
+    const PNG_IHDR* header = &image->header;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    if (bytes_per_line == 0 || !image->image_data || image->image_data_size / bytes_per_line < header->height) {
+        return 0;
+    }
+
+    // 先清理完全透明像素的颜色（可能让图像缩减为更少的颜色），再缩减
+    PNG_Image cleaned;
+    if (options->transparent != PNG_CLEAN_NONE && png_clean_transparent(image, options->transparent, &cleaned)) {
+        PNG_EncodeOptions plain = *options;
+        plain.transparent = PNG_CLEAN_NONE;
+        int ok = png_write_callback(&cleaned, &plain, callback, user_data);
+        png_free_image(&cleaned);
+        return ok;
+    }
+
+    // 换成最小的无损表示（不透明的 RGBA 写为 RGB、灰度写为低位深灰度、不超过 256 色写为调色板等）
+    PNG_Image reduced;
+    if (options->reduce && png_reduce_image(image, &reduced)) {
+        PNG_EncodeOptions plain = *options;
+        plain.reduce = 0;
+        int ok = png_write_callback(&reduced, &plain, callback, user_data);
+        png_free_image(&reduced);
+        return ok;
+    }
+
+    // 调色板图像重排调色板（透明的颜色在前，删除未使用的颜色），自动选择时可能同时改用逐行选择滤波
+    if (options->palette != PNG_ENCODE_PALETTE_KEEP && header->color_type == PNG_COLOR_TYPE_PALETTE) {
+        PNG_EncodeOptions plain = *options;
+        plain.palette = PNG_ENCODE_PALETTE_KEEP;
+        PNG_Image sorted;
+        int has_sorted = png_palette_sort(image, options, &sorted, &plain.filter);
+        int ok = png_write_callback(has_sorted ? &sorted : image, &plain, callback, user_data);
+        if (has_sorted) {
+            png_free_image(&sorted);
+        }
+        return ok;
+    }
+
+    // 每段的压缩输出须能用 32 位长度表示（zlib 的 avail_out），单行过大时退回单线程压缩
+    int interlaced = options->interlace == PNG_INTERLACE_METHOD_ADAM7;
+    uint32_t filtered_line = bytes_per_line + 1;
+    uint32_t segment_rows = options->segment_bytes ?
+        png_encode_band_rows(filtered_line, header->height, options->segment_bytes) : header->height;
+    if (!interlaced &&
+        (segment_rows >= header->height || (uint64_t)segment_rows * filtered_line >= UINT32_MAX / 2)) {
+        PNG_Encoder* encoder = png_encoder_create(image, options, callback, user_data);
+        int ok = encoder && png_encoder_push_rows(encoder, image->image_data, header->height, bytes_per_line) &&
+            png_encoder_finish(encoder);
+        png_encoder_destroy(encoder);
+        return ok;
+    }
+
+    PNG_IdatWriter writer;
+    if (!png_encode_write_header(image, options->interlace, callback, user_data) ||
+        !png_idat_writer_init(&writer, options->idat_size, callback, user_data)) {
+        return 0;
+    }
+    uint8_t iend[PNG_ENCODE_CHUNK_OVERHEAD];
+    int ok = (interlaced ? png_encode_idat_adam7(image, options, &writer) :
+        png_encode_idat_parallel(image, options, segment_rows, &writer)) && png_idat_writer_flush(&writer) &&
+        png_encode_emit_chunk(callback, user_data, iend, PNG_CHUNK_IEND, 0);
+    free(writer.chunk);
+    return ok;
+}
+
+// 内存输出缓冲区
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} PNG_EncodeBuffer;
+
+static int png_encode_buffer_write(void* user_data, const uint8_t* data, size_t size) {
+    PNG_EncodeBuffer* buffer = (PNG_EncodeBuffer*)user_data;
+    if (size > buffer->capacity - buffer->size) {
+        size_t capacity = buffer->capacity ? buffer->capacity : PNG_ENCODE_DEFAULT_IDAT_SIZE;
+        while (capacity - buffer->size < size) {
+            if (capacity > SIZE_MAX / 2) {
+                return 0;
+            }
+            capacity *= 2;
+        }
+        uint8_t* grown = (uint8_t*)realloc(buffer->data, capacity);
+        if (!grown) {
+            return 0;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+/**
+ * 把 PNG 图像编码到内存
+ *
+ * @param image         要编码的图像
+ * @param options       编码选项，NULL 表示使用默认选项
+ * @param output        输出参数，编码结果（由调用者 free）
+ * @param output_size   输出参数，编码结果字节数
+ *
+ * @return              是否编码成功，返回 1(真) 或 0(假)
+ */
+int png_write_memory(const PNG_Image* image, const PNG_EncodeOptions* options, uint8_t** output, size_t* output_size) {
+    if (!output || !output_size) {
+        return 0;
+    }
+
+    PNG_EncodeBuffer buffer = { NULL, 0, 0 };
+    if (!png_write_callback(image, options, png_encode_buffer_write, &buffer)) {
+        free(buffer.data);
+        return 0;
+    }
+
+    // 释放多余的容量
+    uint8_t* shrunk = (uint8_t*)realloc(buffer.data, buffer.size);
+    *output = shrunk ? shrunk : buffer.data;
+    *output_size = buffer.size;
+    return 1;
+}
+
+static int png_encode_file_write(void* user_data, const uint8_t* data, size_t size) {
+    return fwrite(data, 1, size, (FILE*)user_data) == size;
+}
+
+/**
+ * 把 PNG 图像编码到文件
+ *
+ * 先写入唯一命名的临时文件（png_file_create_temp），成功后再替换目标文件并保留其权限位，中途失败时原文件保持不变。
+ *
+ * @param filename      输出文件路径
+ * @param image         要编码的图像
+ * @param options       编码选项，NULL 表示使用默认选项
+ *
+ * @return              是否编码成功，返回 1(真) 或 0(假)
+ */
+int png_write_file(const char* filename, const PNG_Image* image, const PNG_EncodeOptions* options) {
+    if (!filename) {
+        return 0;
+    }
+
+    char* temp_path = NULL;
+    FILE* file = png_file_create_temp(filename, &temp_path);
+    if (!file) {
+        return 0;
+    }
+    int ok = png_write_callback(image, options, png_encode_file_write, file);
+    ok = png_file_commit_temp(file, temp_path, filename, ok);
+    free(temp_path);
+    return ok;
+}
+
+/*
+ * 可局部重新编码的编码器
+ *
+ * 图像每 restart_rows 行为一段，各段独立滤波并压缩为不带字典的原始 deflate 数据（段边界相当于 Z_FULL_FLUSH 重启点：
+ * 字节对齐且不引用之前的数据），编码器保留每段的压缩数据、Adler-32 与在 zlib 流中的位置。编辑后只需标记修改过的行，
+ * 保存时只重新滤波与压缩受影响的段（含修改行的段，以及上一段末行被修改的段，其首行的滤波依赖上一行），
+ * 其余各段的压缩数据原样拼接，Adler-32 由各段的校验和合并得到，保存耗时与修改范围成正比而与图像大小无关。
+ */
+
+struct PNG_RestartEncoder {
+    PNG_IHDR header;
+    PNG_EncodeOptions options;      // segment_index 固定为 1（各段不使用字典）
+    int write_index;                // 是否写入分段索引块 zsEG
+    uint32_t bytes_per_line;
+    uint32_t restart_rows;
+    uint32_t count;
+    PNG_EncodeSegment* segments;
+    uint8_t* dirty;                 // 每段是否需要重新压缩
+};
+
+/**
+ * 释放可局部重新编码的编码器
+ *
+ * @param encoder       png_restart_encoder_create 创建的编码器，可以为 NULL
+ */
+void png_restart_encoder_destroy(PNG_RestartEncoder* encoder) {
+    if (!encoder) {
+        return;
+    }
+    for (uint32_t i = 0; encoder->segments && i < encoder->count; i++) {
+        free(encoder->segments[i].data);
+    }
+    free(encoder->segments);
+    free(encoder->dirty);
+    free(encoder);
+}
+
+/**
+ * 检查图像与编码器记录的图像头是否一致（尺寸、颜色类型与位深）
+ */
+static int png_restart_encoder_matches(const PNG_RestartEncoder* encoder, const PNG_Image* image) {
+    const PNG_IHDR* header = &image->header;
+    return header->width == encoder->header.width && header->height == encoder->header.height &&
+        header->color_type == encoder->header.color_type && header->bit_depth == encoder->header.bit_depth &&
+        image->image_data && image->image_data_size / encoder->bytes_per_line >= header->height;
+}
+
+/**
+ * 重新压缩所有标记为需要更新的段（在线程池上并行），成功后替换各段的压缩数据
+ *
+ * @return              是否成功，返回 1(真) 或 0(假)；失败时保留原数据与标记
+ */
+static int png_restart_encoder_refresh(PNG_RestartEncoder* encoder, const PNG_Image* image, uint32_t* refreshed) {
+    uint32_t dirty = 0;
+    for (uint32_t i = 0; i < encoder->count; i++) {
+        dirty += encoder->dirty[i];
+    }
+    if (refreshed) {
+        *refreshed = dirty;
+    }
+    if (dirty == 0) {
+        return 1;
+    }
+
+    PNG_EncodeSegment* segments = (PNG_EncodeSegment*)calloc(dirty, sizeof(PNG_EncodeSegment));
+    if (!segments) {
+        return 0;
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < encoder->count; i++) {
+        if (encoder->dirty[i]) {
+            segments[n].y_begin = encoder->segments[i].y_begin;
+            segments[n].y_end = encoder->segments[i].y_end;
+            n++;
+        }
+    }
+
+    PNG_EncodeSegmentJob job = { image, &encoder->options, segments, encoder->bytes_per_line };
+    png_parallel_tasks(dirty, png_encode_segment_task, &job);
+    int ok = 1;
+    for (uint32_t i = 0; i < dirty; i++) {
+        ok = ok && segments[i].ok;
+    }
+
+    n = 0;
+    for (uint32_t i = 0; i < encoder->count && ok; i++) {
+        if (encoder->dirty[i]) {
+            free(encoder->segments[i].data);
+            encoder->segments[i] = segments[n];
+            segments[n].data = NULL;
+            encoder->dirty[i] = 0;
+            n++;
+        }
+    }
+    for (uint32_t i = 0; i < dirty; i++) {
+        free(segments[i].data);
+    }
+    free(segments);
+    return ok;
+}
+
+/**
+ * 创建可局部重新编码的编码器，并立即压缩整幅图像的所有段（在线程池上并行）
+ *
+ * 编码器不保存图像本身，只保存各段的压缩数据；保存时由调用者传入修改后的图像。reduce、transparent、palette、
+ * interlace 与 segment_bytes 被忽略（这些选项会改变整幅图像的表示或分段方式），segment_index 表示是否写入分段索引块 zsEG。
+ *
+ * @param image         要编码的图像（与解码器输出的格式相同），隔行图像写为非隔行
+ * @param options       编码选项，NULL 表示使用默认选项
+ * @param restart_rows  每段的行数，0 表示按 PNG_ENCODE_RESTART_BYTES 字节的滤波后数据计算
+ *
+ * @return              编码器（由调用者 png_restart_encoder_destroy），失败时返回 NULL
+ */
+PNG_RestartEncoder* png_restart_encoder_create(const PNG_Image* image, const PNG_EncodeOptions* options,
+    uint32_t restart_rows) {
+    PNG_EncodeOptions defaults;
+    if (!options) {
+        png_encode_options_init(&defaults);
+        options = &defaults;
+    }
+    uint8_t ihdr[13];
+    if (!image || !png_encode_options_valid(options) || !png_encode_header_valid(image, ihdr)) {
+        return NULL;
+    }
+    const PNG_IHDR* header = &image->header;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    uint32_t filtered_line = bytes_per_line + 1;
+    if (restart_rows == 0) {
+        restart_rows = png_encode_band_rows(filtered_line, header->height, PNG_ENCODE_RESTART_BYTES);
+    }
+    if (restart_rows > header->height) {
+        restart_rows = header->height;
+    }
+    // 每段的压缩输出须能用 32 位长度表示（zlib 的 avail_out）
+    if ((uint64_t)restart_rows * filtered_line >= UINT32_MAX / 2) {
+        return NULL;
+    }
+
+    PNG_RestartEncoder* encoder = (PNG_RestartEncoder*)calloc(1, sizeof(PNG_RestartEncoder));
+    if (!encoder) {
+        return NULL;
+    }
+    encoder->header = *header;
+    encoder->options = *options;
+    encoder->options.segment_index = 1;
+    encoder->write_index = options->segment_index;
+    encoder->bytes_per_line = bytes_per_line;
+    encoder->restart_rows = restart_rows;
+    encoder->count = (uint32_t)(((uint64_t)header->height + restart_rows - 1) / restart_rows);
+    encoder->segments = (PNG_EncodeSegment*)calloc(encoder->count, sizeof(PNG_EncodeSegment));
+    encoder->dirty = (uint8_t*)malloc(encoder->count);
+    if (!encoder->segments || !encoder->dirty || !png_restart_encoder_matches(encoder, image)) {
+        png_restart_encoder_destroy(encoder);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < encoder->count; i++) {
+        encoder->segments[i].y_begin = i * restart_rows;
+        encoder->segments[i].y_end = header->height - encoder->segments[i].y_begin > restart_rows ?
+            encoder->segments[i].y_begin + restart_rows : header->height;
+        encoder->dirty[i] = 1;
+    }
+
+    if (!png_restart_encoder_refresh(encoder, image, NULL)) {
+        png_restart_encoder_destroy(encoder);
+        return NULL;
+    }
+    return encoder;
+}
+
+/**
+ * 查询编码器的分段方式
+ *
+ * @param encoder       编码器
+ * @param restart_rows  输出参数，每段的行数，可以为 NULL
+ *
+ * @return              段数
+ */
+uint32_t png_restart_encoder_segments(const PNG_RestartEncoder* encoder, uint32_t* restart_rows) {
+    if (restart_rows) {
+        *restart_rows = encoder ? encoder->restart_rows : 0;
+    }
+    return encoder ? encoder->count : 0;
+}
+
+/**
+ * 标记修改过的行，下次保存时重新压缩受影响的段
+ *
+ * @param encoder       编码器
+ * @param y             第一个修改过的行
+ * @param rows          修改过的行数（超出图像的部分忽略）
+ */
+void png_restart_encoder_invalidate(PNG_RestartEncoder* encoder, uint32_t y, uint32_t rows) {
+    if (!encoder || rows == 0 || y >= encoder->header.height) {
+        return;
+    }
+    uint32_t last = encoder->header.height - y > rows ? y + rows - 1 : encoder->header.height - 1;
+    uint32_t first_segment = y / encoder->restart_rows;
+    uint32_t last_segment = last / encoder->restart_rows;
+    for (uint32_t i = first_segment; i <= last_segment; i++) {
+        encoder->dirty[i] = 1;
+    }
+    // 段的末行改变时，下一段首行的滤波结果也随之改变
+    if ((last + 1) % encoder->restart_rows == 0 && last_segment + 1 < encoder->count) {
+        encoder->dirty[last_segment + 1] = 1;
+    }
+}
+
+/**
+ * 输出 PNG 文件：先重新压缩标记过的段，再把所有段的压缩数据拼接为 IDAT
+ *
+ * @param encoder       编码器
+ * @param image         当前的图像，尺寸、颜色类型与位深须与创建时相同（调色板与 tRNS 取自该图像）
+ * @param callback      输出回调
+ * @param user_data     传给回调的参数
+ * @param refreshed     输出参数，本次重新压缩的段数，可以为 NULL
+ *
+ * @return              是否输出成功，返回 1(真) 或 0(假)
+ */
+int png_restart_encoder_write(PNG_RestartEncoder* encoder, const PNG_Image* image, PNG_WriteCallback callback,
+    void* user_data, uint32_t* refreshed) {
+    if (refreshed) {
+        *refreshed = 0;
+    }
+    uint8_t ihdr[13];
+    if (!encoder || !image || !callback || !png_restart_encoder_matches(encoder, image) ||
+        !png_encode_header_valid(image, ihdr) || !png_restart_encoder_refresh(encoder, image, refreshed)) {
+        return 0;
+    }
+
+    PNG_IdatWriter writer;
+    if (!png_encode_write_header(image, PNG_INTERLACE_METHOD_NONE, callback, user_data) ||
+        !png_idat_writer_init(&writer, encoder->options.idat_size, callback, user_data)) {
+        return 0;
+    }
+    PNG_EncodeOptions options = encoder->options;
+    options.segment_index = encoder->write_index;
+    uint8_t iend[PNG_ENCODE_CHUNK_OVERHEAD];
+    int ok = png_encode_write_segments(encoder->segments, encoder->count, &options, &writer) &&
+        png_idat_writer_flush(&writer) && png_encode_emit_chunk(callback, user_data, iend, PNG_CHUNK_IEND, 0);
+    free(writer.chunk);
+    return ok;
+}
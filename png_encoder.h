@@ -0,0 +1,97 @@
+#ifndef PNG_ENCODER_H
+#define PNG_ENCODER_H
+
+#include "png_decoder.h"
+#include "png_filter.h"
+#include "png_reduce.h"
+#include <zlib.h>
+
+// 扫描线滤波策略：0 ~ 4 表示每行都使用同一种滤波类型（PNG_FILTER_*）
+#define PNG_ENCODE_FILTER_AUTO 5        // 调色板与位深小于 8 的图像不滤波，其余图像按 PNG_ENCODE_FILTER_MINSUM 逐行选择
+#define PNG_ENCODE_FILTER_MINSUM 6      // 逐行选择滤波结果绝对值之和（字节视为有符号数）最小的滤波类型
+#define PNG_ENCODE_FILTER_ENTROPY 7     // 逐行选择滤波结果零阶熵估算最小的滤波类型（压缩率通常更高，略慢）
+
+// 调色板排序方式：透明的颜色总是排在最前面（tRNS 最短），未使用的颜色被删除
+#define PNG_ENCODE_PALETTE_KEEP 0       // 保留原顺序
+#define PNG_ENCODE_PALETTE_LUMA 1       // 按亮度从暗到亮
+#define PNG_ENCODE_PALETTE_FREQUENCY 2  // 按使用次数从多到少
+#define PNG_ENCODE_PALETTE_NEAREST 3    // 从最常用的颜色出发，每次取距离最近的未访问颜色
+#define PNG_ENCODE_PALETTE_AUTO 4       // 抽样试压缩以上各种顺序（含原顺序）选出最小的，滤波策略为 AUTO 时一并选择是否滤波
+
+// 默认选项
+#define PNG_ENCODE_DEFAULT_LEVEL 6
+#define PNG_ENCODE_DEFAULT_MEM_LEVEL 8
+#define PNG_ENCODE_DEFAULT_IDAT_SIZE (64 * 1024)
+
+// 快速预设：Up 滤波 + 压缩级别 1，IDAT 块取 1MB
+#define PNG_ENCODE_FAST_IDAT_SIZE (1024 * 1024)
+
+// 每次交给 zlib 压缩的滤波后数据量（至少一行）
+#define PNG_ENCODE_BAND_BYTES (256 * 1024)
+
+// 并行压缩时每段的滤波后数据量（快速预设使用）
+#define PNG_ENCODE_SEGMENT_BYTES (1024 * 1024)
+
+// 可局部重新编码时每段的滤波后数据量（段越小，局部修改后需要重新压缩的数据越少，压缩率略有下降）
+#define PNG_ENCODE_RESTART_BYTES (256 * 1024)
+
+// 分段索引块（私有辅助块，IDAT 改变后失效，不可安全复制）
+#define PNG_CHUNK_zsEG 0x7A734547
+
+/**
+ * 编码选项
+ */
+typedef struct {
+    int level;                      // zlib 压缩级别（0 ~ 9）
+    int strategy;                   // zlib 压缩策略（Z_DEFAULT_STRATEGY、Z_FILTERED、Z_RLE 等）
+    int mem_level;                  // zlib 内存级别（1 ~ 9）
+    int filter;                     // 滤波策略（PNG_FILTER_* 或 PNG_ENCODE_FILTER_AUTO）
+    uint32_t idat_size;             // 每个 IDAT 块的最大数据长度
+    uint32_t segment_bytes;         // 并行压缩时每段的滤波后数据量，0 表示单线程压缩为一个连续的 deflate 流
+    int segment_index;              // 并行压缩时是否写入分段索引块 zsEG（各段不使用预设字典，可以独立解压）
+    int reduce;                     // 是否先把图像无损缩减为最小的颜色类型与位深（只对整幅图像编码生效）
+    int transparent;                // 完全透明像素的颜色清理方式（PNG_CLEAN_*，默认不清理；只对整幅图像编码生效）
+    int palette;                    // 调色板图像的调色板排序方式（PNG_ENCODE_PALETTE_*，默认自动选择；只对整幅图像编码生效）
+    int interlace;                  // 隔行方式（PNG_INTERLACE_METHOD_NONE 或 ADAM7，默认非隔行；只对整幅图像编码生效）
+} PNG_EncodeOptions;
+
+/**
+ * 编码输出回调，按顺序接收 PNG 文件的全部字节
+ *
+ * @param user_data     调用编码函数时传入的参数
+ * @param data          本次输出的数据
+ * @param size          数据长度
+ *
+ * @return              是否写入成功，返回 1(真) 或 0(假)；返回 0 时编码立即失败
+ */
+typedef int (*PNG_WriteCallback)(void* user_data, const uint8_t* data, size_t size);
+
+// 流式编码器：逐批提交扫描线，内存占用与图像高度无关
+typedef struct PNG_Encoder PNG_Encoder;
+
+// 可局部重新编码的编码器：保留每段的压缩数据，局部修改后只重新压缩受影响的段
+typedef struct PNG_RestartEncoder PNG_RestartEncoder;
+
+void png_encode_options_init(PNG_EncodeOptions* options);
+void png_encode_options_fast(PNG_EncodeOptions* options);
+int png_write_callback(const PNG_Image* image, const PNG_EncodeOptions* options, PNG_WriteCallback callback,
+    void* user_data);
+int png_write_memory(const PNG_Image* image, const PNG_EncodeOptions* options, uint8_t** output, size_t* output_size);
+int png_write_file(const char* filename, const PNG_Image* image, const PNG_EncodeOptions* options);
+uint64_t png_encoder_memory_size(const PNG_IHDR* header, const PNG_EncodeOptions* options);
+PNG_Encoder* png_encoder_create(const PNG_Image* image, const PNG_EncodeOptions* options, PNG_WriteCallback callback,
+    void* user_data);
+int png_encoder_push_rows(PNG_Encoder* encoder, const uint8_t* rows, uint32_t count, size_t stride);
+int png_encoder_finish(PNG_Encoder* encoder);
+void png_encoder_destroy(PNG_Encoder* encoder);
+int png_encode_deflate_size(const PNG_Image* image, int filter, z_stream* strm, const PNG_CancelToken* cancel,
+    uint64_t* size);
+PNG_RestartEncoder* png_restart_encoder_create(const PNG_Image* image, const PNG_EncodeOptions* options,
+    uint32_t restart_rows);
+uint32_t png_restart_encoder_segments(const PNG_RestartEncoder* encoder, uint32_t* restart_rows);
+void png_restart_encoder_invalidate(PNG_RestartEncoder* encoder, uint32_t y, uint32_t rows);
+int png_restart_encoder_write(PNG_RestartEncoder* encoder, const PNG_Image* image, PNG_WriteCallback callback,
+    void* user_data, uint32_t* refreshed);
+void png_restart_encoder_destroy(PNG_RestartEncoder* encoder);
+
+#endif // PNG_ENCODER_H
@@ -0,0 +1,116 @@
+#include "png_file.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/*
+ * 先写临时文件再替换
+ *
+ * 输出文件先写入同一目录下的临时文件 "<路径>.<进程号>-<序号>.tmp"，写完后再改名替换目标文件，中途失败时目标文件保持不变。
+ * 临时文件名由进程号与进程内递增的序号组成，并以独占方式（"wbx"）创建：不会截断恰好同名的已有文件，
+ * 同时保存同一目标的多个线程或进程各写各的临时文件，最后一次替换生效。
+ */
+
+// 临时文件序号，与进程号一起保证各线程 / 进程使用不同的临时文件
+static atomic_uint png_file_temp_counter;
+
+/**
+ * 在目标文件旁以独占方式创建唯一命名的临时文件
+ *
+ * @param path          目标文件路径
+ * @param temp_path     输出：临时文件路径，由调用方 free 释放；失败时为 NULL
+ *
+ * @return              以 "wb" 方式打开的临时文件，失败时返回 NULL
+ */
+FILE* png_file_create_temp(const char* path, char** temp_path) {
+    *temp_path = NULL;
+    if (!path) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    size_t size = strlen(path) + 48;
+    char* name = (char*)malloc(size);
+    if (!name) {
+        return NULL;
+    }
+
+    for (int attempt = 0; attempt < PNG_FILE_TEMP_ATTEMPTS; attempt++) {
+        unsigned int serial = atomic_fetch_add(&png_file_temp_counter, 1);
+        snprintf(name, size, "%s.%lu-%u.tmp", path, pid, serial);
+        errno = 0;
+        FILE* file = fopen(name, "wbx");
+        if (file) {
+            *temp_path = name;
+            return file;
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+        // 残留的同名临时文件（例如进程号被复用），换一个序号
+    }
+    free(name);
+    return NULL;
+}
+
+/**
+ * 把目标文件原有的权限位复制到临时文件，替换后文件权限保持不变（目标不存在时保留新建文件的默认权限）
+ *
+ * Windows 上没有对应的权限位，直接返回成功。
+ */
+static int png_file_copy_mode(const char* temp_path, const char* path) {
+#ifdef _WIN32
+    (void)temp_path;
+    (void)path;
+    return 1;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return errno == ENOENT;
+    }
+    return chmod(temp_path, st.st_mode & 07777) == 0;
+#endif
+}
+
+/**
+ * 用新文件替换目标文件（目标已存在时覆盖）
+ */
+static int png_file_replace(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+/**
+ * 关闭 png_file_create_temp 创建的临时文件，写入成功时替换目标文件，否则删除临时文件
+ *
+ * @param file          png_file_create_temp 返回的文件
+ * @param temp_path     png_file_create_temp 返回的临时文件路径
+ * @param path          目标文件路径
+ * @param ok            临时文件是否已完整写入
+ *
+ * @return              是否替换成功，返回 1(真) 或 0(假)；失败时目标文件保持不变
+ */
+int png_file_commit_temp(FILE* file, const char* temp_path, const char* path, int ok) {
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    ok = ok && png_file_copy_mode(temp_path, path) && png_file_replace(temp_path, path);
+    if (!ok) {
+        remove(temp_path);
+    }
+    return ok;
+}
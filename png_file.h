@@ -0,0 +1,12 @@
+#ifndef PNG_FILE_H
+#define PNG_FILE_H
+
+#include <stdio.h>
+
+// 临时文件名冲突（EEXIST）时换一个序号重试的次数
+#define PNG_FILE_TEMP_ATTEMPTS 16
+
+FILE* png_file_create_temp(const char* path, char** temp_path);
+int png_file_commit_temp(FILE* file, const char* temp_path, const char* path, int ok);
+
+#endif // PNG_FILE_H
@@ -0,0 +1,314 @@
+#include "png_filter.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PNG_FILTER_SSE2 1
+#endif
+
+/**
+ * Paeth 预测器：在左、上、左上三个相邻字节中选出与 left + above - upper_left 最接近的一个
+ */
+static inline uint8_t png_paeth_predictor(uint8_t left, uint8_t above, uint8_t upper_left) {
+    int p = left + above - upper_left;
+    int pa = abs(p - left);
+    int pb = abs(p - above);
+    int pc = abs(p - upper_left);
+
+    if (pa <= pb && pa <= pc) {
+        return left;
+    } else if (pb <= pc) {
+        return above;
+    }
+    return upper_left;
+}
+
+/**
+ * 原地还原一条经过滤波的扫描线
+ *
+ * 每种滤波类型各用一个独立的循环，避免在逐字节循环里分支；
+ * 首个像素没有左侧邻居，单独处理后主循环不再需要边界判断。
+ *
+ * @param filter_type       扫描线首字节记录的滤波类型（0 ~ 4）
+ * @param row               待还原的扫描线（不含滤波类型字节），还原结果直接写回
+ * @param prev_row          已还原的上一条扫描线，首行传入全零缓冲区
+ * @param row_bytes         扫描线字节数
+ * @param bytes_per_pixel   每像素字节数（位深小于 8 时为 1）
+ *
+ * @return      是否还原成功（滤波类型合法），返回 1(真) 或 0(假)
+ */
+int png_unfilter_row(uint8_t filter_type, uint8_t* row, const uint8_t* prev_row, uint32_t row_bytes, uint32_t bytes_per_pixel) {
+    uint32_t bpp = bytes_per_pixel < row_bytes ? bytes_per_pixel : row_bytes;
+
+    switch (filter_type) {
+        // None
+        case PNG_FILTER_NONE:
+            break;
+
+        // Sub
+        case PNG_FILTER_SUB:
+            for (uint32_t x = bpp; x < row_bytes; x++) {
+                row[x] += row[x - bpp];
+            }
+            break;
+
+        // Up
+        case PNG_FILTER_UP:
+            for (uint32_t x = 0; x < row_bytes; x++) {
+                row[x] += prev_row[x];
+            }
+            break;
+
+        // Average
+        case PNG_FILTER_AVERAGE:
+            for (uint32_t x = 0; x < bpp; x++) {
+                row[x] += prev_row[x] >> 1;
+            }
+            for (uint32_t x = bpp; x < row_bytes; x++) {
+                row[x] += (uint8_t)((row[x - bpp] + prev_row[x]) >> 1);
+            }
+            break;
+
+        // Paeth
+        case PNG_FILTER_PAETH:
+            // 首个像素的左侧与左上均视为 0，预测值退化为上方字节
+            for (uint32_t x = 0; x < bpp; x++) {
+                row[x] += prev_row[x];
+            }
+            for (uint32_t x = bpp; x < row_bytes; x++) {
+                row[x] += png_paeth_predictor(row[x - bpp], prev_row[x], prev_row[x - bpp]);
+            }
+            break;
+
+        default:
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * 对一条扫描线做滤波（编码时使用，png_unfilter_row 的逆运算）
+ *
+ * 滤波只读取原始字节，逐字节之间没有依赖，各循环都可以被编译器向量化。
+ *
+ * @param filter_type       滤波类型（0 ~ 4）
+ * @param row               原始扫描线（不含滤波类型字节）
+ * @param prev_row          上一条原始扫描线，首行传入全零缓冲区
+ * @param row_bytes         扫描线字节数
+ * @param bytes_per_pixel   每像素字节数（位深小于 8 时为 1）
+ * @param out               输出滤波后的扫描线（不含滤波类型字节），不能与 row 重叠
+ *
+ * @return      是否滤波成功（滤波类型合法），返回 1(真) 或 0(假)
+ */
+int png_filter_row(uint8_t filter_type, const uint8_t* row, const uint8_t* prev_row, uint32_t row_bytes,
+    uint32_t bytes_per_pixel, uint8_t* out) {
+    uint32_t bpp = bytes_per_pixel < row_bytes ? bytes_per_pixel : row_bytes;
+
+    switch (filter_type) {
+        // None
+        case PNG_FILTER_NONE:
+            memcpy(out, row, row_bytes);
+            break;
+
+        // Sub
+        case PNG_FILTER_SUB:
+            memcpy(out, row, bpp);
+            for (uint32_t x = bpp; x < row_bytes; x++) {
+                out[x] = (uint8_t)(row[x] - row[x - bpp]);
+            }
+            break;
+
+        // Up
+        case PNG_FILTER_UP:
+            for (uint32_t x = 0; x < row_bytes; x++) {
+                out[x] = (uint8_t)(row[x] - prev_row[x]);
+            }
+            break;
+
+        // Average
+        case PNG_FILTER_AVERAGE:
+            for (uint32_t x = 0; x < bpp; x++) {
+                out[x] = (uint8_t)(row[x] - (prev_row[x] >> 1));
+            }
+            for (uint32_t x = bpp; x < row_bytes; x++) {
+                out[x] = (uint8_t)(row[x] - ((row[x - bpp] + prev_row[x]) >> 1));
+            }
+            break;
+
+        // Paeth
+        case PNG_FILTER_PAETH:
+            for (uint32_t x = 0; x < bpp; x++) {
+                out[x] = (uint8_t)(row[x] - prev_row[x]);
+            }
+            for (uint32_t x = bpp; x < row_bytes; x++) {
+                out[x] = (uint8_t)(row[x] - png_paeth_predictor(row[x - bpp], prev_row[x], prev_row[x - bpp]));
+            }
+            break;
+
+        default:
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * 把滤波结果字节视为有符号数后的绝对值（最小绝对差之和启发式的代价）
+ */
+static inline uint32_t png_filter_cost(uint8_t v) {
+    return v < 128 ? v : 256u - v;
+}
+
+/**
+ * 计算一个字节的 5 种滤波结果并累加代价
+ */
+static inline void png_filter_byte_all(uint32_t x, uint8_t value, uint8_t left, uint8_t above, uint8_t upper_left,
+    uint8_t* const out[PNG_FILTER_COUNT], uint64_t sums[PNG_FILTER_COUNT]) {
+    uint8_t v[PNG_FILTER_COUNT];
+    v[PNG_FILTER_NONE] = value;
+    v[PNG_FILTER_SUB] = (uint8_t)(value - left);
+    v[PNG_FILTER_UP] = (uint8_t)(value - above);
+    v[PNG_FILTER_AVERAGE] = (uint8_t)(value - ((left + above) >> 1));
+    v[PNG_FILTER_PAETH] = (uint8_t)(value - png_paeth_predictor(left, above, upper_left));
+    for (int f = 0; f < PNG_FILTER_COUNT; f++) {
+        out[f][x] = v[f];
+        sums[f] += png_filter_cost(v[f]);
+    }
+}
+
+#ifdef PNG_FILTER_SSE2
+/**
+ * 16 字节的绝对值之和（字节视为有符号数），累加到两个 64 位通道
+ */
+static inline __m128i png_filter_cost_sse2(__m128i acc, __m128i v) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i magnitude = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+    return _mm_add_epi64(acc, _mm_sad_epu8(magnitude, zero));
+}
+
+/**
+ * 8 个 16 位通道的 Paeth 预测
+ */
+static inline __m128i png_paeth_predictor_sse2(__m128i a, __m128i b, __m128i c) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pa = _mm_sub_epi16(b, c);
+    __m128i pb = _mm_sub_epi16(a, c);
+    __m128i pc = _mm_add_epi16(pa, pb);
+    pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+    pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+    pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+    // pa <= pb 且 pa <= pc 时取左侧，否则 pb <= pc 时取上方，其余取左上
+    __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+    __m128i b_or_c = _mm_or_si128(_mm_andnot_si128(not_b, b), _mm_and_si128(not_b, c));
+    return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, b_or_c));
+}
+#endif
+
+/**
+ * 一次遍历计算扫描线的全部 5 种滤波结果，以及每种结果的绝对值之和（字节视为有符号数）
+ *
+ * 编码时的滤波只读取原始字节，每个输出字节只依赖当前、左侧、上方与左上 4 个原始字节，
+ * 因此 SSE2 每次加载这 4 组 16 字节即可同时得到 5 种结果；Paeth 在 16 位通道中比较，代价用 SAD 指令累加。
+ *
+ * @param row               原始扫描线（不含滤波类型字节）
+ * @param prev_row          上一条原始扫描线，首行传入全零缓冲区
+ * @param row_bytes         扫描线字节数
+ * @param bytes_per_pixel   每像素字节数（位深小于 8 时为 1）
+ * @param out               5 个输出缓冲区，按滤波类型（PNG_FILTER_*）排列，每个 row_bytes 字节
+ * @param sums              输出每种滤波结果的绝对值之和（最小绝对差之和启发式的代价）
+ */
+void png_filter_row_all(const uint8_t* row, const uint8_t* prev_row, uint32_t row_bytes, uint32_t bytes_per_pixel,
+    uint8_t* const out[PNG_FILTER_COUNT], uint64_t sums[PNG_FILTER_COUNT]) {
+    uint32_t bpp = bytes_per_pixel < row_bytes ? bytes_per_pixel : row_bytes;
+    for (int f = 0; f < PNG_FILTER_COUNT; f++) {
+        sums[f] = 0;
+    }
+
+    // 首个像素的左侧与左上均视为 0
+    for (uint32_t x = 0; x < bpp; x++) {
+        png_filter_byte_all(x, row[x], 0, prev_row[x], 0, out, sums);
+    }
+
+    uint32_t x = bpp;
+#ifdef PNG_FILTER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i acc[PNG_FILTER_COUNT];
+    for (int f = 0; f < PNG_FILTER_COUNT; f++) {
+        acc[f] = zero;
+    }
+    for (; x + 16 <= row_bytes; x += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i a = _mm_loadu_si128((const __m128i*)(row + x - bpp));
+        __m128i b = _mm_loadu_si128((const __m128i*)(prev_row + x));
+        __m128i c = _mm_loadu_si128((const __m128i*)(prev_row + x - bpp));
+
+        // _mm_avg_epu8 向上取整，(a ^ b) 的最低位为 1 时减 1 得到向下取整的平均值
+        __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+        __m128i paeth_lo = png_paeth_predictor_sse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero),
+            _mm_unpacklo_epi8(c, zero));
+        __m128i paeth_hi = png_paeth_predictor_sse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero),
+            _mm_unpackhi_epi8(c, zero));
+
+        __m128i v[PNG_FILTER_COUNT];
+        v[PNG_FILTER_NONE] = value;
+        v[PNG_FILTER_SUB] = _mm_sub_epi8(value, a);
+        v[PNG_FILTER_UP] = _mm_sub_epi8(value, b);
+        v[PNG_FILTER_AVERAGE] = _mm_sub_epi8(value, average);
+        v[PNG_FILTER_PAETH] = _mm_sub_epi8(value, _mm_packus_epi16(paeth_lo, paeth_hi));
+        for (int f = 0; f < PNG_FILTER_COUNT; f++) {
+            _mm_storeu_si128((__m128i*)(out[f] + x), v[f]);
+            acc[f] = png_filter_cost_sse2(acc[f], v[f]);
+        }
+    }
+    for (int f = 0; f < PNG_FILTER_COUNT; f++) {
+        uint64_t lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, acc[f]);
+        sums[f] += lanes[0] + lanes[1];
+    }
+#endif
+
+    for (; x < row_bytes; x++) {
+        png_filter_byte_all(x, row[x], row[x - bpp], prev_row[x], prev_row[x - bpp], out, sums);
+    }
+}
+
+/**
+ * 估算一段数据用零阶熵编码后的位数：n * log2(n) - Σ c * log2(c)，c 为每个字节值出现的次数
+ *
+ * 比绝对值之和更接近 deflate 的 Huffman 编码代价：重复出现的非零值（例如 Sub 滤波后的恒定斜率）也能被识别为低代价。
+ *
+ * @param data      数据
+ * @param size      字节数
+ *
+ * @return          估算的位数
+ */
+double png_filter_entropy(const uint8_t* data, uint32_t size) {
+    // 4 组计数交替累加，减少相同字节值连续出现时对同一计数器的读写依赖
+    uint32_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    uint32_t x = 0;
+    for (; x + 4 <= size; x += 4) {
+        counts[0][data[x]]++;
+        counts[1][data[x + 1]]++;
+        counts[2][data[x + 2]]++;
+        counts[3][data[x + 3]]++;
+    }
+    for (; x < size; x++) {
+        counts[0][data[x]]++;
+    }
+
+    double bits = size > 0 ? size * log2((double)size) : 0.0;
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+        if (c > 1) {
+            bits -= c * log2((double)c);
+        }
+    }
+    return bits;
+}
@@ -0,0 +1,23 @@
+#ifndef PNG_FILTER_H
+#define PNG_FILTER_H
+
+#include <stdint.h>
+
+// 扫描线滤波类型
+#define PNG_FILTER_NONE 0
+#define PNG_FILTER_SUB 1
+#define PNG_FILTER_UP 2
+#define PNG_FILTER_AVERAGE 3
+#define PNG_FILTER_PAETH 4
+
+// 滤波类型数
+#define PNG_FILTER_COUNT 5
+
+int png_unfilter_row(uint8_t filter_type, uint8_t* row, const uint8_t* prev_row, uint32_t row_bytes, uint32_t bytes_per_pixel);
+int png_filter_row(uint8_t filter_type, const uint8_t* row, const uint8_t* prev_row, uint32_t row_bytes,
+    uint32_t bytes_per_pixel, uint8_t* out);
+void png_filter_row_all(const uint8_t* row, const uint8_t* prev_row, uint32_t row_bytes, uint32_t bytes_per_pixel,
+    uint8_t* const out[PNG_FILTER_COUNT], uint64_t sums[PNG_FILTER_COUNT]);
+double png_filter_entropy(const uint8_t* data, uint32_t size);
+
+#endif // PNG_FILTER_H
@@ -0,0 +1,452 @@
+#include "png_index.h"
+#include "png_filter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+/*
+ * 随机访问索引（与 zlib 示例 zran 的思路相同）
+ *
+ * deflate 数据只能从头顺序解压，但在块边界处解压状态只剩输入位置与最近 32KB 输出。
+ * PNG 的滤波还依赖上一行，因此每个检查点还要保存上一行还原后的扫描线，以及块边界之前本行已解压的部分。
+ *
+ * 索引文件格式（小端序）：
+ *   文件头  "PNGIDX1\n"，PNG 文件大小（8 字节）与修改时间（8 字节），IHDR 字段（宽、高各 4 字节，其余 5 个字段各 1 字节），
+ *           检查点间隔行数与检查点个数（各 4 字节）
+ *   检查点  行号、行内偏移（各 4 字节），文件位置（8 字节），块剩余字节数（4 字节），未用位数与前一字节（各 1 字节），
+ *           窗口大小、压缩后数据大小（各 4 字节），之后是用 zlib 压缩的窗口与 row_data
+ */
+
+static const uint8_t png_index_magic[8] = { 'P', 'N', 'G', 'I', 'D', 'X', '1', '\n' };
+
+#define PNG_INDEX_HEADER_SIZE (8 + 8 + 8 + 13 + 8)
+#define PNG_INDEX_POINT_SIZE (4 + 4 + 8 + 4 + 1 + 1 + 4 + 4)
+
+static void png_index_put32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void png_index_put64(uint8_t* p, uint64_t v) {
+    png_index_put32(p, (uint32_t)v);
+    png_index_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t png_index_get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t png_index_get64(const uint8_t* p) {
+    return (uint64_t)png_index_get32(p) | ((uint64_t)png_index_get32(p + 4) << 32);
+}
+
+/**
+ * 获取文件的大小与修改时间
+ *
+ * @return      是否获取成功，返回 1(真) 或 0(假)
+ */
+static int png_index_stat(const char* filename, uint64_t* size, int64_t* mtime) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return 0;
+    }
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return 1;
+}
+
+/**
+ * 检查点 row_data 的字节数：上一行加本行已解压的部分
+ */
+static size_t png_index_row_data_size(const PNG_Index* index, const PNG_IndexPoint* point) {
+    return (size_t)png_row_bytes(&index->header, index->header.width) + point->offset;
+}
+
+/**
+ * 追加一个检查点
+ *
+ * @return      是否追加成功，返回 1(真) 或 0(假)
+ */
+static int png_index_add_point(PNG_Index* index, uint32_t* capacity, PNG_Stream* stream, uint32_t row,
+    const uint8_t* prev_row, const uint8_t* current_row, uint32_t offset) {
+    if (index->count == *capacity) {
+        uint32_t new_capacity = *capacity ? *capacity * 2 : 16;
+        PNG_IndexPoint* points = (PNG_IndexPoint*)realloc(index->points, new_capacity * sizeof(PNG_IndexPoint));
+        if (!points) {
+            return 0;
+        }
+        index->points = points;
+        *capacity = new_capacity;
+    }
+
+    PNG_IndexPoint* point = &index->points[index->count];
+    memset(point, 0, sizeof(PNG_IndexPoint));
+    point->row = row;
+    point->offset = offset;
+    if (!png_stream_save_checkpoint(stream, &point->checkpoint)) {
+        return 0;
+    }
+
+    size_t bytes_per_line = png_row_bytes(&index->header, index->header.width);
+    point->row_data = (uint8_t*)malloc(bytes_per_line + offset);
+    if (!point->row_data) {
+        return 0;
+    }
+    memcpy(point->row_data, prev_row, bytes_per_line);
+    memcpy(point->row_data + bytes_per_line, current_row, offset);
+    index->count++;
+    return 1;
+}
+
+/**
+ * 完整解码一次 PNG 文件，建立随机访问索引
+ *
+ * @param filename      PNG 文件路径
+ * @param span          检查点间隔行数，0 表示按 PNG_INDEX_SPAN_BYTES 与 PNG_INDEX_MIN_SPAN 自动选择
+ * @param index         索引，使用完毕后调用 png_index_free 释放
+ * @param cancel        取消令牌，可以为 NULL，每解码一行检查一次
+ *
+ * @return              是否建立成功，返回 1(真) 或 0(假)；隔行图像返回 0
+ */
+int png_index_build(const char* filename, uint32_t span, PNG_Index* index, const PNG_CancelToken* cancel) {
+    memset(index, 0, sizeof(PNG_Index));
+    if (!png_index_stat(filename, &index->file_size, &index->file_mtime)) {
+        return 0;
+    }
+
+    PNG_Image image;
+    PNG_Stream stream;
+    if (!png_stream_open(&stream, filename, &image)) {
+        return 0;
+    }
+
+    index->header = image.header;
+    uint32_t bytes_per_pixel = png_bytes_per_pixel(&image.header);
+    uint32_t bytes_per_line = png_row_bytes(&image.header, image.header.width);
+    uint32_t capacity = 0;
+    uint8_t* current_line = (uint8_t*)malloc((size_t)bytes_per_line + 1);
+    uint8_t* prev_line = (uint8_t*)calloc((size_t)bytes_per_line + 1, 1);
+    if (!current_line || !prev_line || image.header.interlace_method != PNG_INTERLACE_METHOD_NONE) {
+        goto fail;
+    }
+
+    if (span == 0) {
+        span = PNG_INDEX_SPAN_BYTES / (bytes_per_line + 1);
+        if (span < PNG_INDEX_MIN_SPAN) {
+            span = PNG_INDEX_MIN_SPAN;
+        }
+    }
+    index->span = span;
+
+    uint32_t next_row = span;                       // 到达此行之后的第一个块边界保存下一个检查点
+    for (uint32_t y = 0; y < image.header.height; y++) {
+        uint32_t filled = 0;
+        while (filled < bytes_per_line + 1) {
+            uint32_t produced;
+            int boundary;
+            if (png_cancel_requested(cancel) ||
+                !png_stream_read_block(&stream, current_line + filled, bytes_per_line + 1 - filled, &produced, &boundary)) {
+                goto fail;
+            }
+            filled += produced;
+
+            if (boundary && y >= next_row) {
+                if (!png_index_add_point(index, &capacity, &stream, y, prev_line + 1, current_line, filled)) {
+                    goto fail;
+                }
+                next_row = y + span;
+            }
+        }
+
+        if (!png_unfilter_row(current_line[0], current_line + 1, prev_line + 1, bytes_per_line, bytes_per_pixel)) {
+            goto fail;
+        }
+        uint8_t* tmp = prev_line;
+        prev_line = current_line;
+        current_line = tmp;
+    }
+
+    if (!png_stream_finish(&stream)) {
+        goto fail;
+    }
+
+    png_stream_close(&stream);
+    png_free_image(&image);
+    free(current_line);
+    free(prev_line);
+    return 1;
+
+fail:
+    png_stream_close(&stream);
+    png_free_image(&image);
+    png_index_free(index);
+    free(current_line);
+    free(prev_line);
+    return 0;
+}
+
+/**
+ * 把索引保存到文件
+ *
+ * @param index     索引
+ * @param path      索引文件路径
+ *
+ * @return          是否保存成功，返回 1(真) 或 0(假)
+ */
+int png_index_save(const PNG_Index* index, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    uint8_t header[PNG_INDEX_HEADER_SIZE];
+    uint8_t* p = header;
+    memcpy(p, png_index_magic, 8);
+    png_index_put64(p + 8, index->file_size);
+    png_index_put64(p + 16, (uint64_t)index->file_mtime);
+    png_index_put32(p + 24, index->header.width);
+    png_index_put32(p + 28, index->header.height);
+    p[32] = index->header.bit_depth;
+    p[33] = index->header.color_type;
+    p[34] = index->header.compression_method;
+    p[35] = index->header.filter_method;
+    p[36] = index->header.interlace_method;
+    png_index_put32(p + 37, index->span);
+    png_index_put32(p + 41, index->count);
+
+    int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    uint8_t* raw = NULL;
+    uint8_t* packed = NULL;
+    for (uint32_t i = 0; i < index->count && ok; i++) {
+        const PNG_IndexPoint* point = &index->points[i];
+        const PNG_StreamCheckpoint* checkpoint = &point->checkpoint;
+        size_t row_data_size = png_index_row_data_size(index, point);
+
+        // 窗口与 row_data 一起压缩保存
+        size_t raw_size = checkpoint->window_size + row_data_size;
+        uLongf packed_size = compressBound((uLong)raw_size);
+        raw = (uint8_t*)malloc(raw_size);
+        packed = (uint8_t*)malloc(packed_size);
+        ok = raw && packed;
+        if (ok) {
+            memcpy(raw, checkpoint->window, checkpoint->window_size);
+            memcpy(raw + checkpoint->window_size, point->row_data, row_data_size);
+            ok = compress2(packed, &packed_size, raw, (uLong)raw_size, Z_BEST_SPEED) == Z_OK;
+        }
+
+        uint8_t record[PNG_INDEX_POINT_SIZE];
+        png_index_put32(record, point->row);
+        png_index_put32(record + 4, point->offset);
+        png_index_put64(record + 8, checkpoint->file_offset);
+        png_index_put32(record + 16, checkpoint->chunk_remaining);
+        record[20] = checkpoint->bits;
+        record[21] = checkpoint->partial;
+        png_index_put32(record + 22, checkpoint->window_size);
+        png_index_put32(record + 26, (uint32_t)packed_size);
+        ok = ok && fwrite(record, 1, sizeof(record), file) == sizeof(record) &&
+            fwrite(packed, 1, packed_size, file) == packed_size;
+
+        free(raw);
+        free(packed);
+        raw = NULL;
+        packed = NULL;
+    }
+
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        remove(path);
+    }
+    return ok;
+}
+
+/**
+ * 从文件读取索引，并确认它与 PNG 文件的当前版本一致
+ *
+ * @param index     索引，使用完毕后调用 png_index_free 释放
+ * @param path      索引文件路径
+ * @param filename  索引对应的 PNG 文件路径
+ *
+ * @return          是否读取成功，返回 1(真) 或 0(假)；索引文件损坏或 PNG 文件已修改时返回 0
+ */
+int png_index_load(PNG_Index* index, const char* path, const char* filename) {
+    memset(index, 0, sizeof(PNG_Index));
+
+    uint64_t file_size;
+    int64_t file_mtime;
+    if (!png_index_stat(filename, &file_size, &file_mtime)) {
+        return 0;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    uint8_t header[PNG_INDEX_HEADER_SIZE];
+    uint8_t* packed = NULL;
+    uint8_t* raw = NULL;
+    uint32_t count = 0;
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, png_index_magic, 8) != 0) {
+        goto fail;
+    }
+    index->file_size = png_index_get64(header + 8);
+    index->file_mtime = (int64_t)png_index_get64(header + 16);
+    index->header.width = png_index_get32(header + 24);
+    index->header.height = png_index_get32(header + 28);
+    index->header.bit_depth = header[32];
+    index->header.color_type = header[33];
+    index->header.compression_method = header[34];
+    index->header.filter_method = header[35];
+    index->header.interlace_method = header[36];
+    index->span = png_index_get32(header + 37);
+    count = png_index_get32(header + 41);
+
+    uint32_t bytes_per_line = png_row_bytes(&index->header, index->header.width);
+    if (index->file_size != file_size || index->file_mtime != file_mtime || bytes_per_line == 0 ||
+        index->header.interlace_method != PNG_INTERLACE_METHOD_NONE || count > index->header.height) {
+        goto fail;
+    }
+
+    index->points = (PNG_IndexPoint*)calloc(count > 0 ? count : 1, sizeof(PNG_IndexPoint));
+    if (!index->points) {
+        goto fail;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        PNG_IndexPoint* point = &index->points[i];
+        PNG_StreamCheckpoint* checkpoint = &point->checkpoint;
+        uint8_t record[PNG_INDEX_POINT_SIZE];
+        if (fread(record, 1, sizeof(record), file) != sizeof(record)) {
+            goto fail;
+        }
+        point->row = png_index_get32(record);
+        point->offset = png_index_get32(record + 4);
+        checkpoint->file_offset = png_index_get64(record + 8);
+        checkpoint->chunk_remaining = png_index_get32(record + 16);
+        checkpoint->bits = record[20];
+        checkpoint->partial = record[21];
+        checkpoint->window_size = png_index_get32(record + 22);
+        uint32_t packed_size = png_index_get32(record + 26);
+
+        // 检查点必须按行号递增，且各字段在合法范围内
+        if (point->row >= index->header.height || (i > 0 && point->row <= index->points[i - 1].row) ||
+            point->offset > bytes_per_line + 1 || checkpoint->bits > 7 || checkpoint->window_size > PNG_STREAM_WINDOW_SIZE ||
+            packed_size > compressBound(PNG_STREAM_WINDOW_SIZE + 2 * ((uLong)bytes_per_line + 1))) {
+            goto fail;
+        }
+
+        size_t row_data_size = png_index_row_data_size(index, point);
+        uLongf raw_size = (uLongf)(checkpoint->window_size + row_data_size);
+        packed = (uint8_t*)malloc(packed_size > 0 ? packed_size : 1);
+        raw = (uint8_t*)malloc(raw_size);
+        point->row_data = (uint8_t*)malloc(row_data_size);
+        if (!packed || !raw || !point->row_data || fread(packed, 1, packed_size, file) != packed_size) {
+            goto fail;
+        }
+        uLongf unpacked_size = raw_size;
+        if (uncompress(raw, &unpacked_size, packed, packed_size) != Z_OK || unpacked_size != raw_size) {
+            goto fail;
+        }
+        memcpy(checkpoint->window, raw, checkpoint->window_size);
+        memcpy(point->row_data, raw + checkpoint->window_size, row_data_size);
+        index->count = i + 1;
+
+        free(packed);
+        free(raw);
+        packed = NULL;
+        raw = NULL;
+    }
+
+    fclose(file);
+    return 1;
+
+fail:
+    // 读取到一半的检查点也需释放（index->count 尚未包含它）
+    if (index->points && index->count < count) {
+        free(index->points[index->count].row_data);
+    }
+    free(packed);
+    free(raw);
+    fclose(file);
+    png_index_free(index);
+    return 0;
+}
+
+/**
+ * 读取 PNG 文件旁的索引文件；不存在或已过期时重新建立索引并保存
+ *
+ * 索引文件无法写入（例如目录只读）时仍返回建立好的索引，只是下次需要重新建立。
+ *
+ * @param filename      PNG 文件路径
+ * @param span          重新建立索引时的检查点间隔行数，0 表示自动选择
+ * @param index         索引，使用完毕后调用 png_index_free 释放
+ * @param cancel        取消令牌，可以为 NULL
+ *
+ * @return              是否取得索引，返回 1(真) 或 0(假)
+ */
+int png_index_open(const char* filename, uint32_t span, PNG_Index* index, const PNG_CancelToken* cancel) {
+    size_t length = strlen(filename);
+    char* path = (char*)malloc(length + sizeof(PNG_INDEX_SUFFIX));
+    if (!path) {
+        return 0;
+    }
+    memcpy(path, filename, length);
+    memcpy(path + length, PNG_INDEX_SUFFIX, sizeof(PNG_INDEX_SUFFIX));
+
+    int ok = png_index_load(index, path, filename);
+    if (!ok) {
+        ok = png_index_build(filename, span, index, cancel);
+        if (ok) {
+            png_index_save(index, path);
+        }
+    }
+
+    free(path);
+    return ok;
+}
+
+/**
+ * 查找不晚于指定行的最后一个检查点
+ *
+ * @param index     索引
+ * @param row       目标行
+ *
+ * @return          检查点，目标行之上没有检查点时返回 NULL（需从图像顶部开始解码）
+ */
+const PNG_IndexPoint* png_index_find(const PNG_Index* index, uint32_t row) {
+    if (!index || index->count == 0 || index->points[0].row > row) {
+        return NULL;
+    }
+
+    // 二分查找最后一个 point.row <= row 的检查点
+    uint32_t low = 0;
+    uint32_t high = index->count - 1;
+    while (low < high) {
+        uint32_t mid = low + (high - low + 1) / 2;
+        if (index->points[mid].row <= row) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return &index->points[low];
+}
+
+/**
+ * 释放索引
+ */
+void png_index_free(PNG_Index* index) {
+    if (!index) {
+        return;
+    }
+    for (uint32_t i = 0; i < index->count; i++) {
+        free(index->points[i].row_data);
+    }
+    free(index->points);
+    index->points = NULL;
+    index->count = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef PNG_INDEX_H
+#define PNG_INDEX_H
+
+#include "png_decoder.h"
+#include "png_stream.h"
+
+// 默认每个检查点之间约 1MB 扫描线数据，且至少间隔 64 行（宽图像的检查点要保存一整行，间隔太小索引会过大）
+#define PNG_INDEX_SPAN_BYTES (1024 * 1024)
+#define PNG_INDEX_MIN_SPAN 64
+
+// 索引文件保存在 PNG 文件旁，文件名为 PNG 文件名加此后缀
+#define PNG_INDEX_SUFFIX ".pngidx"
+
+/**
+ * 行检查点：从第 row 行中间的一个 deflate 块边界恢复解压与滤波还原所需的状态
+ */
+typedef struct {
+    uint32_t row;                   // 检查点所在行
+    uint32_t offset;                // 该行在检查点之前已解压的字节数（含过滤类型字节）
+    PNG_StreamCheckpoint checkpoint;
+    uint8_t* row_data;              // 上一行已还原的扫描线（bytes_per_line 字节），之后是本行已解压的 offset 字节
+} PNG_IndexPoint;
+
+/**
+ * 随机访问索引
+ *
+ * 一次完整解码中每隔 span 行在第一个 deflate 块边界处保存一个检查点。区域解码从区域之上最近的检查点
+ * 恢复，不必从图像顶部解压，每次访问的解压量不超过约 span 行。只支持非隔行图像。
+ */
+typedef struct {
+    PNG_IHDR header;
+    uint64_t file_size;             // 建立索引时 PNG 文件的大小与修改时间，用于判断索引是否过期
+    int64_t file_mtime;
+    uint32_t span;                  // 检查点间隔行数
+    uint32_t count;                 // 检查点个数
+    PNG_IndexPoint* points;         // 按行号递增排列
+} PNG_Index;
+
+int png_index_build(const char* filename, uint32_t span, PNG_Index* index, const PNG_CancelToken* cancel);
+int png_index_save(const PNG_Index* index, const char* path);
+int png_index_load(PNG_Index* index, const char* path, const char* filename);
+int png_index_open(const char* filename, uint32_t span, PNG_Index* index, const PNG_CancelToken* cancel);
+const PNG_IndexPoint* png_index_find(const PNG_Index* index, uint32_t row);
+void png_index_free(PNG_Index* index);
+
+#endif // PNG_INDEX_H
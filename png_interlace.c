@@ -0,0 +1,153 @@
+#include "png_interlace.h"
+#include <string.h>
+
+const PNG_Adam7Pass png_adam7_passes[PNG_ADAM7_PASSES] = {
+    { 0, 0, 8, 8 },
+    { 4, 0, 8, 8 },
+    { 0, 4, 4, 8 },
+    { 2, 0, 4, 4 },
+    { 0, 2, 2, 4 },
+    { 1, 0, 2, 2 },
+    { 0, 1, 1, 2 },
+};
+
+/**
+ * 计算 Adam7 某一遍子图像的尺寸（宽或高为 0 表示该遍没有数据，整遍跳过）
+ *
+ * @param header        指向 PNG_IHDR 结构体指针
+ * @param pass          遍序号（0 ~ 6）
+ * @param pass_width    输出参数，子图像宽度
+ * @param pass_height   输出参数，子图像高度
+ *
+ * @return              无
+ */
+void png_adam7_pass_size(const PNG_IHDR* header, int pass, uint32_t* pass_width, uint32_t* pass_height) {
+    const PNG_Adam7Pass* p = &png_adam7_passes[pass];
+    *pass_width = header->width > p->x0 ? (header->width - p->x0 + p->dx - 1) / p->dx : 0;
+    *pass_height = header->height > p->y0 ? (header->height - p->y0 + p->dy - 1) / p->dy : 0;
+    if (*pass_width == 0 || *pass_height == 0) {
+        *pass_width = *pass_height = 0;
+    }
+}
+
+// 以编译期常量的像素字节数展开的步进复制，编译器会把 memcpy 优化为单次定长读写
+#define PNG_SCATTER_FIXED(N)                                        \
+    for (uint32_t i = 0; i < count; i++) {                          \
+        memcpy(dst + (size_t)i * stride, src + (size_t)i * (N), N); \
+    }                                                               \
+    break;
+
+/**
+ * 把 Adam7 子图像的一行像素分散写入最终图像对应行
+ *
+ * 每像素至少 1 字节时按像素字节数选择专门的定长步进复制；第 7 遍的列步长为 1，
+ * 子图像行与最终图像行完全重合，直接整行复制。位深小于 8 时按位写入，
+ * 此时目标行必须预先清零。
+ *
+ * @param header        指向 PNG_IHDR 结构体指针
+ * @param pass          遍序号（0 ~ 6）
+ * @param src           已还原的子图像扫描线（不含滤波类型字节）
+ * @param dst_row       最终图像中对应的扫描线
+ * @param pass_width    子图像宽度
+ *
+ * @return              无
+ */
+void png_adam7_scatter_row(const PNG_IHDR* header, int pass, const uint8_t* src, uint8_t* dst_row, uint32_t pass_width) {
+    const PNG_Adam7Pass* p = &png_adam7_passes[pass];
+    uint32_t count = pass_width;
+
+    if (header->bit_depth < 8) {
+        // 位深小于 8 的只有单通道的灰度与调色板图像
+        uint32_t bits = header->bit_depth;
+        uint8_t mask = (uint8_t)((1 << bits) - 1);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t sbit = i * bits;
+            uint32_t dbit = (p->x0 + i * p->dx) * bits;
+            uint8_t v = (src[sbit >> 3] >> (8 - bits - (sbit & 7))) & mask;
+            dst_row[dbit >> 3] |= (uint8_t)(v << (8 - bits - (dbit & 7)));
+        }
+        return;
+    }
+
+    uint32_t bpp = png_bytes_per_pixel(header);
+    if (p->dx == 1) {
+        memcpy(dst_row, src, (size_t)count * bpp);
+        return;
+    }
+
+    uint8_t* dst = dst_row + (size_t)p->x0 * bpp;
+    size_t stride = (size_t)p->dx * bpp;
+    switch (bpp) {
+        case 1: PNG_SCATTER_FIXED(1)
+        case 2: PNG_SCATTER_FIXED(2)
+        case 3: PNG_SCATTER_FIXED(3)
+        case 4: PNG_SCATTER_FIXED(4)
+        case 6: PNG_SCATTER_FIXED(6)
+        case 8: PNG_SCATTER_FIXED(8)
+        default:
+            for (uint32_t i = 0; i < count; i++) {
+                memcpy(dst + (size_t)i * stride, src + (size_t)i * bpp, bpp);
+            }
+            break;
+    }
+}
+
+#define PNG_GATHER_FIXED(N)                                         \
+    for (uint32_t i = 0; i < count; i++) {                          \
+        memcpy(dst + (size_t)i * (N), src + (size_t)i * stride, N); \
+    }                                                               \
+    break;
+
+/**
+ * 从最终图像的一行中取出 Adam7 子图像的一行像素（png_adam7_scatter_row 的逆操作，编码隔行图像时使用）
+ *
+ * 与分散写入相同，按像素字节数选择专门的定长步进复制，第 7 遍直接整行复制。位深小于 8 时按位读取，
+ * 子图像行末尾不足一字节的填充位置 0。
+ *
+ * @param header        指向 PNG_IHDR 结构体指针
+ * @param pass          遍序号（0 ~ 6）
+ * @param src_row       最终图像中对应的扫描线
+ * @param dst           输出子图像扫描线（不含滤波类型字节）
+ * @param pass_width    子图像宽度
+ *
+ * @return              无
+ */
+void png_adam7_gather_row(const PNG_IHDR* header, int pass, const uint8_t* src_row, uint8_t* dst, uint32_t pass_width) {
+    const PNG_Adam7Pass* p = &png_adam7_passes[pass];
+    uint32_t count = pass_width;
+
+    if (header->bit_depth < 8) {
+        uint32_t bits = header->bit_depth;
+        uint8_t mask = (uint8_t)((1 << bits) - 1);
+        memset(dst, 0, ((size_t)count * bits + 7) / 8);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t sbit = (p->x0 + i * p->dx) * bits;
+            uint32_t dbit = i * bits;
+            uint8_t v = (src_row[sbit >> 3] >> (8 - bits - (sbit & 7))) & mask;
+            dst[dbit >> 3] |= (uint8_t)(v << (8 - bits - (dbit & 7)));
+        }
+        return;
+    }
+
+    uint32_t bpp = png_bytes_per_pixel(header);
+    if (p->dx == 1) {
+        memcpy(dst, src_row, (size_t)count * bpp);
+        return;
+    }
+
+    const uint8_t* src = src_row + (size_t)p->x0 * bpp;
+    size_t stride = (size_t)p->dx * bpp;
+    switch (bpp) {
+        case 1: PNG_GATHER_FIXED(1)
+        case 2: PNG_GATHER_FIXED(2)
+        case 3: PNG_GATHER_FIXED(3)
+        case 4: PNG_GATHER_FIXED(4)
+        case 6: PNG_GATHER_FIXED(6)
+        case 8: PNG_GATHER_FIXED(8)
+        default:
+            for (uint32_t i = 0; i < count; i++) {
+                memcpy(dst + (size_t)i * bpp, src + (size_t)i * stride, bpp);
+            }
+            break;
+    }
+}
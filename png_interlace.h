@@ -0,0 +1,34 @@
+#ifndef PNG_INTERLACE_H
+#define PNG_INTERLACE_H
+
+#include "png_decoder.h"
+
+// Adam7 隔行扫描的遍数
+#define PNG_ADAM7_PASSES 7
+
+/**
+ * Adam7 每一遍在 8x8 块中采样的起点与步长
+ *
+ *     1 6 4 6 2 6 4 6
+ *     7 7 7 7 7 7 7 7
+ *     5 6 5 6 5 6 5 6
+ *     7 7 7 7 7 7 7 7
+ *     3 6 4 6 3 6 4 6
+ *     7 7 7 7 7 7 7 7
+ *     5 6 5 6 5 6 5 6
+ *     7 7 7 7 7 7 7 7
+ */
+typedef struct {
+    uint8_t x0;                     // 起始列
+    uint8_t y0;                     // 起始行
+    uint8_t dx;                     // 列步长
+    uint8_t dy;                     // 行步长
+} PNG_Adam7Pass;
+
+extern const PNG_Adam7Pass png_adam7_passes[PNG_ADAM7_PASSES];
+
+void png_adam7_pass_size(const PNG_IHDR* header, int pass, uint32_t* pass_width, uint32_t* pass_height);
+void png_adam7_scatter_row(const PNG_IHDR* header, int pass, const uint8_t* src, uint8_t* dst_row, uint32_t pass_width);
+void png_adam7_gather_row(const PNG_IHDR* header, int pass, const uint8_t* src_row, uint8_t* dst, uint32_t pass_width);
+
+#endif // PNG_INTERLACE_H
@@ -0,0 +1,292 @@
+#include "png_optimize.h"
+#include "png_palette.h"
+#include "png_reduce.h"
+#include "png_thread.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 无损优化
+ *
+ * 试压缩的组合为：是否无损缩减 × 内存级别 × zlib 策略 × 滤波策略，按预期收益从高到低排列（越靠内层的维度对结果影响越大，
+ * 预算不足时先覆盖全部滤波策略），交给线程池按顺序领取。所有组合共享同一幅未滤波的图像（原图与缩减后的图像各一份，
+ * 调色板图像事先用 png_palette_sort 重排好调色板），边滤波边压缩，只统计压缩后的字节数；每个工作线程保留自己的
+ * deflate 流，内存级别不变时只需 deflateReset 与 deflateParams。全部完成（或预算用完）后选出预计文件最小的组合，
+ * 按该组合真正编码一次。
+ */
+
+// 逐行选择的滤波策略排在前面，固定滤波类型中 Paeth 与 Up 通常更好
+static const int png_optimize_filters[] = {
+    PNG_ENCODE_FILTER_MINSUM, PNG_FILTER_NONE, PNG_ENCODE_FILTER_ENTROPY, PNG_FILTER_PAETH, PNG_FILTER_UP,
+    PNG_FILTER_SUB, PNG_FILTER_AVERAGE,
+};
+
+static const int png_optimize_strategies[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE };
+
+static const int png_optimize_mem_levels[] = { MAX_MEM_LEVEL, PNG_ENCODE_DEFAULT_MEM_LEVEL };
+
+#define PNG_OPTIMIZE_COUNT(list) ((uint32_t)(sizeof(list) / sizeof((list)[0])))
+
+// 看门狗检查预算的间隔（毫秒）
+#define PNG_OPTIMIZE_WATCH_MS 5
+
+// 一个试压缩组合
+typedef struct {
+    int variant;                    // 0：缩减后的图像（可以缩减时）；1：原图
+    int filter;
+    int strategy;
+    int mem_level;
+    uint64_t size;                  // 预计的文件大小，0 表示未完成
+} PNG_OptimizeTrial;
+
+// 每个工作线程复用的 deflate 流
+typedef struct {
+    z_stream strm;
+    int ready;
+    int mem_level;
+} PNG_OptimizeWorker;
+
+typedef struct {
+    const PNG_Image* images[2];     // 缩减后的图像与原图，不能缩减时只有原图
+    uint64_t overhead[2];           // 签名与 IHDR、PLTE、tRNS、IEND 块的字节数
+    int level;
+    PNG_OptimizeTrial* trials;
+    PNG_OptimizeWorker workers[PNG_MAX_THREADS];
+    PNG_CancelToken cancel;
+    atomic_uint completed;
+    atomic_int finished;            // 通知看门狗退出
+    double deadline;
+} PNG_OptimizeContext;
+
+/**
+ * 初始化为默认优化选项：压缩级别 9，不限时间，不清理透明像素
+ *
+ * @param options       优化选项
+ */
+void png_optimize_options_init(PNG_OptimizeOptions* options) {
+    options->time_budget = 0;
+    options->level = PNG_OPTIMIZE_DEFAULT_LEVEL;
+    options->transparent = PNG_CLEAN_NONE;
+}
+
+/**
+ * 不含 IDAT 块的文件开销：签名、IHDR、PLTE、tRNS 与 IEND
+ */
+static uint64_t png_optimize_overhead(const PNG_Image* image) {
+    uint64_t size = PNG_SIGNATURE_SIZE + 12 + 13 + 12;
+    if (image->palette_size > 0) {
+        size += 12 + (uint64_t)image->palette_size * 3;
+    }
+    if (image->transparency_size > 0) {
+        size += 12 + (uint64_t)image->transparency_size;
+    }
+    return size;
+}
+
+/**
+ * 最终编码使用的选项（单线程压缩为一个 zlib 流，与试压缩的统计结果一致）
+ */
+static void png_optimize_encode_options(const PNG_OptimizeContext* ctx, const PNG_OptimizeTrial* trial,
+    PNG_EncodeOptions* options) {
+    png_encode_options_init(options);
+    options->level = ctx->level;
+    options->strategy = trial->strategy;
+    options->mem_level = trial->mem_level;
+    options->filter = trial->filter;
+    options->idat_size = PNG_ENCODE_FAST_IDAT_SIZE;
+    options->reduce = 0;
+    options->palette = PNG_ENCODE_PALETTE_KEEP;
+}
+
+/**
+ * 执行一个试压缩组合
+ */
+static void png_optimize_task(void* user_data, uint32_t index, int worker_index) {
+    PNG_OptimizeContext* ctx = (PNG_OptimizeContext*)user_data;
+    PNG_OptimizeTrial* trial = &ctx->trials[index];
+    PNG_OptimizeWorker* worker = &ctx->workers[worker_index];
+    if (png_cancel_requested(&ctx->cancel)) {
+        return;
+    }
+
+    // 内存级别决定 deflate 状态的大小，改变时才需要重新初始化
+    if (worker->ready && worker->mem_level != trial->mem_level) {
+        deflateEnd(&worker->strm);
+        worker->ready = 0;
+    }
+    if (!worker->ready) {
+        memset(&worker->strm, 0, sizeof(z_stream));
+        if (deflateInit2(&worker->strm, ctx->level, Z_DEFLATED, MAX_WBITS, trial->mem_level, trial->strategy) != Z_OK) {
+            return;
+        }
+        worker->ready = 1;
+        worker->mem_level = trial->mem_level;
+    } else if (deflateReset(&worker->strm) != Z_OK ||
+        deflateParams(&worker->strm, ctx->level, trial->strategy) != Z_OK) {
+        return;
+    }
+
+    uint64_t size;
+    if (png_encode_deflate_size(ctx->images[trial->variant], trial->filter, &worker->strm, &ctx->cancel, &size)) {
+        uint64_t chunks = size / PNG_ENCODE_FAST_IDAT_SIZE + (size % PNG_ENCODE_FAST_IDAT_SIZE != 0);
+        trial->size = ctx->overhead[trial->variant] + size + chunks * 12;
+        atomic_fetch_add(&ctx->completed, 1);
+    }
+}
+
+/**
+ * 看门狗线程：预算用完时取消所有未完成的试压缩
+ */
+static void png_optimize_watchdog(void* arg) {
+    PNG_OptimizeContext* ctx = (PNG_OptimizeContext*)arg;
+    while (!atomic_load(&ctx->finished)) {
+        if (png_monotonic_time() >= ctx->deadline) {
+            png_cancel_request(&ctx->cancel);
+            break;
+        }
+        png_thread_sleep(PNG_OPTIMIZE_WATCH_MS);
+    }
+}
+
+/**
+ * 在线程池上并行尝试多种滤波策略、zlib 策略、内存级别与无损缩减的组合，按预计文件最小的组合编码
+ *
+ * 输出只包含 IHDR、PLTE、tRNS、IDAT 与 IEND 块，不保留原文件的其他辅助块。
+ *
+ * @param image         要优化的图像（与解码器输出的格式相同）
+ * @param options       优化选项，NULL 表示使用默认选项
+ * @param output        输出参数，编码结果（由调用者 free）
+ * @param output_size   输出参数，编码结果字节数
+ * @param result        输出参数，选中的组合与统计信息（失败时也填写组合数与耗时），可以为 NULL
+ *
+ * @return              是否优化成功，返回 1(真) 或 0(假)；预算内没有任何组合完成时也返回 0（result->completed 为 0）
+ */
+int png_optimize_image(const PNG_Image* image, const PNG_OptimizeOptions* options, uint8_t** output,
+    size_t* output_size, PNG_OptimizeResult* result) {
+    PNG_OptimizeOptions defaults;
+    if (!options) {
+        png_optimize_options_init(&defaults);
+        options = &defaults;
+    }
+    if (!image || !output || !output_size || options->level < 0 || options->level > Z_BEST_COMPRESSION ||
+        options->time_budget < 0 || options->transparent < PNG_CLEAN_NONE || options->transparent > PNG_CLEAN_ABOVE) {
+        return 0;
+    }
+
+    double start = png_monotonic_time();
+    PNG_OptimizeContext* ctx = (PNG_OptimizeContext*)calloc(1, sizeof(PNG_OptimizeContext));
+    if (!ctx) {
+        return 0;
+    }
+    ctx->level = options->level;
+    png_cancel_init(&ctx->cancel);
+
+    // 清理后的图像代替原图参与所有组合
+    PNG_Image cleaned;
+    int has_cleaned = png_clean_transparent(image, options->transparent, &cleaned);
+    if (has_cleaned) {
+        image = &cleaned;
+    }
+
+    PNG_Image reduced;
+    int has_reduced = png_reduce_image(image, &reduced);
+    uint32_t variants = has_reduced ? 2 : 1;
+    ctx->images[0] = has_reduced ? &reduced : image;
+    ctx->images[1] = image;
+
+    // 调色板图像先按抽样试压缩选好调色板顺序，所有组合共用
+    PNG_Image sorted[2];
+    int has_sorted[2] = { 0, 0 };
+    PNG_EncodeOptions sort_options;
+    png_encode_options_init(&sort_options);
+    sort_options.level = ctx->level;
+    for (uint32_t v = 0; v < variants; v++) {
+        has_sorted[v] = png_palette_sort(ctx->images[v], &sort_options, &sorted[v], NULL);
+        if (has_sorted[v]) {
+            ctx->images[v] = &sorted[v];
+        }
+    }
+    for (uint32_t v = 0; v < variants; v++) {
+        ctx->overhead[v] = png_optimize_overhead(ctx->images[v]);
+    }
+
+    uint32_t count = variants * PNG_OPTIMIZE_COUNT(png_optimize_mem_levels) *
+        PNG_OPTIMIZE_COUNT(png_optimize_strategies) * PNG_OPTIMIZE_COUNT(png_optimize_filters);
+    ctx->trials = (PNG_OptimizeTrial*)calloc(count, sizeof(PNG_OptimizeTrial));
+    int ok = ctx->trials != NULL;
+    if (ok) {
+        uint32_t n = 0;
+        for (uint32_t v = 0; v < variants; v++) {
+            for (uint32_t m = 0; m < PNG_OPTIMIZE_COUNT(png_optimize_mem_levels); m++) {
+                for (uint32_t s = 0; s < PNG_OPTIMIZE_COUNT(png_optimize_strategies); s++) {
+                    for (uint32_t f = 0; f < PNG_OPTIMIZE_COUNT(png_optimize_filters); f++) {
+                        PNG_OptimizeTrial* trial = &ctx->trials[n++];
+                        trial->variant = (int)v;
+                        trial->filter = png_optimize_filters[f];
+                        trial->strategy = png_optimize_strategies[s];
+                        trial->mem_level = png_optimize_mem_levels[m];
+                    }
+                }
+            }
+        }
+
+        png_thread_t watchdog;
+        int watching = 0;
+        if (options->time_budget > 0) {
+            ctx->deadline = start + options->time_budget;
+            watching = png_thread_create(&watchdog, png_optimize_watchdog, ctx);
+        }
+        png_parallel_tasks(count, png_optimize_task, ctx);
+        if (watching) {
+            atomic_store(&ctx->finished, 1);
+            png_thread_join(watchdog);
+        }
+    }
+
+    const PNG_OptimizeTrial* best = NULL;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        const PNG_OptimizeTrial* trial = &ctx->trials[i];
+        if (trial->size && (!best || trial->size < best->size)) {
+            best = trial;
+        }
+    }
+
+    // 预算内没有任何组合完成时不再编码，避免超出预算
+    PNG_EncodeOptions encode_options;
+    ok = ok && best;
+    if (ok) {
+        png_optimize_encode_options(ctx, best, &encode_options);
+        ok = png_write_memory(ctx->images[best->variant], &encode_options, output, output_size);
+    }
+    if (result) {
+        memset(result, 0, sizeof(PNG_OptimizeResult));
+        result->trials = count;
+        result->completed = atomic_load(&ctx->completed);
+        if (ok) {
+            result->reduced = has_reduced && best->variant == 0;
+            result->options = encode_options;
+        }
+        result->elapsed = png_monotonic_time() - start;
+    }
+
+    for (int i = 0; i < PNG_MAX_THREADS; i++) {
+        if (ctx->workers[i].ready) {
+            deflateEnd(&ctx->workers[i].strm);
+        }
+    }
+    for (uint32_t v = 0; v < variants; v++) {
+        if (has_sorted[v]) {
+            png_free_image(&sorted[v]);
+        }
+    }
+    if (has_reduced) {
+        png_free_image(&reduced);
+    }
+    if (has_cleaned) {
+        png_free_image(&cleaned);
+    }
+    free(ctx->trials);
+    free(ctx);
+    return ok;
+}
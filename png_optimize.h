@@ -0,0 +1,33 @@
+#ifndef PNG_OPTIMIZE_H
+#define PNG_OPTIMIZE_H
+
+#include "png_encoder.h"
+
+// 默认的试压缩级别
+#define PNG_OPTIMIZE_DEFAULT_LEVEL 9
+
+/**
+ * 优化选项
+ */
+typedef struct {
+    double time_budget;             // 试压缩的时间预算（秒），0 表示不限；用完后取消未完成的试压缩，按已完成的结果编码
+    int level;                      // zlib 压缩级别（0 ~ 9），所有组合使用同一级别
+    int transparent;                // 试压缩前完全透明像素的颜色清理方式（PNG_CLEAN_*），默认不清理以保证完全无损
+} PNG_OptimizeOptions;
+
+/**
+ * 优化结果
+ */
+typedef struct {
+    uint32_t trials;                // 计划的试压缩组合数
+    uint32_t completed;             // 在预算内完成的组合数
+    int reduced;                    // 最终结果是否使用了无损缩减后的图像
+    PNG_EncodeOptions options;      // 最终结果的编码选项
+    double elapsed;                 // 总耗时（秒）
+} PNG_OptimizeResult;
+
+void png_optimize_options_init(PNG_OptimizeOptions* options);
+int png_optimize_image(const PNG_Image* image, const PNG_OptimizeOptions* options, uint8_t** output,
+    size_t* output_size, PNG_OptimizeResult* result);
+
+#endif // PNG_OPTIMIZE_H
@@ -0,0 +1,419 @@
+#include "png_palette.h"
+#include "png_thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 调色板排序
+ *
+ * 索引值相近的像素在滤波后残差更小、deflate 更容易匹配，因此调色板的顺序对压缩率影响很大。各种排序方式都先把透明的颜色
+ * 排在最前面（tRNS 只需覆盖这些颜色），并删除未使用的颜色，再生成旧索引到新索引的查找表。位深小于 8 时查找表展开为
+ * 按字节的查找表（一个字节内的所有索引一次完成映射），因此重映射总是对整幅图像逐字节查表一遍。
+ *
+ * 自动选择时在图像中均匀抽取若干行带，各种顺序（含原顺序）在线程池上并行重映射并试压缩，按抽样结果推算整幅图像的大小，
+ * 加上 PLTE 与 tRNS 的字节数后选出最小的。索引是任意的编号，不滤波时换一种顺序只是把字节换成另一个字节，deflate 的结果
+ * 几乎不变；顺序的差异主要体现在滤波之后，因此滤波策略为 PNG_ENCODE_FILTER_AUTO 的 8 位图像同时试压缩不滤波与逐行选择
+ * 滤波两种策略，一并选出。
+ */
+
+// 参与自动选择的排序方式（原顺序排在最前，大小相同时保留原图）
+static const int png_palette_orders[] = {
+    PNG_ENCODE_PALETTE_KEEP, PNG_ENCODE_PALETTE_LUMA, PNG_ENCODE_PALETTE_FREQUENCY, PNG_ENCODE_PALETTE_NEAREST,
+};
+
+#define PNG_PALETTE_ORDER_COUNT ((uint32_t)(sizeof(png_palette_orders) / sizeof(png_palette_orders[0])))
+
+// 一种排序方式的结果
+typedef struct {
+    int order;                      // 排序方式（PNG_ENCODE_PALETTE_*）
+    uint8_t entries[256];           // 按新顺序排列的旧索引
+    uint32_t count;                 // 新调色板的颜色数
+    uint32_t transparency_size;     // 新 tRNS 的长度
+    uint8_t lut[256];               // 按字节的查找表
+} PNG_PaletteOrder;
+
+// 一个试压缩组合：排序方式 × 滤波策略
+typedef struct {
+    const PNG_PaletteOrder* order;
+    int filter;
+    uint64_t size;                  // 推算的 IDAT 与 PLTE、tRNS 数据字节数，0 表示试压缩失败
+} PNG_PaletteTrial;
+
+typedef struct {
+    const PNG_Image* image;
+    const PNG_EncodeOptions* options;
+    uint32_t bytes_per_line;
+    uint32_t band_rows;             // 每个抽样行带的行数
+    uint32_t bands;                 // 抽样行带数
+    PNG_PaletteTrial* trials;
+} PNG_PaletteContext;
+
+static inline uint8_t png_palette_alpha(const PNG_Image* image, uint32_t index) {
+    return index < image->transparency_size ? image->transparency[index] : 0xFF;
+}
+
+/**
+ * 统计每个索引的使用次数：整字节按字节计数后展开，每行末尾不满一字节的部分逐个统计（不计入填充位）
+ *
+ * @return              是否所有索引都在调色板范围内，返回 1(真) 或 0(假)
+ */
+static int png_palette_count(const PNG_Image* image, uint32_t bytes_per_line, uint64_t counts[256]) {
+    const PNG_IHDR* header = &image->header;
+    uint8_t depth = header->bit_depth;
+    uint32_t per_byte = 8 / depth;
+    uint32_t full_bytes = header->width / per_byte;
+    uint32_t rest = header->width % per_byte;
+    uint8_t max_index = (uint8_t)((1u << depth) - 1);
+
+    uint64_t* bytes = (uint64_t*)calloc(256, sizeof(uint64_t));
+    if (!bytes) {
+        return 0;
+    }
+    memset(counts, 0, 256 * sizeof(uint64_t));
+    for (uint32_t y = 0; y < header->height; y++) {
+        const uint8_t* row = image->image_data + (size_t)y * bytes_per_line;
+        for (uint32_t x = 0; x < full_bytes; x++) {
+            bytes[row[x]]++;
+        }
+        for (uint32_t i = 0; i < rest; i++) {
+            counts[(row[full_bytes] >> (8 - depth * (i + 1))) & max_index]++;
+        }
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        if (!bytes[b]) {
+            continue;
+        }
+        for (uint32_t i = 0; i < per_byte; i++) {
+            counts[(b >> (8 - depth * (i + 1))) & max_index] += bytes[b];
+        }
+    }
+    free(bytes);
+
+    for (uint32_t i = image->palette_size; i < 256; i++) {
+        if (counts[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline uint32_t png_palette_luma(const PNG_PaletteEntry* entry) {
+    return 299u * entry->red + 587u * entry->green + 114u * entry->blue;
+}
+
+static inline uint32_t png_palette_distance(const PNG_Image* image, uint32_t a, uint32_t b) {
+    const PNG_PaletteEntry* x = &image->palette[a];
+    const PNG_PaletteEntry* y = &image->palette[b];
+    int dr = x->red - y->red;
+    int dg = x->green - y->green;
+    int db = x->blue - y->blue;
+    int da = png_palette_alpha(image, a) - png_palette_alpha(image, b);
+    return (uint32_t)(dr * dr + dg * dg + db * db + da * da);
+}
+
+/**
+ * 按排序方式排列一组旧索引（原地），keys 为每个旧索引的排序键，键相同时保持原顺序
+ */
+static void png_palette_sort_keys(uint8_t* entries, uint32_t count, const uint64_t* keys) {
+    for (uint32_t i = 1; i < count; i++) {
+        uint8_t entry = entries[i];
+        uint32_t j = i;
+        for (; j > 0 && keys[entries[j - 1]] > keys[entry]; j--) {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = entry;
+    }
+}
+
+/**
+ * 最近邻遍历：从最常用的颜色出发（前一组的最后一个颜色存在时从离它最近的颜色出发），每次取距离最近的未访问颜色
+ */
+static void png_palette_nearest(const PNG_Image* image, const uint64_t* counts, uint8_t* entries, uint32_t count,
+    int previous) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t best = i;
+        for (uint32_t j = i + 1; j < count; j++) {
+            int closer;
+            if (i == 0 && previous < 0) {
+                closer = counts[entries[j]] > counts[entries[best]];
+            } else {
+                uint32_t from = i > 0 ? entries[i - 1] : (uint32_t)previous;
+                closer = png_palette_distance(image, from, entries[j]) < png_palette_distance(image, from, entries[best]);
+            }
+            if (closer) {
+                best = j;
+            }
+        }
+        uint8_t entry = entries[best];
+        entries[best] = entries[i];
+        entries[i] = entry;
+    }
+}
+
+/**
+ * 生成一种排序方式的新顺序与按字节的查找表
+ */
+static void png_palette_build(const PNG_Image* image, const uint64_t* counts, PNG_PaletteOrder* result) {
+    uint8_t index_lut[256] = {0};
+    result->count = 0;
+    result->transparency_size = 0;
+
+    if (result->order == PNG_ENCODE_PALETTE_KEEP) {
+        for (uint32_t i = 0; i < image->palette_size; i++) {
+            result->entries[i] = (uint8_t)i;
+            index_lut[i] = (uint8_t)i;
+        }
+        result->count = image->palette_size;
+        result->transparency_size = image->transparency_size;
+    } else {
+        // 先放使用过的透明颜色，再放使用过的不透明颜色
+        uint32_t transparent = 0;
+        for (int pass = 0; pass < 2; pass++) {
+            uint32_t start = result->count;
+            for (uint32_t i = 0; i < image->palette_size; i++) {
+                if (counts[i] && (png_palette_alpha(image, i) != 0xFF) == (pass == 0)) {
+                    result->entries[result->count++] = (uint8_t)i;
+                }
+            }
+            if (pass == 0) {
+                transparent = result->count;
+            }
+
+            uint8_t* group = result->entries + start;
+            uint32_t group_size = result->count - start;
+            uint64_t keys[256];
+            if (result->order == PNG_ENCODE_PALETTE_LUMA) {
+                for (uint32_t i = 0; i < image->palette_size; i++) {
+                    keys[i] = png_palette_luma(&image->palette[i]);
+                }
+                png_palette_sort_keys(group, group_size, keys);
+            } else if (result->order == PNG_ENCODE_PALETTE_FREQUENCY) {
+                for (uint32_t i = 0; i < image->palette_size; i++) {
+                    keys[i] = UINT64_MAX - counts[i];
+                }
+                png_palette_sort_keys(group, group_size, keys);
+            } else {
+                png_palette_nearest(image, counts, group, group_size, start > 0 ? result->entries[start - 1] : -1);
+            }
+        }
+        result->transparency_size = transparent;
+        for (uint32_t i = 0; i < result->count; i++) {
+            index_lut[result->entries[i]] = (uint8_t)i;
+        }
+    }
+
+    // 展开为按字节的查找表
+    uint8_t depth = image->header.bit_depth;
+    uint32_t max_index = (1u << depth) - 1;
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t mapped = 0;
+        for (uint32_t shift = 0; shift < 8; shift += depth) {
+            mapped |= (uint32_t)index_lut[(b >> shift) & max_index] << shift;
+        }
+        result->lut[b] = (uint8_t)mapped;
+    }
+}
+
+/**
+ * 按查找表重映射一行，末尾不满一字节的填充位保持为 0
+ */
+static void png_palette_remap_row(const uint8_t* lut, const uint8_t* row, uint32_t bytes, uint8_t pad_mask, uint8_t* out) {
+    for (uint32_t x = 0; x < bytes; x++) {
+        out[x] = lut[row[x]];
+    }
+    out[bytes - 1] &= pad_mask;
+}
+
+static uint8_t png_palette_pad_mask(const PNG_IHDR* header) {
+    uint32_t used = (uint32_t)(((uint64_t)header->width * header->bit_depth) % 8);
+    return used ? (uint8_t)(0xFF << (8 - used)) : 0xFF;
+}
+
+/**
+ * 试压缩一个组合：重映射抽样行带后统计 zlib 流的字节数，按抽样比例推算整幅图像
+ */
+static void png_palette_trial(void* user_data, uint32_t index, int worker) {
+    (void)worker;
+    PNG_PaletteContext* ctx = (PNG_PaletteContext*)user_data;
+    PNG_PaletteTrial* trial = &ctx->trials[index];
+    const PNG_Image* image = ctx->image;
+    const PNG_EncodeOptions* options = ctx->options;
+
+    uint32_t sample_rows = ctx->band_rows * ctx->bands;
+    PNG_Image sample;
+    memset(&sample, 0, sizeof(PNG_Image));
+    sample.header = image->header;
+    sample.header.height = sample_rows;
+    sample.header.interlace_method = 0;
+    sample.palette = image->palette;        // 只用于检查图像头，不影响压缩结果
+    sample.palette_size = image->palette_size;
+    sample.image_data_size = (size_t)ctx->bytes_per_line * sample_rows;
+    sample.image_data = (uint8_t*)malloc(sample.image_data_size);
+    if (!sample.image_data) {
+        return;
+    }
+
+    uint8_t pad_mask = png_palette_pad_mask(&image->header);
+    uint8_t* out = sample.image_data;
+    for (uint32_t b = 0; b < ctx->bands; b++) {
+        uint32_t first = ctx->bands > 1 ?
+            (uint32_t)((uint64_t)(image->header.height - ctx->band_rows) * b / (ctx->bands - 1)) : 0;
+        for (uint32_t y = first; y < first + ctx->band_rows; y++) {
+            png_palette_remap_row(trial->order->lut, image->image_data + (size_t)y * ctx->bytes_per_line,
+                ctx->bytes_per_line, pad_mask, out);
+            out += ctx->bytes_per_line;
+        }
+    }
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(z_stream));
+    uint64_t size = 0;
+    if (deflateInit2(&strm, options->level, Z_DEFLATED, MAX_WBITS, options->mem_level, options->strategy) == Z_OK) {
+        if (png_encode_deflate_size(&sample, trial->filter, &strm, NULL, &size)) {
+            trial->size = size * image->header.height / sample_rows + (uint64_t)trial->order->count * 3 +
+                trial->order->transparency_size;
+        }
+        deflateEnd(&strm);
+    }
+    free(sample.image_data);
+}
+
+/**
+ * 自动选择：在均匀分布的抽样行带上并行试压缩各种排序方式（与滤波策略）的组合，返回推算结果最小的组合
+ */
+static const PNG_PaletteTrial* png_palette_choose(const PNG_Image* image, const PNG_EncodeOptions* options,
+    uint32_t bytes_per_line, const PNG_PaletteOrder* orders, PNG_PaletteTrial* trials) {
+    const PNG_IHDR* header = &image->header;
+    PNG_PaletteContext ctx;
+    memset(&ctx, 0, sizeof(PNG_PaletteContext));
+    ctx.image = image;
+    ctx.options = options;
+    ctx.bytes_per_line = bytes_per_line;
+    ctx.trials = trials;
+    if ((uint64_t)bytes_per_line * header->height <= PNG_PALETTE_SAMPLE_BYTES) {
+        ctx.band_rows = header->height;
+        ctx.bands = 1;
+    } else {
+        ctx.band_rows = PNG_PALETTE_SAMPLE_BYTES / PNG_PALETTE_SAMPLE_BANDS / bytes_per_line;
+        if (ctx.band_rows == 0) {
+            ctx.band_rows = 1;
+        }
+        ctx.bands = header->height / ctx.band_rows;
+        if (ctx.bands > PNG_PALETTE_SAMPLE_BANDS) {
+            ctx.bands = PNG_PALETTE_SAMPLE_BANDS;
+        }
+    }
+
+    // 调色板图像按 PNG_ENCODE_FILTER_AUTO 不滤波；8 位索引重排后逐行选择滤波可能更好，一并比较
+    int filters[2] = { options->filter, PNG_ENCODE_FILTER_MINSUM };
+    uint32_t filter_count = options->filter == PNG_ENCODE_FILTER_AUTO && header->bit_depth == 8 ? 2 : 1;
+    uint32_t count = 0;
+    for (uint32_t f = 0; f < filter_count; f++) {
+        for (uint32_t i = 0; i < PNG_PALETTE_ORDER_COUNT; i++) {
+            trials[count].order = &orders[i];
+            trials[count].filter = filters[f];
+            trials[count].size = 0;
+            count++;
+        }
+    }
+    png_parallel_tasks(count, png_palette_trial, &ctx);
+
+    const PNG_PaletteTrial* best = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        if (trials[i].size && (!best || trials[i].size < best->size)) {
+            best = &trials[i];
+        }
+    }
+    return best;
+}
+
+/**
+ * 按编码选项中的排序方式重排调色板图像的调色板，透明的颜色排在最前面，删除未使用的颜色，并重映射所有索引
+ *
+ * 自动选择时在均匀分布的抽样行带上并行试压缩各种顺序（使用编码选项中的 zlib 参数；滤波策略为 PNG_ENCODE_FILTER_AUTO
+ * 的 8 位图像同时比较不滤波与逐行选择滤波），选出推算结果最小的组合；原顺序最小时不生成新图像。
+ * 解码结果（RGBA）与原图完全相同。
+ *
+ * @param image         调色板图像（与解码器输出的格式相同），其他颜色类型直接返回 0
+ * @param options       编码选项，palette 为排序方式
+ * @param sorted        输出参数，重排后的图像（由调用者 png_free_image），总是非隔行
+ * @param filter        输出参数，编码时应使用的滤波策略（未自动选择时为 options->filter），可以为 NULL
+ *
+ * @return              是否生成了重排后的图像，返回 1(真) 或 0(假)；返回 0 时（不需要重排或失败）sorted 无需释放
+ */
+int png_palette_sort(const PNG_Image* image, const PNG_EncodeOptions* options, PNG_Image* sorted, int* filter) {
+    if (!image || !options || !sorted) {
+        return 0;
+    }
+    if (filter) {
+        *filter = options->filter;
+    }
+    memset(sorted, 0, sizeof(PNG_Image));
+
+    const PNG_IHDR* header = &image->header;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    if (options->palette <= PNG_ENCODE_PALETTE_KEEP || options->palette > PNG_ENCODE_PALETTE_AUTO ||
+        header->color_type != PNG_COLOR_TYPE_PALETTE || header->bit_depth > 8 || !image->palette ||
+        image->palette_size == 0 || image->palette_size > 256 || image->transparency_size > image->palette_size ||
+        bytes_per_line == 0 || !image->image_data || image->image_data_size / bytes_per_line < header->height) {
+        return 0;
+    }
+
+    uint64_t* counts = (uint64_t*)malloc(256 * sizeof(uint64_t));
+    PNG_PaletteOrder* orders = (PNG_PaletteOrder*)calloc(PNG_PALETTE_ORDER_COUNT, sizeof(PNG_PaletteOrder));
+    PNG_PaletteTrial* trials = (PNG_PaletteTrial*)calloc(PNG_PALETTE_ORDER_COUNT * 2, sizeof(PNG_PaletteTrial));
+    int ok = counts && orders && trials && png_palette_count(image, bytes_per_line, counts);
+
+    const PNG_PaletteOrder* best = NULL;
+    if (ok && options->palette == PNG_ENCODE_PALETTE_AUTO) {
+        for (uint32_t i = 0; i < PNG_PALETTE_ORDER_COUNT; i++) {
+            orders[i].order = png_palette_orders[i];
+            png_palette_build(image, counts, &orders[i]);
+        }
+        const PNG_PaletteTrial* trial = png_palette_choose(image, options, bytes_per_line, orders, trials);
+        if (trial) {
+            best = trial->order;
+            if (filter) {
+                *filter = trial->filter;
+            }
+        }
+    } else if (ok) {
+        orders[0].order = options->palette;
+        png_palette_build(image, counts, &orders[0]);
+        best = &orders[0];
+    }
+    ok = ok && best && best->order != PNG_ENCODE_PALETTE_KEEP;
+
+    // 生成新的调色板与 tRNS，再对整幅图像查表一遍
+    if (ok) {
+        sorted->header = *header;
+        sorted->header.interlace_method = 0;
+        sorted->palette = (PNG_PaletteEntry*)malloc(sizeof(PNG_PaletteEntry) * best->count);
+        sorted->palette_size = best->count;
+        sorted->transparency = best->transparency_size ? (uint8_t*)malloc(best->transparency_size) : NULL;
+        sorted->transparency_size = best->transparency_size;
+        sorted->image_data_size = (size_t)bytes_per_line * header->height;
+        sorted->image_data = (uint8_t*)malloc(sorted->image_data_size);
+        ok = sorted->palette && (sorted->transparency || !best->transparency_size) && sorted->image_data;
+    }
+    if (ok) {
+        for (uint32_t i = 0; i < best->count; i++) {
+            sorted->palette[i] = image->palette[best->entries[i]];
+        }
+        for (uint32_t i = 0; i < best->transparency_size; i++) {
+            sorted->transparency[i] = png_palette_alpha(image, best->entries[i]);
+        }
+        uint8_t pad_mask = png_palette_pad_mask(header);
+        for (uint32_t y = 0; y < header->height; y++) {
+            png_palette_remap_row(best->lut, image->image_data + (size_t)y * bytes_per_line, bytes_per_line, pad_mask,
+                sorted->image_data + (size_t)y * bytes_per_line);
+        }
+    } else {
+        png_free_image(sorted);
+    }
+
+    free(counts);
+    free(orders);
+    free(trials);
+    return ok;
+}
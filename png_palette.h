@@ -0,0 +1,12 @@
+#ifndef PNG_PALETTE_H
+#define PNG_PALETTE_H
+
+#include "png_encoder.h"
+
+// 自动选择排序方式时试压缩的抽样数据量（未滤波的字节数）与抽样的行带数
+#define PNG_PALETTE_SAMPLE_BYTES (512 * 1024)
+#define PNG_PALETTE_SAMPLE_BANDS 4
+
+int png_palette_sort(const PNG_Image* image, const PNG_EncodeOptions* options, PNG_Image* sorted, int* filter);
+
+#endif // PNG_PALETTE_H
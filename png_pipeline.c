@@ -0,0 +1,576 @@
+#include "png_pipeline.h"
+#include "png_filter.h"
+#include "png_interlace.h"
+#include "png_stream.h"
+#include "png_thread.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 三级流水线解码
+ *
+ *   读取线程：逐块读取 IDAT 并校验 CRC  ──压缩数据缓冲区──▶
+ *   解压线程：inflate 出完整的扫描线     ──扫描线批次──▶
+ *   调用线程：还原滤波并转换为输出格式
+ *
+ * 相邻两级之间各有一对单生产者 / 单消费者队列：一个传递装满的缓冲区，另一个把用完的缓冲区还给上一级。
+ * 缓冲区个数固定，因此内存占用有上限，较快的一级在队列满时自然等待较慢的一级，总耗时趋近最慢一级的耗时。
+ *
+ * 队列本身无锁；等待的一级先让出时间片重试若干次，仍然不能入队 / 出队时在条件变量上阻塞，
+ * 另一级每次入队 / 出队后发现有线程阻塞才加锁唤醒。读取线程等待 I/O 时，其余两级不会空转占满 CPU。
+ */
+
+// 阻塞在条件变量上之前自旋重试的次数
+#define PNG_PIPELINE_SPIN_COUNT 64
+
+// 压缩数据缓冲区
+typedef struct {
+    uint8_t* data;
+    uint32_t size;
+    int last;                               // IDAT 序列已结束（size 为 0）
+} PNG_PipeInput;
+
+// 扫描线批次：若干条完整的扫描线（含过滤类型字节）首尾相接
+typedef struct {
+    uint8_t* data;
+    uint32_t size;
+    int last;                               // 所有扫描线已解压完毕
+} PNG_PipeBatch;
+
+// 按解码顺序遍历扫描线（隔行图像依次遍历各遍，跳过空遍）
+typedef struct {
+    const PNG_IHDR* header;
+    int passes;
+    int pass;
+    uint32_t row;                           // 当前遍内的行号
+    uint32_t pass_width;
+    uint32_t pass_height;
+    uint32_t row_bytes;                     // 当前遍每行的字节数（不含过滤类型字节）
+    int pass_start;                         // 当前行是否为本遍的第一行
+} PNG_RowCursor;
+
+typedef struct {
+    PNG_Stream stream;
+    PNG_PipeInput inputs[PNG_PIPELINE_INPUT_BUFFERS];
+    PNG_PipeBatch batches[PNG_PIPELINE_ROW_BATCHES];
+    uint32_t batch_capacity;
+    PNG_SpscQueue free_inputs;              // 解压线程 → 读取线程
+    PNG_SpscQueue full_inputs;              // 读取线程 → 解压线程
+    PNG_SpscQueue free_batches;             // 调用线程 → 解压线程
+    PNG_SpscQueue full_batches;             // 解压线程 → 调用线程
+    int stream_end;                         // zlib 数据流是否已结束，只由解压线程访问
+    atomic_int failed;                      // 任意一级出错时置位，其余各级随即退出
+    atomic_int waiters;                     // 正在阻塞等待的线程数
+    png_mutex_t lock;                       // 保护阻塞等待（队列本身无锁）
+    png_cond_t wakeup;                      // 任意队列入队 / 出队或出错时广播
+} PNG_Pipeline;
+
+static void png_row_cursor_init(PNG_RowCursor* cursor, const PNG_IHDR* header) {
+    memset(cursor, 0, sizeof(PNG_RowCursor));
+    cursor->header = header;
+    cursor->passes = header->interlace_method == PNG_INTERLACE_METHOD_ADAM7 ? PNG_ADAM7_PASSES : 1;
+    cursor->pass = -1;
+}
+
+/**
+ * 前进到下一条扫描线
+ *
+ * @return      是否还有扫描线，返回 1(真) 或 0(假)
+ */
+static int png_row_cursor_next(PNG_RowCursor* cursor) {
+    if (cursor->pass >= 0 && ++cursor->row < cursor->pass_height) {
+        cursor->pass_start = 0;
+        return 1;
+    }
+
+    while (++cursor->pass < cursor->passes) {
+        cursor->pass_width = cursor->header->width;
+        cursor->pass_height = cursor->header->height;
+        if (cursor->passes > 1) {
+            png_adam7_pass_size(cursor->header, cursor->pass, &cursor->pass_width, &cursor->pass_height);
+        }
+        if (cursor->pass_width > 0 && cursor->pass_height > 0) {
+            cursor->row = 0;
+            cursor->row_bytes = png_row_bytes(cursor->header, cursor->pass_width);
+            cursor->pass_start = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 唤醒阻塞等待的线程（只在有线程阻塞时加锁）
+ */
+static void png_pipeline_wake(PNG_Pipeline* pipeline) {
+    // 与等待方登记 waiters 之后的重试配对：要么对方重试时看到本次入队 / 出队，要么这里看到对方已登记
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&pipeline->waiters) > 0) {
+        png_mutex_lock(&pipeline->lock);
+        png_cond_broadcast(&pipeline->wakeup);
+        png_mutex_unlock(&pipeline->lock);
+    }
+}
+
+/**
+ * 标记流水线出错，并唤醒所有阻塞等待的线程
+ */
+static void png_pipeline_fail(PNG_Pipeline* pipeline) {
+    atomic_store(&pipeline->failed, 1);
+    png_mutex_lock(&pipeline->lock);
+    png_cond_broadcast(&pipeline->wakeup);
+    png_mutex_unlock(&pipeline->lock);
+}
+
+static int png_pipe_try(PNG_SpscQueue* queue, void** item, int push) {
+    return push ? png_spsc_try_push(queue, *item) : png_spsc_try_pop(queue, item);
+}
+
+/**
+ * 阻塞入队或出队：先自旋重试，再在条件变量上等待，其他阶段出错时放弃
+ *
+ * @param item          入队的元素，或输出参数，出队的元素
+ * @param push          1 表示入队，0 表示出队
+ *
+ * @return              是否成功，返回 1(真) 或 0(假)
+ */
+static int png_pipe_transfer(PNG_Pipeline* pipeline, PNG_SpscQueue* queue, void** item, int push) {
+    int done = png_pipe_try(queue, item, push);
+    for (int spin = 0; !done && spin < PNG_PIPELINE_SPIN_COUNT; spin++) {
+        if (atomic_load(&pipeline->failed)) {
+            return 0;
+        }
+        png_thread_yield();
+        done = png_pipe_try(queue, item, push);
+    }
+
+    if (!done) {
+        png_mutex_lock(&pipeline->lock);
+        atomic_fetch_add(&pipeline->waiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!(done = png_pipe_try(queue, item, push)) && !atomic_load(&pipeline->failed)) {
+            png_cond_wait(&pipeline->wakeup, &pipeline->lock);
+        }
+        atomic_fetch_sub(&pipeline->waiters, 1);
+        png_mutex_unlock(&pipeline->lock);
+        if (!done) {
+            return 0;
+        }
+    }
+
+    png_pipeline_wake(pipeline);
+    return 1;
+}
+
+/**
+ * 阻塞入队，其他阶段出错时放弃
+ */
+static int png_pipe_push(PNG_Pipeline* pipeline, PNG_SpscQueue* queue, void* item) {
+    return png_pipe_transfer(pipeline, queue, &item, 1);
+}
+
+/**
+ * 阻塞出队，其他阶段出错时放弃
+ */
+static void* png_pipe_pop(PNG_Pipeline* pipeline, PNG_SpscQueue* queue) {
+    void* item = NULL;
+    return png_pipe_transfer(pipeline, queue, &item, 0) ? item : NULL;
+}
+
+/**
+ * 第一级：读取 IDAT 压缩数据并校验 CRC，IDAT 结束后继续读完 IEND 之前的所有块
+ */
+static void png_pipeline_read(void* arg) {
+    PNG_Pipeline* pipeline = (PNG_Pipeline*)arg;
+
+    for (;;) {
+        PNG_PipeInput* input = (PNG_PipeInput*)png_pipe_pop(pipeline, &pipeline->free_inputs);
+        if (!input) {
+            return;
+        }
+        if (!png_stream_read_idat(&pipeline->stream, input->data, PNG_STREAM_INPUT_SIZE, &input->size)) {
+            png_pipeline_fail(pipeline);
+            return;
+        }
+
+        input->last = input->size == 0;
+        if (input->last && !png_stream_finish_chunks(&pipeline->stream)) {
+            png_pipeline_fail(pipeline);
+            return;
+        }
+        if (!png_pipe_push(pipeline, &pipeline->full_inputs, input) || input->last) {
+            return;
+        }
+    }
+}
+
+/**
+ * 从压缩数据队列中解压出恰好 size 字节，用完的压缩数据缓冲区归还给读取线程
+ *
+ * @param pipeline      流水线
+ * @param zs            zlib 数据流
+ * @param input         当前正在解压的压缩数据缓冲区（输入输出参数），IDAT 序列结束后为 NULL
+ * @param buffer        输出缓冲区，为 NULL 时解压到 Z_STREAM_END 为止并丢弃输出
+ * @param size          需要的字节数
+ *
+ * @return              是否解压成功，返回 1(真) 或 0(假)
+ */
+static int png_pipeline_inflate(PNG_Pipeline* pipeline, z_stream* zs, PNG_PipeInput** input, uint8_t* buffer, uint32_t size) {
+    uint8_t sink[256];
+    int drain = buffer == NULL;
+
+    zs->next_out = drain ? sink : buffer;
+    zs->avail_out = drain ? sizeof(sink) : size;
+
+    while (drain ? !pipeline->stream_end : zs->avail_out > 0) {
+        if (pipeline->stream_end) {
+            return 0;
+        }
+        if (zs->avail_in == 0) {
+            if (*input) {
+                if (!png_pipe_push(pipeline, &pipeline->free_inputs, *input)) {
+                    return 0;
+                }
+                *input = NULL;
+            }
+            *input = (PNG_PipeInput*)png_pipe_pop(pipeline, &pipeline->full_inputs);
+            if (!*input || (*input)->last) {
+                // 压缩数据在扫描线解压完之前就结束了
+                return 0;
+            }
+            zs->next_in = (*input)->data;
+            zs->avail_in = (*input)->size;
+        }
+
+        int ret = inflate(zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            pipeline->stream_end = 1;
+            if (!drain && zs->avail_out > 0) {
+                return 0;
+            }
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return 0;
+        }
+        if (drain) {
+            zs->next_out = sink;
+            zs->avail_out = sizeof(sink);
+        }
+    }
+    return 1;
+}
+
+/**
+ * 第二级：按扫描线边界把解压结果装入批次，一个批次装满即交给下一级
+ */
+static void png_pipeline_inflate_rows(void* arg) {
+    PNG_Pipeline* pipeline = (PNG_Pipeline*)arg;
+    PNG_Image* image = pipeline->stream.image;
+    PNG_PipeInput* input = NULL;
+    PNG_PipeBatch* batch = NULL;
+    PNG_RowCursor cursor;
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(z_stream));
+    if (inflateInit(&zs) != Z_OK) {
+        png_pipeline_fail(pipeline);
+        return;
+    }
+
+    batch = (PNG_PipeBatch*)png_pipe_pop(pipeline, &pipeline->free_batches);
+    if (!batch) {
+        goto fail;
+    }
+    batch->size = 0;
+    batch->last = 0;
+
+    png_row_cursor_init(&cursor, &image->header);
+    while (png_row_cursor_next(&cursor)) {
+        uint32_t size = cursor.row_bytes + 1;
+        if (batch->size + size > pipeline->batch_capacity) {
+            if (!png_pipe_push(pipeline, &pipeline->full_batches, batch)) {
+                goto fail;
+            }
+            batch = (PNG_PipeBatch*)png_pipe_pop(pipeline, &pipeline->free_batches);
+            if (!batch) {
+                goto fail;
+            }
+            batch->size = 0;
+            batch->last = 0;
+        }
+        if (!png_pipeline_inflate(pipeline, &zs, &input, batch->data + batch->size, size)) {
+            goto fail;
+        }
+        batch->size += size;
+    }
+
+    // 校验 zlib 的 Adler-32，然后丢弃剩余的压缩数据直到读取线程报告 IDAT 结束
+    if (!png_pipeline_inflate(pipeline, &zs, &input, NULL, 0)) {
+        goto fail;
+    }
+    while (!input || !input->last) {
+        if (input && !png_pipe_push(pipeline, &pipeline->free_inputs, input)) {
+            goto fail;
+        }
+        input = (PNG_PipeInput*)png_pipe_pop(pipeline, &pipeline->full_inputs);
+        if (!input) {
+            goto fail;
+        }
+    }
+
+    batch->last = 1;
+    if (!png_pipe_push(pipeline, &pipeline->full_batches, batch)) {
+        goto fail;
+    }
+    inflateEnd(&zs);
+    return;
+
+fail:
+    png_pipeline_fail(pipeline);
+    inflateEnd(&zs);
+}
+
+/**
+ * 第三级（调用线程）：还原滤波；非隔行图像逐行直接转换到输出，隔行图像先分散写入最终图像
+ *
+ * @param pipeline      流水线
+ * @param ctx           转换上下文
+ * @param raw           隔行图像的最终图像缓冲区（已清零），非隔行图像为 NULL
+ * @param output        非隔行图像的输出缓冲区
+ *
+ * @return              是否处理成功，返回 1(真) 或 0(假)
+ */
+static int png_pipeline_unfilter_rows(PNG_Pipeline* pipeline, PNG_ConvertContext* ctx, uint8_t* raw, uint8_t* output) {
+    const PNG_IHDR* header = &pipeline->stream.image->header;
+    uint32_t bytes_per_pixel = png_bytes_per_pixel(header);
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    size_t dst_row_bytes = (size_t)header->width * png_format_bytes_per_pixel(ctx->format);
+    uint8_t* zero_line = (uint8_t*)calloc(bytes_per_line + 1, 1);
+    uint8_t* saved_line = (uint8_t*)malloc(bytes_per_line + 1);
+    const uint8_t* prev_line = zero_line;
+    PNG_RowCursor cursor;
+    int ok = 0;
+
+    if (!zero_line || !saved_line) {
+        goto done;
+    }
+
+    png_row_cursor_init(&cursor, header);
+    for (;;) {
+        PNG_PipeBatch* batch = (PNG_PipeBatch*)png_pipe_pop(pipeline, &pipeline->full_batches);
+        if (!batch) {
+            goto done;
+        }
+
+        uint32_t offset = 0;
+        while (offset < batch->size) {
+            if (!png_row_cursor_next(&cursor)) {
+                goto done;
+            }
+            if (cursor.pass_start) {
+                prev_line = zero_line;
+            }
+
+            // 每行第一个字节是过滤类型
+            uint8_t* row = batch->data + offset;
+            if (!png_unfilter_row(row[0], row + 1, prev_line + 1, cursor.row_bytes, bytes_per_pixel)) {
+                goto done;
+            }
+            if (raw) {
+                uint32_t y = png_adam7_passes[cursor.pass].y0 + cursor.row * png_adam7_passes[cursor.pass].dy;
+                png_adam7_scatter_row(header, cursor.pass, row + 1, raw + (size_t)y * bytes_per_line, cursor.pass_width);
+            } else {
+                png_convert_row(ctx, row + 1, output + (size_t)cursor.row * dst_row_bytes);
+            }
+
+            prev_line = row;
+            offset += cursor.row_bytes + 1;
+        }
+
+        // 批次即将归还给解压线程，保留最后一行作为下一批次第一行的上一行
+        if (prev_line != zero_line) {
+            memcpy(saved_line, prev_line, cursor.row_bytes + 1);
+            prev_line = saved_line;
+        }
+
+        int last = batch->last;
+        if (!png_pipe_push(pipeline, &pipeline->free_batches, batch)) {
+            goto done;
+        }
+        if (last) {
+            break;
+        }
+    }
+
+    ok = 1;
+
+done:
+    if (!ok) {
+        png_pipeline_fail(pipeline);
+    }
+    free(zero_line);
+    free(saved_line);
+    return ok;
+}
+
+/**
+ * 以三级流水线读取 PNG 文件并直接输出指定格式的像素
+ *
+ * 读取与 CRC 校验、inflate 解压、还原滤波与格式转换分别在三个线程上同时进行，
+ * 压缩数据和扫描线在固定数量的缓冲区之间流转，不缓存整个文件，也不保留解压后的完整图像
+ * （隔行图像除外，需要集齐全部七遍后才能转换）。适合单个大文件、且 I/O 或解压耗时较长的场景。
+ *
+ * @param filename      PNG 文件路径
+ * @param image         图像结构体，只写入 header、palette、transparency，image_data 保持为空
+ * @param format        输出像素格式（PNG_FORMAT_*）
+ * @param output        输出像素数据（需要调用者释放）
+ * @param output_size   输出数据大小
+ *
+ * @return              是否解码成功，返回 1(真) 或 0(假)
+ */
+int png_read_file_pipelined(const char* filename, PNG_Image* image, int format, uint8_t** output, size_t* output_size) {
+    if (!output || !output_size || png_format_bytes_per_pixel(format) == 0) {
+        return 0;
+    }
+    *output = NULL;
+    *output_size = 0;
+
+    PNG_Pipeline* pipeline = (PNG_Pipeline*)calloc(1, sizeof(PNG_Pipeline));
+    if (!pipeline) {
+        return 0;
+    }
+    if (!png_stream_open(&pipeline->stream, filename, image)) {
+        free(pipeline);
+        return 0;
+    }
+    if (!png_check_memory_budget(&image->header)) {
+        png_stream_close(&pipeline->stream);
+        png_free_image(image);
+        free(pipeline);
+        return 0;
+    }
+
+    PNG_IHDR* header = &image->header;
+    int interlaced = header->interlace_method == PNG_INTERLACE_METHOD_ADAM7;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    PNG_ConvertContext ctx;
+    int ctx_ready = 0;
+    int reader_started = 0;
+    int inflater_started = 0;
+    png_thread_t reader;
+    png_thread_t inflater;
+    uint8_t* pixels = NULL;
+    uint64_t pixels_size = (uint64_t)header->width * header->height * png_format_bytes_per_pixel(format);
+    int ok = 0;
+
+    atomic_init(&pipeline->failed, 0);
+    atomic_init(&pipeline->waiters, 0);
+    png_mutex_init(&pipeline->lock);
+    png_cond_init(&pipeline->wakeup);
+
+    // 每个批次约为一个行带大小，至少能容纳一整行
+    pipeline->batch_capacity = PNG_BAND_BYTES;
+    if (pipeline->batch_capacity < bytes_per_line + 1) {
+        pipeline->batch_capacity = bytes_per_line + 1;
+    }
+
+    if (!png_spsc_init(&pipeline->free_inputs, PNG_PIPELINE_INPUT_BUFFERS) ||
+        !png_spsc_init(&pipeline->full_inputs, PNG_PIPELINE_INPUT_BUFFERS) ||
+        !png_spsc_init(&pipeline->free_batches, PNG_PIPELINE_ROW_BATCHES) ||
+        !png_spsc_init(&pipeline->full_batches, PNG_PIPELINE_ROW_BATCHES)) {
+        goto cleanup;
+    }
+    for (int i = 0; i < PNG_PIPELINE_INPUT_BUFFERS; i++) {
+        pipeline->inputs[i].data = (uint8_t*)malloc(PNG_STREAM_INPUT_SIZE);
+        if (!pipeline->inputs[i].data) {
+            goto cleanup;
+        }
+        png_spsc_try_push(&pipeline->free_inputs, &pipeline->inputs[i]);
+    }
+    for (int i = 0; i < PNG_PIPELINE_ROW_BATCHES; i++) {
+        pipeline->batches[i].data = (uint8_t*)malloc(pipeline->batch_capacity);
+        if (!pipeline->batches[i].data) {
+            goto cleanup;
+        }
+        png_spsc_try_push(&pipeline->free_batches, &pipeline->batches[i]);
+    }
+
+    if (pixels_size > SIZE_MAX || pixels_size > png_get_memory_budget() || !png_convert_context_init(&ctx, image, format)) {
+        goto cleanup;
+    }
+    ctx_ready = 1;
+
+    if (interlaced) {
+        // 位深小于 8 时分散写入按位进行，最终图像需预先清零
+        uint64_t image_size = (uint64_t)header->height * bytes_per_line;
+        if (image_size > SIZE_MAX) {
+            goto cleanup;
+        }
+        image->image_data_size = (size_t)image_size;
+        image->image_data = (uint8_t*)calloc(image->image_data_size, 1);
+        if (!image->image_data) {
+            goto cleanup;
+        }
+    } else {
+        pixels = (uint8_t*)malloc((size_t)pixels_size);
+        if (!pixels) {
+            goto cleanup;
+        }
+    }
+
+    reader_started = png_thread_create(&reader, png_pipeline_read, pipeline);
+    inflater_started = reader_started && png_thread_create(&inflater, png_pipeline_inflate_rows, pipeline);
+    if (!inflater_started) {
+        png_pipeline_fail(pipeline);
+        goto cleanup;
+    }
+
+    ok = png_pipeline_unfilter_rows(pipeline, &ctx, interlaced ? image->image_data : NULL, pixels);
+
+cleanup:
+    if (reader_started) {
+        png_thread_join(reader);
+    }
+    if (inflater_started) {
+        png_thread_join(inflater);
+    }
+    ok = ok && !atomic_load(&pipeline->failed);
+
+    if (ok && interlaced) {
+        size_t size = 0;
+        ok = png_convert_image(image, format, &pixels, &size, NULL);
+    }
+    if (image->image_data) {
+        free(image->image_data);
+        image->image_data = NULL;
+        image->image_data_size = 0;
+    }
+
+    if (ctx_ready) {
+        png_convert_context_free(&ctx);
+    }
+    for (int i = 0; i < PNG_PIPELINE_INPUT_BUFFERS; i++) {
+        free(pipeline->inputs[i].data);
+    }
+    for (int i = 0; i < PNG_PIPELINE_ROW_BATCHES; i++) {
+        free(pipeline->batches[i].data);
+    }
+    png_spsc_destroy(&pipeline->free_inputs);
+    png_spsc_destroy(&pipeline->full_inputs);
+    png_spsc_destroy(&pipeline->free_batches);
+    png_spsc_destroy(&pipeline->full_batches);
+    png_cond_destroy(&pipeline->wakeup);
+    png_mutex_destroy(&pipeline->lock);
+    png_stream_close(&pipeline->stream);
+    free(pipeline);
+
+    if (!ok) {
+        free(pixels);
+        png_free_image(image);
+        return 0;
+    }
+
+    *output = pixels;
+    *output_size = (size_t)pixels_size;
+    return 1;
+}
@@ -0,0 +1,14 @@
+#ifndef PNG_PIPELINE_H
+#define PNG_PIPELINE_H
+
+#include "png_decoder.h"
+
+// 读取线程与解压线程之间流转的压缩数据缓冲区个数
+#define PNG_PIPELINE_INPUT_BUFFERS 8
+
+// 解压线程与还原 / 转换阶段之间流转的扫描线批次个数
+#define PNG_PIPELINE_ROW_BATCHES 4
+
+int png_read_file_pipelined(const char* filename, PNG_Image* image, int format, uint8_t** output, size_t* output_size);
+
+#endif // PNG_PIPELINE_H
@@ -0,0 +1,176 @@
+#include "png_pixel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PNG_PIXEL_SSE2 1
+#endif
+
+/**
+ * 将一行 RGBA16 像素转换为 BGRA8 像素（每个通道按 (x * 255 + 32895) >> 16 正确舍入）
+ *
+ * @param src       源像素行，每像素 4 个 16 位通道（R, G, B, A，主机字节序）
+ * @param dst       目标像素行，每像素 4 字节（B, G, R, A）
+ * @param width     像素个数
+ *
+ * @return          无
+ */
+void png_row_rgba16_to_bgra8(const uint16_t* src, uint8_t* dst, uint32_t width) {
+    uint32_t x = 0;
+
+#ifdef PNG_PIXEL_SSE2
+    const __m128i k255 = _mm_set1_epi16(255);
+    const __m128i sign = _mm_set1_epi16((short)0x8000);
+    const __m128i limit = _mm_set1_epi16((short)(32640 ^ 0x8000));
+
+    // 一次处理 4 个像素：x * 255 的 32 位乘积拆成高低两半，低半加上 32895 产生的进位补到高半
+    for (; x + 4 <= width; x += 4) {
+        __m128i v[2];
+        for (int i = 0; i < 2; i++) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(src + x * 4 + i * 8));
+            __m128i hi = _mm_mulhi_epu16(p, k255);
+            __m128i lo = _mm_mullo_epi16(p, k255);
+            // SSE2 没有无符号 16 位比较，翻转符号位后用有符号比较代替：lo + 32895 >= 65536 即 lo > 32640
+            __m128i carry = _mm_cmpgt_epi16(_mm_xor_si128(lo, sign), limit);
+            __m128i r = _mm_sub_epi16(hi, carry);
+            // 每个像素内交换 R 与 B
+            r = _mm_shufflelo_epi16(r, _MM_SHUFFLE(3, 0, 1, 2));
+            v[i] = _mm_shufflehi_epi16(r, _MM_SHUFFLE(3, 0, 1, 2));
+        }
+        _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(v[0], v[1]));
+    }
+#endif
+
+    for (; x < width; x++) {
+        const uint16_t* p = src + x * 4;
+        dst[x * 4] = png_round16to8(p[2]);
+        dst[x * 4 + 1] = png_round16to8(p[1]);
+        dst[x * 4 + 2] = png_round16to8(p[0]);
+        dst[x * 4 + 3] = png_round16to8(p[3]);
+    }
+}
+
+/**
+ * 将一行 BGRA8 像素无损扩展为 RGBA16 像素（x * 257，使 0 与 255 分别映射到 0 与 65535）
+ *
+ * @param src       源像素行，每像素 4 字节（B, G, R, A）
+ * @param dst       目标像素行，每像素 4 个 16 位通道（R, G, B, A，主机字节序）
+ * @param width     像素个数
+ *
+ * @return          无
+ */
+void png_row_bgra8_to_rgba16(const uint8_t* src, uint16_t* dst, uint32_t width) {
+    uint32_t x = 0;
+
+#ifdef PNG_PIXEL_SSE2
+    for (; x + 4 <= width; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        // 字节与自身交错即得到 x * 257
+        __m128i lo = _mm_unpacklo_epi8(p, p);
+        __m128i hi = _mm_unpackhi_epi8(p, p);
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        _mm_storeu_si128((__m128i*)(dst + x * 4), lo);
+        _mm_storeu_si128((__m128i*)(dst + x * 4 + 8), hi);
+    }
+#endif
+
+    for (; x < width; x++) {
+        const uint8_t* p = src + x * 4;
+        dst[x * 4] = (uint16_t)(p[2] * 257);
+        dst[x * 4 + 1] = (uint16_t)(p[1] * 257);
+        dst[x * 4 + 2] = (uint16_t)(p[0] * 257);
+        dst[x * 4 + 3] = (uint16_t)(p[3] * 257);
+    }
+}
+
+/**
+ * 将一行直通 α（straight alpha）的 BGRA8 像素转换为预乘 α 像素：c' = round(c * a / 255)
+ *
+ * @param src       源像素行，每像素 4 字节（B, G, R, A）
+ * @param dst       目标像素行，可以与 src 相同（原地转换）
+ * @param width     像素个数
+ *
+ * @return          无
+ */
+void png_row_premultiply_bgra8(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    uint32_t x = 0;
+
+#ifdef PNG_PIXEL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    // α 通道自身乘以 255 再除以 255，结果不变
+    const __m128i alpha_one = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+    for (; x + 4 <= width; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        __m128i v[2] = { _mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero) };
+        for (int i = 0; i < 2; i++) {
+            // 把每个像素的 α 广播到 4 个通道，α 通道位置替换为 255
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v[i], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_or_si128(_mm_andnot_si128(alpha_mask, a), alpha_one);
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(v[i], a), bias);
+            v[i] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+        _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(v[0], v[1]));
+    }
+#endif
+
+    for (; x < width; x++) {
+        uint8_t a = src[x * 4 + 3];
+        dst[x * 4] = png_div255(src[x * 4] * a);
+        dst[x * 4 + 1] = png_div255(src[x * 4 + 1] * a);
+        dst[x * 4 + 2] = png_div255(src[x * 4 + 2] * a);
+        dst[x * 4 + 3] = a;
+    }
+}
+
+/**
+ * 将一行预乘 α 的 BGRA8 像素还原为直通 α 像素：c' = min(255, round(c * 255 / a))，a 为 0 时颜色清零
+ *
+ * @param src       源像素行，每像素 4 字节（B, G, R, A）
+ * @param dst       目标像素行，可以与 src 相同（原地转换）
+ * @param width     像素个数
+ *
+ * @return          无
+ */
+void png_row_unpremultiply_bgra8(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    uint32_t x = 0;
+
+#ifdef PNG_PIXEL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+    const __m128 k510 = _mm_set1_ps(510.0f);
+    const __m128 k255 = _mm_set1_ps(255.0f);
+    const __m128 kzero = _mm_setzero_ps();
+
+    // 商 (510c + a) / 2a 的分子小于 2^24，单精度除法正确舍入后向下取整即为精确结果
+    for (; x + 4 <= width; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        __m128i w[2] = { _mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero) };
+        __m128i q[4];
+        for (int i = 0; i < 4; i++) {
+            __m128i d = (i & 1) ? _mm_unpackhi_epi16(w[i >> 1], zero) : _mm_unpacklo_epi16(w[i >> 1], zero);
+            __m128 c = _mm_cvtepi32_ps(d);
+            __m128 a = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 r = _mm_div_ps(_mm_add_ps(_mm_mul_ps(c, k510), a), _mm_add_ps(a, a));
+            // a == 0 时除法得到 inf / NaN，min 会返回 255，随后再用掩码清零
+            r = _mm_min_ps(r, k255);
+            r = _mm_andnot_ps(_mm_cmpeq_ps(a, kzero), r);
+            q[i] = _mm_cvttps_epi32(r);
+        }
+        __m128i out = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+        out = _mm_or_si128(_mm_andnot_si128(alpha_mask, out), _mm_and_si128(alpha_mask, p));
+        _mm_storeu_si128((__m128i*)(dst + x * 4), out);
+    }
+#endif
+
+    for (; x < width; x++) {
+        uint32_t a = src[x * 4 + 3];
+        for (int c = 0; c < 3; c++) {
+            uint32_t v = a ? (src[x * 4 + c] * 255 + a / 2) / a : 0;
+            dst[x * 4 + c] = (uint8_t)(v > 255 ? 255 : v);
+        }
+        dst[x * 4 + 3] = (uint8_t)a;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef PNG_PIXEL_H
+#define PNG_PIXEL_H
+
+#include <stdint.h>
+
+/**
+ * 像素行处理内核
+ *
+ * 所有函数都以“行”为单位工作，输入输出均为紧密排列的像素数组。
+ * 在支持 SSE2 的平台上使用向量化实现，其余平台退回到逐像素的标量实现，两者结果逐位一致。
+ */
+
+/**
+ * 将 16 位通道值正确舍入为 8 位，等价于 round(x * 255 / 65535)
+ *
+ * @param x     16 位通道值
+ *
+ * @return      8 位通道值
+ */
+static inline uint8_t png_round16to8(uint32_t x) {
+    return (uint8_t)((x * 255 + 32895) >> 16);
+}
+
+/**
+ * 精确计算 round(x / 255)，x 取值范围 [0, 255 * 255]
+ *
+ * @param x     被除数（通常为两个 8 位通道值的乘积）
+ *
+ * @return      舍入后的商
+ */
+static inline uint8_t png_div255(uint32_t x) {
+    x += 128;
+    return (uint8_t)((x + (x >> 8)) >> 8);
+}
+
+void png_row_rgba16_to_bgra8(const uint16_t* src, uint8_t* dst, uint32_t width);
+void png_row_bgra8_to_rgba16(const uint8_t* src, uint16_t* dst, uint32_t width);
+void png_row_premultiply_bgra8(const uint8_t* src, uint8_t* dst, uint32_t width);
+void png_row_unpremultiply_bgra8(const uint8_t* src, uint8_t* dst, uint32_t width);
+
+#endif // PNG_PIXEL_H
@@ -0,0 +1,196 @@
+#include "png_progressive.h"
+#include "png_filter.h"
+#include "png_interlace.h"
+#include "png_stream.h"
+#include "png_thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+// 完成每一遍后，已解码像素在水平 / 垂直方向上的间距（即预览时每个像素要复制成的块大小）
+static const uint8_t png_preview_block_width[PNG_ADAM7_PASSES] = { 8, 4, 4, 2, 2, 1, 1 };
+static const uint8_t png_preview_block_height[PNG_ADAM7_PASSES] = { 8, 8, 4, 4, 2, 2, 1 };
+
+// 预览生成任务
+typedef struct {
+    const PNG_Image* image;
+    PNG_ConvertContext* contexts;           // 每个工作线程一个
+    uint8_t* output;
+    uint32_t src_row_bytes;
+    size_t dst_row_bytes;
+    uint32_t pixel_bytes;
+    uint32_t block_width;
+    uint32_t block_height;
+} PNG_PreviewJob;
+
+static void png_preview_band(void* ctx, uint32_t y_begin, uint32_t y_end, int worker) {
+    PNG_PreviewJob* job = (PNG_PreviewJob*)ctx;
+    uint32_t width = job->image->header.width;
+
+    for (uint32_t y = y_begin; y < y_end; y++) {
+        uint8_t* dst_row = job->output + y * job->dst_row_bytes;
+        uint32_t source_y = y & ~(job->block_height - 1);
+
+        // 块的首行若在本行带之内则直接复制；位于上一个行带时由本线程重新转换，行带之间互不等待
+        if (source_y != y && source_y >= y_begin) {
+            memcpy(dst_row, job->output + source_y * job->dst_row_bytes, job->dst_row_bytes);
+            continue;
+        }
+
+        png_convert_row(&job->contexts[worker], job->image->image_data + (size_t)source_y * job->src_row_bytes, dst_row);
+        if (job->block_width > 1) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t source_x = x & ~(job->block_width - 1);
+                if (source_x != x) {
+                    memcpy(dst_row + x * job->pixel_bytes, dst_row + source_x * job->pixel_bytes, job->pixel_bytes);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * 根据已完成的前若干遍 Adam7 数据生成块复制预览
+ *
+ * 只依赖图像数据与转换上下文，与平台无关。每个块只转换其左上角所在的扫描线，
+ * 块内其余像素在水平方向原地复制，其余扫描线整行复制；按行带在线程池上并行生成。
+ *
+ * @param image         图像结构体，image_data 为逐行排列的最终图像（尚未解码的位置可为任意值）
+ * @param pass          已完成的最后一遍序号（0 ~ 6）
+ * @param contexts      与输出格式对应的转换上下文，每个工作线程一个（png_convert_contexts_create）
+ * @param output        输出缓冲区，大小为 width * height * 每像素字节数
+ *
+ * @return              是否生成成功，返回 1(真) 或 0(假)
+ */
+int png_preview_render(const PNG_Image* image, int pass, PNG_ConvertContext* contexts, uint8_t* output) {
+    if (!image || !image->image_data || !contexts || !output || pass < 0 || pass >= PNG_ADAM7_PASSES) {
+        return 0;
+    }
+
+    PNG_PreviewJob job;
+    job.image = image;
+    job.contexts = contexts;
+    job.output = output;
+    job.src_row_bytes = png_row_bytes(&image->header, image->header.width);
+    job.pixel_bytes = png_format_bytes_per_pixel(contexts[0].format);
+    job.dst_row_bytes = (size_t)image->header.width * job.pixel_bytes;
+    job.block_width = png_preview_block_width[pass];
+    job.block_height = png_preview_block_height[pass];
+
+    return png_parallel_bands(image->header.height, job.dst_row_bytes, png_preview_band, &job);
+}
+
+/**
+ * 流式读取 PNG 文件，每完成一遍 Adam7 就通过回调交付一次预览
+ *
+ * 压缩数据边读边解压，第一遍（约 1/64 的数据）解码完成即可显示整幅图像的粗略预览，
+ * 之后每遍逐步细化。解码完成后 image 的内容与 png_read_file 的结果相同。
+ *
+ * @param filename      PNG 文件路径
+ * @param image         图像结构体
+ * @param format        预览像素格式（PNG_FORMAT_*）
+ * @param callback      逐遍预览回调，可以为 NULL
+ * @param user_data     传给回调的自定义数据
+ * @param cancel        取消令牌，可以为 NULL，每解码一行检查一次；取消后不再调用回调
+ *
+ * @return              是否解码成功，返回 1(真) 或 0(假)；取消时返回 0 并释放所有内存
+ */
+int png_read_file_progressive(const char* filename, PNG_Image* image, int format, PNG_PassCallback callback, void* user_data,
+    const PNG_CancelToken* cancel) {
+    PNG_Stream stream;
+    if (!png_stream_open(&stream, filename, image)) {
+        return 0;
+    }
+    if (!png_check_memory_budget(&image->header)) {
+        png_stream_close(&stream);
+        png_free_image(image);
+        return 0;
+    }
+
+    PNG_IHDR* header = &image->header;
+    int interlaced = header->interlace_method == PNG_INTERLACE_METHOD_ADAM7;
+    uint32_t bytes_per_pixel = png_bytes_per_pixel(header);
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    uint8_t* current_line = (uint8_t*)malloc(bytes_per_line + 1);
+    uint8_t* prev_line = (uint8_t*)malloc(bytes_per_line + 1);
+    uint8_t* preview = NULL;
+    PNG_ConvertContext* contexts = NULL;
+    int threads = png_get_thread_count();
+
+    // 位深小于 8 时分散写入按位进行，最终图像需预先清零
+    uint64_t image_size = (uint64_t)header->height * bytes_per_line;
+    if (image_size > SIZE_MAX) {
+        goto fail;
+    }
+    image->image_data_size = (size_t)image_size;
+    image->image_data = (uint8_t*)calloc(image->image_data_size, 1);
+    if (!current_line || !prev_line || !image->image_data) {
+        goto fail;
+    }
+    if (callback) {
+        preview = (uint8_t*)malloc((size_t)header->width * header->height * png_format_bytes_per_pixel(format));
+        contexts = png_convert_contexts_create(image, format, threads);
+        if (!preview || !contexts) {
+            goto fail;
+        }
+    }
+
+    for (int pass = 0; pass < (interlaced ? PNG_ADAM7_PASSES : 1); pass++) {
+        uint32_t pass_width = header->width;
+        uint32_t pass_height = header->height;
+        if (interlaced) {
+            png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+            if (pass_width == 0) {
+                continue;
+            }
+        }
+
+        uint32_t pass_row_bytes = png_row_bytes(header, pass_width);
+        memset(prev_line, 0, pass_row_bytes + 1);
+
+        for (uint32_t py = 0; py < pass_height; py++) {
+            // 每行第一个字节是过滤类型
+            if (png_cancel_requested(cancel) || !png_stream_read(&stream, current_line, pass_row_bytes + 1) ||
+                !png_unfilter_row(current_line[0], current_line + 1, prev_line + 1, pass_row_bytes, bytes_per_pixel)) {
+                goto fail;
+            }
+
+            if (interlaced) {
+                uint32_t y = png_adam7_passes[pass].y0 + py * png_adam7_passes[pass].dy;
+                png_adam7_scatter_row(header, pass, current_line + 1, image->image_data + (size_t)y * bytes_per_line, pass_width);
+            } else {
+                memcpy(image->image_data + (size_t)py * bytes_per_line, current_line + 1, bytes_per_line);
+            }
+
+            uint8_t* tmp = prev_line;
+            prev_line = current_line;
+            current_line = tmp;
+        }
+
+        if (callback && !png_cancel_requested(cancel)) {
+            // 非隔行图像只在全部解码后交付一次，按最后一遍处理
+            int preview_pass = interlaced ? pass : PNG_ADAM7_PASSES - 1;
+            png_preview_render(image, preview_pass, contexts, preview);
+            callback(user_data, preview_pass, preview, header->width, header->height);
+        }
+    }
+
+    if (!png_stream_finish(&stream)) {
+        goto fail;
+    }
+
+    png_stream_close(&stream);
+    png_convert_contexts_free(contexts, threads);
+    free(preview);
+    free(current_line);
+    free(prev_line);
+    return 1;
+
+fail:
+    png_stream_close(&stream);
+    png_convert_contexts_free(contexts, threads);
+    png_free_image(image);
+    free(preview);
+    free(current_line);
+    free(prev_line);
+    return 0;
+}
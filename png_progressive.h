@@ -0,0 +1,25 @@
+#ifndef PNG_PROGRESSIVE_H
+#define PNG_PROGRESSIVE_H
+
+#include "png_decoder.h"
+
+/**
+ * 逐遍预览回调
+ *
+ * 隔行扫描图像每完成一遍 Adam7 调用一次（pass 为 0 ~ 6），非隔行图像只在解码完成时以 pass = 6 调用一次。
+ * preview 为整幅图像尺寸的预览像素，尚未解码的像素用所在块左上角已解码的像素填充；
+ * 最后一遍的预览即为完整图像。preview 只在回调期间有效，需要保留时应自行复制。
+ *
+ * @param user_data     调用方传入的自定义数据
+ * @param pass          刚完成的遍序号
+ * @param preview       预览像素，格式与调用 png_read_file_progressive 时指定的一致
+ * @param width         预览宽度（与图像宽度相同）
+ * @param height        预览高度（与图像高度相同）
+ */
+typedef void (*PNG_PassCallback)(void* user_data, int pass, const uint8_t* preview, uint32_t width, uint32_t height);
+
+int png_preview_render(const PNG_Image* image, int pass, PNG_ConvertContext* contexts, uint8_t* output);
+int png_read_file_progressive(const char* filename, PNG_Image* image, int format, PNG_PassCallback callback, void* user_data,
+    const PNG_CancelToken* cancel);
+
+#endif // PNG_PROGRESSIVE_H
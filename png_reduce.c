@@ -0,0 +1,732 @@
+#include "png_reduce.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PNG_REDUCE_SSE2 1
+#endif
+
+/*
+ * 无损颜色类型与位深缩减
+ *
+ * 每行先转换为 BGRA8（16 位图像转换为 RGBA16，样本都满足高字节 == 低字节时再收窄为 BGRA8），然后在同一次扫描中
+ * 判断 α 是否全部不透明、是否全部为灰度、样本可以无损表示的最小位深，并用小哈希表统计颜色数（超过 256 种即停止统计）。
+ * 扫描结束后按原始数据量（加上 PLTE / tRNS 的开销）选出最小的表示：1 ~ 8 位灰度、灰度 + α、RGB、RGBA、
+ * 1 ~ 8 位调色板，或者 16 位的灰度 / 灰度 + α / RGB / RGBA。
+ *
+ * png_clean_transparent 是编码前的另一个可选步骤：完全透明的像素不论颜色是什么显示结果都相同，
+ * 把其中残留的杂乱颜色改写为相邻像素的颜色，可以让滤波残差变为 0，也让更多图像可以缩减为调色板。
+ */
+
+// 颜色哈希表的槽数（2 的幂，至少为最大颜色数的两倍）
+#define PNG_REDUCE_HASH_BITS 10
+#define PNG_REDUCE_HASH_SIZE (1 << PNG_REDUCE_HASH_BITS)
+
+// 位深掩码：全部样本可以无损表示为 1 / 2 / 4 位
+#define PNG_REDUCE_DEPTH_1 1
+#define PNG_REDUCE_DEPTH_2 2
+#define PNG_REDUCE_DEPTH_4 4
+#define PNG_REDUCE_DEPTH_ALL 7
+
+// 颜色表：开放寻址的哈希表，颜色按首次出现的顺序编号
+typedef struct {
+    uint32_t keys[PNG_REDUCE_HASH_SIZE];
+    uint16_t slots[PNG_REDUCE_HASH_SIZE];       // 颜色序号 + 1，0 表示空槽
+    uint32_t colors[PNG_REDUCE_MAX_COLORS];     // 按序号排列的颜色（B | G << 8 | R << 16 | A << 24）
+    uint32_t count;                             // 颜色数，超过 PNG_REDUCE_MAX_COLORS 表示已停止统计
+} PNG_ColorTable;
+
+// 扫描状态
+typedef struct {
+    int opaque;
+    int gray;
+    int depth16;
+    int depth_mask;                 // PNG_REDUCE_DEPTH_* 的组合
+    PNG_ColorTable* table;
+} PNG_ReduceScan;
+
+static inline uint32_t png_reduce_key(const uint8_t* pixel) {
+    return (uint32_t)pixel[0] | ((uint32_t)pixel[1] << 8) | ((uint32_t)pixel[2] << 16) | ((uint32_t)pixel[3] << 24);
+}
+
+/**
+ * 查找颜色的序号
+ *
+ * @param table         颜色表
+ * @param key           颜色
+ * @param insert        未找到时是否加入颜色表
+ *
+ * @return              颜色序号；未找到（或颜色表已满）时返回 -1，插入时颜色表已满会把 count 置为溢出
+ */
+static int png_color_table_index(PNG_ColorTable* table, uint32_t key, int insert) {
+    uint32_t slot = (key * 0x9E3779B1u) >> (32 - PNG_REDUCE_HASH_BITS);
+    while (table->slots[slot]) {
+        if (table->keys[slot] == key) {
+            return table->slots[slot] - 1;
+        }
+        slot = (slot + 1) & (PNG_REDUCE_HASH_SIZE - 1);
+    }
+    if (!insert) {
+        return -1;
+    }
+    if (table->count >= PNG_REDUCE_MAX_COLORS) {
+        table->count = PNG_REDUCE_MAX_COLORS + 1;
+        return -1;
+    }
+    table->keys[slot] = key;
+    table->colors[table->count] = key;
+    table->slots[slot] = (uint16_t)(++table->count);
+    return (int)table->count - 1;
+}
+
+/**
+ * 单个样本可以无损表示的位深掩码：样本按 8 位计，n 位值扩展到 8 位时是把 n 位重复填满
+ */
+static inline int png_reduce_sample_mask(uint8_t v) {
+    int mask = 0;
+    if ((v >> 4) == (v & 0x0F)) {
+        mask |= PNG_REDUCE_DEPTH_4;
+        if (((v >> 2) & 0x03) == (v & 0x03)) {
+            mask |= PNG_REDUCE_DEPTH_2;
+            if (((v >> 1) & 0x01) == (v & 0x01)) {
+                mask |= PNG_REDUCE_DEPTH_1;
+            }
+        }
+    }
+    return mask;
+}
+
+/**
+ * 扫描一行 BGRA8 像素：更新不透明、灰度、位深标志与颜色表
+ */
+static void png_reduce_scan_row(PNG_ReduceScan* scan, const uint8_t* row, uint32_t width) {
+    // 不透明、灰度与位深都已排除时只统计颜色
+    uint32_t x = scan->opaque || scan->gray || scan->depth_mask ? 0 : width;
+
+#ifdef PNG_REDUCE_SSE2
+    if (x == 0) {
+        const __m128i ones = _mm_set1_epi8(-1);
+        const __m128i low4 = _mm_set1_epi8(0x0F);
+        const __m128i low2 = _mm_set1_epi8(0x03);
+        const __m128i low1 = _mm_set1_epi8(0x01);
+        __m128i alpha = ones, gray = ones, depth4 = ones, depth2 = ones, depth1 = ones;
+        for (; x + 4 <= width; x += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(row + (size_t)x * 4));
+            alpha = _mm_and_si128(alpha, v);
+            // 每个像素的字节 0、1 分别比较 B == G、G == R
+            gray = _mm_and_si128(gray, _mm_cmpeq_epi8(v, _mm_srli_epi32(v, 8)));
+            depth4 = _mm_and_si128(depth4, _mm_cmpeq_epi8(_mm_and_si128(_mm_srli_epi16(v, 4), low4), _mm_and_si128(v, low4)));
+            depth2 = _mm_and_si128(depth2, _mm_cmpeq_epi8(_mm_and_si128(_mm_srli_epi16(v, 2), low2), _mm_and_si128(v, low2)));
+            depth1 = _mm_and_si128(depth1, _mm_cmpeq_epi8(_mm_and_si128(_mm_srli_epi16(v, 1), low1), _mm_and_si128(v, low1)));
+        }
+        alpha = _mm_or_si128(alpha, _mm_set1_epi32(0x00FFFFFF));
+        gray = _mm_or_si128(gray, _mm_set1_epi32((int)0xFFFF0000u));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, ones)) != 0xFFFF) {
+            scan->opaque = 0;
+        }
+        if (_mm_movemask_epi8(gray) != 0xFFFF) {
+            scan->gray = 0;
+        }
+        int mask = 0;
+        if (_mm_movemask_epi8(depth4) == 0xFFFF) {
+            mask |= PNG_REDUCE_DEPTH_4;
+            if (_mm_movemask_epi8(depth2) == 0xFFFF) {
+                mask |= PNG_REDUCE_DEPTH_2;
+                if (_mm_movemask_epi8(depth1) == 0xFFFF) {
+                    mask |= PNG_REDUCE_DEPTH_1;
+                }
+            }
+        }
+        scan->depth_mask &= mask;
+    }
+#endif
+
+    for (; x < width; x++) {
+        const uint8_t* p = row + (size_t)x * 4;
+        if (p[3] != 0xFF) {
+            scan->opaque = 0;
+        }
+        if (p[0] != p[1] || p[1] != p[2]) {
+            scan->gray = 0;
+        }
+        scan->depth_mask &= png_reduce_sample_mask(p[0]) & png_reduce_sample_mask(p[1]) &
+            png_reduce_sample_mask(p[2]) & png_reduce_sample_mask(p[3]);
+    }
+
+    // 统计颜色数：与前一像素相同时跳过哈希查找
+    PNG_ColorTable* table = scan->table;
+    if (table->count <= PNG_REDUCE_MAX_COLORS) {
+        uint32_t previous = 0;
+        for (x = 0; x < width; x++) {
+            uint32_t key = png_reduce_key(row + (size_t)x * 4);
+            if (x > 0 && key == previous) {
+                continue;
+            }
+            previous = key;
+            if (png_color_table_index(table, key, 1) < 0) {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * 检查一行 RGBA16 像素的所有样本是否都满足高字节 == 低字节（可以无损缩减为 8 位）
+ */
+static int png_reduce_row_is_8bit(const uint16_t* row, uint32_t width) {
+    size_t count = (size_t)width * 4;
+    size_t i = 0;
+
+#ifdef PNG_REDUCE_SSE2
+    const __m128i ones = _mm_set1_epi8(-1);
+    __m128i equal = ones;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + i));
+        __m128i swapped = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        equal = _mm_and_si128(equal, _mm_cmpeq_epi8(v, swapped));
+    }
+    if (_mm_movemask_epi8(equal) != 0xFFFF) {
+        return 0;
+    }
+#endif
+
+    for (; i < count; i++) {
+        if ((row[i] >> 8) != (row[i] & 0xFF)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 扫描一行不能缩减为 8 位的 RGBA16 像素：只更新不透明与灰度标志
+ */
+static void png_reduce_scan_row16(PNG_ReduceScan* scan, const uint16_t* row, uint32_t width) {
+    for (uint32_t x = 0; x < width && (scan->opaque || scan->gray); x++) {
+        const uint16_t* p = row + (size_t)x * 4;
+        if (p[3] != 0xFFFF) {
+            scan->opaque = 0;
+        }
+        if (p[0] != p[1] || p[1] != p[2]) {
+            scan->gray = 0;
+        }
+    }
+}
+
+/**
+ * 把 RGBA16 行（样本已确认高字节 == 低字节）收窄为 BGRA8
+ */
+static void png_reduce_narrow_row(const uint16_t* row, uint32_t width, uint8_t* out) {
+    for (uint32_t x = 0; x < width; x++) {
+        out[0] = (uint8_t)row[2];
+        out[1] = (uint8_t)row[1];
+        out[2] = (uint8_t)row[0];
+        out[3] = (uint8_t)row[3];
+        row += 4;
+        out += 4;
+    }
+}
+
+/**
+ * 按原始数据量（含滤波类型字节）与 PLTE / tRNS 块的开销估算某种表示的大小
+ */
+static uint64_t png_reduce_estimate(const PNG_IHDR* header, uint8_t color_type, uint8_t bit_depth, uint32_t palette_size,
+    uint32_t transparency_size) {
+    PNG_IHDR target = *header;
+    target.color_type = color_type;
+    target.bit_depth = bit_depth;
+    uint64_t size = ((uint64_t)png_row_bytes(&target, header->width) + 1) * header->height;
+    if (palette_size) {
+        size += (uint64_t)palette_size * 3 + 12;
+    }
+    if (transparency_size) {
+        size += transparency_size + 12;
+    }
+    return size;
+}
+
+/**
+ * 根据扫描结果选出最小的无损表示，写入 info->color_type 与 info->bit_depth；不比原图小时保留原图的颜色类型与位深
+ */
+static void png_reduce_choose(const PNG_Image* image, PNG_ReduceInfo* info) {
+    const PNG_IHDR* header = &image->header;
+    uint8_t color_type;
+    uint8_t bit_depth = info->depth16 ? 16 : 8;
+    if (info->gray) {
+        color_type = info->opaque ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_GRAY_ALPHA;
+        if (info->opaque && !info->depth16) {
+            bit_depth = info->sample_depth;
+        }
+    } else {
+        color_type = info->opaque ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGBA;
+    }
+    uint64_t best = png_reduce_estimate(header, color_type, bit_depth, 0, 0);
+
+    if (!info->depth16 && info->color_count <= PNG_REDUCE_MAX_COLORS) {
+        uint32_t colors = info->color_count;
+        uint8_t palette_depth = colors <= 2 ? 1 : colors <= 4 ? 2 : colors <= 16 ? 4 : 8;
+        uint64_t size = png_reduce_estimate(header, PNG_COLOR_TYPE_PALETTE, palette_depth, colors,
+            info->opaque ? 0 : colors);
+        if (size < best) {
+            best = size;
+            color_type = PNG_COLOR_TYPE_PALETTE;
+            bit_depth = palette_depth;
+        }
+    }
+
+    uint64_t original = png_reduce_estimate(header, header->color_type, header->bit_depth,
+        header->color_type == PNG_COLOR_TYPE_PALETTE ? image->palette_size : 0, image->transparency ? image->transparency_size : 0);
+    if (best < original) {
+        info->color_type = color_type;
+        info->bit_depth = bit_depth;
+    } else {
+        info->color_type = header->color_type;
+        info->bit_depth = header->bit_depth;
+    }
+}
+
+/**
+ * 扫描整幅图像，填写 info 并把颜色记录到 table
+ */
+static int png_reduce_scan_image(const PNG_Image* image, PNG_ReduceInfo* info, PNG_ColorTable* table) {
+    const PNG_IHDR* header = &image->header;
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    if (bytes_per_line == 0 || !image->image_data || image->image_data_size / bytes_per_line < header->height) {
+        return 0;
+    }
+
+    int wide = header->bit_depth == 16;
+    PNG_ConvertContext ctx;
+    memset(&ctx, 0, sizeof(PNG_ConvertContext));
+    uint8_t* row = (uint8_t*)malloc((size_t)header->width * 4);
+    uint16_t* row16 = wide ? (uint16_t*)malloc((size_t)header->width * 8) : NULL;
+    int ok = row && (!wide || row16) && png_convert_context_init(&ctx, image, wide ? PNG_FORMAT_RGBA16 : PNG_FORMAT_BGRA8);
+    if (ok) {
+        PNG_ReduceScan scan = { 1, 1, 0, PNG_REDUCE_DEPTH_ALL, table };
+        for (uint32_t y = 0; y < header->height; y++) {
+            const uint8_t* src = image->image_data + (size_t)y * bytes_per_line;
+            if (!wide) {
+                png_convert_row(&ctx, src, row);
+                png_reduce_scan_row(&scan, row, header->width);
+            } else {
+                png_convert_row(&ctx, src, (uint8_t*)row16);
+                if (!scan.depth16 && png_reduce_row_is_8bit(row16, header->width)) {
+                    png_reduce_narrow_row(row16, header->width, row);
+                    png_reduce_scan_row(&scan, row, header->width);
+                } else {
+                    scan.depth16 = 1;
+                    png_reduce_scan_row16(&scan, row16, header->width);
+                }
+            }
+            // 所有缩减的可能都已排除时不必继续扫描
+            if (!scan.opaque && !scan.gray && (!wide || scan.depth16) &&
+                (scan.depth16 || (!scan.depth_mask && table->count > PNG_REDUCE_MAX_COLORS))) {
+                break;
+            }
+        }
+
+        info->opaque = scan.opaque;
+        info->gray = scan.gray;
+        info->depth16 = scan.depth16;
+        info->sample_depth = (scan.depth_mask & PNG_REDUCE_DEPTH_1) ? 1 : (scan.depth_mask & PNG_REDUCE_DEPTH_2) ? 2 :
+            (scan.depth_mask & PNG_REDUCE_DEPTH_4) ? 4 : 8;
+        info->color_count = scan.depth16 ? PNG_REDUCE_MAX_COLORS + 1 : table->count;
+        png_reduce_choose(image, info);
+    }
+
+    png_convert_context_free(&ctx);
+    free(row);
+    free(row16);
+    return ok;
+}
+
+/**
+ * 分析图像可以无损缩减到的最小表示
+ *
+ * @param image         要分析的图像（与解码器输出的格式相同）
+ * @param info          输出参数，分析结果；color_type 与 bit_depth 与原图相同表示无需缩减
+ *
+ * @return              是否分析成功，返回 1(真) 或 0(假)
+ */
+int png_reduce_analyze(const PNG_Image* image, PNG_ReduceInfo* info) {
+    if (!image || !info) {
+        return 0;
+    }
+    memset(info, 0, sizeof(PNG_ReduceInfo));
+
+    PNG_ColorTable* table = (PNG_ColorTable*)calloc(1, sizeof(PNG_ColorTable));
+    int ok = table && png_reduce_scan_image(image, info, table);
+    free(table);
+    return ok;
+}
+
+/**
+ * 按 MSB 优先把 1 / 2 / 4 / 8 位的值打包到一行
+ */
+static inline void png_reduce_pack(uint8_t* out, uint32_t x, uint8_t bit_depth, uint8_t value) {
+    if (bit_depth == 8) {
+        out[x] = value;
+        return;
+    }
+    uint32_t per_byte = 8 / bit_depth;
+    uint32_t shift = 8 - bit_depth * (x % per_byte + 1);
+    out[x / per_byte] |= (uint8_t)(value << shift);
+}
+
+/**
+ * 把一行 BGRA8 像素写成 8 位及以下的目标表示
+ */
+static void png_reduce_write_row(const PNG_ReduceInfo* info, PNG_ColorTable* table, const uint8_t* row, uint32_t width,
+    uint8_t* out, uint32_t out_bytes) {
+    memset(out, 0, out_bytes);
+    switch (info->color_type) {
+        case PNG_COLOR_TYPE_GRAY:
+            for (uint32_t x = 0; x < width; x++) {
+                png_reduce_pack(out, x, info->bit_depth, (uint8_t)(row[(size_t)x * 4] >> (8 - info->bit_depth)));
+            }
+            break;
+        case PNG_COLOR_TYPE_GRAY_ALPHA:
+            for (uint32_t x = 0; x < width; x++) {
+                out[(size_t)x * 2] = row[(size_t)x * 4];
+                out[(size_t)x * 2 + 1] = row[(size_t)x * 4 + 3];
+            }
+            break;
+        case PNG_COLOR_TYPE_RGB:
+            for (uint32_t x = 0; x < width; x++) {
+                const uint8_t* p = row + (size_t)x * 4;
+                uint8_t* q = out + (size_t)x * 3;
+                q[0] = p[2];
+                q[1] = p[1];
+                q[2] = p[0];
+            }
+            break;
+        case PNG_COLOR_TYPE_RGBA:
+            for (uint32_t x = 0; x < width; x++) {
+                const uint8_t* p = row + (size_t)x * 4;
+                uint8_t* q = out + (size_t)x * 4;
+                q[0] = p[2];
+                q[1] = p[1];
+                q[2] = p[0];
+                q[3] = p[3];
+            }
+            break;
+        case PNG_COLOR_TYPE_PALETTE: {
+            uint32_t previous = 0;
+            uint8_t index = 0;
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t key = png_reduce_key(row + (size_t)x * 4);
+                if (x == 0 || key != previous) {
+                    previous = key;
+                    index = (uint8_t)png_color_table_index(table, key, 0);
+                }
+                png_reduce_pack(out, x, info->bit_depth, index);
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * 把一行 RGBA16 像素写成 16 位的目标表示（大端序）
+ */
+static void png_reduce_write_row16(const PNG_ReduceInfo* info, const uint16_t* row, uint32_t width, uint8_t* out) {
+    static const uint8_t channels[][4] = {
+        [PNG_COLOR_TYPE_GRAY] = { 0 },
+        [PNG_COLOR_TYPE_RGB] = { 0, 1, 2 },
+        [PNG_COLOR_TYPE_GRAY_ALPHA] = { 0, 3 },
+        [PNG_COLOR_TYPE_RGBA] = { 0, 1, 2, 3 },
+    };
+    uint32_t count = info->color_type == PNG_COLOR_TYPE_GRAY ? 1 : info->color_type == PNG_COLOR_TYPE_GRAY_ALPHA ? 2 :
+        info->color_type == PNG_COLOR_TYPE_RGB ? 3 : 4;
+    const uint8_t* order = channels[info->color_type];
+    for (uint32_t x = 0; x < width; x++) {
+        for (uint32_t c = 0; c < count; c++) {
+            uint16_t v = row[order[c]];
+            *out++ = (uint8_t)(v >> 8);
+            *out++ = (uint8_t)v;
+        }
+        row += 4;
+    }
+}
+
+/**
+ * 8 位真彩色 / 灰度图像缩减为 8 位的非调色板表示时，直接从原始样本中挑选通道，不经过 BGRA8 转换
+ *
+ * @param src           原始行
+ * @param src_channels  原始行每像素的通道数
+ * @param map           目标每个通道取自原始像素的第几个通道
+ * @param channels      目标每像素的通道数
+ * @param width         像素数
+ * @param out           输出行
+ */
+static void png_reduce_select_channels(const uint8_t* src, uint32_t src_channels, const uint8_t* map, uint32_t channels,
+    uint32_t width, uint8_t* out) {
+    switch (channels) {
+        case 1:
+            for (uint32_t x = 0; x < width; x++, src += src_channels) {
+                *out++ = src[map[0]];
+            }
+            break;
+        case 2:
+            for (uint32_t x = 0; x < width; x++, src += src_channels, out += 2) {
+                out[0] = src[map[0]];
+                out[1] = src[map[1]];
+            }
+            break;
+        default:
+            for (uint32_t x = 0; x < width; x++, src += src_channels, out += 3) {
+                out[0] = src[map[0]];
+                out[1] = src[map[1]];
+                out[2] = src[map[2]];
+            }
+            break;
+    }
+}
+
+/**
+ * 生成调色板与 tRNS（tRNS 截止到最后一个不透明度小于 255 的颜色）
+ */
+static int png_reduce_build_palette(const PNG_ColorTable* table, PNG_Image* reduced) {
+    reduced->palette = (PNG_PaletteEntry*)malloc(sizeof(PNG_PaletteEntry) * table->count);
+    if (!reduced->palette) {
+        return 0;
+    }
+    reduced->palette_size = table->count;
+
+    uint32_t transparency_size = 0;
+    for (uint32_t i = 0; i < table->count; i++) {
+        uint32_t color = table->colors[i];
+        reduced->palette[i].blue = (uint8_t)color;
+        reduced->palette[i].green = (uint8_t)(color >> 8);
+        reduced->palette[i].red = (uint8_t)(color >> 16);
+        if ((color >> 24) != 0xFF) {
+            transparency_size = i + 1;
+        }
+    }
+    if (transparency_size) {
+        reduced->transparency = (uint8_t*)malloc(transparency_size);
+        if (!reduced->transparency) {
+            return 0;
+        }
+        for (uint32_t i = 0; i < transparency_size; i++) {
+            reduced->transparency[i] = (uint8_t)(table->colors[i] >> 24);
+        }
+        reduced->transparency_size = transparency_size;
+    }
+    return 1;
+}
+
+/**
+ * 把图像无损缩减为最小的表示（颜色类型与位深），解码结果（RGBA）与原图完全相同
+ *
+ * 结果总是非隔行图像，不带原图的 tRNS 透明色（透明色已展开为 α 后重新选择表示）。
+ *
+ * @param image         要缩减的图像（与解码器输出的格式相同）
+ * @param reduced       输出参数，缩减后的图像（由调用者 png_free_image）
+ *
+ * @return              是否生成了更小的表示，返回 1(真) 或 0(假)；返回 0 时（无法缩减或失败）reduced 无需释放
+ */
+int png_reduce_image(const PNG_Image* image, PNG_Image* reduced) {
+    if (!image || !reduced) {
+        return 0;
+    }
+    memset(reduced, 0, sizeof(PNG_Image));
+
+    PNG_ReduceInfo info;
+    memset(&info, 0, sizeof(PNG_ReduceInfo));
+    PNG_ColorTable* table = (PNG_ColorTable*)calloc(1, sizeof(PNG_ColorTable));
+    if (!table || !png_reduce_scan_image(image, &info, table) ||
+        (info.color_type == image->header.color_type && info.bit_depth == image->header.bit_depth)) {
+        free(table);
+        return 0;
+    }
+
+    const PNG_IHDR* header = &image->header;
+    reduced->header = *header;
+    reduced->header.color_type = info.color_type;
+    reduced->header.bit_depth = info.bit_depth;
+    reduced->header.interlace_method = 0;
+
+    int wide = header->bit_depth == 16;
+    uint32_t src_bytes = png_row_bytes(header, header->width);
+    uint32_t out_bytes = png_row_bytes(&reduced->header, header->width);
+    PNG_ConvertContext ctx;
+    memset(&ctx, 0, sizeof(PNG_ConvertContext));
+    uint8_t* row = (uint8_t*)malloc((size_t)header->width * 4);
+    uint16_t* row16 = wide ? (uint16_t*)malloc((size_t)header->width * 8) : NULL;
+    reduced->image_data_size = (size_t)out_bytes * header->height;
+    reduced->image_data = (uint8_t*)malloc(reduced->image_data_size);
+    int ok = row && (!wide || row16) && reduced->image_data &&
+        (info.color_type != PNG_COLOR_TYPE_PALETTE || png_reduce_build_palette(table, reduced)) &&
+        png_convert_context_init(&ctx, image, wide ? PNG_FORMAT_RGBA16 : PNG_FORMAT_BGRA8);
+    // 原图为不带 tRNS 的 8 位真彩色 / 灰度、目标为 8 位非调色板表示时只需挑选通道（目标通道数总是少于原图）
+    uint32_t src_channels = png_bytes_per_pixel(header);
+    uint32_t channels = png_bytes_per_pixel(&reduced->header);
+    int direct = header->bit_depth == 8 && header->color_type != PNG_COLOR_TYPE_PALETTE && !image->transparency &&
+        info.bit_depth == 8 && info.color_type != PNG_COLOR_TYPE_PALETTE;
+    uint8_t map[3] = { 0, 1, 2 };
+    if (info.color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        map[1] = (uint8_t)(src_channels - 1);
+    }
+
+    if (ok) {
+        for (uint32_t y = 0; y < header->height; y++) {
+            const uint8_t* src = image->image_data + (size_t)y * src_bytes;
+            uint8_t* out = reduced->image_data + (size_t)y * out_bytes;
+            if (direct) {
+                png_reduce_select_channels(src, src_channels, map, channels, header->width, out);
+            } else if (!wide) {
+                png_convert_row(&ctx, src, row);
+                png_reduce_write_row(&info, table, row, header->width, out, out_bytes);
+            } else if (info.bit_depth == 16) {
+                png_convert_row(&ctx, src, (uint8_t*)row16);
+                png_reduce_write_row16(&info, row16, header->width, out);
+            } else {
+                png_convert_row(&ctx, src, (uint8_t*)row16);
+                png_reduce_narrow_row(row16, header->width, row);
+                png_reduce_write_row(&info, table, row, header->width, out, out_bytes);
+            }
+        }
+    }
+
+    png_convert_context_free(&ctx);
+    free(row);
+    free(row16);
+    free(table);
+    if (!ok) {
+        png_free_image(reduced);
+    }
+    return ok;
+}
+
+/**
+ * 清理一行像素中 α = 0 的像素的颜色（任意位深的灰度 + α 与 RGBA）
+ *
+ * @param row           要清理的行（原地修改）
+ * @param above         已清理的上一行，首行为 NULL
+ * @param width         像素数
+ * @param pixel_bytes   每像素字节数
+ * @param color_bytes   每像素颜色部分的字节数（α 位于其后）
+ * @param mode          清理方式（PNG_CLEAN_*）
+ * @param x             从第几个像素开始
+ */
+static void png_clean_row(uint8_t* row, const uint8_t* above, uint32_t width, uint32_t pixel_bytes,
+    uint32_t color_bytes, int mode, uint32_t x) {
+    for (; x < width; x++) {
+        uint8_t* p = row + (size_t)x * pixel_bytes;
+        int transparent = 1;
+        for (uint32_t i = color_bytes; i < pixel_bytes; i++) {
+            transparent &= p[i] == 0;
+        }
+        if (!transparent) {
+            continue;
+        }
+
+        const uint8_t* left = x > 0 ? p - pixel_bytes : NULL;
+        const uint8_t* up = above ? above + (size_t)x * pixel_bytes : NULL;
+        const uint8_t* source = NULL;
+        if (mode == PNG_CLEAN_LEFT) {
+            source = left ? left : up;
+        } else if (mode == PNG_CLEAN_ABOVE) {
+            source = up ? up : left;
+        }
+        if (source) {
+            memcpy(p, source, color_bytes);
+        } else {
+            memset(p, 0, color_bytes);
+        }
+    }
+}
+
+/**
+ * 清理一行 RGBA8 像素：每次检查 4 个像素，置 0 与复制上方像素完全向量化，复制左侧像素只逐个处理含透明像素的组
+ */
+static void png_clean_row_rgba8(uint8_t* row, const uint8_t* above, uint32_t width, int mode) {
+    uint32_t x = 0;
+
+#ifdef PNG_REDUCE_SSE2
+    const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000u);
+    const __m128i color_mask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i zero = _mm_setzero_si128();
+    if (mode == PNG_CLEAN_ZERO || (mode == PNG_CLEAN_ABOVE && above)) {
+        for (; x + 4 <= width; x += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(row + (size_t)x * 4));
+            __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(v, alpha_mask), zero);
+            if (_mm_movemask_epi8(transparent) == 0) {
+                continue;
+            }
+            __m128i fill = zero;
+            if (mode == PNG_CLEAN_ABOVE) {
+                fill = _mm_and_si128(_mm_loadu_si128((const __m128i*)(above + (size_t)x * 4)), color_mask);
+            }
+            v = _mm_or_si128(_mm_andnot_si128(transparent, v), _mm_and_si128(transparent, fill));
+            _mm_storeu_si128((__m128i*)(row + (size_t)x * 4), v);
+        }
+    } else {
+        // 复制左侧像素存在行内依赖，只对含透明像素的组逐个处理
+        for (; x + 4 <= width; x += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(row + (size_t)x * 4));
+            __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(v, alpha_mask), zero);
+            if (_mm_movemask_epi8(transparent) != 0) {
+                png_clean_row(row, above, x + 4, 4, 3, mode, x);
+            }
+        }
+    }
+#endif
+
+    png_clean_row(row, above, width, 4, 3, mode, x);
+}
+
+/**
+ * 清理完全透明（α = 0）像素的颜色：这些像素不论颜色是什么显示结果都相同，
+ * 改写为相邻像素的颜色后滤波残差为 0，deflate 更容易匹配，也可能让图像缩减为调色板
+ *
+ * 只处理带 α 通道的图像（灰度 + α 与 RGBA）；调色板与 tRNS 透明色的颜色决定了哪些像素透明，不做改写。
+ * 清理后的解码结果在 α = 0 的像素上颜色不同，其余像素完全相同。
+ *
+ * @param image         要清理的图像（与解码器输出的格式相同）
+ * @param mode          清理方式（PNG_CLEAN_ZERO、PNG_CLEAN_LEFT 或 PNG_CLEAN_ABOVE）
+ * @param cleaned       输出参数，清理后的图像（由调用者 png_free_image）
+ *
+ * @return              是否生成了清理后的图像，返回 1(真) 或 0(假)；图像没有 α 通道或失败时返回 0，cleaned 无需释放
+ */
+int png_clean_transparent(const PNG_Image* image, int mode, PNG_Image* cleaned) {
+    if (!image || !cleaned) {
+        return 0;
+    }
+    memset(cleaned, 0, sizeof(PNG_Image));
+
+    const PNG_IHDR* header = &image->header;
+    if (mode <= PNG_CLEAN_NONE || mode > PNG_CLEAN_ABOVE ||
+        (header->color_type != PNG_COLOR_TYPE_GRAY_ALPHA && header->color_type != PNG_COLOR_TYPE_RGBA)) {
+        return 0;
+    }
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    if (bytes_per_line == 0 || !image->image_data || image->image_data_size / bytes_per_line < header->height) {
+        return 0;
+    }
+
+    cleaned->header = *header;
+    cleaned->header.interlace_method = 0;
+    cleaned->image_data_size = (size_t)bytes_per_line * header->height;
+    cleaned->image_data = (uint8_t*)malloc(cleaned->image_data_size);
+    if (!cleaned->image_data) {
+        png_free_image(cleaned);
+        return 0;
+    }
+
+    uint32_t pixel_bytes = png_bytes_per_pixel(header);
+    uint32_t color_bytes = pixel_bytes - header->bit_depth / 8;
+    for (uint32_t y = 0; y < header->height; y++) {
+        uint8_t* row = cleaned->image_data + (size_t)y * bytes_per_line;
+        const uint8_t* above = y > 0 ? row - bytes_per_line : NULL;
+        memcpy(row, image->image_data + (size_t)y * bytes_per_line, bytes_per_line);
+        if (header->color_type == PNG_COLOR_TYPE_RGBA && header->bit_depth == 8) {
+            png_clean_row_rgba8(row, above, header->width, mode);
+        } else {
+            png_clean_row(row, above, header->width, pixel_bytes, color_bytes, mode, 0);
+        }
+    }
+    return 1;
+}
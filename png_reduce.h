@@ -0,0 +1,32 @@
+#ifndef PNG_REDUCE_H
+#define PNG_REDUCE_H
+
+#include "png_decoder.h"
+
+// 可以写成调色板图像的最大颜色数
+#define PNG_REDUCE_MAX_COLORS 256
+
+// 完全透明（α = 0）像素的颜色清理方式
+#define PNG_CLEAN_NONE 0                // 保留原样
+#define PNG_CLEAN_ZERO 1                // 颜色置 0
+#define PNG_CLEAN_LEFT 2                // 复制左侧像素的颜色（行首复制上方像素），Sub / Paeth 滤波的残差为 0
+#define PNG_CLEAN_ABOVE 3               // 复制上方像素的颜色（首行复制左侧像素），Up / Paeth 滤波的残差为 0
+
+/**
+ * 无损缩减分析结果（按解码后的 RGBA 像素判断，tRNS 透明色已展开为 α）
+ */
+typedef struct {
+    int opaque;                     // 所有像素的 α 都是最大值
+    int gray;                       // 所有像素都满足 R == G == B
+    int depth16;                    // 存在不能无损缩减为 8 位的 16 位样本
+    uint8_t sample_depth;           // 全部样本（按 8 位计）可以无损表示的最小位深：1、2、4 或 8
+    uint32_t color_count;           // 不同的 RGBA8 颜色数，超过 PNG_REDUCE_MAX_COLORS 时为 PNG_REDUCE_MAX_COLORS + 1
+    uint8_t color_type;             // 最小的无损表示：颜色类型
+    uint8_t bit_depth;              // 最小的无损表示：位深
+} PNG_ReduceInfo;
+
+int png_reduce_analyze(const PNG_Image* image, PNG_ReduceInfo* info);
+int png_reduce_image(const PNG_Image* image, PNG_Image* reduced);
+int png_clean_transparent(const PNG_Image* image, int mode, PNG_Image* cleaned);
+
+#endif // PNG_REDUCE_H
@@ -0,0 +1,258 @@
+#include "png_region.h"
+#include "png_filter.h"
+#include "png_interlace.h"
+#include "png_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 区域解码
+ *
+ * 滤波以上一行为参考，因此目标区域之上的行必须依次解压并还原，但区域最后一行之后的数据既不需要解压也不需要读取，
+ * 靠近图像顶部的区域耗时与所需行数成正比。每行只转换区域覆盖的列，输出缓冲区也只有区域大小。
+ *
+ * 隔行图像的每一遍都覆盖整幅图像，前六遍必须完整解压；只有最后一遍可以在区域之后停止。
+ * 每一遍中区域之后的行只需解压、不再还原滤波。
+ *
+ * 有随机访问索引（png_index）时，从区域之上最近的检查点恢复解压，区域之上的行也不必全部解压。
+ */
+
+/**
+ * 估算区域解码所需的内存
+ *
+ * @param header    图像头信息
+ * @param format    输出像素格式（PNG_FORMAT_*）
+ * @param width     区域宽度
+ * @param height    区域高度
+ *
+ * @return          所需字节数，参数非法时返回 UINT64_MAX
+ */
+uint64_t png_region_memory_size(const PNG_IHDR* header, int format, uint32_t width, uint32_t height) {
+    uint32_t bytes_per_line = header ? png_row_bytes(header, header->width) : 0;
+    uint32_t pixel_bytes = png_format_bytes_per_pixel(format);
+    if (bytes_per_line == 0 || pixel_bytes == 0) {
+        return UINT64_MAX;
+    }
+
+    // 两行扫描线（当前行与上一行，各含过滤类型字节）加区域大小的输出
+    uint64_t size = 2 * ((uint64_t)bytes_per_line + 1) + (uint64_t)width * height * pixel_bytes;
+    if (header->interlace_method == PNG_INTERLACE_METHOD_ADAM7) {
+        // 隔行图像先把区域所在的行还原为完整扫描线
+        size += (uint64_t)height * bytes_per_line;
+    }
+    return size;
+}
+
+/**
+ * 索引是否为同一幅图像建立（逐字段比较 IHDR）
+ */
+static int png_region_index_matches(const PNG_Index* index, const PNG_IHDR* header) {
+    return index->header.width == header->width && index->header.height == header->height &&
+        index->header.bit_depth == header->bit_depth && index->header.color_type == header->color_type &&
+        index->header.compression_method == header->compression_method &&
+        index->header.filter_method == header->filter_method && index->header.interlace_method == header->interlace_method;
+}
+
+/**
+ * 区域解码的实现，index 为 NULL 时从图像顶部开始解码
+ */
+static int png_region_decode(const char* filename, const PNG_Index* index, PNG_Image* image, int format, uint32_t x,
+    uint32_t y, uint32_t width, uint32_t height, uint8_t** output, size_t* output_size, const PNG_CancelToken* cancel) {
+    if (!output || !output_size || width == 0 || height == 0 || png_format_bytes_per_pixel(format) == 0) {
+        return 0;
+    }
+    *output = NULL;
+    *output_size = 0;
+
+    PNG_Stream stream;
+    if (!png_stream_open(&stream, filename, image)) {
+        return 0;
+    }
+
+    PNG_IHDR* header = &image->header;
+    int interlaced = header->interlace_method == PNG_INTERLACE_METHOD_ADAM7;
+    uint32_t bytes_per_pixel = png_bytes_per_pixel(header);
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    uint32_t y_end = y + height;
+    size_t dst_row_bytes = (size_t)width * png_format_bytes_per_pixel(format);
+    uint8_t* current_line = NULL;
+    uint8_t* prev_line = NULL;
+    uint8_t* pixels = NULL;
+    PNG_ConvertContext ctx;
+    int ctx_ready = 0;
+
+    if ((uint64_t)x + width > header->width || (uint64_t)y + height > header->height) {
+        goto fail;
+    }
+    if (png_region_memory_size(header, format, width, height) > png_get_memory_budget()) {
+        goto fail;
+    }
+
+    current_line = (uint8_t*)malloc((size_t)bytes_per_line + 1);
+    prev_line = (uint8_t*)malloc((size_t)bytes_per_line + 1);
+    pixels = (uint8_t*)malloc(dst_row_bytes * height);
+    if (!current_line || !prev_line || !pixels) {
+        goto fail;
+    }
+    if (interlaced) {
+        // 只保存区域所在的行；位深小于 8 时分散写入按位进行，需预先清零
+        image->image_data_size = (size_t)height * bytes_per_line;
+        image->image_data = (uint8_t*)calloc(image->image_data_size, 1);
+        if (!image->image_data) {
+            goto fail;
+        }
+    }
+    if (!png_convert_context_init(&ctx, image, format)) {
+        goto fail;
+    }
+    ctx_ready = 1;
+
+    // 从检查点恢复时，从检查点所在行的中间开始：上一行与本行已解压的部分取自检查点
+    uint32_t start_row = 0;
+    uint32_t start_offset = 0;
+    const PNG_IndexPoint* point = interlaced ? NULL : png_index_find(index, y);
+    if (point && png_region_index_matches(index, header)) {
+        if (!png_stream_restore_checkpoint(&stream, &point->checkpoint)) {
+            goto fail;
+        }
+        start_row = point->row;
+        start_offset = point->offset;
+        prev_line[0] = 0;
+        memcpy(prev_line + 1, point->row_data, bytes_per_line);
+        memcpy(current_line, point->row_data + bytes_per_line, start_offset);
+    }
+
+    for (int pass = 0; pass < (interlaced ? PNG_ADAM7_PASSES : 1); pass++) {
+        uint32_t pass_width = header->width;
+        uint32_t pass_height = header->height;
+        uint32_t needed = y_end;                    // 本遍需要还原的行数
+        if (interlaced) {
+            png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+            if (pass_width == 0) {
+                continue;
+            }
+            const PNG_Adam7Pass* p = &png_adam7_passes[pass];
+            needed = y_end > p->y0 ? (y_end - p->y0 + p->dy - 1) / p->dy : 0;
+            if (needed > pass_height) {
+                needed = pass_height;
+            }
+        }
+
+        uint32_t pass_row_bytes = png_row_bytes(header, pass_width);
+        if (start_row == 0 && start_offset == 0) {
+            memset(prev_line, 0, (size_t)pass_row_bytes + 1);
+        }
+
+        for (uint32_t py = start_row; py < needed; py++) {
+            uint32_t offset = py == start_row ? start_offset : 0;
+            // 每行第一个字节是过滤类型
+            if (png_cancel_requested(cancel) ||
+                !png_stream_read(&stream, current_line + offset, pass_row_bytes + 1 - offset) ||
+                !png_unfilter_row(current_line[0], current_line + 1, prev_line + 1, pass_row_bytes, bytes_per_pixel)) {
+                goto fail;
+            }
+
+            if (interlaced) {
+                uint32_t row = png_adam7_passes[pass].y0 + py * png_adam7_passes[pass].dy;
+                if (row >= y) {
+                    png_adam7_scatter_row(header, pass, current_line + 1,
+                        image->image_data + (size_t)(row - y) * bytes_per_line, pass_width);
+                }
+            } else if (py >= y) {
+                png_convert_row_span(&ctx, current_line + 1, x, width, pixels + (size_t)(py - y) * dst_row_bytes);
+            }
+
+            uint8_t* tmp = prev_line;
+            prev_line = current_line;
+            current_line = tmp;
+        }
+
+        // 最后一遍在区域之后即可停止；之前各遍之后还有数据，剩余的行只需解压跳过
+        if (interlaced && pass < PNG_ADAM7_PASSES - 1) {
+            for (uint32_t py = needed; py < pass_height; py++) {
+                if (png_cancel_requested(cancel) || !png_stream_read(&stream, current_line, pass_row_bytes + 1)) {
+                    goto fail;
+                }
+            }
+        }
+    }
+
+    if (interlaced) {
+        for (uint32_t row = 0; row < height; row++) {
+            png_convert_row_span(&ctx, image->image_data + (size_t)row * bytes_per_line, x, width,
+                pixels + (size_t)row * dst_row_bytes);
+        }
+        free(image->image_data);
+        image->image_data = NULL;
+        image->image_data_size = 0;
+    }
+
+    png_stream_close(&stream);
+    png_convert_context_free(&ctx);
+    free(current_line);
+    free(prev_line);
+    *output = pixels;
+    *output_size = dst_row_bytes * height;
+    return 1;
+
+fail:
+    png_stream_close(&stream);
+    if (ctx_ready) {
+        png_convert_context_free(&ctx);
+    }
+    png_free_image(image);
+    free(pixels);
+    free(current_line);
+    free(prev_line);
+    return 0;
+}
+
+/**
+ * 解码图像中的一个矩形区域
+ *
+ * 只解压、还原到区域的最后一行为止，之后的数据不再读取，因此不校验其后的 IDAT 与 IEND；
+ * 每行只转换区域覆盖的列。解码完成后 image 只保留头部信息（header、palette 等），image_data 为 NULL。
+ *
+ * @param filename      PNG 文件路径
+ * @param image         图像结构体
+ * @param format        输出像素格式（PNG_FORMAT_*）
+ * @param x             区域左上角列号
+ * @param y             区域左上角行号
+ * @param width         区域宽度（大于 0）
+ * @param height        区域高度（大于 0）
+ * @param output        输出像素数据，逐行紧密排列，每行 width 个像素（需要调用者释放）
+ * @param output_size   输出数据大小
+ * @param cancel        取消令牌，可以为 NULL，每解码一行检查一次
+ *
+ * @return              是否解码成功，返回 1(真) 或 0(假)；区域超出图像范围时返回 0
+ */
+int png_decode_region(const char* filename, PNG_Image* image, int format, uint32_t x, uint32_t y, uint32_t width,
+    uint32_t height, uint8_t** output, size_t* output_size, const PNG_CancelToken* cancel) {
+    return png_region_decode(filename, NULL, image, format, x, y, width, height, output, output_size, cancel);
+}
+
+/**
+ * 借助随机访问索引解码图像中的一个矩形区域
+ *
+ * 从区域之上最近的检查点恢复解压，解压量约为 span 行加区域本身，与区域在图像中的位置无关。
+ * 检查点所在的 IDAT 块只读取了后半部分，不校验其 CRC。索引与文件不匹配（IHDR 不同）或为隔行图像时
+ * 退化为 png_decode_region。
+ *
+ * @param filename      PNG 文件路径
+ * @param index         png_index_open / png_index_build 取得的索引，可以为 NULL
+ * @param image         图像结构体
+ * @param format        输出像素格式（PNG_FORMAT_*）
+ * @param x             区域左上角列号
+ * @param y             区域左上角行号
+ * @param width         区域宽度（大于 0）
+ * @param height        区域高度（大于 0）
+ * @param output        输出像素数据，逐行紧密排列，每行 width 个像素（需要调用者释放）
+ * @param output_size   输出数据大小
+ * @param cancel        取消令牌，可以为 NULL，每解码一行检查一次
+ *
+ * @return              是否解码成功，返回 1(真) 或 0(假)；区域超出图像范围时返回 0
+ */
+int png_decode_region_indexed(const char* filename, const PNG_Index* index, PNG_Image* image, int format, uint32_t x,
+    uint32_t y, uint32_t width, uint32_t height, uint8_t** output, size_t* output_size, const PNG_CancelToken* cancel) {
+    return png_region_decode(filename, index, image, format, x, y, width, height, output, output_size, cancel);
+}
@@ -0,0 +1,13 @@
+#ifndef PNG_REGION_H
+#define PNG_REGION_H
+
+#include "png_decoder.h"
+#include "png_index.h"
+
+uint64_t png_region_memory_size(const PNG_IHDR* header, int format, uint32_t width, uint32_t height);
+int png_decode_region(const char* filename, PNG_Image* image, int format, uint32_t x, uint32_t y, uint32_t width,
+    uint32_t height, uint8_t** output, size_t* output_size, const PNG_CancelToken* cancel);
+int png_decode_region_indexed(const char* filename, const PNG_Index* index, PNG_Image* image, int format, uint32_t x,
+    uint32_t y, uint32_t width, uint32_t height, uint8_t** output, size_t* output_size, const PNG_CancelToken* cancel);
+
+#endif // PNG_REGION_H
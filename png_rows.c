@@ -0,0 +1,198 @@
+#include "png_rows.h"
+#include "png_filter.h"
+#include "png_interlace.h"
+#include "png_stream.h"
+#include "png_thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 逐行带输出
+ *
+ * png_read_file 需要同时持有全部压缩数据、解压后的扫描线和转换后的像素，十亿像素级别的图像很容易超出内存。
+ * 这里压缩数据边读边解压，每行还原后立即转换到一个行带大小的输出缓冲区，攒满一个行带就交给回调，
+ * 非隔行图像任何时刻只持有两行扫描线和一个行带。隔行图像的最后一遍才补齐每一行，
+ * 仍需先还原出完整的扫描线数据，但转换后的像素依然按行带交付，不再额外占用整幅图像的输出内存。
+ */
+
+/**
+ * 计算每个行带的行数：约 PNG_BAND_BYTES 字节，至少一行
+ */
+static uint32_t png_rows_band_rows(uint32_t height, size_t dst_row_bytes) {
+    size_t rows = dst_row_bytes > 0 ? PNG_BAND_BYTES / dst_row_bytes : 0;
+    if (rows == 0) {
+        rows = 1;
+    }
+    return rows < height ? (uint32_t)rows : height;
+}
+
+/**
+ * 估算逐行带输出所需的内存
+ *
+ * @param header    图像头信息
+ * @param format    输出像素格式（PNG_FORMAT_*）
+ *
+ * @return          所需字节数，参数非法或无法表示时返回 UINT64_MAX
+ */
+uint64_t png_rows_memory_size(const PNG_IHDR* header, int format) {
+    uint32_t bytes_per_line = header ? png_row_bytes(header, header->width) : 0;
+    uint32_t pixel_bytes = png_format_bytes_per_pixel(format);
+    if (bytes_per_line == 0 || pixel_bytes == 0) {
+        return UINT64_MAX;
+    }
+
+    uint64_t dst_row_bytes = (uint64_t)header->width * pixel_bytes;
+    if (dst_row_bytes > SIZE_MAX) {
+        return UINT64_MAX;
+    }
+
+    // 两行扫描线（当前行与上一行，各含过滤类型字节）加一个行带的输出
+    uint64_t size = 2 * ((uint64_t)bytes_per_line + 1);
+    size += png_rows_band_rows(header->height, (size_t)dst_row_bytes) * dst_row_bytes;
+    if (header->interlace_method == PNG_INTERLACE_METHOD_ADAM7) {
+        size += (uint64_t)header->height * bytes_per_line;
+    }
+    return size;
+}
+
+/**
+ * 流式读取 PNG 文件，按行带交付转换后的像素
+ *
+ * 适用于解码后超过内存或地址空间的大图：调用方在回调中把像素写入磁盘、拼接瓦片或缩放，
+ * 整幅图像的像素不会同时存在于内存中。内存预算按本函数实际占用（png_rows_memory_size）检查，
+ * 而不是按整幅图像检查。解码完成后 image 只保留头部信息（header、palette 等），image_data 为 NULL。
+ *
+ * @param filename      PNG 文件路径
+ * @param image         图像结构体
+ * @param format        输出像素格式（PNG_FORMAT_*）
+ * @param callback      行带回调
+ * @param user_data     传给回调的自定义数据
+ * @param cancel        取消令牌，可以为 NULL，每解码一行检查一次；取消后不再调用回调
+ *
+ * @return              是否解码成功，返回 1(真) 或 0(假)；失败时释放 image
+ */
+int png_read_file_rows(const char* filename, PNG_Image* image, int format, PNG_RowCallback callback, void* user_data,
+    const PNG_CancelToken* cancel) {
+    if (!callback || png_format_bytes_per_pixel(format) == 0) {
+        return 0;
+    }
+
+    PNG_Stream stream;
+    if (!png_stream_open(&stream, filename, image)) {
+        return 0;
+    }
+
+    PNG_IHDR* header = &image->header;
+    int interlaced = header->interlace_method == PNG_INTERLACE_METHOD_ADAM7;
+    uint32_t bytes_per_pixel = png_bytes_per_pixel(header);
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    uint8_t* current_line = NULL;
+    uint8_t* prev_line = NULL;
+    uint8_t* band = NULL;
+    PNG_ConvertContext ctx;
+    int ctx_ready = 0;
+
+    if (png_rows_memory_size(header, format) > png_get_memory_budget()) {
+        goto fail;
+    }
+
+    size_t dst_row_bytes = (size_t)header->width * png_format_bytes_per_pixel(format);
+    uint32_t band_rows = png_rows_band_rows(header->height, dst_row_bytes);
+    current_line = (uint8_t*)malloc((size_t)bytes_per_line + 1);
+    prev_line = (uint8_t*)malloc((size_t)bytes_per_line + 1);
+    band = (uint8_t*)malloc((size_t)band_rows * dst_row_bytes);
+    if (!current_line || !prev_line || !band) {
+        goto fail;
+    }
+    if (interlaced) {
+        // 位深小于 8 时分散写入按位进行，最终图像需预先清零
+        image->image_data_size = (size_t)header->height * bytes_per_line;
+        image->image_data = (uint8_t*)calloc(image->image_data_size, 1);
+        if (!image->image_data) {
+            goto fail;
+        }
+    }
+    if (!png_convert_context_init(&ctx, image, format)) {
+        goto fail;
+    }
+    ctx_ready = 1;
+
+    uint32_t band_y = 0;
+    uint32_t band_count = 0;
+    for (int pass = 0; pass < (interlaced ? PNG_ADAM7_PASSES : 1); pass++) {
+        uint32_t pass_width = header->width;
+        uint32_t pass_height = header->height;
+        if (interlaced) {
+            png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+            if (pass_width == 0) {
+                continue;
+            }
+        }
+
+        uint32_t pass_row_bytes = png_row_bytes(header, pass_width);
+        memset(prev_line, 0, (size_t)pass_row_bytes + 1);
+
+        for (uint32_t py = 0; py < pass_height; py++) {
+            // 每行第一个字节是过滤类型
+            if (png_cancel_requested(cancel) || !png_stream_read(&stream, current_line, pass_row_bytes + 1) ||
+                !png_unfilter_row(current_line[0], current_line + 1, prev_line + 1, pass_row_bytes, bytes_per_pixel)) {
+                goto fail;
+            }
+
+            if (interlaced) {
+                uint32_t y = png_adam7_passes[pass].y0 + py * png_adam7_passes[pass].dy;
+                png_adam7_scatter_row(header, pass, current_line + 1, image->image_data + (size_t)y * bytes_per_line, pass_width);
+            } else {
+                png_convert_row(&ctx, current_line + 1, band + (size_t)band_count * dst_row_bytes);
+                if (++band_count == band_rows || py + 1 == pass_height) {
+                    callback(user_data, band_y, band_count, band, dst_row_bytes);
+                    band_y += band_count;
+                    band_count = 0;
+                }
+            }
+
+            uint8_t* tmp = prev_line;
+            prev_line = current_line;
+            current_line = tmp;
+        }
+    }
+
+    if (!png_stream_finish(&stream)) {
+        goto fail;
+    }
+
+    if (interlaced) {
+        // 最后一遍完成后每行才完整，此时再按行带转换交付
+        for (uint32_t y = 0; y < header->height; y += band_count) {
+            if (png_cancel_requested(cancel)) {
+                goto fail;
+            }
+            band_count = header->height - y < band_rows ? header->height - y : band_rows;
+            for (uint32_t i = 0; i < band_count; i++) {
+                png_convert_row(&ctx, image->image_data + (size_t)(y + i) * bytes_per_line, band + (size_t)i * dst_row_bytes);
+            }
+            callback(user_data, y, band_count, band, dst_row_bytes);
+        }
+        free(image->image_data);
+        image->image_data = NULL;
+        image->image_data_size = 0;
+    }
+
+    png_stream_close(&stream);
+    png_convert_context_free(&ctx);
+    free(band);
+    free(current_line);
+    free(prev_line);
+    return 1;
+
+fail:
+    png_stream_close(&stream);
+    if (ctx_ready) {
+        png_convert_context_free(&ctx);
+    }
+    png_free_image(image);
+    free(band);
+    free(current_line);
+    free(prev_line);
+    return 0;
+}
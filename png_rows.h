@@ -0,0 +1,24 @@
+#ifndef PNG_ROWS_H
+#define PNG_ROWS_H
+
+#include "png_decoder.h"
+
+/**
+ * 逐行带输出回调
+ *
+ * 按从上到下的顺序调用，每次交付连续的若干行（约 PNG_BAND_BYTES 字节）。
+ * pixels 只在回调期间有效，需要保留时应自行复制或写入磁盘。
+ *
+ * @param user_data     调用方传入的自定义数据
+ * @param y             本批第一行的行号
+ * @param rows          本批行数
+ * @param pixels        转换后的像素，格式与调用 png_read_file_rows 时指定的一致
+ * @param stride        相邻两行的字节间距
+ */
+typedef void (*PNG_RowCallback)(void* user_data, uint32_t y, uint32_t rows, const uint8_t* pixels, size_t stride);
+
+uint64_t png_rows_memory_size(const PNG_IHDR* header, int format);
+int png_read_file_rows(const char* filename, PNG_Image* image, int format, PNG_RowCallback callback, void* user_data,
+    const PNG_CancelToken* cancel);
+
+#endif // PNG_ROWS_H
@@ -0,0 +1,292 @@
+#include "png_scale.h"
+#include "png_filter.h"
+#include "png_interlace.h"
+#include "png_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 缩小解码（1/2、1/4、1/8）
+ *
+ * 隔行图像前几遍的像素恰好落在 2、4、8 像素的网格上：第 1 遍为每 8x8 块的左上角，前 3 遍为每 4x4 块，
+ * 前 5 遍为每 2x2 块。缩小解码只解压到对应的那一遍就停止，直接取这些像素作为缩略图。
+ *
+ * 非隔行图像必须解压每一行，但每行转换后立即按块累加（盒式滤波），攒满 scale 行输出一行缩略图，
+ * 全分辨率的像素从不整幅保存。累加在预乘 α 空间进行，透明像素的颜色不会渗入相邻的不透明像素。
+ */
+
+// 缩小 scale 倍时隔行图像需要解码到的最后一遍
+static int png_scale_last_pass(uint32_t scale) {
+    switch (scale) {
+        case 1:  return PNG_ADAM7_PASSES - 1;
+        case 2:  return 4;
+        case 4:  return 2;
+        default: return 0;
+    }
+}
+
+/**
+ * 估算缩小解码所需的内存
+ *
+ * @param header    图像头信息
+ * @param format    输出像素格式（PNG_FORMAT_*）
+ * @param scale     缩小倍数（1、2、4、8）
+ *
+ * @return          所需字节数，参数非法时返回 UINT64_MAX
+ */
+uint64_t png_scaled_memory_size(const PNG_IHDR* header, int format, uint32_t scale) {
+    uint32_t bytes_per_line = header ? png_row_bytes(header, header->width) : 0;
+    uint32_t pixel_bytes = png_format_bytes_per_pixel(format);
+    if (bytes_per_line == 0 || pixel_bytes == 0 || scale == 0 || scale > PNG_SCALE_MAX || (scale & (scale - 1)) != 0) {
+        return UINT64_MAX;
+    }
+
+    uint64_t output_width = ((uint64_t)header->width + scale - 1) / scale;
+    uint64_t output_height = ((uint64_t)header->height + scale - 1) / scale;
+
+    // 两行扫描线、一行转换后的全分辨率像素（含转换上下文的中间缓冲区）、缩略图，以及每个输出像素 4 个累加器
+    uint64_t size = 2 * ((uint64_t)bytes_per_line + 1) + (uint64_t)header->width * (pixel_bytes + 8);
+    size += output_width * output_height * pixel_bytes;
+    if (header->interlace_method == PNG_INTERLACE_METHOD_NONE && scale > 1) {
+        size += output_width * 4 * sizeof(uint64_t);
+    }
+    return size;
+}
+
+/**
+ * 把一行转换后的像素按块累加：颜色乘以 α 后累加，α 单独累加
+ *
+ * @param row           转换后的一行像素（BGRA8 或 RGBA16，α 均为第 4 个通道）
+ * @param wide          是否为 16 位通道
+ * @param width         源图像宽度
+ * @param scale         缩小倍数
+ * @param sums          每个输出像素 4 个累加器
+ */
+static void png_scale_accumulate_row(const uint8_t* row, int wide, uint32_t width, uint32_t scale, uint64_t* sums) {
+    if (wide) {
+        const uint16_t* p = (const uint16_t*)row;
+        for (uint32_t x = 0; x < width; x++, p += 4) {
+            uint64_t* sum = sums + (size_t)(x / scale) * 4;
+            uint64_t a = p[3];
+            sum[0] += p[0] * a;
+            sum[1] += p[1] * a;
+            sum[2] += p[2] * a;
+            sum[3] += a;
+        }
+        return;
+    }
+
+    // 8 位通道时一个块内最多 8 个像素的乘积之和不超过 32 位，先在块内累加再写回
+    const uint8_t* p = row;
+    for (uint32_t x0 = 0; x0 < width; x0 += scale) {
+        uint32_t x1 = width - x0 < scale ? width : x0 + scale;
+        uint32_t c0 = 0, c1 = 0, c2 = 0, a = 0;
+        for (uint32_t x = x0; x < x1; x++, p += 4) {
+            c0 += (uint32_t)p[0] * p[3];
+            c1 += (uint32_t)p[1] * p[3];
+            c2 += (uint32_t)p[2] * p[3];
+            a += p[3];
+        }
+        uint64_t* sum = sums + (size_t)(x0 / scale) * 4;
+        sum[0] += c0;
+        sum[1] += c1;
+        sum[2] += c2;
+        sum[3] += a;
+    }
+}
+
+/**
+ * 由累加器求出一行缩略图像素，并清零累加器
+ *
+ * @param sums          每个输出像素 4 个累加器
+ * @param format        输出像素格式（PNG_FORMAT_*）
+ * @param width         源图像宽度
+ * @param scale         缩小倍数
+ * @param rows          本行缩略图覆盖的源图像行数（图像底部可能不足 scale 行）
+ * @param dst           输出的一行缩略图
+ */
+static void png_scale_emit_row(uint64_t* sums, int format, uint32_t width, uint32_t scale, uint32_t rows, uint8_t* dst) {
+    uint32_t output_width = (width + scale - 1) / scale;
+    uint64_t max = format == PNG_FORMAT_RGBA16 ? 65535 : 255;
+
+    for (uint32_t ox = 0; ox < output_width; ox++) {
+        uint64_t* sum = sums + (size_t)ox * 4;
+        uint32_t columns = width - ox * scale < scale ? width - ox * scale : scale;
+        uint64_t count = (uint64_t)columns * rows;
+        uint64_t value[4];
+
+        value[3] = (sum[3] + count / 2) / count;
+        for (int c = 0; c < 3; c++) {
+            if (format == PNG_FORMAT_BGRA8_PREMULTIPLIED) {
+                // 预乘输出：颜色为块内预乘颜色的平均值
+                value[c] = (sum[c] + max * count / 2) / (max * count);
+            } else {
+                // 非预乘输出：颜色为以 α 加权的平均值，完全透明的块颜色为 0
+                value[c] = sum[3] > 0 ? (sum[c] + sum[3] / 2) / sum[3] : 0;
+            }
+        }
+
+        if (format == PNG_FORMAT_RGBA16) {
+            uint16_t* p = (uint16_t*)dst + (size_t)ox * 4;
+            for (int c = 0; c < 4; c++) {
+                p[c] = (uint16_t)value[c];
+            }
+        } else {
+            uint8_t* p = dst + (size_t)ox * 4;
+            for (int c = 0; c < 4; c++) {
+                p[c] = (uint8_t)value[c];
+            }
+        }
+        memset(sum, 0, 4 * sizeof(uint64_t));
+    }
+}
+
+/**
+ * 以 1/2、1/4 或 1/8 的分辨率解码 PNG 文件（用于生成缩略图）
+ *
+ * 隔行图像解码到所需的 Adam7 遍即停止，取每块左上角的像素；非隔行图像逐行解码并在预乘 α 空间按块求平均。
+ * 两种方式都不会生成全分辨率的整幅像素。缩略图尺寸为原尺寸除以 scale 后向上取整。
+ * 解码完成后 image 只保留头部信息（header、palette 等），image_data 为 NULL。
+ *
+ * @param filename      PNG 文件路径
+ * @param image         图像结构体
+ * @param format        输出像素格式（PNG_FORMAT_*）
+ * @param scale         缩小倍数（1、2、4、8）
+ * @param output        输出像素数据，逐行紧密排列（需要调用者释放）
+ * @param output_size   输出数据大小
+ * @param output_width  缩略图宽度
+ * @param output_height 缩略图高度
+ * @param cancel        取消令牌，可以为 NULL，每解码一行检查一次
+ *
+ * @return              是否解码成功，返回 1(真) 或 0(假)
+ */
+int png_read_file_scaled(const char* filename, PNG_Image* image, int format, uint32_t scale, uint8_t** output,
+    size_t* output_size, uint32_t* output_width, uint32_t* output_height, const PNG_CancelToken* cancel) {
+    if (!output || !output_size || !output_width || !output_height || png_format_bytes_per_pixel(format) == 0) {
+        return 0;
+    }
+    *output = NULL;
+    *output_size = 0;
+
+    PNG_Stream stream;
+    if (!png_stream_open(&stream, filename, image)) {
+        return 0;
+    }
+
+    PNG_IHDR* header = &image->header;
+    int interlaced = header->interlace_method == PNG_INTERLACE_METHOD_ADAM7;
+    int accumulate = !interlaced && scale > 1;
+    uint32_t bytes_per_pixel = png_bytes_per_pixel(header);
+    uint32_t bytes_per_line = png_row_bytes(header, header->width);
+    uint32_t pixel_bytes = png_format_bytes_per_pixel(format);
+    uint8_t* current_line = NULL;
+    uint8_t* prev_line = NULL;
+    uint8_t* row = NULL;
+    uint8_t* pixels = NULL;
+    uint64_t* sums = NULL;
+    PNG_ConvertContext ctx;
+    int ctx_ready = 0;
+
+    if (png_scaled_memory_size(header, format, scale) > png_get_memory_budget()) {
+        goto fail;
+    }
+
+    uint32_t width = (header->width + scale - 1) / scale;
+    uint32_t height = (header->height + scale - 1) / scale;
+    size_t dst_row_bytes = (size_t)width * pixel_bytes;
+    current_line = (uint8_t*)malloc((size_t)bytes_per_line + 1);
+    prev_line = (uint8_t*)malloc((size_t)bytes_per_line + 1);
+    row = (uint8_t*)malloc((size_t)header->width * pixel_bytes);
+    pixels = (uint8_t*)malloc(dst_row_bytes * height);
+    if (accumulate) {
+        sums = (uint64_t*)calloc((size_t)width * 4, sizeof(uint64_t));
+    }
+    if (!current_line || !prev_line || !row || !pixels || (accumulate && !sums)) {
+        goto fail;
+    }
+
+    // 累加时先转换为非预乘的 BGRA8 或 RGBA16，由累加器统一处理预乘
+    int row_format = accumulate && format == PNG_FORMAT_BGRA8_PREMULTIPLIED ? PNG_FORMAT_BGRA8 : format;
+    if (!png_convert_context_init(&ctx, image, row_format)) {
+        goto fail;
+    }
+    ctx_ready = 1;
+
+    int last_pass = interlaced ? png_scale_last_pass(scale) : 0;
+    for (int pass = 0; pass <= last_pass; pass++) {
+        uint32_t pass_width = header->width;
+        uint32_t pass_height = header->height;
+        if (interlaced) {
+            png_adam7_pass_size(header, pass, &pass_width, &pass_height);
+            if (pass_width == 0) {
+                continue;
+            }
+        }
+
+        uint32_t pass_row_bytes = png_row_bytes(header, pass_width);
+        memset(prev_line, 0, (size_t)pass_row_bytes + 1);
+
+        for (uint32_t py = 0; py < pass_height; py++) {
+            // 每行第一个字节是过滤类型
+            if (png_cancel_requested(cancel) || !png_stream_read(&stream, current_line, pass_row_bytes + 1) ||
+                !png_unfilter_row(current_line[0], current_line + 1, prev_line + 1, pass_row_bytes, bytes_per_pixel)) {
+                goto fail;
+            }
+
+            if (interlaced) {
+                // 前 last_pass 遍的像素都落在 scale 网格上，每个像素恰好对应一个输出像素
+                const PNG_Adam7Pass* p = &png_adam7_passes[pass];
+                uint32_t y = p->y0 + py * p->dy;
+                uint8_t* dst = pixels + (size_t)(y / scale) * dst_row_bytes;
+                png_convert_row_span(&ctx, current_line + 1, 0, pass_width, row);
+                for (uint32_t i = 0; i < pass_width; i++) {
+                    uint32_t x = p->x0 + i * p->dx;
+                    memcpy(dst + (size_t)(x / scale) * pixel_bytes, row + (size_t)i * pixel_bytes, pixel_bytes);
+                }
+            } else if (!accumulate) {
+                png_convert_row(&ctx, current_line + 1, pixels + (size_t)py * dst_row_bytes);
+            } else {
+                png_convert_row(&ctx, current_line + 1, row);
+                png_scale_accumulate_row(row, format == PNG_FORMAT_RGBA16, header->width, scale, sums);
+                if ((py + 1) % scale == 0 || py + 1 == pass_height) {
+                    png_scale_emit_row(sums, format, header->width, scale, py % scale + 1,
+                        pixels + (size_t)(py / scale) * dst_row_bytes);
+                }
+            }
+
+            uint8_t* tmp = prev_line;
+            prev_line = current_line;
+            current_line = tmp;
+        }
+    }
+
+    // 非隔行图像已解压全部数据，校验文件剩余部分；隔行图像提前停止，不再读取之后的数据
+    if (!interlaced && !png_stream_finish(&stream)) {
+        goto fail;
+    }
+
+    png_stream_close(&stream);
+    png_convert_context_free(&ctx);
+    free(current_line);
+    free(prev_line);
+    free(row);
+    free(sums);
+    *output = pixels;
+    *output_size = dst_row_bytes * height;
+    *output_width = width;
+    *output_height = height;
+    return 1;
+
+fail:
+    png_stream_close(&stream);
+    if (ctx_ready) {
+        png_convert_context_free(&ctx);
+    }
+    png_free_image(image);
+    free(current_line);
+    free(prev_line);
+    free(row);
+    free(sums);
+    free(pixels);
+    return 0;
+}
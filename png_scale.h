@@ -0,0 +1,13 @@
+#ifndef PNG_SCALE_H
+#define PNG_SCALE_H
+
+#include "png_decoder.h"
+
+// 缩小解码支持的最大倍数（1/8，对应 Adam7 第一遍的采样间隔）
+#define PNG_SCALE_MAX 8
+
+uint64_t png_scaled_memory_size(const PNG_IHDR* header, int format, uint32_t scale);
+int png_read_file_scaled(const char* filename, PNG_Image* image, int format, uint32_t scale, uint8_t** output,
+    size_t* output_size, uint32_t* output_width, uint32_t* output_height, const PNG_CancelToken* cancel);
+
+#endif // PNG_SCALE_H
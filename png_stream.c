@@ -0,0 +1,438 @@
+#include "png_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * 以大端序读取 32 位整数
+ */
+static uint32_t png_stream_be32(const uint8_t* data) {
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+/**
+ * 获取文件的当前位置（64 位，支持超过 2GB 的文件）
+ */
+static int64_t png_stream_tell(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (int64_t)ftello(file);
+#endif
+}
+
+/**
+ * 移动到文件中的指定位置（64 位，支持超过 2GB 的文件）
+ */
+static int png_stream_seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (int64_t)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+/**
+ * 读取下一个块的长度与类型，并以块类型初始化 CRC
+ *
+ * @param stream    流式读取器
+ *
+ * @return          是否读取成功，返回 1(真) 或 0(假)
+ */
+static int png_stream_begin_chunk(PNG_Stream* stream) {
+    uint8_t buf[8];
+    if (fread(buf, 1, 8, stream->file) != 8) {
+        return 0;
+    }
+
+    stream->chunk_remaining = png_stream_be32(buf);
+    stream->chunk_type = png_stream_be32(buf + 4);
+    stream->chunk_crc = (uint32_t)crc32(0, buf + 4, 4);
+
+    // 检查是否超出最大长度：IDAT 边读边解压，不受块缓冲区大小限制，只需满足规范上限
+    if (stream->chunk_type == PNG_CHUNK_IDAT) {
+        return stream->chunk_remaining <= PNG_MAX_IDAT_LENGTH;
+    }
+    return stream->chunk_remaining <= MAX_CHUNK_LENGTH;
+}
+
+/**
+ * 读取当前块的一段数据，同时累计 CRC
+ */
+static int png_stream_read_payload(PNG_Stream* stream, uint8_t* buffer, uint32_t size) {
+    if (size > stream->chunk_remaining || fread(buffer, 1, size, stream->file) != size) {
+        return 0;
+    }
+    stream->chunk_crc = (uint32_t)crc32(stream->chunk_crc, buffer, size);
+    stream->chunk_remaining -= size;
+    return 1;
+}
+
+/**
+ * 跳过当前块的剩余数据（仍需读取以校验 CRC），然后读取并验证 CRC
+ */
+static int png_stream_end_chunk(PNG_Stream* stream) {
+    while (stream->chunk_remaining > 0) {
+        uint32_t n = stream->chunk_remaining < PNG_STREAM_INPUT_SIZE ? stream->chunk_remaining : PNG_STREAM_INPUT_SIZE;
+        if (!png_stream_read_payload(stream, stream->input, n)) {
+            return 0;
+        }
+    }
+
+    uint8_t crc_buf[4];
+    if (fread(crc_buf, 1, 4, stream->file) != 4) {
+        return 0;
+    }
+    if (stream->crc_unchecked) {
+        // 只读取了块的后半部分，CRC 无从计算
+        stream->crc_unchecked = 0;
+        return 1;
+    }
+    return png_stream_be32(crc_buf) == stream->chunk_crc;
+}
+
+/**
+ * 从 IDAT 块序列中读取下一段压缩数据（不解压）
+ *
+ * 每个 IDAT 块的 CRC 在读完该块时校验。解压由调用方负责时（例如在另一个线程上），可直接用此函数取得压缩数据。
+ *
+ * @param stream    流式读取器
+ * @param buffer    输出缓冲区
+ * @param capacity  缓冲区大小
+ * @param size      实际读取的字节数，IDAT 序列已结束时为 0
+ *
+ * @return          是否读取成功，返回 1(真) 或 0(假)
+ */
+int png_stream_read_idat(PNG_Stream* stream, uint8_t* buffer, uint32_t capacity, uint32_t* size) {
+    *size = 0;
+
+    // 当前 IDAT 块已读完时切换到下一个块，允许出现长度为 0 的 IDAT
+    while (stream->in_idat && stream->chunk_remaining == 0) {
+        if (!png_stream_end_chunk(stream) || !png_stream_begin_chunk(stream)) {
+            return 0;
+        }
+        if (stream->chunk_type != PNG_CHUNK_IDAT) {
+            // IDAT 必须连续出现，此时已读入下一个块的头部，留给 png_stream_finish_chunks 处理
+            stream->in_idat = 0;
+            stream->idat_ended = 1;
+        }
+    }
+    if (!stream->in_idat) {
+        return 1;
+    }
+
+    uint32_t n = stream->chunk_remaining < capacity ? stream->chunk_remaining : capacity;
+    if (!png_stream_read_payload(stream, buffer, n)) {
+        return 0;
+    }
+    *size = n;
+    return 1;
+}
+
+/**
+ * 从 IDAT 块序列中读取下一段压缩数据作为 zlib 的输入
+ *
+ * @param stream    流式读取器
+ *
+ * @return          是否读取到数据，IDAT 序列已结束或读取失败时返回 0
+ */
+static int png_stream_refill(PNG_Stream* stream) {
+    uint32_t n = 0;
+    if (!png_stream_read_idat(stream, stream->input, PNG_STREAM_INPUT_SIZE, &n) || n == 0) {
+        return 0;
+    }
+    stream->zstream.next_in = stream->input;
+    stream->zstream.avail_in = n;
+    return 1;
+}
+
+/**
+ * 打开 PNG 文件并读取图像数据之前的所有块，停在第一个 IDAT 块的数据开头
+ *
+ * @param stream    流式读取器
+ * @param filename  PNG 文件路径
+ * @param image     图像结构体，header、palette、transparency 写入其中，image_data 保持为空
+ *
+ * @return          是否打开成功，返回 1(真) 或 0(假)；失败时已释放所有资源
+ */
+int png_stream_open(PNG_Stream* stream, const char* filename, PNG_Image* image) {
+    memset(stream, 0, sizeof(PNG_Stream));
+    memset(image, 0, sizeof(PNG_Image));
+    stream->image = image;
+
+    stream->file = fopen(filename, "rb");
+    if (!stream->file) {
+        return 0;
+    }
+    stream->input = (uint8_t*)malloc(PNG_STREAM_INPUT_SIZE);
+    if (!stream->input || !png_validate_signature(stream->file)) {
+        goto fail;
+    }
+
+    int has_ihdr = 0;
+    for (;;) {
+        if (!png_stream_begin_chunk(stream)) {
+            goto fail;
+        }
+        if (stream->chunk_type == PNG_CHUNK_IDAT) {
+            if (!has_ihdr) {
+                goto fail;
+            }
+            stream->in_idat = 1;
+            break;
+        }
+        if (stream->chunk_type == PNG_CHUNK_IEND) {
+            // 没有图像数据
+            goto fail;
+        }
+
+        PNG_Chunk chunk = {0};
+        chunk.type = stream->chunk_type;
+        chunk.length = stream->chunk_remaining;
+        if (chunk.length > 0) {
+            chunk.data = (uint8_t*)malloc(chunk.length);
+            if (!chunk.data || !png_stream_read_payload(stream, chunk.data, chunk.length)) {
+                png_free_chunk(&chunk);
+                goto fail;
+            }
+        }
+        int ok = png_stream_end_chunk(stream) && png_process_header_chunk(&chunk, image, &has_ihdr);
+        png_free_chunk(&chunk);
+        if (!ok) {
+            goto fail;
+        }
+    }
+
+    if (inflateInit(&stream->zstream) != Z_OK) {
+        goto fail;
+    }
+    stream->zstream_ready = 1;
+    return 1;
+
+fail:
+    png_stream_close(stream);
+    png_free_image(image);
+    return 0;
+}
+
+/**
+ * 解压出恰好 size 字节的扫描线数据，需要时继续读取后续 IDAT 块
+ *
+ * @param stream    流式读取器
+ * @param buffer    输出缓冲区
+ * @param size      需要的字节数
+ *
+ * @return          是否读取成功，数据不足或损坏时返回 0
+ */
+int png_stream_read(PNG_Stream* stream, uint8_t* buffer, uint32_t size) {
+    z_stream* zs = &stream->zstream;
+    zs->next_out = buffer;
+    zs->avail_out = size;
+
+    while (zs->avail_out > 0) {
+        if (stream->stream_end) {
+            return 0;
+        }
+        if (zs->avail_in == 0 && !png_stream_refill(stream)) {
+            return 0;
+        }
+        int ret = inflate(zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            stream->stream_end = 1;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * 解压至多 size 字节的扫描线数据，到达 deflate 块边界时提前返回
+ *
+ * 与 png_stream_read 相同，但每到一个块边界就返回，使调用方可以在此处调用 png_stream_save_checkpoint。
+ *
+ * @param stream    流式读取器
+ * @param buffer    输出缓冲区
+ * @param size      最多解压的字节数
+ * @param produced  实际解压的字节数
+ * @param boundary  是否停在块边界（不包括最后一个块之后）
+ *
+ * @return          是否读取成功，数据不足或损坏时返回 0
+ */
+int png_stream_read_block(PNG_Stream* stream, uint8_t* buffer, uint32_t size, uint32_t* produced, int* boundary) {
+    z_stream* zs = &stream->zstream;
+    zs->next_out = buffer;
+    zs->avail_out = size;
+    *produced = 0;
+    *boundary = 0;
+
+    while (zs->avail_out > 0 && !*boundary) {
+        if (stream->stream_end) {
+            return 0;
+        }
+        if (zs->avail_in == 0 && !png_stream_refill(stream)) {
+            return 0;
+        }
+        int ret = inflate(zs, Z_BLOCK);
+        if (ret == Z_STREAM_END) {
+            stream->stream_end = 1;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return 0;
+        }
+
+        // data_type 的第 7 位表示刚解码完一个块（或 zlib 头部），第 6 位表示正在处理最后一个块；
+        // 有未用完的位时，所在字节必须仍在输入缓冲区中，保存检查点时才能取得
+        int bits = zs->data_type & 7;
+        *boundary = (zs->data_type & 128) && !(zs->data_type & 64) && (bits == 0 || zs->next_in != stream->input);
+    }
+
+    *produced = size - zs->avail_out;
+    return 1;
+}
+
+/**
+ * 在 deflate 块边界上保存解压检查点（紧接在 png_stream_read_block 报告块边界之后调用）
+ *
+ * @param stream        流式读取器
+ * @param checkpoint    检查点
+ *
+ * @return              是否保存成功，返回 1(真) 或 0(假)
+ */
+int png_stream_save_checkpoint(PNG_Stream* stream, PNG_StreamCheckpoint* checkpoint) {
+    z_stream* zs = &stream->zstream;
+    int64_t position = png_stream_tell(stream->file);
+    if (position < 0 || (uint64_t)position < zs->avail_in) {
+        return 0;
+    }
+
+    // 输入缓冲区总是来自同一个 IDAT 块，尚未解压的部分仍属于当前块
+    checkpoint->file_offset = (uint64_t)position - zs->avail_in;
+    checkpoint->chunk_remaining = stream->chunk_remaining + zs->avail_in;
+    checkpoint->bits = (uint8_t)(zs->data_type & 7);
+    checkpoint->partial = checkpoint->bits > 0 ? zs->next_in[-1] : 0;
+
+    uInt window_size = 0;
+    if (inflateGetDictionary(zs, checkpoint->window, &window_size) != Z_OK) {
+        return 0;
+    }
+    checkpoint->window_size = window_size;
+    return 1;
+}
+
+/**
+ * 从检查点恢复解压：之后的 png_stream_read 从检查点所在位置继续产出扫描线数据
+ *
+ * 流式读取器需已由 png_stream_open 打开同一个文件。恢复位置所在的 IDAT 块只读取了后半部分，
+ * 不校验其 CRC；之后的块照常校验。
+ *
+ * @param stream        流式读取器
+ * @param checkpoint    png_stream_save_checkpoint 保存的检查点
+ *
+ * @return              是否恢复成功，返回 1(真) 或 0(假)
+ */
+int png_stream_restore_checkpoint(PNG_Stream* stream, const PNG_StreamCheckpoint* checkpoint) {
+    if (checkpoint->bits > 7 || checkpoint->window_size > PNG_STREAM_WINDOW_SIZE ||
+        checkpoint->chunk_remaining > PNG_MAX_IDAT_LENGTH || !png_stream_seek(stream->file, checkpoint->file_offset)) {
+        return 0;
+    }
+
+    if (stream->zstream_ready) {
+        inflateEnd(&stream->zstream);
+        stream->zstream_ready = 0;
+    }
+
+    // 检查点位于 zlib 头部之后，以原始 deflate 格式继续解压
+    memset(&stream->zstream, 0, sizeof(z_stream));
+    if (inflateInit2(&stream->zstream, -15) != Z_OK) {
+        return 0;
+    }
+    stream->zstream_ready = 1;
+    if (checkpoint->bits > 0 &&
+        inflatePrime(&stream->zstream, checkpoint->bits, checkpoint->partial >> (8 - checkpoint->bits)) != Z_OK) {
+        return 0;
+    }
+    if (checkpoint->window_size > 0 &&
+        inflateSetDictionary(&stream->zstream, checkpoint->window, checkpoint->window_size) != Z_OK) {
+        return 0;
+    }
+
+    stream->chunk_type = PNG_CHUNK_IDAT;
+    stream->chunk_remaining = checkpoint->chunk_remaining;
+    stream->crc_unchecked = 1;
+    stream->in_idat = 1;
+    stream->idat_ended = 0;
+    stream->stream_end = 0;
+    return 1;
+}
+
+/**
+ * 读完剩余的压缩数据（校验 zlib 的 Adler-32）以及 IDAT 之后的所有块，直到 IEND
+ *
+ * @param stream    流式读取器
+ *
+ * @return          文件剩余部分是否完整有效，返回 1(真) 或 0(假)
+ */
+int png_stream_finish(PNG_Stream* stream) {
+    // 扫描线之后只应剩下 zlib 校验和，多余的图像数据直接丢弃
+    uint8_t sink[256];
+    while (!stream->stream_end) {
+        if (!png_stream_read(stream, sink, sizeof(sink)) && !stream->stream_end) {
+            return 0;
+        }
+    }
+
+    return png_stream_finish_chunks(stream);
+}
+
+/**
+ * 跳过尚未读取的 IDAT 数据，并读完之后的所有块直到 IEND，逐块校验 CRC
+ *
+ * @param stream    流式读取器
+ *
+ * @return          文件剩余部分是否完整有效，返回 1(真) 或 0(假)
+ */
+int png_stream_finish_chunks(PNG_Stream* stream) {
+    // 跳过剩余的 IDAT 块
+    while (stream->in_idat) {
+        if (!png_stream_end_chunk(stream) || !png_stream_begin_chunk(stream)) {
+            return 0;
+        }
+        if (stream->chunk_type != PNG_CHUNK_IDAT) {
+            stream->in_idat = 0;
+            stream->idat_ended = 1;
+        }
+    }
+
+    // 此时已读入 IDAT 之后第一个块的头部，忽略 IEND 之前的辅助块
+    while (stream->chunk_type != PNG_CHUNK_IEND) {
+        if (!png_stream_end_chunk(stream) || !png_stream_begin_chunk(stream)) {
+            return 0;
+        }
+        if (stream->chunk_type == PNG_CHUNK_IDAT) {
+            // IDAT 必须连续出现
+            return 0;
+        }
+    }
+
+    return stream->chunk_remaining == 0 && png_stream_end_chunk(stream);
+}
+
+/**
+ * 关闭流式读取器并释放资源（不释放 image 中的数据）
+ *
+ * @param stream    流式读取器
+ *
+ * @return          无
+ */
+void png_stream_close(PNG_Stream* stream) {
+    if (stream->zstream_ready) {
+        inflateEnd(&stream->zstream);
+        stream->zstream_ready = 0;
+    }
+    if (stream->file) {
+        fclose(stream->file);
+        stream->file = NULL;
+    }
+    free(stream->input);
+    stream->input = NULL;
+}
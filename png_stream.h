@@ -0,0 +1,59 @@
+#ifndef PNG_STREAM_H
+#define PNG_STREAM_H
+
+#include "png_decoder.h"
+#include <zlib.h>
+
+// 每次从 IDAT 块读取的压缩数据量 64KB
+#define PNG_STREAM_INPUT_SIZE (64 * 1024)
+
+// deflate 回溯引用的最大距离 32KB，即从检查点恢复解压所需的窗口大小
+#define PNG_STREAM_WINDOW_SIZE (32 * 1024)
+
+/**
+ * 流式读取器：边读取 IDAT 块边解压，按需产出扫描线数据
+ *
+ * 与 png_read_file 先缓存全部 IDAT、再整体解压不同，流式读取器任何时刻只持有
+ * 一小段压缩数据，调用方可以逐行取出解压结果，在读到最后一个 IDAT 之前就开始处理图像。
+ */
+typedef struct {
+    FILE* file;
+    PNG_Image* image;               // 头部信息（header、palette、transparency）写入的图像结构体
+    z_stream zstream;
+    int zstream_ready;              // zstream 是否已初始化
+    int stream_end;                 // zlib 数据流是否已结束
+    uint8_t* input;                 // 压缩数据缓冲区
+    uint32_t chunk_type;            // 当前块类型
+    uint32_t chunk_remaining;       // 当前 IDAT 块尚未读取的数据字节数
+    uint32_t chunk_crc;             // 当前块已读取部分的 CRC
+    int in_idat;                    // 当前是否处于 IDAT 块内
+    int idat_ended;                 // IDAT 块序列是否已结束（之后不允许再出现 IDAT）
+    int crc_unchecked;              // 当前块是从中间开始读取的（从检查点恢复），无法校验 CRC
+} PNG_Stream;
+
+/**
+ * 解压检查点：在 deflate 块边界上恢复解压所需的全部状态
+ *
+ * deflate 块之间不共享霍夫曼表，块边界处的解压状态只有输入位置与最近 32KB 的输出（回溯引用的范围），
+ * 保存下来即可直接从该位置继续解压，而不必从头解压之前的所有数据。
+ */
+typedef struct {
+    uint64_t file_offset;           // 下一个未读取的压缩字节在文件中的位置
+    uint32_t chunk_remaining;       // 该位置所在 IDAT 块的剩余字节数
+    uint8_t bits;                   // 前一个字节中尚未使用的位数（0 ~ 7）
+    uint8_t partial;                // 前一个字节，bits > 0 时有效
+    uint32_t window_size;           // 窗口的有效字节数
+    uint8_t window[PNG_STREAM_WINDOW_SIZE];
+} PNG_StreamCheckpoint;
+
+int png_stream_open(PNG_Stream* stream, const char* filename, PNG_Image* image);
+int png_stream_read(PNG_Stream* stream, uint8_t* buffer, uint32_t size);
+int png_stream_finish(PNG_Stream* stream);
+int png_stream_read_idat(PNG_Stream* stream, uint8_t* buffer, uint32_t capacity, uint32_t* size);
+int png_stream_finish_chunks(PNG_Stream* stream);
+int png_stream_read_block(PNG_Stream* stream, uint8_t* buffer, uint32_t size, uint32_t* produced, int* boundary);
+int png_stream_save_checkpoint(PNG_Stream* stream, PNG_StreamCheckpoint* checkpoint);
+int png_stream_restore_checkpoint(PNG_Stream* stream, const PNG_StreamCheckpoint* checkpoint);
+void png_stream_close(PNG_Stream* stream);
+
+#endif // PNG_STREAM_H
@@ -0,0 +1,589 @@
+#include "png_thread.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/**
+ * 线程池
+ *
+ * 调用线程自身也参与执行任务（工作线程序号 0），另外创建 thread_count - 1 个常驻工作线程。
+ * 每次 png_thread_pool_run 都要等所有工作线程确认处理完这一批任务才返回，
+ * 因此不会有迟到的线程把上一批的任务函数用在下一批的任务序号上。
+ */
+struct PNG_ThreadPool {
+    int thread_count;                       // 线程总数（含调用线程）
+    png_thread_t threads[PNG_MAX_THREADS];
+    struct PNG_PoolWorker {
+        PNG_ThreadPool* pool;
+        int index;
+    } workers[PNG_MAX_THREADS];
+    png_mutex_t mutex;
+    png_cond_t work_cond;                   // 有新一批任务或需要退出
+    png_cond_t done_cond;                   // 某个工作线程完成了当前批次
+    uint64_t generation;                    // 批次编号，每次 run 加 1
+    int shutdown;
+    int busy;                               // 是否正在执行某一批任务
+    PNG_TaskFunc func;
+    void* ctx;
+    uint32_t count;
+    atomic_uint next;                       // 下一个待领取的任务序号
+    uint32_t completed;                     // 已完成的任务数
+    int finished_workers;                   // 已处理完当前批次的工作线程数
+};
+
+// 当前线程是否为线程池的工作线程；工作线程内再次并行时直接串行执行，避免嵌套等待造成死锁
+static _Thread_local int png_in_pool = 0;
+
+/*
+ * 平台线程原语
+ */
+
+// 线程入口参数，由新线程负责释放
+typedef struct {
+    PNG_ThreadFunc func;
+    void* arg;
+} PNG_ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI png_thread_trampoline(LPVOID param) {
+    PNG_ThreadStart start = *(PNG_ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+#else
+static void* png_thread_trampoline(void* param) {
+    PNG_ThreadStart start = *(PNG_ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return NULL;
+}
+#endif
+
+/**
+ * 创建线程
+ *
+ * @param thread    输出参数，线程句柄
+ * @param func      线程入口函数
+ * @param arg       传给入口函数的参数
+ *
+ * @return          是否创建成功，返回 1(真) 或 0(假)
+ */
+int png_thread_create(png_thread_t* thread, PNG_ThreadFunc func, void* arg) {
+    PNG_ThreadStart* start = (PNG_ThreadStart*)malloc(sizeof(PNG_ThreadStart));
+    if (!start) {
+        return 0;
+    }
+    start->func = func;
+    start->arg = arg;
+
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, png_thread_trampoline, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return 0;
+    }
+#else
+    if (pthread_create(thread, NULL, png_thread_trampoline, start) != 0) {
+        free(start);
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+/**
+ * 等待线程结束并释放线程句柄
+ */
+void png_thread_join(png_thread_t thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/**
+ * 让出当前线程的剩余时间片
+ */
+void png_thread_yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+/**
+ * 让当前线程休眠
+ *
+ * @param milliseconds  休眠时长（毫秒）
+ */
+void png_thread_sleep(uint32_t milliseconds) {
+#ifdef _WIN32
+    Sleep(milliseconds);
+#else
+    struct timespec duration = { (time_t)(milliseconds / 1000), (long)(milliseconds % 1000) * 1000000L };
+    nanosleep(&duration, NULL);
+#endif
+}
+
+/**
+ * 获取单调递增的时间（秒），不受系统时钟调整影响，只用于计算时间间隔
+ */
+double png_monotonic_time(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void png_mutex_init(png_mutex_t* mutex) {
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void png_mutex_lock(png_mutex_t* mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void png_mutex_unlock(png_mutex_t* mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void png_mutex_destroy(png_mutex_t* mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void png_cond_init(png_cond_t* cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+void png_cond_wait(png_cond_t* cond, png_mutex_t* mutex) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void png_cond_signal(png_cond_t* cond) {
+#ifdef _WIN32
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+void png_cond_broadcast(png_cond_t* cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+void png_cond_destroy(png_cond_t* cond) {
+#ifdef _WIN32
+    (void)cond;                             // Windows 条件变量无需销毁
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+/**
+ * 获取逻辑处理器数量
+ */
+int png_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (count < 1) {
+        count = 1;
+    }
+    return count > PNG_MAX_THREADS ? PNG_MAX_THREADS : count;
+}
+
+/*
+ * 线程池
+ */
+
+/**
+ * 领取并执行当前批次的任务，直到任务全部被领取
+ *
+ * @return      本线程执行的任务数
+ */
+static uint32_t png_thread_pool_work(PNG_ThreadPool* pool, PNG_TaskFunc func, void* ctx, uint32_t count, int worker) {
+    uint32_t done = 0;
+    for (;;) {
+        uint32_t index = atomic_fetch_add(&pool->next, 1);
+        if (index >= count) {
+            break;
+        }
+        func(ctx, index, worker);
+        done++;
+    }
+    return done;
+}
+
+static void png_thread_pool_worker(void* arg) {
+    struct PNG_PoolWorker* self = (struct PNG_PoolWorker*)arg;
+    PNG_ThreadPool* pool = self->pool;
+    uint64_t seen = 0;
+
+    png_in_pool = 1;
+    png_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            png_cond_wait(&pool->work_cond, &pool->mutex);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        PNG_TaskFunc func = pool->func;
+        void* ctx = pool->ctx;
+        uint32_t count = pool->count;
+        png_mutex_unlock(&pool->mutex);
+
+        uint32_t done = png_thread_pool_work(pool, func, ctx, count, self->index);
+
+        png_mutex_lock(&pool->mutex);
+        pool->completed += done;
+        pool->finished_workers++;
+        png_cond_broadcast(&pool->done_cond);
+    }
+    png_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * 创建线程池
+ *
+ * @param thread_count  线程总数（含调用线程），小于 1 时使用逻辑处理器数量
+ *
+ * @return              线程池指针，失败时返回 NULL
+ */
+PNG_ThreadPool* png_thread_pool_create(int thread_count) {
+    if (thread_count < 1) {
+        thread_count = png_cpu_count();
+    }
+    if (thread_count > PNG_MAX_THREADS) {
+        thread_count = PNG_MAX_THREADS;
+    }
+
+    PNG_ThreadPool* pool = (PNG_ThreadPool*)calloc(1, sizeof(PNG_ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+    png_mutex_init(&pool->mutex);
+    png_cond_init(&pool->work_cond);
+    png_cond_init(&pool->done_cond);
+    atomic_init(&pool->next, 0);
+
+    // 调用线程是 0 号工作线程，只需创建其余线程；创建失败时以已创建的线程数继续工作
+    pool->thread_count = 1;
+    for (int i = 1; i < thread_count; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (!png_thread_create(&pool->threads[i], png_thread_pool_worker, &pool->workers[i])) {
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    return pool;
+}
+
+/**
+ * 通知所有工作线程退出，等待其结束后释放线程池
+ */
+void png_thread_pool_destroy(PNG_ThreadPool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    png_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    png_cond_broadcast(&pool->work_cond);
+    png_mutex_unlock(&pool->mutex);
+
+    for (int i = 1; i < pool->thread_count; i++) {
+        png_thread_join(pool->threads[i]);
+    }
+
+    png_cond_destroy(&pool->work_cond);
+    png_cond_destroy(&pool->done_cond);
+    png_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+/**
+ * 获取线程池的线程总数（含调用线程）
+ */
+int png_thread_pool_size(const PNG_ThreadPool* pool) {
+    return pool ? pool->thread_count : 1;
+}
+
+/**
+ * 在线程池上执行一批任务，全部完成后返回
+ *
+ * 线程池正被其他调用占用、或在工作线程内部再次调用时，任务直接在调用线程上串行执行（worker 为 0）。
+ *
+ * @param pool      线程池，为 NULL 时串行执行
+ * @param count     任务数
+ * @param func      任务函数
+ * @param ctx       传给任务函数的上下文
+ *
+ * @return          无
+ */
+void png_thread_pool_run(PNG_ThreadPool* pool, uint32_t count, PNG_TaskFunc func, void* ctx) {
+    int parallel = pool && pool->thread_count > 1 && count > 1 && !png_in_pool;
+    if (parallel) {
+        png_mutex_lock(&pool->mutex);
+        if (pool->busy) {
+            parallel = 0;
+        } else {
+            pool->busy = 1;
+            pool->func = func;
+            pool->ctx = ctx;
+            pool->count = count;
+            pool->completed = 0;
+            pool->finished_workers = 0;
+            atomic_store(&pool->next, 0);
+            pool->generation++;
+            png_cond_broadcast(&pool->work_cond);
+        }
+        png_mutex_unlock(&pool->mutex);
+    }
+
+    if (!parallel) {
+        for (uint32_t i = 0; i < count; i++) {
+            func(ctx, i, 0);
+        }
+        return;
+    }
+
+    png_in_pool = 1;
+    uint32_t done = png_thread_pool_work(pool, func, ctx, count, 0);
+    png_in_pool = 0;
+
+    png_mutex_lock(&pool->mutex);
+    pool->completed += done;
+    while (pool->completed < count || pool->finished_workers < pool->thread_count - 1) {
+        png_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pool->busy = 0;
+    png_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * 单生产者 / 单消费者队列
+ */
+
+/**
+ * 初始化队列
+ *
+ * @param queue     队列
+ * @param capacity  容量，向上取整为 2 的幂
+ *
+ * @return          是否初始化成功，返回 1(真) 或 0(假)
+ */
+int png_spsc_init(PNG_SpscQueue* queue, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+    memset(queue, 0, sizeof(PNG_SpscQueue));
+    queue->slots = (void**)calloc(size, sizeof(void*));
+    if (!queue->slots) {
+        return 0;
+    }
+    queue->mask = size - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return 1;
+}
+
+/**
+ * 释放队列（不释放队列中剩余的元素）
+ */
+void png_spsc_destroy(PNG_SpscQueue* queue) {
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+/**
+ * 尝试入队，只能由生产者线程调用
+ *
+ * @return      是否入队成功，队列已满时返回 0
+ */
+int png_spsc_try_push(PNG_SpscQueue* queue, void* item) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head > queue->mask) {
+        return 0;
+    }
+    queue->slots[tail & queue->mask] = item;
+    // release 保证元素内容先于新的 tail 对消费者可见
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * 尝试出队，只能由消费者线程调用
+ *
+ * @return      是否出队成功，队列为空时返回 0
+ */
+int png_spsc_try_pop(PNG_SpscQueue* queue, void** item) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail) {
+        return 0;
+    }
+    *item = queue->slots[head & queue->mask];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
+
+/*
+ * 全局线程池与行带并行
+ */
+
+static PNG_ThreadPool* png_default_pool = NULL;
+static int png_configured_threads = 0;      // 0 表示使用逻辑处理器数量
+static atomic_flag png_default_pool_lock = ATOMIC_FLAG_INIT;
+
+/**
+ * 获取全局线程池，首次使用时创建
+ */
+static PNG_ThreadPool* png_get_default_pool(void) {
+    while (atomic_flag_test_and_set(&png_default_pool_lock)) {
+        png_thread_yield();
+    }
+    if (!png_default_pool) {
+        png_default_pool = png_thread_pool_create(png_configured_threads);
+    }
+    PNG_ThreadPool* pool = png_default_pool;
+    atomic_flag_clear(&png_default_pool_lock);
+    return pool;
+}
+
+/**
+ * 设置解码器内部并行处理使用的线程数（含调用线程）
+ *
+ * 应在没有解码任务运行时调用；已创建的全局线程池会被销毁，下次使用时按新线程数重新创建。
+ *
+ * @param thread_count  线程数，1 表示完全串行，0 表示使用逻辑处理器数量
+ *
+ * @return              无
+ */
+void png_set_thread_count(int thread_count) {
+    while (atomic_flag_test_and_set(&png_default_pool_lock)) {
+        png_thread_yield();
+    }
+    png_configured_threads = thread_count < 0 ? 0 : thread_count;
+    png_thread_pool_destroy(png_default_pool);
+    png_default_pool = NULL;
+    atomic_flag_clear(&png_default_pool_lock);
+}
+
+/**
+ * 获取解码器内部并行处理的实际线程数（含调用线程），用于分配每线程独占的缓冲区
+ */
+int png_get_thread_count(void) {
+    return png_thread_pool_size(png_get_default_pool());
+}
+
+typedef struct {
+    PNG_BandFunc func;
+    void* ctx;
+    uint32_t rows;
+    uint32_t band_rows;
+} PNG_BandJob;
+
+static void png_band_task(void* ctx, uint32_t index, int worker) {
+    PNG_BandJob* job = (PNG_BandJob*)ctx;
+    uint32_t y_begin = index * job->band_rows;
+    uint32_t y_end = job->rows - y_begin > job->band_rows ? y_begin + job->band_rows : job->rows;
+    job->func(job->ctx, y_begin, y_end, worker);
+}
+
+/**
+ * 把逐行独立的处理拆成缓存大小的行带，交给全局线程池并行执行
+ *
+ * @param rows      总行数
+ * @param row_bytes 每行处理的数据量（通常取输出行字节数），用于计算每个行带的行数
+ * @param func      行带任务函数
+ * @param ctx       传给任务函数的上下文
+ *
+ * @return          是否执行成功，返回 1(真) 或 0(假)
+ */
+int png_parallel_bands(uint32_t rows, size_t row_bytes, PNG_BandFunc func, void* ctx) {
+    if (!func) {
+        return 0;
+    }
+    if (rows == 0) {
+        return 1;
+    }
+
+    size_t band_rows = row_bytes > 0 ? PNG_BAND_BYTES / row_bytes : rows;
+    if (band_rows == 0) {
+        band_rows = 1;
+    }
+    if (band_rows >= rows) {
+        func(ctx, 0, rows, 0);
+        return 1;
+    }
+
+    PNG_BandJob job = { func, ctx, rows, (uint32_t)band_rows };
+    uint32_t bands = (uint32_t)((rows + band_rows - 1) / band_rows);
+    png_thread_pool_run(png_get_default_pool(), bands, png_band_task, &job);
+    return 1;
+}
+
+/**
+ * 把若干个互相独立的任务交给全局线程池并行执行，返回时所有任务均已完成
+ *
+ * @param count     任务数
+ * @param func      任务函数
+ * @param ctx       传给任务函数的上下文
+ */
+void png_parallel_tasks(uint32_t count, PNG_TaskFunc func, void* ctx) {
+    png_thread_pool_run(png_get_default_pool(), count, func, ctx);
+}
@@ -0,0 +1,99 @@
+#ifndef PNG_THREAD_H
+#define PNG_THREAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE png_thread_t;
+typedef CRITICAL_SECTION png_mutex_t;
+typedef CONDITION_VARIABLE png_cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t png_thread_t;
+typedef pthread_mutex_t png_mutex_t;
+typedef pthread_cond_t png_cond_t;
+#endif
+
+// 线程数上限
+#define PNG_MAX_THREADS 64
+
+// 每个行带（row band）的目标字节数 256KB，约为 L2 缓存大小，使一个行带的输入输出都能留在缓存中
+#define PNG_BAND_BYTES (256 * 1024)
+
+/**
+ * 线程入口函数
+ *
+ * @param arg       png_thread_create 传入的参数
+ */
+typedef void (*PNG_ThreadFunc)(void* arg);
+
+/**
+ * 行带任务函数：处理 [y_begin, y_end) 范围内的行
+ *
+ * @param ctx       png_parallel_bands 传入的上下文
+ * @param y_begin   起始行（包含）
+ * @param y_end     结束行（不包含）
+ * @param worker    执行任务的工作线程序号（0 ~ 线程数 - 1），可用于索引每线程独占的缓冲区
+ */
+typedef void (*PNG_BandFunc)(void* ctx, uint32_t y_begin, uint32_t y_end, int worker);
+
+/**
+ * 线程池任务函数
+ *
+ * @param ctx       png_thread_pool_run 传入的上下文
+ * @param index     任务序号（0 ~ 任务数 - 1）
+ * @param worker    执行任务的工作线程序号（0 ~ 线程数 - 1），调用线程自身为 0
+ */
+typedef void (*PNG_TaskFunc)(void* ctx, uint32_t index, int worker);
+
+typedef struct PNG_ThreadPool PNG_ThreadPool;
+
+/**
+ * 无锁单生产者 / 单消费者队列（环形缓冲区）
+ *
+ * 只允许一个线程入队、另一个线程出队。head 与 tail 分处不同缓存行，避免生产者与消费者互相争用。
+ */
+typedef struct {
+    void** slots;
+    size_t mask;                            // 容量 - 1（容量为 2 的幂）
+    char pad0[64];
+    _Atomic size_t head;                    // 下一个出队位置，只由消费者写入
+    char pad1[64];
+    _Atomic size_t tail;                    // 下一个入队位置，只由生产者写入
+    char pad2[64];
+} PNG_SpscQueue;
+
+int png_thread_create(png_thread_t* thread, PNG_ThreadFunc func, void* arg);
+void png_thread_join(png_thread_t thread);
+void png_thread_yield(void);
+void png_thread_sleep(uint32_t milliseconds);
+double png_monotonic_time(void);
+void png_mutex_init(png_mutex_t* mutex);
+void png_mutex_lock(png_mutex_t* mutex);
+void png_mutex_unlock(png_mutex_t* mutex);
+void png_mutex_destroy(png_mutex_t* mutex);
+void png_cond_init(png_cond_t* cond);
+void png_cond_wait(png_cond_t* cond, png_mutex_t* mutex);
+void png_cond_signal(png_cond_t* cond);
+void png_cond_broadcast(png_cond_t* cond);
+void png_cond_destroy(png_cond_t* cond);
+int png_cpu_count(void);
+
+PNG_ThreadPool* png_thread_pool_create(int thread_count);
+void png_thread_pool_destroy(PNG_ThreadPool* pool);
+int png_thread_pool_size(const PNG_ThreadPool* pool);
+void png_thread_pool_run(PNG_ThreadPool* pool, uint32_t count, PNG_TaskFunc func, void* ctx);
+
+int png_spsc_init(PNG_SpscQueue* queue, size_t capacity);
+void png_spsc_destroy(PNG_SpscQueue* queue);
+int png_spsc_try_push(PNG_SpscQueue* queue, void* item);
+int png_spsc_try_pop(PNG_SpscQueue* queue, void** item);
+
+void png_set_thread_count(int thread_count);
+int png_get_thread_count(void);
+int png_parallel_bands(uint32_t rows, size_t row_bytes, PNG_BandFunc func, void* ctx);
+void png_parallel_tasks(uint32_t count, PNG_TaskFunc func, void* ctx);
+
+#endif // PNG_THREAD_H
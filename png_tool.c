@@ -0,0 +1,569 @@
+#include "png_chunks.h"
+#include "png_decoder.h"
+#include "png_optimize.h"
+#include "png_thread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * PNG 命令行工具
+ *
+ * 用法：png_tool chunks <文件.png> ...
+ *       png_tool rewrite [-s metadata|all] [-r 块类型] [-t 关键字=文本] [-d 关键字] [-a 块类型:数据文件] [-c]
+ *                        [-o 输出文件] [-l 列表文件] <文件.png> ...
+ *       png_tool optimize [-b 秒数] [-z 级别] [-a zero|left|above] [-t 线程数] [-o 输出文件] [-l 列表文件]
+ *                         <文件.png> ...
+ *
+ * chunks：列出每个块的位置、类型与长度（只读取块头）。
+ *
+ * rewrite：在块级改写文件（png_rewrite_chunks），不解码像素，IDAT 按字节原样复制。
+ *   -s metadata   删除文本、时间、EXIF 等元数据块，保留透明度、颜色管理、像素比例与 APNG 动画块
+ *   -s all        只保留 tRNS 与 APNG 动画块
+ *   -r 块类型     删除指定类型的辅助块（可重复）
+ *   -t 关键字=文本  设置 tEXt 文本，替换关键字相同的文本块（可重复）
+ *   -d 关键字     删除关键字相同的文本块（可重复）
+ *   -a 块类型:文件  添加辅助块，数据取自文件，替换同类型的块（可重复）
+ *   -c            校验原样复制的块的 CRC
+ *   -o 输出文件   只处理一个文件时可指定输出路径，否则原地改写
+ *   -l 列表文件   从列表文件（每行一个路径）读取要处理的文件，适合批量清理大量文件
+ * 结束后报告处理的文件数、改写前后的总大小与吞吐量。
+ *
+ * optimize：解码后在线程池上并行尝试多种滤波策略、zlib 策略、内存级别与无损缩减的组合（png_optimize_image），
+ * 只在结果更小时写出。保留颜色管理（gAMA、cHRM、sRGB、iCCP、cICP）、tIME 与可安全复制的辅助块（文本、pHYs、eXIf 等），
+ * 丢弃依赖原颜色类型的块（bKGD、sBIT、hIST、sPLT）；APNG 动画跳过。
+ *   -b 秒数       每个文件试压缩的时间预算，适合在 CI 中限制总耗时（默认不限）
+ *   -z 级别       zlib 压缩级别（默认 9）
+ *   -a 方式       先清理完全透明像素的颜色（置 0、复制左侧或上方像素），显示结果不变但不再逐字节无损（默认不清理）
+ *   -t 线程数     线程池的线程数（默认为逻辑处理器数量）
+ *   -o 输出文件   只处理一个文件时可指定输出路径，否则原地改写
+ *   -l 列表文件   从列表文件（每行一个路径）读取要处理的文件
+ */
+
+#define TOOL_MAX_EDITS 64
+
+// 优化时保留的辅助块（除可安全复制的块之外）：颜色管理与修改时间，与像素的编码方式无关
+static const uint32_t tool_optimize_keep[] = {
+    PNG_CHUNK_TYPE('g', 'A', 'M', 'A'), PNG_CHUNK_TYPE('c', 'H', 'R', 'M'), PNG_CHUNK_TYPE('s', 'R', 'G', 'B'),
+    PNG_CHUNK_TYPE('i', 'C', 'C', 'P'), PNG_CHUNK_TYPE('c', 'I', 'C', 'P'), PNG_CHUNK_TYPE('t', 'I', 'M', 'E'),
+};
+
+static uint64_t tool_file_size(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+/**
+ * 把 4 个字符的字符串解析为块类型
+ *
+ * @return      是否解析成功，返回 1(真) 或 0(假)
+ */
+static int tool_parse_type(const char* text, size_t length, uint32_t* type) {
+    if (length != 4) {
+        return 0;
+    }
+    *type = PNG_CHUNK_TYPE(text[0], text[1], text[2], text[3]);
+    return 1;
+}
+
+/**
+ * 读取整个文件（用作添加的块数据）
+ *
+ * @return      是否读取成功，返回 1(真) 或 0(假)
+ */
+static int tool_read_file(const char* path, uint8_t** data, uint32_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    uint64_t length = tool_file_size(path);
+    int ok = length <= MAX_CHUNK_LENGTH;
+    *data = ok ? (uint8_t*)malloc(length ? (size_t)length : 1) : NULL;
+    ok = *data && fread(*data, 1, (size_t)length, file) == length;
+    fclose(file);
+    if (!ok) {
+        free(*data);
+        *data = NULL;
+        return 0;
+    }
+    *size = (uint32_t)length;
+    return 1;
+}
+
+static void tool_on_chunk(void* user_data, uint32_t type, uint32_t length, uint64_t offset) {
+    (void)user_data;
+    printf("  %12llu  %c%c%c%c  %10u\n", (unsigned long long)offset, (char)(type >> 24), (char)(type >> 16),
+        (char)(type >> 8), (char)type, length);
+}
+
+/**
+ * 列出块命令：png_tool chunks <文件.png> ...
+ */
+static int tool_chunks(int argc, char** argv) {
+    int failed = 0;
+    for (int i = 2; i < argc; i++) {
+        printf("%s\n", argv[i]);
+        if (!png_list_chunks(argv[i], tool_on_chunk, NULL)) {
+            fprintf(stderr, "%s: invalid or truncated PNG\n", argv[i]);
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+typedef struct {
+    uint32_t files;
+    uint32_t failed;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} ToolRewriteStats;
+
+static void tool_rewrite_file(const char* input, const char* output, const PNG_RewriteOptions* options,
+    ToolRewriteStats* stats) {
+    uint64_t size_in = tool_file_size(input);
+    stats->files++;
+    if (!png_rewrite_chunks(input, output, options)) {
+        fprintf(stderr, "%s: rewrite failed\n", input);
+        stats->failed++;
+        return;
+    }
+    stats->bytes_in += size_in;
+    stats->bytes_out += tool_file_size(output);
+}
+
+/**
+ * 块级改写命令：png_tool rewrite [选项] <文件.png> ...
+ */
+static int tool_rewrite(int argc, char** argv) {
+    PNG_RewriteOptions options = {0};
+    uint32_t remove_types[TOOL_MAX_EDITS];
+    PNG_TextEdit text_edits[TOOL_MAX_EDITS];
+    PNG_Chunk add_chunks[TOOL_MAX_EDITS];
+    const char* output = NULL;
+    const char* list_path = NULL;
+    int file_count = 0;
+    int ok = 1;
+
+    options.remove_types = remove_types;
+    options.text_edits = text_edits;
+    options.add_chunks = add_chunks;
+
+    for (int i = 2; i < argc && ok; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg[0] != '-') {
+            file_count++;
+            continue;
+        }
+        if (strcmp(arg, "-c") == 0) {
+            options.verify_crc = 1;
+            continue;
+        }
+        if (!value) {
+            ok = 0;
+            break;
+        }
+        i++;
+
+        if (strcmp(arg, "-s") == 0) {
+            if (strcmp(value, "metadata") == 0) {
+                options.strip = PNG_STRIP_METADATA;
+            } else if (strcmp(value, "all") == 0) {
+                options.strip = PNG_STRIP_ALL;
+            } else {
+                ok = 0;
+            }
+        } else if (strcmp(arg, "-r") == 0 && options.remove_count < TOOL_MAX_EDITS) {
+            ok = tool_parse_type(value, strlen(value), &remove_types[options.remove_count++]);
+        } else if ((strcmp(arg, "-t") == 0 || strcmp(arg, "-d") == 0) && options.text_count < TOOL_MAX_EDITS) {
+            // 关键字与文本直接指向命令行参数，"=" 替换为字符串结束符
+            PNG_TextEdit* edit = &text_edits[options.text_count++];
+            edit->keyword = value;
+            edit->text = NULL;
+            if (arg[1] == 't') {
+                char* separator = strchr(argv[i], '=');
+                ok = separator != NULL;
+                if (ok) {
+                    *separator = '\0';
+                    edit->text = separator + 1;
+                }
+            }
+        } else if (strcmp(arg, "-a") == 0 && options.add_count < TOOL_MAX_EDITS) {
+            const char* separator = strchr(value, ':');
+            PNG_Chunk* chunk = &add_chunks[options.add_count];
+            ok = separator && tool_parse_type(value, (size_t)(separator - value), &chunk->type) &&
+                tool_read_file(separator + 1, &chunk->data, &chunk->length);
+            if (ok) {
+                options.add_count++;
+            }
+        } else if (strcmp(arg, "-o") == 0) {
+            output = value;
+        } else if (strcmp(arg, "-l") == 0) {
+            list_path = value;
+        } else {
+            ok = 0;
+        }
+    }
+
+    if (!ok || (output && (file_count != 1 || list_path)) || (file_count == 0 && !list_path)) {
+        fprintf(stderr, "png_tool rewrite: invalid arguments\n");
+        for (uint32_t i = 0; i < options.add_count; i++) {
+            free(add_chunks[i].data);
+        }
+        return 1;
+    }
+
+    ToolRewriteStats stats = {0};
+    double start = png_monotonic_time();
+    for (int i = 2; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            i += strcmp(argv[i], "-c") != 0;
+            continue;
+        }
+        tool_rewrite_file(argv[i], output ? output : argv[i], &options, &stats);
+    }
+    if (list_path) {
+        FILE* list = fopen(list_path, "r");
+        if (!list) {
+            fprintf(stderr, "%s: cannot open list\n", list_path);
+            stats.failed++;
+        } else {
+            char line[4096];
+            while (fgets(line, sizeof(line), list)) {
+                line[strcspn(line, "\r\n")] = 0;
+                if (line[0] != 0) {
+                    tool_rewrite_file(line, line, &options, &stats);
+                }
+            }
+            fclose(list);
+        }
+    }
+    double elapsed = png_monotonic_time() - start;
+
+    printf("%u files, %u failed, %.1f MB -> %.1f MB, %.2f s, %.1f MB/s\n", stats.files, stats.failed,
+        stats.bytes_in / 1048576.0, stats.bytes_out / 1048576.0, elapsed,
+        elapsed > 0 ? stats.bytes_in / 1048576.0 / elapsed : 0.0);
+
+    for (uint32_t i = 0; i < options.add_count; i++) {
+        free(add_chunks[i].data);
+    }
+    return stats.failed != 0;
+}
+
+// 优化时要保留的块（类型、长度与在源文件中的位置）
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* types;
+    uint32_t* lengths;
+    uint64_t* offsets;
+    int animated;
+    int failed;
+} ToolKeptChunks;
+
+static void tool_on_kept_chunk(void* user_data, uint32_t type, uint32_t length, uint64_t offset) {
+    ToolKeptChunks* kept = (ToolKeptChunks*)user_data;
+    if (type == PNG_CHUNK_TYPE('a', 'c', 'T', 'L')) {
+        kept->animated = 1;
+    }
+    // 辅助块（第一个字母小写）中保留可安全复制的块（第四个字母小写）与颜色管理块，tRNS 由编码器重新生成
+    int ancillary = (type & 0x20000000u) != 0;
+    int safe_to_copy = (type & 0x20u) != 0;
+    int listed = 0;
+    for (uint32_t i = 0; i < sizeof(tool_optimize_keep) / sizeof(tool_optimize_keep[0]); i++) {
+        listed |= tool_optimize_keep[i] == type;
+    }
+    if (!ancillary || type == PNG_CHUNK_tRNS || !(safe_to_copy || listed) || kept->failed) {
+        return;
+    }
+
+    if (kept->count == kept->capacity) {
+        uint32_t capacity = kept->capacity ? kept->capacity * 2 : 16;
+        uint32_t* types = (uint32_t*)realloc(kept->types, capacity * sizeof(uint32_t));
+        kept->types = types ? types : kept->types;
+        uint32_t* lengths = (uint32_t*)realloc(kept->lengths, capacity * sizeof(uint32_t));
+        kept->lengths = lengths ? lengths : kept->lengths;
+        uint64_t* offsets = (uint64_t*)realloc(kept->offsets, capacity * sizeof(uint64_t));
+        kept->offsets = offsets ? offsets : kept->offsets;
+        if (!types || !lengths || !offsets) {
+            kept->failed = 1;
+            return;
+        }
+        kept->capacity = capacity;
+    }
+    kept->types[kept->count] = type;
+    kept->lengths[kept->count] = length;
+    kept->offsets[kept->count] = offset;
+    kept->count++;
+}
+
+static int tool_seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (int64_t)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+/**
+ * 从源文件读取要保留的块的数据
+ *
+ * @return      是否读取成功，返回 1(真) 或 0(假)；chunks 中已读取的数据由调用者释放
+ */
+static int tool_read_kept_chunks(const char* path, const ToolKeptChunks* kept, PNG_Chunk* chunks) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    int ok = 1;
+    for (uint32_t i = 0; i < kept->count && ok; i++) {
+        PNG_Chunk* chunk = &chunks[i];
+        chunk->type = kept->types[i];
+        chunk->length = kept->lengths[i];
+        chunk->data = (uint8_t*)malloc(chunk->length ? chunk->length : 1);
+        ok = chunk->data && tool_seek(file, kept->offsets[i] + 8) &&
+            fread(chunk->data, 1, chunk->length, file) == chunk->length;
+    }
+    fclose(file);
+    return ok;
+}
+
+static int tool_write_file(const char* path, const uint8_t* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    int ok = fwrite(data, 1, size, file) == size;
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+static const char* tool_filter_name(int filter) {
+    static const char* const names[] = { "none", "sub", "up", "average", "paeth", "auto", "minsum", "entropy" };
+    return filter >= 0 && filter <= PNG_ENCODE_FILTER_ENTROPY ? names[filter] : "?";
+}
+
+static const char* tool_strategy_name(int strategy) {
+    return strategy == Z_FILTERED ? "filtered" : strategy == Z_RLE ? "rle" : "default";
+}
+
+/**
+ * 优化一个文件：先写出优化后的像素块，再用 png_rewrite_chunks 加入保留的辅助块并替换输出文件；
+ * 无法变小（或跳过）时保留原文件，输出到其他路径时原样复制
+ */
+static void tool_optimize_file(const char* input, const char* output, const PNG_OptimizeOptions* options,
+    ToolRewriteStats* stats) {
+    stats->files++;
+    uint64_t size_in = tool_file_size(input);
+    uint64_t size_out = size_in;
+
+    ToolKeptChunks kept = {0};
+    PNG_Image image;
+    int decoded = 0;
+    uint8_t* encoded = NULL;
+    size_t encoded_size = 0;
+    PNG_Chunk* chunks = NULL;
+    char* temp_path = NULL;
+    PNG_OptimizeResult result = {0};
+    PNG_RewriteOptions rewrite = {0};
+    int optimized = 0;
+    int ok = png_list_chunks(input, tool_on_kept_chunk, &kept) && !kept.failed;
+    if (ok && kept.animated) {
+        printf("%s: animated PNG, skipped\n", input);
+    } else if (ok && (decoded = png_read_file(input, &image)) &&
+        !png_optimize_image(&image, options, &encoded, &encoded_size, &result)) {
+        ok = result.trials > 0 && result.completed == 0;
+        if (ok) {
+            printf("%s: no trial finished within the time budget, unchanged\n", input);
+        }
+    } else if (ok && decoded) {
+        chunks = (PNG_Chunk*)calloc(kept.count ? kept.count : 1, sizeof(PNG_Chunk));
+        ok = chunks && tool_read_kept_chunks(input, &kept, chunks);
+        optimized = ok;
+    } else {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: optimize failed\n", input);
+        stats->failed++;
+        goto cleanup;
+    }
+
+    if (optimized) {
+        uint64_t size = encoded_size;
+        for (uint32_t i = 0; i < kept.count; i++) {
+            size += 12 + (uint64_t)chunks[i].length;
+        }
+        printf("%s: %llu -> %llu bytes (%+.1f%%), %u/%u trials, %s%s filter, %s strategy, mem %d, %.2f s\n", input,
+            (unsigned long long)size_in, (unsigned long long)size,
+            size_in ? ((double)size - (double)size_in) * 100.0 / (double)size_in : 0.0, result.completed,
+            result.trials, result.reduced ? "reduced, " : "", tool_filter_name(result.options.filter),
+            tool_strategy_name(result.options.strategy), result.options.mem_level, result.elapsed);
+        optimized = size < size_in;
+        if (optimized) {
+            size_out = size;
+        }
+    }
+
+    if (optimized) {
+        // 优化结果先写入临时文件，再与保留的块一起改写到输出文件
+        size_t length = strlen(output);
+        temp_path = (char*)malloc(length + sizeof(".opt"));
+        ok = temp_path != NULL;
+        if (ok) {
+            memcpy(temp_path, output, length);
+            memcpy(temp_path + length, ".opt", sizeof(".opt"));
+            rewrite.add_chunks = chunks;
+            rewrite.add_count = kept.count;
+            ok = tool_write_file(temp_path, encoded, encoded_size) && png_rewrite_chunks(temp_path, output, &rewrite);
+            remove(temp_path);
+        }
+    } else if (strcmp(input, output) != 0) {
+        ok = png_rewrite_chunks(input, output, &rewrite);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: write failed\n", output);
+        stats->failed++;
+        goto cleanup;
+    }
+    stats->bytes_in += size_in;
+    stats->bytes_out += size_out;
+
+cleanup:
+    if (chunks) {
+        for (uint32_t i = 0; i < kept.count; i++) {
+            free(chunks[i].data);
+        }
+    }
+    free(chunks);
+    free(temp_path);
+    free(encoded);
+    if (decoded) {
+        png_free_image(&image);
+    }
+    free(kept.types);
+    free(kept.lengths);
+    free(kept.offsets);
+}
+
+/**
+ * 优化命令：png_tool optimize [选项] <文件.png> ...
+ */
+static int tool_optimize(int argc, char** argv) {
+    PNG_OptimizeOptions options;
+    png_optimize_options_init(&options);
+    const char* output = NULL;
+    const char* list_path = NULL;
+    int threads = 0;
+    int file_count = 0;
+    int ok = 1;
+
+    for (int i = 2; i < argc && ok; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg[0] != '-') {
+            file_count++;
+            continue;
+        }
+        if (!value) {
+            ok = 0;
+            break;
+        }
+        i++;
+
+        char* end = NULL;
+        if (strcmp(arg, "-b") == 0) {
+            options.time_budget = strtod(value, &end);
+            ok = *end == 0 && options.time_budget >= 0;
+        } else if (strcmp(arg, "-z") == 0) {
+            options.level = (int)strtol(value, &end, 10);
+            ok = *end == 0 && options.level >= 0 && options.level <= 9;
+        } else if (strcmp(arg, "-a") == 0) {
+            if (strcmp(value, "zero") == 0) {
+                options.transparent = PNG_CLEAN_ZERO;
+            } else if (strcmp(value, "left") == 0) {
+                options.transparent = PNG_CLEAN_LEFT;
+            } else if (strcmp(value, "above") == 0) {
+                options.transparent = PNG_CLEAN_ABOVE;
+            } else {
+                ok = 0;
+            }
+        } else if (strcmp(arg, "-t") == 0) {
+            threads = (int)strtol(value, &end, 10);
+            ok = *end == 0 && threads >= 0;
+        } else if (strcmp(arg, "-o") == 0) {
+            output = value;
+        } else if (strcmp(arg, "-l") == 0) {
+            list_path = value;
+        } else {
+            ok = 0;
+        }
+    }
+
+    if (!ok || (output && (file_count != 1 || list_path)) || (file_count == 0 && !list_path)) {
+        fprintf(stderr, "png_tool optimize: invalid arguments\n");
+        return 1;
+    }
+    png_set_thread_count(threads);
+
+    ToolRewriteStats stats = {0};
+    double start = png_monotonic_time();
+    for (int i = 2; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            i++;
+            continue;
+        }
+        tool_optimize_file(argv[i], output ? output : argv[i], &options, &stats);
+    }
+    if (list_path) {
+        FILE* list = fopen(list_path, "r");
+        if (!list) {
+            fprintf(stderr, "%s: cannot open list\n", list_path);
+            stats.failed++;
+        } else {
+            char line[4096];
+            while (fgets(line, sizeof(line), list)) {
+                line[strcspn(line, "\r\n")] = 0;
+                if (line[0] != 0) {
+                    tool_optimize_file(line, line, &options, &stats);
+                }
+            }
+            fclose(list);
+        }
+    }
+    double elapsed = png_monotonic_time() - start;
+
+    printf("%u files, %u failed, %.1f MB -> %.1f MB (%+.1f%%), %.2f s\n", stats.files, stats.failed,
+        stats.bytes_in / 1048576.0, stats.bytes_out / 1048576.0,
+        stats.bytes_in ? ((double)stats.bytes_out - (double)stats.bytes_in) * 100.0 / (double)stats.bytes_in : 0.0,
+        elapsed);
+    return stats.failed != 0;
+}
+
+static void tool_usage(void) {
+    fprintf(stderr, "usage: png_tool chunks <file.png> ...\n");
+    fprintf(stderr, "       png_tool rewrite [-s metadata|all] [-r TYPE] [-t keyword=text] [-d keyword] [-a TYPE:file] [-c]\n");
+    fprintf(stderr, "                        [-o output.png] [-l list.txt] <file.png> ...\n");
+    fprintf(stderr, "       png_tool optimize [-b seconds] [-z level] [-a zero|left|above] [-t threads] [-o output.png]\n");
+    fprintf(stderr, "                         [-l list.txt] <file.png> ...\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        tool_usage();
+        return 1;
+    }
+    if (strcmp(argv[1], "chunks") == 0) {
+        return tool_chunks(argc, argv);
+    }
+    if (strcmp(argv[1], "rewrite") == 0) {
+        return tool_rewrite(argc, argv);
+    }
+    if (strcmp(argv[1], "optimize") == 0) {
+        return tool_optimize(argc, argv);
+    }
+    tool_usage();
+    return 1;
+}
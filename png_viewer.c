@@ -2,6 +2,8 @@
 
 
 ImageData g_imageData = { NULL, 0, 0, 1 };
+DecodeJob* g_decodeJobs = NULL;         // 尚未结束的解码任务（包括已取消、正在退出的任务）
+DecodeJob* g_currentJob = NULL;         // 当前要显示的解码任务，其余任务的消息一律忽略
 
 /**
  * Windows 应用程序的入口函数
@@ -12,6 +14,14 @@ ImageData g_imageData = { NULL, 0, 0, 1 };
  * @param nCmdShow        	窗口的初始显示状态（如最小化、最大化）
  */
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // 解码结果缓存在临时目录中，再次打开同一幅图像时直接映射缓存文件，不必重新解压
+    char cacheDirectory[MAX_PATH];
+    DWORD length = GetTempPathA(sizeof(cacheDirectory), cacheDirectory);
+    if (length > 0 && length + sizeof(CACHE_DIRECTORY_NAME) <= sizeof(cacheDirectory)) {
+        memcpy(cacheDirectory + length, CACHE_DIRECTORY_NAME, sizeof(CACHE_DIRECTORY_NAME));
+        png_cache_set_directory(cacheDirectory);
+    }
+    
     // 注册窗口类
     WNDCLASS wc = {0};
     wc.lpfnWndProc = WindowProc;                        // 指定窗口过程函数（WindowProc），用于处理窗口消息
@@ -117,14 +127,14 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 int x = (clientRect.right - bm.bmWidth) / 2;        // 居中坐标 x
                 int y = (clientRect.bottom - bm.bmHeight) / 2;      // 居中坐标 y
                 
-                // 将内存 DC 中的位图复制到窗口 DC。参数说明：
+                // 将内存 DC 中的位图按 α 混合到窗口 DC（位图像素已预乘 α，透明区域露出窗口背景）。参数说明：
                 //      hdc：目标 DC（窗口）
-                //      (x, y)：目标起始坐标（居中位置）
-                //      bm.bmWidth 和 bm.bmHeight：图像尺寸
+                //      (x, y)、bm.bmWidth 和 bm.bmHeight：目标区域（居中位置，原始尺寸）
                 //      hdcMem：源 DC（内存 DC）
-                //      (0, 0)：源位图起始坐标
-                //      SRCCOPY：直接复制模式
-                BitBlt(hdc, x, y, bm.bmWidth, bm.bmHeight, hdcMem, 0, 0, SRCCOPY);
+                //      (0, 0)、bm.bmWidth 和 bm.bmHeight：源区域
+                //      blend：AC_SRC_OVER 叠加模式，AC_SRC_ALPHA 表示使用像素自身的预乘 α
+                BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+                AlphaBlend(hdc, x, y, bm.bmWidth, bm.bmHeight, hdcMem, 0, 0, bm.bmWidth, bm.bmHeight, blend);
                 
                 SelectObject(hdcMem, hbmOld);                       // 恢复内存 DC 的旧位图（避免资源泄漏）
                 DeleteDC(hdcMem);                                   // 释放内存 DC
@@ -158,8 +168,21 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             break;
         }
         
+        // 解码线程交付了新的预览
+        case WM_APP_DECODE_PREVIEW: {
+            OnDecodePreview(hwnd, (DecodeJob*)lParam);
+            break;
+        }
+        
+        // 解码线程结束
+        case WM_APP_DECODE_DONE: {
+            OnDecodeDone(hwnd, (DecodeJob*)lParam, (int)wParam);
+            break;
+        }
+        
         // 窗口关闭时触发
         case WM_DESTROY: {
+            CancelAllDecodes();                                     // 取消并等待所有解码线程
             CleanupImage(&g_imageData);                             // 释放位图资源
             PostQuitMessage(0);                                     // 发送退出消息，结束消息循环
             break;
@@ -204,36 +227,20 @@ void OpenImageFile(HWND hwnd) {
 }
 
 /**
- * 加载并显示图像
+ * 创建与图像尺寸相同的 DIB（设备无关位图）并保存到全局图像数据
  * 
- * @param hwnd        		窗口句柄，用于显示图像和错误提示
- * @param filename   		PNG 文件绝对路径
+ * @param hwnd        		窗口句柄
+ * @param width        		图像像素宽度
+ * @param height        	图像像素高度
+ * 
+ * @return      是否创建成功，返回 1(真) 或 0(假)
  */
-void DisplayImage(HWND hwnd, const char* filename) {
-    PNG_Image pngImage;
-    if (!png_read_file(filename, &pngImage)) {
-        MessageBox(hwnd, "Failed to load PNG file", "Error", MB_ICONERROR | MB_OK);
-        return;
-    }
-    
-    // 转换为 RGBA 格式
-    uint8_t* rgba_data = NULL;
-    uint32_t rgba_size = 0;
-    if (!png_convert_to_rgba(&pngImage, &rgba_data, &rgba_size)) {
-        png_free_image(&pngImage);
-        MessageBox(hwnd, "Failed to convert PNG to RGBA", "Error", MB_ICONERROR | MB_OK);
-        return;
-    }
-    
-    // 清理之前的图像
-    CleanupImage(&g_imageData);
-    
-    // 创建 DIB（设备无关位图）
+int CreateImageBitmap(HWND hwnd, uint32_t width, uint32_t height) {
     HDC hdc = GetDC(hwnd);
     BITMAPINFO bmi = {0};
     bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = pngImage.header.width;
-    bmi.bmiHeader.biHeight = -(pngImage.header.height);   // 负高度表示从上到下的位图（Windows 默认是从下到上）
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -(LONG)height;                         // 负高度表示从上到下的位图（Windows 默认是从下到上）
     bmi.bmiHeader.biPlanes = 1;
     bmi.bmiHeader.biBitCount = 32;                                  // 32 位 RGBA 格式
     bmi.bmiHeader.biCompression = BI_RGB;                           // 未压缩格式
@@ -247,42 +254,232 @@ void DisplayImage(HWND hwnd, const char* filename) {
         NULL,
         0
     );
+    ReleaseDC(hwnd, hdc);
     
     if (!g_imageData.bitmap) {
-        // 如果位图创建失败，释放 DC、PNG 数据和 RGBA 数据
-        ReleaseDC(hwnd, hdc);
+        return 0;
+    }
+    
+    // 更新图像尺寸
+    g_imageData.width = width;
+    g_imageData.height = height;
+    return 1;
+}
+
+/**
+ * 解码器每完成一遍 Adam7 时的回调（在解码线程上执行）：保存预览副本并通知窗口线程
+ * 
+ * 窗口线程可能来不及处理每一遍，此时只显示最新的一遍。
+ * 
+ * @param user_data        	指向 DecodeJob 结构体
+ * @param pass        		刚完成的遍序号（最后一遍的预览即为完整图像）
+ * @param preview        	预乘 α 的 BGRA 预览像素
+ * @param width        		预览宽度
+ * @param height        	预览高度
+ */
+void OnPassDecoded(void* user_data, int pass, const uint8_t* preview, uint32_t width, uint32_t height) {
+    DecodeJob* job = (DecodeJob*)user_data;
+    size_t size = (size_t)width * height * 4;
+    (void)pass;
+    
+    png_mutex_lock(&job->mutex);
+    if (!job->preview) {
+        job->preview = (uint8_t*)malloc(size);
+    }
+    if (job->preview) {
+        memcpy(job->preview, preview, size);
+        job->width = width;
+        job->height = height;
+    }
+    png_mutex_unlock(&job->mutex);
+    
+    PostMessage(job->hwnd, WM_APP_DECODE_PREVIEW, 0, (LPARAM)job);
+}
+
+/**
+ * 解码线程入口：逐遍解码，结束后通知窗口线程回收
+ * 
+ * @param arg        		指向 DecodeJob 结构体
+ */
+void DecodeThread(void* arg) {
+    DecodeJob* job = (DecodeJob*)arg;
+    PNG_Image pngImage;
+    PNG_CachedImage cached;
+    
+    // 缓存命中时直接交付映射的像素，作为最后一遍预览
+    if (png_cache_lookup(job->filename, PNG_FORMAT_BGRA8_PREMULTIPLIED, &cached)) {
+        OnPassDecoded(job, PNG_ADAM7_PASSES - 1, cached.pixels, cached.width, cached.height);
+        png_cache_close(&cached);
+        PostMessage(job->hwnd, WM_APP_DECODE_DONE, (WPARAM)1, (LPARAM)job);
+        return;
+    }
+    
+    // 解码为预乘 α 的 BGRA 格式（AlphaBlend 要求），预乘在转换每行时顺带完成
+    int success = png_read_file_progressive(job->filename, &pngImage, PNG_FORMAT_BGRA8_PREMULTIPLIED, OnPassDecoded, job, &job->cancel);
+    if (success) {
+        // 像素已在最后一遍回调中交付，preview 即为完整图像；解码结束后本线程不再写入 preview，无需加锁即可读取
         png_free_image(&pngImage);
-        free(rgba_data);
-        MessageBox(hwnd, "Failed to create bitmap", "Error", MB_ICONERROR | MB_OK);
+        if (job->preview) {
+            png_cache_store(job->filename, PNG_FORMAT_BGRA8_PREMULTIPLIED, job->preview, job->width, job->height);
+        }
+    }
+    
+    PostMessage(job->hwnd, WM_APP_DECODE_DONE, (WPARAM)success, (LPARAM)job);
+}
+
+/**
+ * 把解码任务最新的预览复制到位图并重绘（在窗口线程上执行）
+ * 
+ * @param hwnd        		窗口句柄
+ * @param job        		发出消息的解码任务
+ */
+void OnDecodePreview(HWND hwnd, DecodeJob* job) {
+    if (job != g_currentJob) {
+        // 已被取消的任务
         return;
     }
     
-    // 获取位图信息（如 bmBits，即像素数据指针）
-    BITMAP bm;
-    GetObject(g_imageData.bitmap, sizeof(bm), &bm);
+    png_mutex_lock(&job->mutex);
+    if (job->preview) {
+        // 首次交付预览时替换之前的图像
+        if (!job->delivered) {
+            CleanupImage(&g_imageData);
+            job->delivered = CreateImageBitmap(hwnd, job->width, job->height);
+        }
+        if (job->delivered) {
+            // 获取位图信息（如 bmBits，即像素数据指针），复制像素数据到位图
+            BITMAP bm;
+            GetObject(g_imageData.bitmap, sizeof(bm), &bm);
+            memcpy(bm.bmBits, job->preview, (size_t)job->width * job->height * 4);
+        }
+    }
+    png_mutex_unlock(&job->mutex);
+    
+    InvalidateRect(hwnd, NULL, TRUE);
+}
+
+/**
+ * 释放解码任务（解码线程必须已经结束）
+ */
+static void FreeDecodeJob(DecodeJob* job) {
+    png_thread_join(job->thread);
+    png_mutex_destroy(&job->mutex);
+    free(job->preview);
+    free(job);
+}
+
+/**
+ * 从未结束任务链表中移除解码任务
+ */
+static void UnlinkDecodeJob(DecodeJob* job) {
+    for (DecodeJob** p = &g_decodeJobs; *p; p = &(*p)->next) {
+        if (*p == job) {
+            *p = job->next;
+            return;
+        }
+    }
+}
+
+/**
+ * 解码线程结束后回收任务并报告结果（在窗口线程上执行）
+ * 
+ * 同一任务的预览消息先于结束消息投递，此时最后一遍预览已经复制到位图。
+ * 
+ * @param hwnd        		窗口句柄
+ * @param job        		结束的解码任务
+ * @param success        	是否解码成功
+ */
+void OnDecodeDone(HWND hwnd, DecodeJob* job, int success) {
+    int current = job == g_currentJob;
+    int cancelled = png_cancel_requested(&job->cancel);
+    int delivered = job->delivered;
+    char title[512];
+    snprintf(title, sizeof(title), "%s - %s", WINDOW_TITLE, job->filename);
     
-    // 复制像素数据到位图
-    uint8_t* bits = (uint8_t*)bm.bmBits;
-    memcpy(bits, rgba_data, rgba_size);
+    UnlinkDecodeJob(job);
+    FreeDecodeJob(job);
+    if (!current) {
+        return;
+    }
+    g_currentJob = NULL;
     
-    // 更新图像尺寸
-    g_imageData.width = pngImage.header.width;
-    g_imageData.height = pngImage.header.height;
+    if (!success) {
+        if (delivered) {
+            // 已显示部分预览的图像不完整，直接清除
+            CleanupImage(&g_imageData);
+            InvalidateRect(hwnd, NULL, TRUE);
+        }
+        if (!cancelled) {
+            MessageBox(hwnd, "Failed to load PNG file", "Error", MB_ICONERROR | MB_OK);
+        }
+        return;
+    }
     
-    // 清理资源
-    ReleaseDC(hwnd, hdc);
-    png_free_image(&pngImage);
-    free(rgba_data);
+    if (!g_imageData.bitmap) {
+        MessageBox(hwnd, "Failed to create bitmap", "Error", MB_ICONERROR | MB_OK);
+        return;
+    }
     
     // 重绘窗口，触发 WM_PAINT 消息
     InvalidateRect(hwnd, NULL, TRUE);
     
     // 更新窗口标题
-    char title[512];
-    snprintf(title, sizeof(title), "%s - %s", WINDOW_TITLE, filename);
     SetWindowText(hwnd, title);
 }
 
+/**
+ * 取消所有解码任务并等待解码线程退出（窗口销毁时调用）
+ */
+void CancelAllDecodes(void) {
+    for (DecodeJob* job = g_decodeJobs; job; job = job->next) {
+        png_cancel_request(&job->cancel);
+    }
+    while (g_decodeJobs) {
+        DecodeJob* job = g_decodeJobs;
+        g_decodeJobs = job->next;
+        FreeDecodeJob(job);
+    }
+    g_currentJob = NULL;
+}
+
+/**
+ * 加载并显示图像
+ * 
+ * 解码在后台线程进行，窗口在此期间保持响应。隔行扫描图像在第一遍解码完成后即显示粗略预览，之后每遍逐步细化。
+ * 再次打开图像时取消尚未完成的解码，被取消的解码在毫秒级时间内停止并释放内存。
+ * 
+ * @param hwnd        		窗口句柄，用于显示图像和错误提示
+ * @param filename   		PNG 文件绝对路径
+ */
+void DisplayImage(HWND hwnd, const char* filename) {
+    if (g_currentJob) {
+        png_cancel_request(&g_currentJob->cancel);
+        g_currentJob = NULL;
+    }
+    
+    DecodeJob* job = (DecodeJob*)calloc(1, sizeof(DecodeJob));
+    if (!job) {
+        MessageBox(hwnd, "Failed to load PNG file", "Error", MB_ICONERROR | MB_OK);
+        return;
+    }
+    job->hwnd = hwnd;
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    png_cancel_init(&job->cancel);
+    png_mutex_init(&job->mutex);
+    
+    if (!png_thread_create(&job->thread, DecodeThread, job)) {
+        png_mutex_destroy(&job->mutex);
+        free(job);
+        MessageBox(hwnd, "Failed to load PNG file", "Error", MB_ICONERROR | MB_OK);
+        return;
+    }
+    
+    // 解码线程的消息要等本函数返回后才会被处理，此时 thread 已经写入
+    job->next = g_decodeJobs;
+    g_decodeJobs = job;
+    g_currentJob = job;
+}
+
 /**
  * 清理图像数据 - 释放位图资源，重置图像尺寸
  */
@@ -1,4 +1,8 @@
+#include "png_cache.h"
 #include "png_decoder.h"
+#include "png_interlace.h"
+#include "png_progressive.h"
+#include "png_thread.h"
 #include <stdint.h>
 #include <windows.h>
 #include <commdlg.h>
@@ -6,6 +10,13 @@
 #define WINDOW_CLASS_NAME "PNGViewerWindow"
 #define WINDOW_TITLE "PNG Viewer"
 
+// 解码结果缓存目录（位于系统临时目录下）
+#define CACHE_DIRECTORY_NAME "png_viewer_cache"
+
+// 解码线程发往窗口的消息（lParam 均为 DecodeJob 指针）
+#define WM_APP_DECODE_PREVIEW (WM_APP + 1)     // 新的一遍预览已就绪
+#define WM_APP_DECODE_DONE (WM_APP + 2)        // 解码结束，wParam 为是否成功
+
 typedef struct {
     HBITMAP bitmap;             // Windows GDI 位图句柄，用于存储解码后的 PNG 图像数据
     uint32_t width;             // 图像像素宽度，用于计算显示位置和缩放比例
@@ -13,7 +24,26 @@ typedef struct {
     float scale;                // 当前缩放比例
 } ImageData;
 
+typedef struct DecodeJob {
+    HWND hwnd;                  // 显示图像的窗口
+    char filename[MAX_PATH];    // 正在解码的文件
+    PNG_CancelToken cancel;     // 打开另一幅图像或关闭窗口时取消本次解码
+    png_thread_t thread;        // 解码线程
+    png_mutex_t mutex;          // 保护 preview（解码线程写入，窗口线程读取）
+    uint8_t* preview;           // 最近一遍预览的副本
+    uint32_t width;             // 预览宽度
+    uint32_t height;            // 预览高度
+    int delivered;              // 窗口线程是否已为本任务创建位图（首次交付时替换旧图像）
+    struct DecodeJob* next;     // 尚未结束的解码任务链表
+} DecodeJob;
+
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 void OpenImageFile(HWND hwnd);
+int CreateImageBitmap(HWND hwnd, uint32_t width, uint32_t height);
+void OnPassDecoded(void* user_data, int pass, const uint8_t* preview, uint32_t width, uint32_t height);
+void DecodeThread(void* arg);
+void OnDecodePreview(HWND hwnd, DecodeJob* job);
+void OnDecodeDone(HWND hwnd, DecodeJob* job, int success);
+void CancelAllDecodes(void);
 void DisplayImage(HWND hwnd, const char* filename);
 void CleanupImage(ImageData* imageData);